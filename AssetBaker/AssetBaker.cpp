@@ -0,0 +1,77 @@
+#define OLC_PGE_APPLICATION
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "../Frazzer_Racing/olcPixelGameEngine.h"
+
+// Images to bake, as { file in the gfx folder, symbol in namespace assets }
+const std::pair<const char *, const char *> IMAGES[] = {
+  { "car.png", "car" },
+  { "mapTiles.png", "tiles" },
+};
+
+void configureLoader()
+{
+#if defined( OLC_IMAGE_GDI )
+  olc::Sprite::loader = std::make_unique<olc::ImageLoader_GDIPlus>();
+#endif
+#if defined( OLC_IMAGE_LIBPNG )
+  olc::Sprite::loader = std::make_unique<olc::ImageLoader_LibPNG>();
+#endif
+#if defined( OLC_IMAGE_STB )
+  olc::Sprite::loader = std::make_unique<olc::ImageLoader_STB>();
+#endif
+}
+
+bool bakeImage( std::ostream & out, const std::string & sFile, const std::string & sName )
+{
+  olc::Sprite spr;
+  if( spr.LoadFromFile( sFile ) != olc::OK )
+  {
+    std::cerr << "AssetBaker: failed to load " << sFile << "\n";
+    return false;
+  }
+
+  out << "  alignas( 16 ) static const uint32_t " << sName << "Pixels[] = {";
+  for( int i = 0; i < spr.width * spr.height; i++ )
+  {
+    if( i % 8 == 0 ) out << "\n   ";
+    out << " 0x" << std::hex << std::setw( 8 ) << std::setfill( '0' ) << spr.pColData[i].n << std::dec << ",";
+  }
+  out << "\n  };\n";
+  out << "  const BakedImage " << sName << " = { " << spr.width << ", " << spr.height << ", " << sName << "Pixels };\n\n";
+  return true;
+}
+
+// Usage: AssetBaker <gfx folder> <output .cpp>
+int main( int argc, char * argv[] )
+{
+  if( argc != 3 )
+  {
+    std::cerr << "Usage: AssetBaker <gfx folder> <output.cpp>\n";
+    return 1;
+  }
+
+  configureLoader();
+
+  std::ostringstream out;
+  out << "// Generated by AssetBaker from the gfx folder, do not edit by hand\n\n";
+  out << "#include \"Assets.h\"\n\n";
+  out << "namespace assets\n{\n";
+  for( const auto & [sFile, sName] : IMAGES )
+    if( !bakeImage( out, std::string( argv[1] ) + "/" + sFile, sName ) ) return 1;
+  out << "} // namespace assets\n";
+
+  // Only touch the output when something changed so the game isn't rebuilt every time
+  std::ifstream ifs( argv[2], std::ios::binary );
+  std::string   sOld( ( std::istreambuf_iterator<char>( ifs ) ), std::istreambuf_iterator<char>() );
+  ifs.close();
+  if( sOld == out.str() ) return 0;
+
+  std::ofstream ofs( argv[2], std::ios::binary );
+  ofs << out.str();
+  return ofs.good() ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+// Engine core for the simulation library. Track and Physics use olc::Pixel and olc::vi2d, which need the engine
+// implementation at link time, but the library never opens a window, so it is built with a platform, renderer and
+// image loader that do nothing. That keeps X11, OpenGL and libpng out of the library's link line.
+#define OLC_PLATFORM_CUSTOM_EX  NullPlatform
+#define OLC_GFX_CUSTOM_EX
+#define OLC_RENDERER_CUSTOM_EX  NullRenderer
+#define OLC_IMAGE_CUSTOM_EX     NullImageLoader
+#include "olcPixelGameEngine.h"
+
+namespace
+{
+  class NullPlatform : public olc::Platform
+  {
+  public:
+    olc::rcode ApplicationStartUp() override { return olc::OK; }
+    olc::rcode ApplicationCleanUp() override { return olc::OK; }
+    olc::rcode ThreadStartUp() override { return olc::OK; }
+    olc::rcode ThreadCleanUp() override { return olc::OK; }
+    olc::rcode CreateGraphics( bool, bool, const olc::vi2d &, const olc::vi2d & ) override { return olc::FAIL; }
+    olc::rcode CreateWindowPane( const olc::vi2d &, olc::vi2d &, bool ) override { return olc::FAIL; }
+    olc::rcode SetWindowTitle( const std::string & ) override { return olc::OK; }
+    olc::rcode StartSystemEventLoop() override { return olc::FAIL; }
+    olc::rcode HandleSystemEvent() override { return olc::FAIL; }
+  };
+
+  class NullRenderer : public olc::Renderer
+  {
+  public:
+    void       PrepareDevice() override {}
+    olc::rcode CreateDevice( std::vector<void *>, bool, bool ) override { return olc::FAIL; }
+    olc::rcode DestroyDevice() override { return olc::OK; }
+    void       DisplayFrame() override {}
+    void       PrepareDrawing() override {}
+    void       SetDecalMode( const olc::DecalMode & ) override {}
+    void       DrawLayerQuad( const olc::vf2d &, const olc::vf2d &, const olc::Pixel ) override {}
+    void       DrawDecal( const olc::DecalInstance & ) override {}
+    uint32_t   CreateTexture( const uint32_t, const uint32_t, const bool, const bool ) override { return 0; }
+    void       UpdateTexture( uint32_t, olc::Sprite * ) override {}
+    void       ReadTexture( uint32_t, olc::Sprite * ) override {}
+    uint32_t   DeleteTexture( const uint32_t id ) override { return id; }
+    void       ApplyTexture( uint32_t ) override {}
+    void       UpdateViewport( const olc::vi2d &, const olc::vi2d & ) override {}
+    void       ClearBuffer( olc::Pixel, bool ) override {}
+  };
+
+  class NullImageLoader : public olc::ImageLoader
+  {
+  public:
+    olc::rcode LoadImageResource( olc::Sprite *, const std::string &, olc::ResourcePack * ) override
+    {
+      return olc::FAIL;
+    }
+    olc::rcode SaveImageResource( olc::Sprite *, const std::string & ) override { return olc::FAIL; }
+  };
+} // namespace
+
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
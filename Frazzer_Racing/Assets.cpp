@@ -0,0 +1,13 @@
+#include "Assets.h"
+
+#include <cstring>
+
+namespace assets
+{
+  std::unique_ptr<olc::Sprite> makeSprite( const BakedImage & image )
+  {
+    auto spr = std::make_unique<olc::Sprite>( image.width, image.height );
+    std::memcpy( static_cast<void *>( spr->GetData() ), image.pixels, sizeof( uint32_t ) * image.width * image.height );
+    return spr;
+  }
+} // namespace assets
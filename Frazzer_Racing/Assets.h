@@ -0,0 +1,22 @@
+#pragma once
+
+#include <memory>
+
+#include "olcPixelGameEngine.h"
+
+namespace assets
+{
+  // Pre-decoded RGBA image linked into the executable, generated by AssetBaker
+  struct BakedImage
+  {
+    int32_t          width;
+    int32_t          height;
+    const uint32_t * pixels;
+  };
+
+  extern const BakedImage car;
+  extern const BakedImage tiles;
+
+  // Builds a sprite from a baked image with a single copy, no file I/O or decode
+  std::unique_ptr<olc::Sprite> makeSprite( const BakedImage & image );
+} // namespace assets
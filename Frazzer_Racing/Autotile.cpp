@@ -0,0 +1,229 @@
+#include "Autotile.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace
+{
+  // Neighbour bits of a mask, clockwise from north
+  enum : uint8_t
+  {
+    N  = 1 << 0,
+    NE = 1 << 1,
+    E  = 1 << 2,
+    SE = 1 << 3,
+    S  = 1 << 4,
+    SW = 1 << 5,
+    W  = 1 << 6,
+    NW = 1 << 7,
+  };
+
+  // Edges name the side of the kerb the road is not on, so a kerb with road to its south is a top edge. Edges win
+  // over corners, and a tile between two roads takes the first matching edge, as the hand-placed oval did.
+  mapTiles kerbFor( uint8_t nMask )
+  {
+    if( nMask & S ) return mapTiles::Road_T_Edge;
+    if( nMask & N ) return mapTiles::Road_B_Edge;
+    if( nMask & E ) return mapTiles::Road_L_Edge;
+    if( nMask & W ) return mapTiles::Road_R_Edge;
+    if( nMask & SE ) return mapTiles::Road_TL_Corner;
+    if( nMask & SW ) return mapTiles::Road_TR_Corner;
+    if( nMask & NE ) return mapTiles::Road_BL_Corner;
+    if( nMask & NW ) return mapTiles::Road_BR_Corner;
+    return mapTiles::None;
+  }
+
+  std::array<mapTiles, 256> makeKerbTable()
+  {
+    std::array<mapTiles, 256> table;
+    for( int i = 0; i < 256; i++ ) table[i] = kerbFor( uint8_t( i ) );
+    return table;
+  }
+
+  const std::array<mapTiles, 256> KERB_TILES = makeKerbTable();
+
+  // Writes land in runs of whole visual words, which start every 16 rows whatever the width
+  const int32_t WRITE_ROWS = 16;
+
+  int32_t lowestBit( uint64_t v )
+  {
+#ifdef _MSC_VER
+    unsigned long nBit;
+    _BitScanForward64( &nBit, v );
+    return int32_t( nBit );
+#else
+    return __builtin_ctzll( v );
+#endif
+  }
+
+  // Bits [from, to) of a word, to in 1..64
+  uint64_t spanBits( int32_t from, int32_t to )
+  {
+    uint64_t high = to == 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << to ) - 1;
+    return high & ~( ( uint64_t( 1 ) << from ) - 1 );
+  }
+
+  bool painted( mapTiles tile ) { return tile == mapTiles::Road || tile == mapTiles::Wall; }
+
+  uint8_t maskAt( const uint8_t * pUp, const uint8_t * pMid, const uint8_t * pDown, int32_t x )
+  {
+    return uint8_t( pUp[x + 1] * N | pUp[x + 2] * NE | pMid[x + 2] * E | pDown[x + 2] * SE | pDown[x + 1] * S
+                    | pDown[x] * SW | pMid[x] * W | pUp[x] * NW );
+  }
+
+  // Derived tiles for rows [y0, y1) into pOut, one byte per tile. Keeps the plain road flags of the rows above,
+  // on and below the current one, padded by a tile either side so the edges need no checks.
+  void deriveRows( const Track & track, int32_t y0, int32_t y1, uint8_t * pOut )
+  {
+    int32_t              nWidth = track.width();
+    std::vector<uint8_t> rows[3];
+    auto                 load = [&]( std::vector<uint8_t> & row, int32_t y ) {
+      row.assign( nWidth + 2, 0 );
+      if( y < 0 || y >= track.height() ) return;
+      for( int32_t x = 0; x < nWidth; x++ ) row[x + 1] = track[track.cordToIndex( x, y )] == mapTiles::Road;
+    };
+    load( rows[0], y0 - 1 );
+    load( rows[1], y0 );
+
+    for( int32_t y = y0; y < y1; y++ )
+    {
+      load( rows[( y - y0 + 2 ) % 3], y + 1 );
+      const uint8_t * pUp   = rows[( y - y0 ) % 3].data();
+      const uint8_t * pMid  = rows[( y - y0 + 1 ) % 3].data();
+      const uint8_t * pDown = rows[( y - y0 + 2 ) % 3].data();
+      uint8_t *       pRow  = pOut + size_t( y - y0 ) * nWidth;
+      for( int32_t x = 0; x < nWidth; x++ )
+      {
+        mapTiles tile = track[track.cordToIndex( x, y )];
+        if( painted( tile ) )
+        {
+          pRow[x] = uint8_t( tile );
+          continue;
+        }
+        pRow[x] = uint8_t( KERB_TILES[maskAt( pUp, pMid, pDown, x )] );
+      }
+    }
+  }
+
+  void writeRows( Track & track, int32_t y0, int32_t y1, const uint8_t * pTiles )
+  {
+    for( int32_t y = y0; y < y1; y++ )
+    {
+      const uint8_t * pRow = pTiles + size_t( y ) * track.width();
+      for( int32_t x = 0; x < track.width(); x++ )
+        if( track[track.cordToIndex( x, y )] != mapTiles( pRow[x] ) ) track.set( { x, y }, mapTiles( pRow[x] ) );
+    }
+  }
+} // namespace
+
+void autotileAround( Track & track, olc::vi2d cord )
+{
+  // Plain road flags for the 5x5 block that the nine tiles' masks look at, then each tile is one table lookup
+  uint8_t road[5][7] = {};
+  for( int32_t j = 0; j < 5; j++ )
+    for( int32_t i = 0; i < 5; i++ )
+    {
+      olc::vi2d at   = cord + olc::vi2d( i - 2, j - 2 );
+      road[j][i + 1] = track.inRange( at ) && track[track.cordToIndex( at )] == mapTiles::Road;
+    }
+
+  for( int32_t j = 0; j < 3; j++ )
+  {
+    for( int32_t i = 0; i < 3; i++ )
+    {
+      olc::vi2d at = cord + olc::vi2d( i - 1, j - 1 );
+      if( !track.inRange( at ) ) continue;
+      mapTiles tile = track[track.cordToIndex( at )];
+      if( painted( tile ) ) continue;
+      mapTiles kerb = KERB_TILES[maskAt( road[j], road[j + 1], road[j + 2], i + 1 )];
+      if( kerb != tile ) track.set( at, kerb );
+    }
+  }
+}
+
+void autotile( Track & track )
+{
+  std::vector<uint8_t> tiles( size_t( track.width() ) * track.height() );
+  deriveRows( track, 0, track.height(), tiles.data() );
+  writeRows( track, 0, track.height(), tiles.data() );
+}
+
+void autotile( Track & track, ThreadPool & pool )
+{
+  // Derive everything from the untouched map first, then write in bands that never share a packed word
+  std::vector<uint8_t> tiles( size_t( track.width() ) * track.height() );
+  size_t               nBands = ( track.height() + WRITE_ROWS - 1 ) / WRITE_ROWS;
+  pool.parallelFor( nBands, [&]( size_t nBand ) {
+    int32_t y0 = int32_t( nBand ) * WRITE_ROWS;
+    int32_t y1 = std::min( y0 + WRITE_ROWS, track.height() );
+    deriveRows( track, y0, y1, tiles.data() + size_t( y0 ) * track.width() );
+  } );
+  pool.parallelFor( nBands, [&]( size_t nBand ) {
+    int32_t y0 = int32_t( nBand ) * WRITE_ROWS;
+    writeRows( track, y0, std::min( y0 + WRITE_ROWS, track.height() ), tiles.data() );
+  } );
+}
+
+void autotileFresh( Track & track, const TileRect & rect )
+{
+  int32_t x0 = std::max( rect.x, 0 );
+  int32_t y0 = std::max( rect.y, 0 );
+  int32_t x1 = std::min( rect.x + rect.w, track.width() );
+  int32_t y1 = std::min( rect.y + rect.h, track.height() );
+  if( x1 <= x0 || y1 <= y0 ) return;
+
+  // Road bits of the rows above, on and below, copied before the row is kerbed since kerbs land in the Road plane.
+  // Padded with a word either side, which holds the neighbouring word of the map where there is one.
+  const TileMap &       tiles     = track.tileMap();
+  int32_t               nRowWords = ( track.width() + 63 ) >> 6;
+  int32_t               nFirst    = x0 >> 6;
+  int32_t               nWords    = ( ( x1 - 1 ) >> 6 ) - nFirst + 1;
+  std::vector<uint64_t> rows[3];
+  auto                  load = [&]( std::vector<uint64_t> & row, int32_t y ) {
+    row.assign( nWords + 2, 0 );
+    if( y < 0 || y >= track.height() ) return;
+    const uint64_t * pRoad = tiles.row( TileLayer::Road, y );
+    for( int32_t w = std::max( nFirst - 1, 0 ); w <= std::min( nFirst + nWords, nRowWords - 1 ); w++ )
+      row[w - nFirst + 1] = pRoad[w];
+  };
+  auto bitAt = []( const uint64_t * pRow, int32_t i ) { return uint8_t( ( pRow[i >> 6] >> ( i & 63 ) ) & 1 ); };
+  load( rows[0], y0 - 1 );
+  load( rows[1], y0 );
+
+  for( int32_t y = y0; y < y1; y++ )
+  {
+    load( rows[( y - y0 + 2 ) % 3], y + 1 );
+    const uint64_t * pUp   = rows[( y - y0 ) % 3].data();
+    const uint64_t * pMid  = rows[( y - y0 + 1 ) % 3].data();
+    const uint64_t * pDown = rows[( y - y0 + 2 ) % 3].data();
+    const uint64_t * pWall = tiles.row( TileLayer::Wall, y );
+    for( int32_t k = 1; k <= nWords; k++ )
+    {
+      // Bit x of west is road at x - 1, of east road at x + 1
+      auto     west = [&]( const uint64_t * pRow ) { return ( pRow[k] << 1 ) | ( pRow[k - 1] >> 63 ); };
+      auto     east = [&]( const uint64_t * pRow ) { return ( pRow[k] >> 1 ) | ( pRow[k + 1] << 63 ); };
+      int32_t  w    = nFirst + k - 1;
+      uint64_t near = pUp[k] | pDown[k] | west( pUp ) | west( pMid ) | west( pDown ) | east( pUp ) | east( pMid )
+                    | east( pDown );
+      uint64_t inRect = spanBits( std::max( x0 - w * 64, 0 ), std::min( x1 - w * 64, 64 ) );
+      uint64_t kerbs  = near & ~pMid[k] & ~pWall[w] & inRect;
+      while( kerbs )
+      {
+        int32_t nBit = lowestBit( kerbs );
+        kerbs &= kerbs - 1;
+
+        // Index into the padded rows, whose bit 64 is the first tile of word nFirst
+        int32_t i     = ( k << 6 ) + nBit;
+        uint8_t nMask = uint8_t( bitAt( pUp, i ) * N | bitAt( pUp, i + 1 ) * NE | bitAt( pMid, i + 1 ) * E
+                                 | bitAt( pDown, i + 1 ) * SE | bitAt( pDown, i ) * S | bitAt( pDown, i - 1 ) * SW
+                                 | bitAt( pMid, i - 1 ) * W | bitAt( pUp, i - 1 ) * NW );
+        track.set( { w * 64 + nBit, y }, KERB_TILES[nMask] );
+      }
+    }
+  }
+}
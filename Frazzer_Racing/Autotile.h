@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include "Track.h"
+
+// Kerbs are never painted by hand. Road, Wall and None are the painted tiles, and every None tile next to plain
+// Road becomes the edge or corner facing it, looked up from a 256 entry table indexed by which of its eight
+// neighbours are Road. Edge and corner tiles count as None when re-deriving, so painting over them is safe.
+
+// What was painted under a tile, kerbs being grass
+inline mapTiles paintedTile( mapTiles tile )
+{
+  return tile == mapTiles::Wall || tile == mapTiles::Road ? tile : mapTiles::None;
+}
+
+// Re-derives the tile at cord and its eight neighbours after cord has been painted
+void autotileAround( Track & track, olc::vi2d cord );
+
+// Re-derives every tile, for building or loading a track. Rows are spread over the pool.
+void autotile( Track & track );
+void autotile( Track & track, ThreadPool & pool );
+
+// Derives the kerbs inside rect on a track that has none yet, such as one just painted by a generator. Works along
+// the Road bitplane a word at a time, so grass away from any road costs next to nothing.
+void autotileFresh( Track & track, const TileRect & rect );
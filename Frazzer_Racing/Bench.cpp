@@ -0,0 +1,1257 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Autotile.h"
+#include "Checkpoints.h"
+#include "DistanceField.h"
+#include "FlowField.h"
+#include "FrazzerSim.h"
+#include "GameState.h"
+#include "Ghost.h"
+#include "Lidar.h"
+#include "Physics.h"
+#include "RacingLine.h"
+#include "Replay.h"
+#include "Simulation.h"
+#include "SnapshotCodec.h"
+#include "Standings.h"
+#include "Surface.h"
+#include "ThreadPool.h"
+#include "TileMap.h"
+#include "Track.h"
+#include "TrackEditor.h"
+#include "TrackGenerator.h"
+#include "VecEnv.h"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  double secondsSince( Clock::time_point start )
+  {
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+  }
+
+  void benchPhysics()
+  {
+    const int            STEPS = 10'000'000;
+    std::vector<uint8_t> inputs( STEPS );
+    for( int i = 0; i < STEPS; i++ ) inputs[i] = scriptedInput( i );
+
+    CarState car;
+    auto     start = Clock::now();
+    for( int i = 0; i < STEPS; i++ ) stepCar( car, inputs[i], 1.0f / TICK_RATE );
+    double fFloat = secondsSince( start );
+
+    CarStateFx carFx = toFixed( CarState() );
+    start            = Clock::now();
+    for( int i = 0; i < STEPS; i++ ) stepCarFx( carFx, inputs[i] );
+    double fFixed = secondsSince( start );
+
+    std::printf( "physics: float %.2f ns/step, Q16.16 %.2f ns/step\n", fFloat * 1e9 / STEPS, fFixed * 1e9 / STEPS );
+    std::printf( "physics: float end (%f, %f)\n", car.pos.x, car.pos.y );
+    std::printf( "physics: Q16.16 end x=%lld y=%lld vel=%lld angle=%u\n",
+                 (long long)carFx.x,
+                 (long long)carFx.y,
+                 (long long)carFx.vel,
+                 carFx.angle );
+  }
+
+  // Records a scripted ten minute race, then checks playback through the file reproduces it bit for bit
+  void benchReplay()
+  {
+    const uint32_t TICKS = 10 * 60 * TICK_RATE;
+    Track          track( 80, 40 );
+    track.buildDefault();
+
+    ReplayRecorder recorder;
+    CarStateFx     car = toFixed( CarState() );
+    recorder.begin( car, track.checksum() );
+    for( uint32_t i = 0; i < TICKS; i++ )
+    {
+      recorder.record( scriptedInput( i ), car );
+      simulateTick( car, scriptedInput( i ), track );
+    }
+
+    Replay replay;
+    if( !saveReplay( recorder.current(), "bench.frr" ) || !loadReplay( "bench.frr", replay ) )
+    {
+      std::printf( "replay: could not write bench.frr\n" );
+      return;
+    }
+    std::remove( "bench.frr" );
+
+    const int  RUNS  = 100;
+    CarStateFx end;
+    auto       start = Clock::now();
+    for( int i = 0; i < RUNS; i++ ) end = simulateReplay( replay, track );
+    double fPlayback = secondsSince( start ) / RUNS;
+
+    bool bMatch = end.x == car.x && end.y == car.y && end.vel == car.vel && end.angle == car.angle;
+    std::printf( "replay: %u ticks in %zu bytes (%.3f bits/tick)\n",
+                 TICKS,
+                 replay.stream.size(),
+                 replay.stream.size() * 8.0 / TICKS );
+    std::printf( "replay: headless playback %.3f ms (%.0fx real time), %s\n",
+                 fPlayback * 1e3,
+                 TICKS / double( TICK_RATE ) / fPlayback,
+                 bMatch ? "matches recording" : "DIVERGED" );
+  }
+
+  // File size against worst case seek time for a range of keyframe intervals over an hour long race
+  void benchReplaySeek()
+  {
+    const uint32_t TICKS = 60 * 60 * TICK_RATE;
+    Track          track( 80, 40 );
+    track.buildDefault();
+    Checkpoints checkpoints( track );
+
+    for( uint32_t nInterval : { 0u, 60u * TICK_RATE, 10u * TICK_RATE, 1u * TICK_RATE } )
+    {
+      ReplayRecorder recorder;
+      CarStateFx     car = toFixed( CarState() );
+      LapTimes       laps;
+      recorder.begin( car, track.checksum(), nInterval );
+      for( uint32_t i = 0; i < TICKS; i++ )
+      {
+        CarStateFx before = car;
+        recorder.record( scriptedInput( i ), car, laps );
+        simulateTick( car, scriptedInput( i ), track );
+        checkpoints.update( &laps, &before, &car, 1, i );
+      }
+
+      Replay replay;
+      if( !saveReplay( recorder.current(), "bench.frr" ) || !loadReplay( "bench.frr", replay ) )
+      {
+        std::printf( "replay-seek: could not write bench.frr\n" );
+        return;
+      }
+      std::ifstream ifs( "bench.frr", std::ios::binary | std::ios::ate );
+      size_t        nFileSize = size_t( ifs.tellg() );
+      ifs.close();
+      std::remove( "bench.frr" );
+
+      // Seek to just before each keyframe (or the end), the furthest a seek ever has to simulate
+      const int    SEEKS = 200;
+      ReplayReader reader( replay );
+      CarStateFx   seekCar;
+      bool         bMatch = true;
+      auto         start  = Clock::now();
+      for( int i = 0; i < SEEKS; i++ )
+      {
+        uint32_t nTarget = TICKS - 1 - uint32_t( i ) * 97;
+        if( nInterval > 0 ) nTarget = ( nTarget / nInterval ) * nInterval + nInterval - 1;
+        reader.seek( std::min( nTarget, TICKS ), track, seekCar );
+      }
+      double fSeek = secondsSince( start ) / SEEKS;
+
+      // The lap times come back with the car, timed from the keyframe
+      LapTimes seekLaps;
+      reader.seek( TICKS, track, checkpoints, seekCar, seekLaps );
+      bMatch = seekCar.x == car.x && seekCar.y == car.y && seekCar.vel == car.vel && seekCar.angle == car.angle;
+      bMatch &= seekLaps.nLaps == laps.nLaps && seekLaps.nNextGate == laps.nNextGate
+                && seekLaps.nLastSector == laps.nLastSector && seekLaps.nLapStartUs == laps.nLapStartUs
+                && seekLaps.nSectorStartUs == laps.nSectorStartUs && seekLaps.nLastLapUs == laps.nLastLapUs
+                && seekLaps.nBestLapUs == laps.nBestLapUs && seekLaps.nLastSectorUs == laps.nLastSectorUs;
+      std::printf( "replay-seek: keyframe every %5u ticks, %6zu bytes, worst seek %8.3f ms, %s\n",
+                   nInterval,
+                   nFileSize,
+                   fSeek * 1e3,
+                   bMatch ? "matches recording" : "DIVERGED" );
+    }
+  }
+
+  // Per frame cost of stepping and posing ghosts, without the draw calls which need a window
+  void benchCheckpoints()
+  {
+    const int32_t SIZE  = 4096;
+    const size_t  CARS  = 10000;
+    const int     TICKS = 600;
+    Track         track( SIZE, SIZE );
+    size_t        nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    ThreadPool    pool( nCores );
+
+    for( uint32_t nGates : { 4u, 64u, 1024u, 16384u } )
+    {
+      TrackGenParams params;
+      params.nSectors    = nGates;
+      GeneratedTrack gen = generateTrack( track, 3, pool, params );
+      Checkpoints    checkpoints( track );
+
+      // Cars drive the centreline at their own speeds, positions worked out ahead so only the timing is measured
+      const std::vector<olc::vf2d> & line = gen.centreline;
+      std::vector<float>             arc( line.size() + 1, 0.0f );
+      for( size_t i = 0; i < line.size(); i++ ) arc[i + 1] = arc[i] + ( line[( i + 1 ) % line.size()] - line[i] ).mag();
+      float fLoop = arc.back();
+      auto  carAt = [&]( double fAlong ) {
+        float     s = float( std::fmod( fAlong, double( fLoop ) ) );
+        size_t    i = std::upper_bound( arc.begin(), arc.end(), s ) - arc.begin() - 1;
+        float     t = ( s - arc[i] ) / std::max( arc[i + 1] - arc[i], 1e-6f );
+        olc::vf2d p = ( line[i] + ( line[( i + 1 ) % line.size()] - line[i] ) * t ) * olc::vf2d( track.blockSize() );
+        return CarStateFx{ floatToFixed( p.x ), floatToFixed( p.y ), 0, 0 };
+      };
+      std::mt19937        rng( 9 );
+      std::vector<double> starts( CARS ), speeds( CARS );
+      for( size_t i = 0; i < CARS; i++ )
+      {
+        starts[i] = fLoop * ( rng() % 1000 ) / 1000.0;
+        speeds[i] = 0.4 + ( rng() % 1000 ) / 1000.0;  // Tiles per tick
+      }
+      std::vector<CarStateFx> positions( CARS * ( TICKS + 1 ) );
+      for( int t = 0; t <= TICKS; t++ )
+        for( size_t i = 0; i < CARS; i++ ) positions[t * CARS + i] = carAt( starts[i] + speeds[i] * t );
+
+      std::vector<LapTimes> times( CARS );
+      auto                  start = Clock::now();
+      for( int t = 0; t < TICKS; t++ )
+      {
+        const CarStateFx * pBefore = &positions[t * CARS];
+        checkpoints.update( times.data(), pBefore, pBefore + CARS, CARS, uint32_t( t ), pool );
+      }
+      double fSeconds = secondsSince( start );
+
+      // The first start line crossing starts the clock, every one after that is a lap
+      size_t nWrong = 0;
+      for( size_t i = 0; i < CARS; i++ )
+      {
+        int64_t nCrossed = int64_t( std::floor( ( starts[i] + speeds[i] * TICKS ) / fLoop ) );
+        nWrong += int64_t( times[i].nLaps ) != std::max<int64_t>( nCrossed - 1, 0 );
+      }
+      std::printf( "checkpoints: %5zu gates, %zu cars on %zu threads, %.1f ns per car per tick, %zu lap counts wrong\n",
+                   checkpoints.gateCount(),
+                   CARS,
+                   nCores,
+                   fSeconds * 1e9 / ( double( CARS ) * TICKS ),
+                   nWrong );
+    }
+  }
+
+  void benchStandings()
+  {
+    const int32_t SIZE  = 4096;
+    const size_t  CARS  = 10000;
+    const int     TICKS = 600;
+    Track         track( SIZE, SIZE );
+    size_t        nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    ThreadPool    pool( nCores );
+    generateTrack( track, 3, pool );
+    Checkpoints checkpoints( track );
+    Standings   standings( track );
+
+    // Cars spread round the loop at their own speeds, overtaking all the way, driven ahead of time along the
+    // centreline so only the standings are measured
+    const std::vector<olc::vf2d> & line = track.centreline();
+    std::vector<double>            arc( line.size() + 1, 0.0 );
+    for( size_t i = 0; i < line.size(); i++ ) arc[i + 1] = arc[i] + ( line[( i + 1 ) % line.size()] - line[i] ).mag();
+    double fLoop = arc.back();
+    auto   carAt = [&]( double fAlong ) {
+      double    s = std::fmod( fAlong, fLoop );
+      size_t    i = std::upper_bound( arc.begin(), arc.end(), s ) - arc.begin() - 1;
+      float     t = float( ( s - arc[i] ) / std::max( arc[i + 1] - arc[i], 1e-6 ) );
+      olc::vf2d p = line[i] + ( line[( i + 1 ) % line.size()] - line[i] ) * t;
+      return CarStateFx{ floatToFixed( p.x ), floatToFixed( p.y ), 0, 0 };
+    };
+    std::mt19937        rng( 11 );
+    std::vector<double> starts( CARS ), speeds( CARS );
+    for( size_t i = 0; i < CARS; i++ )
+    {
+      starts[i] = fLoop * ( rng() % 10000 ) / 10000.0;
+      speeds[i] = 4.0 + ( rng() % 1000 ) / 100.0;  // Pixels per tick
+    }
+    std::vector<CarStateFx> positions( CARS * ( TICKS + 1 ) );
+    for( int t = 0; t <= TICKS; t++ )
+      for( size_t i = 0; i < CARS; i++ ) positions[t * CARS + i] = carAt( starts[i] + speeds[i] * t );
+
+    std::vector<LapTimes> times( CARS );
+    double                fSeconds = 0.0;
+    size_t                nMoves   = 0;
+    standings.update( positions.data(), times.data(), CARS, pool );
+    for( int t = 0; t < TICKS; t++ )
+    {
+      const CarStateFx * pBefore = &positions[t * CARS];
+      checkpoints.update( times.data(), pBefore, pBefore + CARS, CARS, uint32_t( t ), pool );
+      auto start = Clock::now();
+      standings.update( pBefore + CARS, times.data(), CARS, pool );
+      fSeconds += secondsSince( start );
+      nMoves += standings.lastMoves();
+    }
+
+    // Every car starts on the lap before its first start line crossing, so the distance raced is where it is less a
+    // lap, and the order has to match sorting those from scratch
+    size_t nOff = 0;
+    for( size_t i = 0; i < CARS; i++ )
+      nOff += std::abs( standings.distanceOf( uint32_t( i ) ) - ( starts[i] + speeds[i] * TICKS - fLoop ) ) > 1.0;
+    std::vector<uint32_t> sorted( CARS );
+    for( uint32_t i = 0; i < CARS; i++ ) sorted[i] = i;
+    std::sort( sorted.begin(), sorted.end(), [&]( uint32_t a, uint32_t b ) {
+      double fA = standings.distanceOf( a ), fB = standings.distanceOf( b );
+      return fA > fB || ( fA == fB && a < b );
+    } );
+    std::printf( "standings: %zu cars on %zu threads, %.1f ns per car per tick, %.1f places changed per tick\n",
+                 CARS,
+                 nCores,
+                 fSeconds * 1e9 / ( double( CARS ) * TICKS ),
+                 double( nMoves ) / TICKS );
+    std::printf( "standings: %zu distances more than a pixel out, order %s a full sort\n",
+                 nOff,
+                 sorted == standings.order() ? "matches" : "differs from" );
+  }
+
+  void benchDistanceField()
+  {
+    const int32_t SIZE    = 10000;
+    const int     EDITS   = 1000;
+    const size_t  SAMPLES = 10000 * 4;
+    size_t        nCores  = std::max( 1u, std::thread::hardware_concurrency() );
+    Track         track( SIZE, SIZE );
+    {
+      ThreadPool pool;
+      generateTrack( track, 1, pool );
+    }
+
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool    pool( nThreads );
+      auto          start = Clock::now();
+      DistanceField field( track, TileLayer::Road );
+      double        fSerialMs = secondsSince( start ) * 1e3;
+      start                   = Clock::now();
+      field.rebuild( pool );
+      std::printf( "distfield: %dx%d road field on %2zu threads %.1f ms (%.1f ms without the pool), %.1f MB\n",
+                   SIZE,
+                   SIZE,
+                   nThreads,
+                   secondsSince( start ) * 1e3,
+                   fSerialMs,
+                   double( SIZE ) * SIZE / 1e6 );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+
+    // Single tiles painted round the middle of the map, each brought up to date on its own
+    DistanceField field( track, TileLayer::Road );
+    std::mt19937  rng( 3 );
+    auto          start = Clock::now();
+    for( int i = 0; i < EDITS; i++ )
+    {
+      olc::vi2d c = { SIZE / 2 + int32_t( rng() % 2000 ) - 1000, SIZE / 2 + int32_t( rng() % 2000 ) - 1000 };
+      track.set( c, rng() % 2 ? mapTiles::Road : mapTiles::None );
+      field.update( { c.x, c.y, 1, 1 } );
+    }
+    double        fEditUs = secondsSince( start ) * 1e6 / EDITS;
+    DistanceField fresh( track, TileLayer::Road );
+    size_t        nDiffer = 0;
+    for( int32_t y = 0; y < SIZE; y++ )
+      for( int32_t x = 0; x < SIZE; x++ ) nDiffer += field.at( x, y ) != fresh.at( x, y );
+    std::printf( "distfield: %.1f us per single tile edit, %zu tiles differ from a rebuild\n", fEditUs, nDiffer );
+
+    // Car corners scattered over the middle of the map
+    std::vector<olc::vf2d> points( SAMPLES );
+    olc::vf2d              vWorld = olc::vf2d( track.worldSize() );
+    for( olc::vf2d & p : points )
+      p = { vWorld.x * ( 0.25f + 0.5f * ( rng() % 10000 ) / 10000.0f ),
+            vWorld.y * ( 0.25f + 0.5f * ( rng() % 10000 ) / 10000.0f ) };
+    float fSum = 0.0f;
+    start      = Clock::now();
+    for( int nPass = 0; nPass < 100; nPass++ )
+    {
+      for( const olc::vf2d & p : points )
+      {
+        olc::vf2d vGradient;
+        fSum += field.distance( p, vGradient ) + vGradient.x;
+      }
+    }
+    std::printf( "distfield: %.1f ns per distance and gradient sample (sum %.0f)\n",
+                 secondsSince( start ) * 1e9 / ( 100.0 * SAMPLES ),
+                 fSum );
+  }
+
+  // A field of cars ticked with and without the surfaces under their wheels, then with a rumble strip textured along
+  // every kerb, and how far a car gets accelerating on tarmac against grass
+  void benchSurfaces()
+  {
+    const int32_t SIZE  = 2048;
+    const size_t  CARS  = 100000;
+    const int     TICKS = 100;
+    Track         track( SIZE, SIZE );
+    {
+      ThreadPool pool;
+      generateTrack( track, 5, pool );
+    }
+
+    std::mt19937            rng( 5 );
+    olc::vi2d               vWorld = track.worldSize();
+    std::vector<CarStateFx> start( CARS );
+    std::vector<uint8_t>    inputs( CARS );
+    for( size_t i = 0; i < CARS; i++ )
+    {
+      start[i].x     = toFixed( int32_t( rng() % vWorld.x ) );
+      start[i].y     = toFixed( int32_t( rng() % vWorld.y ) );
+      start[i].vel   = toFixed( 100 );
+      start[i].angle = uint32_t( rng() );
+      inputs[i]      = uint8_t( rng() & 0x0F );
+    }
+
+    // Headings carry from one tick to the next as VecEnv keeps them, the hash comparing vector and scalar builds
+    std::vector<WheelGrip> wheels( CARS );
+    uint64_t               nHash = 0;
+    auto                   run   = [&]( bool bSurfaces ) {
+      std::vector<CarStateFx> cars = start;
+      std::vector<SinCos>     headings( CARS );
+      for( size_t i = 0; i < CARS; i++ ) headings[i] = fixedSinCos( cars[i].angle );
+      auto begin = Clock::now();
+      for( int t = 0; t < TICKS; t++ )
+      {
+        if( bSurfaces )
+        {
+          simulateTick( cars.data(), headings.data(), inputs.data(), CARS, track );
+          continue;
+        }
+        for( size_t i = 0; i < CARS; i++ )
+        {
+          stepCarFx( cars[i], inputs[i], WheelGrip(), headings[i] );
+          clampCarFx( cars[i], track.blockSize(), vWorld - track.blockSize() );
+        }
+      }
+      double fNs = secondsSince( begin ) * 1e9 / ( double( CARS ) * TICKS );
+      sampleWheels( cars.data(), headings.data(), CARS, track, wheels.data() );
+      nHash = 0;
+      for( const CarStateFx & car : cars ) nHash = ( nHash ^ uint64_t( car.x ^ car.y ^ car.angle ) ) * 0x100000001B3ull;
+      return fNs;
+    };
+    double fTarmac   = run( false );
+    double fSurfaces = run( true );
+
+    size_t nOffRoad = 0;
+    for( const WheelGrip & grip : wheels ) nOffRoad += grip.friction != FIXED_ONE;
+
+    // Rumble strips double the friction across the outer half of every kerb, which costs nothing more to sample
+    SurfaceTable  rumble = track.surfaces();
+    const int32_t T      = SurfaceTable::TEXELS;
+    for( mapTiles tile :
+         { mapTiles::Road_L_Edge, mapTiles::Road_R_Edge, mapTiles::Road_T_Edge, mapTiles::Road_B_Edge } )
+    {
+      uint8_t texels[T * T];
+      for( int32_t v = 0; v < T; v++ )
+        for( int32_t u = 0; u < T; u++ )
+        {
+          bool bOuter = tile == mapTiles::Road_L_Edge   ? u < T / 2
+                        : tile == mapTiles::Road_R_Edge ? u >= T / 2
+                        : tile == mapTiles::Road_T_Edge ? v < T / 2
+                                                        : v >= T / 2;
+          texels[v * T + u] = bOuter ? 2 * SurfaceTable::NEUTRAL : SurfaceTable::NEUTRAL;
+        }
+      rumble.setTexture( tile, texels );
+    }
+    track.setSurfaces( rumble );
+    double fTextured = run( true );
+
+    std::printf( "surfaces: %zu cars, %.1f ns per car per tick on tarmac, %.1f sampling four wheels, %.1f textured\n",
+                 CARS,
+                 fTarmac,
+                 fSurfaces,
+                 fTextured );
+    std::printf( "surfaces: %.1f%% of cars off plain tarmac at the end, field hash %016llx\n",
+                 100.0 * nOffRoad / CARS,
+                 (unsigned long long)nHash );
+
+    // Ten seconds flat out from a standstill down a straight, on road and on grass
+    Track straight( 200, 20 );
+    straight.buildEmpty();
+    auto drive = [&]() {
+      CarStateFx car = { toFixed( 100 ), toFixed( 100 ), 0, 0x40000000u };
+      for( int t = 0; t < 10 * TICK_RATE; t++ ) simulateTick( car, INPUT_ACCEL, straight );
+      return std::make_pair( fixedToFloat( car.x ) - 100.0f, fixedToFloat( car.vel ) );
+    };
+    auto grass = drive();
+    for( int32_t y = 1; y < straight.height() - 1; y++ )
+      for( int32_t x = 1; x < straight.width() - 1; x++ ) straight.set( { x, y }, mapTiles::Road );
+    auto road = drive();
+    std::printf( "surfaces: 10 s flat out covers %.0f px at %.1f px/s on road, %.0f px at %.1f px/s on grass\n",
+                 road.first,
+                 road.second,
+                 grass.first,
+                 grass.second );
+  }
+
+  // Building every gate's field on a large track across thread counts, repairing them after blocks of wall are
+  // dropped on the road and taken away again, then a field of AI cars lapping on nothing but the fields
+  void benchFlowField()
+  {
+    const int32_t SIZE   = 2048;
+    const int     EDITS  = 200;
+    const size_t  CARS   = 1000;
+    const int     TICKS  = 120 * TICK_RATE;
+    size_t        nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    Track         track( SIZE, SIZE );
+    {
+      ThreadPool pool;
+      generateTrack( track, 7, pool );
+    }
+
+    FlowField flow( track );
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool pool( nThreads );
+      auto       start = Clock::now();
+      flow.rebuild( pool );
+      std::printf( "flowfield: %dx%d, %zu gates on %2zu threads %.1f ms\n",
+                   SIZE,
+                   SIZE,
+                   flow.gateCount(),
+                   nThreads,
+                   secondsSince( start ) * 1e3 );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+
+    // Blocks dropped on the centreline, every other edit clearing the last one back to road
+    const std::vector<olc::vf2d> & line = track.centreline();
+    std::mt19937                   rng( 7 );
+    ThreadPool                     pool( nCores );
+    TileRect                       rect;
+    double                         fEdits = 0.0;
+    for( int i = 0; i < EDITS; i++ )
+    {
+      bool bClear = i % 2 == 1;
+      if( !bClear )
+      {
+        olc::vi2d vTile = track.worldCordToTileCord( olc::vi2d( line[rng() % line.size()] ) );
+        rect            = { vTile.x - 1, vTile.y - 1, 3, 3 };
+      }
+      mapTiles tile = bClear ? mapTiles::Road : mapTiles::Wall;
+      for( int32_t y = rect.y; y < rect.y + rect.h; y++ )
+        for( int32_t x = rect.x; x < rect.x + rect.w; x++ ) track.set( { x, y }, tile );
+      auto start = Clock::now();
+      flow.update( rect, pool );
+      fEdits += secondsSince( start );
+    }
+    FlowField fresh( track );
+    size_t    nDiffer = 0;
+    for( uint32_t g = 0; g < flow.gateCount(); g++ )
+      for( int32_t y = 0; y < SIZE; y++ )
+        for( int32_t x = 0; x < SIZE; x++ ) nDiffer += flow.cost( g, x, y ) != fresh.cost( g, x, y );
+    std::printf( "flowfield: %.2f ms per edit, %zu costs differ from a rebuild\n", fEdits * 1e3 / EDITS, nDiffer );
+
+    // On a track small enough to lap a few times, cars spread round the centreline facing along it and none of them
+    // having crossed the start line yet
+    Track lapTrack( 256, 256 );
+    generateTrack( lapTrack, 7, pool );
+    FlowField                      lapFlow( lapTrack );
+    Checkpoints                    checkpoints( lapTrack );
+    const std::vector<olc::vf2d> & loop = lapTrack.centreline();
+    std::vector<CarStateFx>        cars( CARS ), before( CARS );
+    std::vector<LapTimes>          times( CARS );
+    for( size_t i = 0; i < CARS; i++ )
+    {
+      size_t    nPoint = i * loop.size() / CARS;
+      olc::vf2d vDir   = loop[( nPoint + 1 ) % loop.size()] - loop[nPoint];
+      CarState  car;
+      car.pos   = loop[nPoint];
+      car.angle = std::atan2( vDir.x, -vDir.y );
+      cars[i]   = toFixed( car );
+    }
+    double fSteer = 0.0;
+    for( int t = 0; t < TICKS; t++ )
+    {
+      before = cars;
+      std::vector<uint8_t> inputs( CARS );
+      auto                 start = Clock::now();
+      for( size_t i = 0; i < CARS; i++ ) inputs[i] = lapFlow.steer( cars[i], times[i].nNextGate, toFixed( 150 ) );
+      fSteer += secondsSince( start );
+      for( size_t i = 0; i < CARS; i++ ) simulateTick( cars[i], inputs[i], lapTrack );
+      checkpoints.update( times.data(), before.data(), cars.data(), CARS, uint32_t( t ) );
+    }
+    uint32_t nLaps = 0, nNone = 0;
+    int64_t  nBest = -1;
+    for( const LapTimes & lap : times )
+    {
+      nLaps += lap.nLaps;
+      nNone += lap.nLaps == 0;
+      if( lap.nBestLapUs >= 0 && ( nBest < 0 || lap.nBestLapUs < nBest ) ) nBest = lap.nBestLapUs;
+    }
+    std::printf( "flowfield: %zu AI cars %.1f ns per car per tick steering, %.2f laps each in %d s, %u without a lap, "
+                 "best %.2f s\n",
+                 CARS,
+                 fSteer * 1e9 / ( double( CARS ) * TICKS ),
+                 double( nLaps ) / CARS,
+                 TICKS / TICK_RATE,
+                 nNone,
+                 nBest * 1e-6 );
+  }
+
+  void benchEditor()
+  {
+    const int32_t SIZE    = 10000;
+    const int     STROKES = 1000;
+    auto          start   = Clock::now();
+    Track         track( SIZE, SIZE );
+    track.buildEmpty();
+    std::printf( "editor: %dx%d empty track in %.1f ms, %.1f MB\n",
+                 SIZE,
+                 SIZE,
+                 secondsSince( start ) * 1e3,
+                 track.tileMap().memoryBytes() / 1e6 );
+
+    // Flat colour per tile, the cost being measured is finding and redrawing tiles rather than blitting art
+    olc::vi2d   vBlock   = track.blockSize();
+    ThreadPool  pool( std::max( 1u, std::thread::hardware_concurrency() ) );
+    auto        drawFlat = [=]( const SpriteView & target, const olc::vi2d & pos, mapTiles tile ) {
+      fillRect( target, pos, vBlock, olc::Pixel( uint8_t( tile ) * 20, 0, 0 ) );
+    };
+    TrackEditor editor( track, "bench.frt", pool, drawFlat );
+    const olc::vi2d SCREEN = { 1280, 720 };
+    uint32_t        nEmpty = track.checksum();
+    start                  = Clock::now();
+    editor.cacheView( SCREEN );
+    std::printf( "editor: %zu chunks in view built in %.1f ms\n", editor.cachedChunks(), secondsSince( start ) * 1e3 );
+
+    // Short strokes of road and wall in view, each brought on screen before the next like a frame would
+    std::mt19937 rng( 5 );
+    double       fWorst = 0.0;
+    start               = Clock::now();
+    for( int i = 0; i < STROKES; i++ )
+    {
+      auto      strokeStart = Clock::now();
+      olc::vi2d c           = { int32_t( rng() % 70 ) + 4, int32_t( rng() % 36 ) + 4 };
+      editor.beginStroke();
+      for( int j = 0; j < 8; j++ ) editor.paint( c + olc::vi2d( j, j / 2 ), i % 3 ? mapTiles::Road : mapTiles::Wall );
+      editor.endStroke();
+      editor.cacheView( SCREEN );
+      fWorst = std::max( fWorst, secondsSince( strokeStart ) );
+    }
+    std::printf( "editor: %.2f us per 8 tile stroke with redraw, worst %.2f us, undo history %zu bytes\n",
+                 secondsSince( start ) * 1e6 / STROKES,
+                 fWorst * 1e6,
+                 editor.undoBytes() );
+
+    uint32_t nEdited = track.checksum();
+    start            = Clock::now();
+    while( editor.undo() ) editor.cacheView( SCREEN );
+    double fUndo = secondsSince( start );
+    std::printf( "editor: undid %d strokes in %.1f ms, %s\n",
+                 STROKES,
+                 fUndo * 1e3,
+                 track.checksum() == nEmpty ? "back to empty" : "TRACK DIFFERS" );
+    start = Clock::now();
+    while( editor.redo() ) editor.cacheView( SCREEN );
+    double fRedo = secondsSince( start );
+    std::printf( "editor: redid %d strokes in %.1f ms, %s\n",
+                 STROKES,
+                 fRedo * 1e3,
+                 track.checksum() == nEdited ? "same track" : "TRACK DIFFERS" );
+
+    start = Clock::now();
+    editor.save();
+    double fSave = secondsSince( start );
+    start        = Clock::now();
+    Track loaded;
+    bool   bLoaded = loadTrack( "bench.frt", loaded, pool );
+    double fLoad   = secondsSince( start );
+    std::printf( "editor: saved in %.1f ms, loaded in %.1f ms, %s\n",
+                 fSave * 1e3,
+                 fLoad * 1e3,
+                 bLoaded && loaded.checksum() == nEdited ? "round trip matches" : "ROUND TRIP DIFFERS" );
+
+    // The tile art only fits the track's own block size
+    Track other( 8, 8, vBlock * 2 );
+    other.buildEmpty();
+    bool bReloaded = editor.load();
+    bool bRefused  = saveTrack( other, "bench.frt" ) && !editor.load() && track.checksum() == nEdited;
+    std::printf( "editor: reload %s, other block size %s\n",
+                 bReloaded ? "works" : "FAILS",
+                 bRefused ? "refused" : "NOT REFUSED" );
+    std::remove( "bench.frt" );
+  }
+
+  void benchGhosts()
+  {
+    Track track( 80, 40 );
+    track.buildDefault();
+
+    ReplayRecorder recorder;
+    CarStateFx     car = toFixed( CarState() );
+    recorder.begin( car, track.checksum() );
+    for( uint32_t i = 0; i < 60 * TICK_RATE; i++ )
+    {
+      recorder.record( scriptedInput( i ), car );
+      simulateTick( car, scriptedInput( i ), track );
+    }
+    Replay replay = recorder.current();
+
+    for( int nGhosts : { 1, 8, 64, 512 } )
+    {
+      GhostCars ghosts;
+      for( int i = 0; i < nGhosts; i++ ) ghosts.add( replay, olc::WHITE );
+
+      const int FRAMES = 3600;
+      size_t    nDrawn = 0;
+      auto      start  = Clock::now();
+      for( int i = 0; i < FRAMES; i++ )
+      {
+        ghosts.tick( track );
+        nDrawn += ghosts.poses( 0.5f ).size();
+      }
+      double fFrame = secondsSince( start ) / FRAMES;
+      std::printf( "ghosts: %3d ghosts %7.3f us/frame (%.1f ns/ghost), %zu poses\n",
+                   nGhosts,
+                   fFrame * 1e6,
+                   fFrame * 1e9 / nGhosts,
+                   nDrawn );
+    }
+  }
+
+  // Snapshot and restore of a full race into a pre-allocated ring, plus a save file round trip
+  void benchSnapshot()
+  {
+    Track track( 80, 40 );
+    track.buildDefault();
+
+    GameState state;
+    state.nCars         = MAX_CARS;
+    state.trackChecksum = track.checksum();
+    for( int i = 0; i < MAX_CARS; i++ ) state.cars[i] = toFixed( CarState() );
+
+    // Fill the ring with a real history first
+    SnapshotRing ring( 10 * TICK_RATE );
+    uint8_t      inputs[MAX_CARS];
+    for( size_t i = 0; i < ring.capacity(); i++ )
+    {
+      for( int c = 0; c < MAX_CARS; c++ ) inputs[c] = scriptedInput( int( i ) + c * 37 );
+      ring.push( state );
+      simulateTick( state, inputs, track );
+    }
+
+    const int RUNS  = 10'000'000;
+    auto      start = Clock::now();
+    for( int i = 0; i < RUNS; i++ )
+    {
+      ring.push( state );
+      state.tick++;
+    }
+    double fPush = secondsSince( start );
+
+    GameState restored;
+    uint32_t  nFound = 0;
+    start            = Clock::now();
+    for( int i = 0; i < RUNS; i++ ) nFound += ring.find( state.tick - 1 - uint32_t( i % 300 ), restored );
+    double fFind = secondsSince( start );
+
+    bool bSaved = saveGameState( state, "bench.frs" ) && loadGameState( "bench.frs", restored );
+    std::remove( "bench.frs" );
+    bool bMatch = bSaved && std::memcmp( &state.cars, &restored.cars, sizeof( state.cars ) ) == 0;
+
+    std::printf( "snapshot: %zu byte GameState, push %.1f ns, restore %.1f ns (%u found)\n",
+                 sizeof( GameState ),
+                 fPush * 1e9 / RUNS,
+                 fFind * 1e9 / RUNS,
+                 nFound );
+    std::printf( "snapshot: save file round trip %s\n", bMatch ? "matches" : "FAILED" );
+  }
+
+  // Spectator snapshot size and encode time against a baseline 3 ticks old, as with ~50 ms of round trip
+  void benchSpectator()
+  {
+    Track track( 80, 40 );
+    track.buildDefault();
+    std::mt19937 rng( 7 );
+
+    for( size_t nCars : { 100, 1000, 10000 } )
+    {
+      std::vector<CarStateFx> cars( nCars );
+      std::vector<int>        offsets( nCars );
+      for( size_t i = 0; i < nCars; i++ )
+      {
+        CarState car;
+        car.pos    = { float( 20 + rng() % 760 ), float( 20 + rng() % 360 ) };
+        car.angle  = float( rng() % 628 ) / 100.0f;
+        cars[i]    = toFixed( car );
+        offsets[i] = int( rng() % 1000 );
+      }
+
+      SnapshotEncoder encoder;
+      SnapshotDecoder decoder;
+      const uint32_t  WARMUP = 60, TICKS = 300, LAG = 3;
+      size_t          nDeltaBytes = 0, nFullBytes = 0;
+      double          fEncode     = 0.0;
+      bool            bMatch      = true;
+      for( uint32_t tick = 0; tick < WARMUP + TICKS; tick++ )
+      {
+        for( size_t i = 0; i < nCars; i++ ) simulateTick( cars[i], scriptedInput( int( tick ) + offsets[i] ), track );
+
+        auto start = Clock::now();
+        encoder.capture( tick, cars.data(), nCars );
+        BitWriter delta;
+        encoder.encode( tick >= LAG ? tick - LAG : NO_BASELINE, delta );
+        double fTick = secondsSince( start );
+
+        // Full snapshots keep the decoder's history complete so every delta has its baseline
+        BitWriter full;
+        encoder.encode( NO_BASELINE, full );
+        Snapshot  decoded;
+        BitReader fullReader( full.bytes().data(), full.bytes().size() );
+        decoder.decode( fullReader, decoded );
+        if( tick < WARMUP ) continue;
+
+        BitReader deltaReader( delta.bytes().data(), delta.bytes().size() );
+        bMatch &= decoder.decode( deltaReader, decoded ) && decoded.cars == encoder.latest().cars;
+        fEncode += fTick;
+        nDeltaBytes += delta.bytes().size();
+        nFullBytes += full.bytes().size();
+      }
+
+      std::printf( "spectator: %5zu cars, delta %7.0f bytes/tick (%.2f bits/car), full %7.0f, raw floats %7zu, "
+                   "capture+encode %8.2f us, %s\n",
+                   nCars,
+                   double( nDeltaBytes ) / TICKS,
+                   nDeltaBytes * 8.0 / TICKS / nCars,
+                   double( nFullBytes ) / TICKS,
+                   nCars * 4 * sizeof( float ),
+                   fEncode * 1e6 / TICKS,
+                   bMatch ? "decodes exactly" : "MISMATCH" );
+    }
+  }
+
+  // Environment steps per second for a batch of training races, across thread counts
+  void benchRacingLine()
+  {
+    const int32_t SIZE   = 2048;
+    const size_t  CARS   = 1000;
+    const int     TICKS  = 120 * TICK_RATE;
+    size_t        nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    Track         track( SIZE, SIZE );
+    {
+      ThreadPool pool;
+      generateTrack( track, 7, pool );
+    }
+
+    RacingLine line;
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool      pool( nThreads );
+      RacingLineStats stats;
+      auto            start = Clock::now();
+      line                  = buildRacingLine( track, pool, RacingLineParams(), &stats );
+      std::printf( "racingline: %dx%d on %2zu threads %.1f ms, %u levels %u iterations, %u points %u touching the "
+                   "edge, lap %.2f s\n",
+                   SIZE,
+                   SIZE,
+                   nThreads,
+                   secondsSince( start ) * 1e3,
+                   stats.nLevels,
+                   stats.nIterations,
+                   stats.nPoints,
+                   stats.nTouching,
+                   stats.fLapTime );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+
+    // Pinned to the centreline by a margin wider than the road, for what the line saves
+    RacingLineParams middle;
+    middle.fMargin = 1e6f;
+    RacingLineStats centre;
+    buildRacingLine( track, middle, &centre );
+
+    RacingLine loaded;
+    bool       bSaved = saveRacingLine( line, "bench.line" ) && loadRacingLine( "bench.line", loaded );
+    std::ifstream ifs( "bench.line", std::ios::binary | std::ios::ate );
+    size_t        nBytes = bSaved ? size_t( ifs.tellg() ) : 0;
+    ifs.close();
+    std::remove( "bench.line" );
+    bool bSame = bSaved && loaded.trackKey == line.trackKey && loaded.points.size() == line.points.size();
+    for( size_t i = 0; bSame && i < line.points.size(); i++ )
+      bSame = loaded.points[i].x == line.points[i].x && loaded.points[i].y == line.points[i].y &&
+              loaded.points[i].speed == line.points[i].speed;
+    std::printf( "racingline: %zu points kept in %zu bytes, %s, centreline lap %.2f s\n",
+                 line.points.size(),
+                 nBytes,
+                 bSame ? "loads back exactly" : "DIFFERS ONCE LOADED",
+                 centre.fLapTime );
+
+    // Cars spread round the lap track as for the flow field, each following the line from its nearest segment
+    ThreadPool pool( nCores );
+    Track      lapTrack( 256, 256 );
+    generateTrack( lapTrack, 7, pool );
+    RacingLineStats                stats;
+    RacingLine                     lapLine = buildRacingLine( lapTrack, pool, RacingLineParams(), &stats );
+    Checkpoints                    checkpoints( lapTrack );
+    const std::vector<olc::vf2d> & loop = lapTrack.centreline();
+    std::vector<CarStateFx>        cars( CARS ), before( CARS );
+    std::vector<LapTimes>          times( CARS );
+    std::vector<uint32_t>          segments( CARS );
+    for( size_t i = 0; i < CARS; i++ )
+    {
+      size_t    nPoint = i * loop.size() / CARS;
+      olc::vf2d vDir   = loop[( nPoint + 1 ) % loop.size()] - loop[nPoint];
+      CarState  car;
+      car.pos     = loop[nPoint];
+      car.angle   = std::atan2( vDir.x, -vDir.y );
+      cars[i]     = toFixed( car );
+      segments[i] = nearestSegment( lapLine, cars[i] );
+    }
+    double fSteer   = 0.0;
+    size_t nOffRoad = 0;
+    for( int t = 0; t < TICKS; t++ )
+    {
+      before = cars;
+      std::vector<uint8_t> inputs( CARS );
+      auto                 start = Clock::now();
+      for( size_t i = 0; i < CARS; i++ ) inputs[i] = steerAlong( lapLine, cars[i], segments[i] );
+      fSteer += secondsSince( start );
+      for( size_t i = 0; i < CARS; i++ )
+      {
+        simulateTick( cars[i], inputs[i], lapTrack );
+        nOffRoad += !lapTrack.isRoad( lapTrack.worldCordToTileCord( olc::vi2d( toFloat( cars[i] ).pos ) ) );
+      }
+      checkpoints.update( times.data(), before.data(), cars.data(), CARS, uint32_t( t ) );
+    }
+    uint32_t nLaps = 0, nNone = 0;
+    int64_t  nBest = -1;
+    for( const LapTimes & lap : times )
+    {
+      nLaps += lap.nLaps;
+      nNone += lap.nLaps == 0;
+      if( lap.nBestLapUs >= 0 && ( nBest < 0 || lap.nBestLapUs < nBest ) ) nBest = lap.nBestLapUs;
+    }
+    std::printf( "racingline: %zu AI cars %.1f ns per car per tick steering, %.2f laps each in %d s, %u without a "
+                 "lap, best %.2f s of %.2f s, %.2f%% of ticks off the road\n",
+                 CARS,
+                 fSteer * 1e9 / ( double( CARS ) * TICKS ),
+                 double( nLaps ) / CARS,
+                 TICKS / TICK_RATE,
+                 nNone,
+                 nBest * 1e-6,
+                 stats.fLapTime,
+                 100.0 * nOffRoad / ( double( CARS ) * TICKS ) );
+  }
+
+  void benchTrackGen()
+  {
+    size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    for( int32_t nSize : { 256, 1024, 4096, 10000 } )
+    {
+      Track track( nSize, nSize );
+      for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+      {
+        ThreadPool     pool( nThreads );
+        auto           start = Clock::now();
+        GeneratedTrack gen   = generateTrack( track, 1, pool );
+        double         fMs   = secondsSince( start ) * 1e3;
+        std::printf( "trackgen: %5dx%-5d on %2zu threads %6.1f ms, candidate %2u width %d length %.2f curvature %.2f "
+                     "overlap %.3f\n",
+                     nSize,
+                     nSize,
+                     nThreads,
+                     fMs,
+                     gen.nCandidate,
+                     gen.nWidth,
+                     gen.score.fLength,
+                     gen.score.fCurvature,
+                     gen.score.fOverlap );
+        if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+      }
+
+      // Kerbing only round the road must give what a full pass does
+      Track full = track;
+      autotile( full );
+      TileRect all = { 0, 0, nSize, nSize };
+      std::printf( "trackgen: %u road tiles, kerbs %s a full autotile pass\n",
+                   track.tileMap().count( TileLayer::Road, all ),
+                   full.checksum() == track.checksum() ? "match" : "DIFFER FROM" );
+    }
+  }
+
+  void benchVecEnv()
+  {
+    Track track( 80, 40 );
+    track.buildDefault();
+
+    const size_t         ENVS = 4096;
+    const int            STEPS = 2000;
+    std::mt19937         rng( 3 );
+    std::vector<uint8_t> actions( ENVS * 16 );
+    for( uint8_t & a : actions ) a = uint8_t( rng() % 16 );
+
+    size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool pool( nThreads );
+      VecEnv     env( track, ENVS, pool, 30 * TICK_RATE );
+      auto       start = Clock::now();
+      for( int i = 0; i < STEPS; i++ ) env.step( actions.data() + ( i % 16 ) * ENVS );
+      double fSeconds = secondsSince( start );
+
+      start = Clock::now();
+      env.reset();
+      double fReset = secondsSince( start );
+
+      double fSteps = double( ENVS ) * STEPS / fSeconds;
+      std::printf( "vecenv: %zu envs on %2zu threads, %6.1f M steps/s (%.0f M/min), %.1f ns/step, reset all %.1f us\n",
+                   ENVS,
+                   nThreads,
+                   fSteps / 1e6,
+                   fSteps * 60 / 1e6,
+                   1e9 / fSteps,
+                   fReset * 1e6 );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+  }
+
+  // Cost of a step through the C interface beyond the simulation itself, with a single env so overhead dominates
+  void benchAbi()
+  {
+    const int STEPS   = 2'000'000;
+    uint8_t   actions = FR_INPUT_ACCEL;
+
+    for( uint32_t nThreads : { 1u, 0u } )
+    {
+      FrSim * sim = fr_create( 1, nThreads, 60 * TICK_RATE, nullptr );
+      if( sim == nullptr ) return;
+      auto start = Clock::now();
+      for( int i = 0; i < STEPS; i++ ) fr_step( sim, &actions );
+      double fStep = secondsSince( start ) / STEPS;
+      fr_destroy( sim );
+      std::printf( "abi: 1 env, %s threads, %.1f ns per fr_step\n", nThreads ? "1" : "all", fStep * 1e9 );
+    }
+
+    // The shared memory path writes the same arrays, only their home differs
+    FrSim * sim = fr_create_shm( 4096, 1, 60 * TICK_RATE, "/frazzer_bench" );
+    if( sim == nullptr )
+    {
+      std::printf( "abi: could not create shared memory\n" );
+      return;
+    }
+    uint8_t * pActions = fr_shm_actions( sim );
+    for( int i = 0; i < 4096; i++ ) pActions[i] = uint8_t( i % 16 );
+    auto start = Clock::now();
+    for( int i = 0; i < 1000; i++ ) fr_step( sim, pActions );
+    double fStep = secondsSince( start ) / 1000;
+    std::printf( "abi: 4096 envs in shared memory, %.1f us per fr_step (%.1f ns per env)\n",
+                 fStep * 1e6,
+                 fStep * 1e9 / 4096 );
+    fr_destroy( sim );
+  }
+  // Full passes over a large map of random road blobs, then single tile edits
+  void benchAutotile()
+  {
+    const int32_t SIZE  = 4096;
+    const int     EDITS = 1'000'000;
+    Track         track( SIZE, SIZE );
+    std::mt19937  rng( 11 );
+    for( int32_t y = 0; y < SIZE; y++ )
+      for( int32_t x = 0; x < SIZE; x++ ) track.set( { x, y }, ( rng() % 4 ) ? mapTiles::None : mapTiles::Road );
+
+    size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool pool( nThreads );
+      auto       start = Clock::now();
+      autotile( track, pool );
+      std::printf( "autotile: %dx%d full pass on %2zu threads %.1f ms\n",
+                   SIZE,
+                   SIZE,
+                   nThreads,
+                   secondsSince( start ) * 1e3 );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+
+    std::vector<olc::vi2d> cords( 4096 );
+    for( olc::vi2d & c : cords ) c = { int32_t( rng() % SIZE ), int32_t( rng() % SIZE ) };
+    auto start = Clock::now();
+    for( int i = 0; i < EDITS; i++ )
+    {
+      olc::vi2d c = cords[i & 4095];
+      track.set( c, ( i & 1 ) ? mapTiles::Road : mapTiles::None );
+      autotileAround( track, c );
+    }
+    double fEdit = secondsSince( start );
+
+    Track full = track;
+    autotile( full );
+    bool bSame = full.checksum() == track.checksum();
+    std::printf( "autotile: %.1f ns per painted tile, %s a full pass\n",
+                 fEdit * 1e9 / EDITS,
+                 bSame ? "matches" : "DIFFERS FROM" );
+  }
+
+  // Packed tile map against the 4 byte enum per tile it replaced, and rect queries against a per-tile scan
+  void benchTileMap()
+  {
+    const int32_t SIZE    = 4096;
+    const int     QUERIES = 1'000'000;
+    Track         track( SIZE, SIZE );
+    std::mt19937  rng( 9 );
+    for( int32_t y = 0; y < SIZE; y++ )
+      for( int32_t x = 0; x < SIZE; x++ ) track.set( { x, y }, mapTiles( rng() % 11 ) );
+
+    size_t nEnum = size_t( SIZE ) * SIZE * sizeof( mapTiles );
+    std::printf( "tilemap: %dx%d tiles in %.1f MB, was %.1f MB (%.1fx smaller)\n",
+                 SIZE,
+                 SIZE,
+                 track.tileMap().memoryBytes() / 1e6,
+                 nEnum / 1e6,
+                 double( nEnum ) / track.tileMap().memoryBytes() );
+
+    std::vector<TileRect> rects( 4096 );
+    for( TileRect & r : rects ) r = { int32_t( rng() % SIZE ) - 16, int32_t( rng() % SIZE ) - 16, 3, 3 };
+    const TileMap & tiles = track.tileMap();
+
+    // 3x3 wall checks like checkWallCollision, then 64x64 road counts
+    for( int32_t nSize : { 3, 64 } )
+    {
+      uint64_t nScan = 0, nPacked = 0;
+      auto     start = Clock::now();
+      for( int i = 0; i < QUERIES; i++ )
+      {
+        TileRect r = rects[i & 4095];
+        for( int32_t y = std::max( r.y, 0 ); y < std::min( r.y + nSize, SIZE ); y++ )
+          for( int32_t x = std::max( r.x, 0 ); x < std::min( r.x + nSize, SIZE ); x++ )
+          {
+            mapTiles tile = track[track.cordToIndex( x, y )];
+            nScan += nSize == 3 ? tile == mapTiles::Wall : tile != mapTiles::Wall && tile != mapTiles::None;
+          }
+      }
+      double fScan = secondsSince( start );
+
+      start = Clock::now();
+      for( int i = 0; i < QUERIES; i++ )
+      {
+        TileRect r = rects[i & 4095];
+        r.w = r.h = nSize;
+        nPacked += nSize == 3 ? tiles.count( TileLayer::Wall, r ) : tiles.count( TileLayer::Road, r );
+      }
+      double fPacked = secondsSince( start );
+
+      std::printf( "tilemap: %dx%d %s, per-tile scan %.1f ns, bitplane %.1f ns, %s\n",
+                   nSize,
+                   nSize,
+                   nSize == 3 ? "wall count" : "road count",
+                   fScan * 1e9 / QUERIES,
+                   fPacked * 1e9 / QUERIES,
+                   nScan == nPacked ? "counts match" : "COUNTS DIFFER" );
+    }
+
+    uint64_t nAny  = 0;
+    auto     start = Clock::now();
+    for( int i = 0; i < QUERIES; i++ )
+    {
+      TileRect r = rects[i & 4095];
+      nAny += tiles.any( TileLayer::Wall, r );
+    }
+    std::printf( "tilemap: 3x3 any wall %.1f ns (%llu hits)\n",
+                 secondsSince( start ) * 1e9 / QUERIES,
+                 (unsigned long long)nAny );
+  }
+
+  // 64 rays round each of 1000 cars scattered over the default track's tarmac, checked against one ray at a time
+  void benchLidar()
+  {
+    Track track( 80, 40 );
+    track.buildDefault();
+
+    const size_t            CARS  = 1000;
+    const int               TICKS = 200;
+    Lidar                   lidar( track );
+    uint32_t                nRays = lidar.params().nRays;
+    std::mt19937            rng( 5 );
+    std::vector<CarStateFx> cars( CARS );
+    for( CarStateFx & car : cars )
+    {
+      do
+      {
+        car.x = fixed( rng() % ( track.worldSize().x * FIXED_ONE ) );
+        car.y = fixed( rng() % ( track.worldSize().y * FIXED_ONE ) );
+      } while( !track.isRoad( track.worldCordToTileCord( { int32_t( car.x >> FIXED_SHIFT ),
+                                                          int32_t( car.y >> FIXED_SHIFT ) } ) ) );
+      car.angle = rng();
+    }
+    std::vector<float> ranges( CARS * nRays );
+
+    // The batched cast must agree with castRay to the bit, whichever path it took
+    lidar.cast( cars.data(), CARS, ranges.data() );
+    size_t nMismatch = 0;
+    double fTotal    = 0;
+    for( size_t i = 0; i < CARS; i++ )
+    {
+      olc::vf2d vPos = { fixedToFloat( cars[i].x ), fixedToFloat( cars[i].y ) };
+      for( uint32_t r = 0; r < nRays; r++ )
+      {
+        float fOne = lidar.castRay( vPos, lidar.rayDirection( cars[i], r ) );
+        nMismatch += std::memcmp( &fOne, &ranges[i * nRays + r], sizeof( float ) ) != 0;
+        fTotal += ranges[i * nRays + r];
+      }
+    }
+    std::printf( "lidar: mean range %.1f px, %zu of %zu rays differ from castRay\n",
+                 fTotal / ranges.size(),
+                 nMismatch,
+                 ranges.size() );
+
+    size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+    for( size_t nThreads = 1; nThreads <= nCores; nThreads *= 2 )
+    {
+      ThreadPool pool( nThreads );
+      auto       start = Clock::now();
+      for( int i = 0; i < TICKS; i++ ) lidar.cast( cars.data(), CARS, ranges.data(), pool );
+      double fSeconds = secondsSince( start ) / TICKS;
+      std::printf( "lidar: %u rays x %zu cars on %2zu threads, %.3f ms per tick, %.1f ns per ray\n",
+                   nRays,
+                   CARS,
+                   nThreads,
+                   fSeconds * 1e3,
+                   fSeconds * 1e9 / ranges.size() );
+      if( nThreads < nCores && nThreads * 2 > nCores ) nThreads = nCores / 2;
+    }
+  }
+
+
+  const std::map<std::string, std::function<void()>> BENCHES = {
+    { "abi", benchAbi },
+    { "autotile", benchAutotile },
+    { "checkpoints", benchCheckpoints },
+    { "distfield", benchDistanceField },
+    { "editor", benchEditor },
+    { "flowfield", benchFlowField },
+    { "ghosts", benchGhosts },
+    { "lidar", benchLidar },
+    { "physics", benchPhysics },
+    { "racingline", benchRacingLine },
+    { "replay", benchReplay },
+    { "replay-seek", benchReplaySeek },
+    { "snapshot", benchSnapshot },
+    { "spectator", benchSpectator },
+    { "standings", benchStandings },
+    { "surfaces", benchSurfaces },
+    { "tilemap", benchTileMap },
+    { "trackgen", benchTrackGen },
+    { "vecenv", benchVecEnv },
+  };
+} // namespace
+
+int runBench( const std::string & sName )
+{
+  bool bFound = false;
+  for( const auto & [sBench, func] : BENCHES )
+  {
+    if( sName != "all" && sName != sBench ) continue;
+    func();
+    bFound = true;
+  }
+
+  if( !bFound )
+  {
+    std::printf( "Unknown benchmark '%s', available:", sName.c_str() );
+    for( const auto & bench : BENCHES ) std::printf( " %s", bench.first.c_str() );
+    std::printf( " all\n" );
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// Headless micro benchmarks, run with `Frazzer_Racing --bench <name>`, or `all`
+int runBench( const std::string & sName );
@@ -0,0 +1,95 @@
+#include "BitStream.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+  // Bit reversal of every byte, for writing gamma codes' high-bit-first tails in one go
+  const std::array<uint8_t, 256> REVERSED = [] {
+    std::array<uint8_t, 256> table = {};
+    for( int i = 0; i < 256; i++ )
+      for( int b = 0; b < 8; b++ ) table[i] |= uint8_t( ( ( i >> b ) & 1 ) << ( 7 - b ) );
+    return table;
+  }();
+
+  uint32_t reverseBits( uint32_t v, int nBits )
+  {
+    uint32_t r = ( uint32_t( REVERSED[v & 0xFF] ) << 24 ) | ( uint32_t( REVERSED[( v >> 8 ) & 0xFF] ) << 16 )
+                 | ( uint32_t( REVERSED[( v >> 16 ) & 0xFF] ) << 8 ) | REVERSED[v >> 24];
+    return r >> ( 32 - nBits );
+  }
+} // namespace
+
+void BitWriter::write( uint32_t value, int nBits )
+{
+  if( nBits <= 0 ) return;
+
+  // Shift the value to where the last byte is filled up to and OR in at most 5 bytes
+  uint64_t bits  = uint64_t( nBits == 32 ? value : value & ( ( 1u << nBits ) - 1 ) ) << ( nBitCount % 8 );
+  size_t   nByte = nBitCount / 8;
+  nBitCount += nBits;
+  while( data.size() * 8 < nBitCount ) data.push_back( 0 );
+  for( ; bits != 0; bits >>= 8 ) data[nByte++] |= uint8_t( bits );
+}
+
+void BitWriter::write64( uint64_t value )
+{
+  write( uint32_t( value ), 32 );
+  write( uint32_t( value >> 32 ), 32 );
+}
+
+void BitWriter::writeGamma( uint32_t n )
+{
+  int nBits = 0;
+  while( ( n >> nBits ) > 1 ) nBits++;
+
+  // Highest bit first so the leading 1 terminates the run of zeros, written as one reversed field
+  uint32_t reversed = reverseBits( n, nBits + 1 );
+  if( 2 * nBits + 1 <= 32 ) write( reversed << nBits, 2 * nBits + 1 );
+  else
+  {
+    write( 0, nBits );
+    write( reversed, nBits + 1 );
+  }
+}
+
+uint32_t BitReader::read( int nBits )
+{
+  uint32_t value = 0;
+  int      nDone = 0;
+  while( nDone < nBits )
+  {
+    if( nBitPos >= nBytes * 8 )
+    {
+      bOverrun = true;
+      return value;
+    }
+    int      nUsed = int( nBitPos % 8 );
+    int      nTake = std::min( 8 - nUsed, nBits - nDone );
+    uint32_t bits  = ( data[nBitPos / 8] >> nUsed ) & ( ( 1u << nTake ) - 1 );
+    value |= bits << nDone;
+    nDone += nTake;
+    nBitPos += nTake;
+  }
+  return value;
+}
+
+uint64_t BitReader::read64()
+{
+  uint64_t lo = read( 32 );
+  uint64_t hi = read( 32 );
+  return lo | ( hi << 32 );
+}
+
+uint32_t BitReader::readGamma()
+{
+  int nBits = 0;
+  while( read( 1 ) == 0 )
+  {
+    if( bOverrun || ++nBits > 31 ) return 0;
+  }
+  uint32_t n = 1;
+  for( int i = 0; i < nBits; i++ ) n = ( n << 1 ) | read( 1 );
+  return n;
+}
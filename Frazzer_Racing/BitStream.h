@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Packs values LSB first into a growing byte buffer
+class BitWriter
+{
+public:
+  void write( uint32_t value, int nBits );
+  void write64( uint64_t value );
+
+  // Elias gamma code for n >= 1: small numbers take few bits, 1 takes a single bit
+  void writeGamma( uint32_t n );
+
+  void                         reserve( size_t nBytes ) { data.reserve( nBytes ); }
+  size_t                       bitCount() const { return nBitCount; }
+  const std::vector<uint8_t> & bytes() const { return data; }
+
+private:
+  std::vector<uint8_t> data;
+  size_t               nBitCount = 0;
+};
+
+// Reads back what BitWriter wrote, reading past the end yields zeros and sets overrun()
+class BitReader
+{
+public:
+  BitReader() = default;
+  BitReader( const uint8_t * data, size_t nBytes, size_t nBitPos = 0 )
+    : data( data ), nBytes( nBytes ), nBitPos( nBitPos )
+  {}
+
+  uint32_t read( int nBits );
+  uint64_t read64();
+  uint32_t readGamma();
+
+  size_t bitPos() const { return nBitPos; }
+  bool   overrun() const { return bOverrun; }
+
+private:
+  const uint8_t * data     = nullptr;
+  size_t          nBytes   = 0;
+  size_t          nBitPos  = 0;
+  bool            bOverrun = false;
+};
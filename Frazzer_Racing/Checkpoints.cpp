@@ -0,0 +1,161 @@
+#include "Checkpoints.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Pixels, about a gate's length so most gates land in one or two cells
+  const float CELL_SIZE = 64.0f;
+
+  // Moves spanning more cells than this a side are jumps rather than driving
+  const int32_t MAX_MOVE_CELLS = 4;
+
+  const size_t UPDATE_GRAIN = 256;
+} // namespace
+
+Checkpoints::Checkpoints( const Track & track ) : track( track ) { rebuild(); }
+
+void Checkpoints::rebuild()
+{
+  olc::vi2d vWorld = track.worldSize();
+  nCellsX          = std::max( int32_t( std::ceil( vWorld.x / CELL_SIZE ) ), 1 );
+  nCellsY          = std::max( int32_t( std::ceil( vWorld.y / CELL_SIZE ) ), 1 );
+
+  // Each gate goes in every cell its bounding box touches, counted first and then filled
+  const std::vector<Gate> & gates    = track.gates();
+  auto                      forCells = [&]( const Gate & gate, auto func ) {
+    int32_t cx0 = std::clamp( int32_t( std::floor( std::min( gate.a.x, gate.b.x ) / CELL_SIZE ) ), 0, nCellsX - 1 );
+    int32_t cx1 = std::clamp( int32_t( std::floor( std::max( gate.a.x, gate.b.x ) / CELL_SIZE ) ), 0, nCellsX - 1 );
+    int32_t cy0 = std::clamp( int32_t( std::floor( std::min( gate.a.y, gate.b.y ) / CELL_SIZE ) ), 0, nCellsY - 1 );
+    int32_t cy1 = std::clamp( int32_t( std::floor( std::max( gate.a.y, gate.b.y ) / CELL_SIZE ) ), 0, nCellsY - 1 );
+    for( int32_t cy = cy0; cy <= cy1; cy++ )
+      for( int32_t cx = cx0; cx <= cx1; cx++ ) func( size_t( cy ) * nCellsX + cx );
+  };
+  cellStart.assign( size_t( nCellsX ) * nCellsY + 1, 0 );
+  for( const Gate & gate : gates ) forCells( gate, [&]( size_t nCell ) { cellStart[nCell + 1]++; } );
+  for( size_t i = 1; i < cellStart.size(); i++ ) cellStart[i] += cellStart[i - 1];
+  cellGates.resize( cellStart.back() );
+  std::vector<uint32_t> fill( cellStart.begin(), cellStart.end() - 1 );
+  for( uint32_t i = 0; i < gates.size(); i++ )
+    forCells( gates[i], [&]( size_t nCell ) { cellGates[fill[nCell]++] = i; } );
+}
+
+uint32_t Checkpoints::crossings( const olc::vf2d & vFrom, const olc::vf2d & vTo, Crossing * pOut ) const
+{
+  int32_t cx0 = std::clamp( int32_t( std::floor( std::min( vFrom.x, vTo.x ) / CELL_SIZE ) ), 0, nCellsX - 1 );
+  int32_t cx1 = std::clamp( int32_t( std::floor( std::max( vFrom.x, vTo.x ) / CELL_SIZE ) ), 0, nCellsX - 1 );
+  int32_t cy0 = std::clamp( int32_t( std::floor( std::min( vFrom.y, vTo.y ) / CELL_SIZE ) ), 0, nCellsY - 1 );
+  int32_t cy1 = std::clamp( int32_t( std::floor( std::max( vFrom.y, vTo.y ) / CELL_SIZE ) ), 0, nCellsY - 1 );
+  if( cx1 - cx0 >= MAX_MOVE_CELLS || cy1 - cy0 >= MAX_MOVE_CELLS ) return 0;
+
+  const std::vector<Gate> & gates  = track.gates();
+  olc::vf2d                 vMove  = vTo - vFrom;
+  uint32_t                  nFound = 0;
+  for( int32_t cy = cy0; cy <= cy1; cy++ )
+  {
+    for( int32_t cx = cx0; cx <= cx1; cx++ )
+    {
+      size_t nCell = size_t( cy ) * nCellsX + cx;
+      for( uint32_t k = cellStart[nCell]; k < cellStart[nCell + 1]; k++ )
+      {
+        // Forwards is to the right of a -> b. The move counts from just after vFrom up to and including vTo, so a
+        // car stopping on the line crosses it once.
+        uint32_t     nGate = cellGates[k];
+        const Gate & gate  = gates[nGate];
+        olc::vf2d    vGate = gate.b - gate.a;
+        float        fDet  = vGate.cross( vMove );
+        if( fDet <= 0.0f ) continue;
+        olc::vf2d vToGate = gate.a - vFrom;
+        float     fAt     = vGate.cross( vToGate ) / fDet;
+        float     fAlong  = vMove.cross( vToGate ) / fDet;
+        if( fAt <= 0.0f || fAt > 1.0f || fAlong < 0.0f || fAlong > 1.0f ) continue;
+
+        // A gate spanning several cells is found once per cell
+        bool bSeen = false;
+        for( uint32_t i = 0; i < nFound; i++ ) bSeen |= pOut[i].nGate == nGate;
+        if( bSeen || nFound == MAX_CROSSINGS ) continue;
+
+        // Kept in order along the move
+        uint32_t i = nFound++;
+        for( ; i > 0 && pOut[i - 1].fAt > fAt; i-- ) pOut[i] = pOut[i - 1];
+        pOut[i] = { nGate, fAt };
+      }
+    }
+  }
+  return nFound;
+}
+
+uint32_t Checkpoints::update( LapTimes &        times,
+                              const olc::vf2d & vFrom,
+                              const olc::vf2d & vTo,
+                              int64_t           nFromUs,
+                              int64_t           nToUs ) const
+{
+  uint32_t nGates = uint32_t( gateCount() );
+  if( nGates == 0 ) return 0;
+
+  Crossing found[MAX_CROSSINGS];
+  uint32_t nFound  = crossings( vFrom, vTo, found );
+  uint32_t nPassed = 0;
+  for( uint32_t i = 0; i < nFound; i++ )
+  {
+    // Out of order gates don't count, so a lap has to take in every sector
+    uint32_t nGate = found[i].nGate;
+    if( nGate != times.nNextGate ) continue;
+    int64_t nAtUs = nFromUs + int64_t( std::llround( double( nToUs - nFromUs ) * found[i].fAt ) );
+
+    if( times.nLapStartUs >= 0 )
+    {
+      times.nLastSector   = ( nGate + nGates - 1 ) % nGates;
+      times.nLastSectorUs = nAtUs - times.nSectorStartUs;
+    }
+    if( nGate == 0 )
+    {
+      if( times.nLapStartUs >= 0 )
+      {
+        times.nLastLapUs = nAtUs - times.nLapStartUs;
+        times.nBestLapUs = times.nBestLapUs < 0 ? times.nLastLapUs : std::min( times.nBestLapUs, times.nLastLapUs );
+        times.nLaps++;
+      }
+      times.nLapStartUs = nAtUs;
+    }
+    times.nSectorStartUs = nAtUs;
+    times.nNextGate      = ( nGate + 1 ) % nGates;
+    nPassed++;
+  }
+  return nPassed;
+}
+
+void Checkpoints::update( LapTimes *         pTimes,
+                          const CarStateFx * pBefore,
+                          const CarStateFx * pAfter,
+                          size_t             nCars,
+                          uint32_t           nTick ) const
+{
+  int64_t nFromUs = tickToUs( nTick );
+  int64_t nToUs   = tickToUs( nTick + 1 );
+  for( size_t i = 0; i < nCars; i++ )
+  {
+    olc::vf2d vFrom = { fixedToFloat( pBefore[i].x ), fixedToFloat( pBefore[i].y ) };
+    olc::vf2d vTo   = { fixedToFloat( pAfter[i].x ), fixedToFloat( pAfter[i].y ) };
+    update( pTimes[i], vFrom, vTo, nFromUs, nToUs );
+  }
+}
+
+void Checkpoints::update( LapTimes *         pTimes,
+                          const CarStateFx * pBefore,
+                          const CarStateFx * pAfter,
+                          size_t             nCars,
+                          uint32_t           nTick,
+                          ThreadPool &       pool ) const
+{
+  pool.parallelFor( nCars, UPDATE_GRAIN, [&]( size_t nBegin, size_t nEnd ) {
+    update( pTimes + nBegin, pBefore + nBegin, pAfter + nBegin, nEnd - nBegin, nTick );
+  } );
+}
+
+void Checkpoints::update( LapTimes * pTimes, const GameState & before, const GameState & after ) const
+{
+  update( pTimes, before.cars, after.cars, std::min( before.nCars, after.nCars ), before.tick );
+}
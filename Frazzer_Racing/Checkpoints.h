@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GameState.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// Lap and sector timing against a track's gates. Each car's motion over a tick is a segment, tested against only the
+// gates in the grid cells it touches, so the cost per car stays the same however many gates the track has. Gates
+// count when crossed forwards and in order, the time interpolated to where along the motion they were crossed.
+class Checkpoints
+{
+public:
+  explicit Checkpoints( const Track & track );
+
+  // Re-reads the gates, call after the track or its gates have changed
+  void rebuild();
+
+  // Times one car moving from vFrom at nFromUs to vTo at nToUs, returning how many gates it passed. A move across
+  // more than a few grid cells is a jump, such as a restart, and crosses nothing.
+  uint32_t update( LapTimes &        times,
+                   const olc::vf2d & vFrom,
+                   const olc::vf2d & vTo,
+                   int64_t           nFromUs,
+                   int64_t           nToUs ) const;
+
+  // Times cars over the fixed tick from nTick to nTick + 1, times[i] following before[i] to after[i]
+  void update( LapTimes *         pTimes,
+               const CarStateFx * pBefore,
+               const CarStateFx * pAfter,
+               size_t             nCars,
+               uint32_t           nTick ) const;
+  void update( LapTimes *         pTimes,
+               const CarStateFx * pBefore,
+               const CarStateFx * pAfter,
+               size_t             nCars,
+               uint32_t           nTick,
+               ThreadPool &       pool ) const;
+
+  // Every car of a race over the tick from before to after
+  void update( LapTimes * pTimes, const GameState & before, const GameState & after ) const;
+
+  size_t gateCount() const { return track.gates().size(); }
+
+  // Start of a fixed tick on the race clock
+  static int64_t tickToUs( uint32_t nTick ) { return int64_t( nTick ) * 1000000 / TICK_RATE; }
+
+private:
+  struct Crossing
+  {
+    uint32_t nGate;
+    float    fAt;  // Fraction of the way along the motion
+  };
+
+  // Gates crossed forwards by the motion, in the order they were crossed, up to MAX_CROSSINGS
+  uint32_t crossings( const olc::vf2d & vFrom, const olc::vf2d & vTo, Crossing * pOut ) const;
+
+  static constexpr uint32_t MAX_CROSSINGS = 8;
+
+  const Track &         track;
+  int32_t               nCellsX = 0;
+  int32_t               nCellsY = 0;
+  std::vector<uint32_t> cellStart;  // Gates of cell c are cellGates[cellStart[c], cellStart[c + 1])
+  std::vector<uint32_t> cellGates;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+// The builds target the baseline architecture; SIMD kernels are compiled for their instruction set function by
+// function with FR_TARGET_* and only called after the matching cpuHas*() check
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#  define FR_X86_SIMD
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+// MSVC accepts any intrinsic without /arch
+#    define FR_TARGET_SSSE3
+#    define FR_TARGET_AVX2
+#  else
+#    define FR_TARGET_SSSE3 __attribute__( ( target( "ssse3" ) ) )
+#    define FR_TARGET_AVX2  __attribute__( ( target( "avx2" ) ) )
+#  endif
+
+inline bool cpuHasSsse3()
+{
+#  ifdef _MSC_VER
+  static const bool bSsse3 = []
+  {
+    int info[4];
+    __cpuid( info, 1 );
+    return ( info[2] & ( 1 << 9 ) ) != 0;
+  }();
+  return bSsse3;
+#  else
+  return __builtin_cpu_supports( "ssse3" );
+#  endif
+}
+
+inline bool cpuHasAvx2()
+{
+#  ifdef _MSC_VER
+  static const bool bAvx2 = []
+  {
+    int info[4];
+    __cpuid( info, 0 );
+    if( info[0] < 7 ) return false;
+
+    // AVX and OSXSAVE, and the OS saving the YMM registers
+    __cpuid( info, 1 );
+    if( ( info[2] & ( 1 << 27 ) ) == 0 || ( info[2] & ( 1 << 28 ) ) == 0 ) return false;
+    if( ( _xgetbv( 0 ) & 6 ) != 6 ) return false;
+
+    __cpuidex( info, 7, 0 );
+    return ( info[1] & ( 1 << 5 ) ) != 0;
+  }();
+  return bAvx2;
+#  else
+  return __builtin_cpu_supports( "avx2" );
+#  endif
+}
+#endif
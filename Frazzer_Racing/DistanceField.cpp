@@ -0,0 +1,282 @@
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+  const int32_t UNITS_PER_TILE = 8;
+
+  // Gaps down a column are a nibble each, so RANGE_TILES is the most they can say: that far or further
+  const uint8_t FAR_GAP = uint8_t( DistanceField::RANGE_TILES );
+
+  const size_t COLUMN_GRAIN = 256;
+  const size_t ROW_GRAIN    = 16;
+
+  // Columns whose rows are checked for the surface together, a bitplane word
+  const size_t CHUNK = 64;
+
+  const float INF = std::numeric_limits<float>::infinity();
+
+  // A tile's gaps up or down its column to the nearest tile on the surface (low nibble) and off it (high nibble)
+  uint8_t stepGaps( uint8_t nGaps )
+  {
+    uint8_t nOn  = uint8_t( std::min( ( nGaps & 15 ) + 1, int( FAR_GAP ) ) );
+    uint8_t nOff = uint8_t( std::min( ( nGaps >> 4 ) + 1, int( FAR_GAP ) ) );
+    return uint8_t( nOn | nOff << 4 );
+  }
+
+  uint8_t minGaps( uint8_t a, uint8_t b )
+  {
+    return uint8_t( std::min( a & 15, b & 15 ) | std::min( a >> 4, b >> 4 ) << 4 );
+  }
+
+  // First tile from x on whose gap to the surface is in range, eight at a time through stretches far from it
+  int32_t skipFar( const uint8_t * pGaps, int32_t x, int32_t n )
+  {
+    const uint64_t ALL_FAR = 0x0F0F0F0F0F0F0F0Full;
+    for( ; x + 8 <= n; x += 8 )
+    {
+      uint64_t nEight;
+      std::memcpy( &nEight, pGaps + x, 8 );
+      if( ( nEight & ALL_FAR ) != ALL_FAR ) break;
+    }
+    while( x < n && ( pGaps[x] & 15 ) == FAR_GAP ) x++;
+    return x;
+  }
+
+  // Lower envelope of the parabolas pF[q] + ( fSpacing * ( p - q ) )^2 sampled at every p, pZ holding where each
+  // parabola of the envelope takes over in pixels. pV needs n entries and pZ n + 1.
+  void transform1d( const float * pF, int32_t n, float fSpacing, float * pOut, int32_t * pV, float * pZ )
+  {
+    auto meet = [&]( int32_t q, int32_t p ) {
+      return ( pF[q] - pF[p] ) / ( 2.0f * fSpacing * ( q - p ) ) + 0.5f * fSpacing * ( q + p );
+    };
+    int32_t k = 0;
+    pV[0]     = 0;
+    pZ[0]     = -INF;
+    pZ[1]     = INF;
+    for( int32_t q = 1; q < n; q++ )
+    {
+      float s = meet( q, pV[k] );
+      while( s <= pZ[k] ) s = meet( q, pV[--k] );
+      k++;
+      pV[k]     = q;
+      pZ[k]     = s;
+      pZ[k + 1] = INF;
+    }
+    k = 0;
+    for( int32_t q = 0; q < n; q++ )
+    {
+      while( pZ[k + 1] < fSpacing * q ) k++;
+      float fAlong = fSpacing * ( q - pV[k] );
+      pOut[q]      = fAlong * fAlong + pF[pV[k]];
+    }
+  }
+} // namespace
+
+DistanceField::DistanceField( const Track & track, TileLayer layer ) : track( track ), fieldLayer( layer )
+{
+  rebuild();
+}
+
+void DistanceField::rebuild() { rebuildAll( nullptr ); }
+
+void DistanceField::rebuild( ThreadPool & pool ) { rebuildAll( &pool ); }
+
+void DistanceField::rebuildAll( ThreadPool * pPool )
+{
+  nWidth  = track.width();
+  nHeight = track.height();
+  vBlock  = olc::vf2d( track.blockSize() );
+  fUnit   = std::min( vBlock.x, vBlock.y ) / UNITS_PER_TILE;
+  field.assign( size_t( nWidth ) * nHeight, 0 );
+
+  // The whole map is its own window, the gaps worked out in the field's memory
+  TileRect all = { 0, 0, nWidth, nHeight };
+  buildWindow( all, all, reinterpret_cast<uint8_t *>( field.data() ), pPool );
+}
+
+void DistanceField::update( const TileRect & rect )
+{
+  if( track.width() != nWidth || track.height() != nHeight || olc::vf2d( track.blockSize() ) != vBlock )
+  {
+    rebuild();
+    return;
+  }
+
+  // Tiles within range of the change can see a different nearest edge, and the edges they can see are within range
+  // of them in turn
+  auto grow = [&]( int32_t nBy ) {
+    int32_t x0 = std::max( rect.x - nBy, 0 );
+    int32_t y0 = std::max( rect.y - nBy, 0 );
+    int32_t x1 = std::min( rect.x + rect.w + nBy, nWidth );
+    int32_t y1 = std::min( rect.y + rect.h + nBy, nHeight );
+    return TileRect{ x0, y0, std::max( x1 - x0, 0 ), std::max( y1 - y0, 0 ) };
+  };
+  TileRect out = grow( RANGE_TILES );
+  if( out.w == 0 || out.h == 0 ) return;
+  TileRect             window = grow( 2 * RANGE_TILES );
+  std::vector<uint8_t> gaps( size_t( window.w ) * window.h );
+  buildWindow( window, out, gaps.data(), nullptr );
+}
+
+void DistanceField::buildWindow( const TileRect & window, const TileRect & out, uint8_t * pGaps, ThreadPool * pPool )
+{
+  if( window.w == 0 || window.h == 0 ) return;
+  const TileMap & tiles = track.tileMap();
+
+  // Down the columns and back up for each tile's gaps, a strip of columns at a time so rows are read in order.
+  // Stretches of a row with no tile of the surface within FAR_GAP rows are far from it and off it, so are filled
+  // without looking at each tile.
+  auto columns = [&]( size_t nBegin, size_t nEnd ) {
+    size_t               nChunks = ( nEnd - nBegin + CHUNK - 1 ) / CHUNK;
+    std::vector<uint8_t> onChunk( nChunks * window.h );
+    std::vector<int32_t> quiet( nChunks, FAR_GAP );  // Rows in a row without the surface, counting this one
+    for( int32_t y = 0; y < window.h; y++ )
+    {
+      uint8_t * pRow   = pGaps + size_t( y ) * window.w;
+      uint8_t * pAbove = pRow - window.w;
+      for( size_t c = 0; c < nChunks; c++ )
+      {
+        size_t   x0    = nBegin + c * CHUNK;
+        size_t   x1    = std::min( x0 + CHUNK, nEnd );
+        TileRect chunk = { window.x + int32_t( x0 ), window.y + y, int32_t( x1 - x0 ), 1 };
+        bool     bOn   = tiles.any( fieldLayer, chunk );
+        onChunk[size_t( y ) * nChunks + c] = bOn;
+        quiet[c]                           = bOn ? 0 : quiet[c] + 1;
+        if( quiet[c] >= FAR_GAP )
+        {
+          std::memset( pRow + x0, FAR_GAP, x1 - x0 );
+          continue;
+        }
+        for( size_t x = x0; x < x1; x++ )
+        {
+          uint8_t nAbove = y > 0 ? stepGaps( pAbove[x] ) : uint8_t( FAR_GAP | FAR_GAP << 4 );
+          pRow[x] = tiles.test( fieldLayer, window.x + int32_t( x ), window.y + y ) ? nAbove & 0xF0 : nAbove & 0x0F;
+        }
+      }
+    }
+
+    // Going back up only changes tiles with the surface in range below them
+    std::fill( quiet.begin(), quiet.end(), FAR_GAP );
+    for( int32_t y = window.h - 1; y >= 0; y-- )
+    {
+      uint8_t *       pRow   = pGaps + size_t( y ) * window.w;
+      const uint8_t * pBelow = pRow + window.w;
+      for( size_t c = 0; c < nChunks; c++ )
+      {
+        quiet[c] = onChunk[size_t( y ) * nChunks + c] ? 0 : quiet[c] + 1;
+        if( y == window.h - 1 || quiet[c] > FAR_GAP ) continue;
+        size_t x1 = std::min( nBegin + ( c + 1 ) * CHUNK, nEnd );
+        for( size_t x = nBegin + c * CHUNK; x < x1; x++ ) pRow[x] = minGaps( pRow[x], stepGaps( pBelow[x] ) );
+      }
+    }
+  };
+
+  // Then along each row, to the nearest tile on the surface from tiles off it and the other way round. Only
+  // stretches of the row in range of what they measure to need the transform, the rest of the row is off the
+  // surface and out of range. A row of the field may share memory with its gaps, so they are copied out first.
+  float  fHalf  = 0.5f * std::min( vBlock.x, vBlock.y );
+  float  fRange = RANGE_TILES * std::min( vBlock.x, vBlock.y );
+  float  fLimit = float( RANGE_TILES * UNITS_PER_TILE );
+  int8_t nFar   = int8_t( std::round( ( fRange - fHalf ) / fUnit ) );
+  auto   rows   = [&]( size_t nBegin, size_t nEnd ) {
+    size_t               n = size_t( window.w );
+    std::vector<uint8_t> gaps( n );
+    std::vector<float>   f( n ), to( n ), z( n + 1 );
+    std::vector<int32_t> v( n );
+    for( size_t i = nBegin; i < nEnd; i++ )
+    {
+      int32_t y = out.y + int32_t( i );
+      std::memcpy( gaps.data(), pGaps + size_t( y - window.y ) * window.w, n );
+      int8_t * pField = field.data() + size_t( y ) * nWidth;
+      std::fill( pField + out.x, pField + out.x + out.w, nFar );
+
+      auto spans = [&]( auto bNear, bool bOn ) {
+        for( int32_t x = 0; x < window.w; )
+        {
+          if( !bNear( gaps[x] ) )
+          {
+            x = skipFar( gaps.data(), x + 1, window.w );
+            continue;
+          }
+          int32_t nFrom = std::max( x - RANGE_TILES, 0 );
+          int32_t nLast = x;
+          for( x++; x < window.w && x <= nLast + 2 * RANGE_TILES; x++ )
+            if( bNear( gaps[x] ) ) nLast = x;
+          int32_t nTo = std::min( nLast + RANGE_TILES + 1, window.w );
+          for( int32_t q = nFrom; q < nTo; q++ )
+          {
+            float fGap   = ( bOn ? gaps[q] >> 4 : gaps[q] & 15 ) * vBlock.y;
+            f[q - nFrom] = fGap * fGap;
+          }
+          transform1d( f.data(), nTo - nFrom, vBlock.x, to.data(), v.data(), z.data() );
+
+          int32_t nOutFrom = std::max( nFrom, out.x - window.x );
+          int32_t nOutTo   = std::min( nTo, out.x + out.w - window.x );
+          for( int32_t q = nOutFrom; q < nOutTo; q++ )
+          {
+            if( ( ( gaps[q] & 15 ) == 0 ) != bOn ) continue;
+            float fTo            = std::min( std::sqrt( to[q - nFrom] ), fRange ) - fHalf;
+            float fValue         = std::round( ( bOn ? -fTo : fTo ) / fUnit );
+            pField[window.x + q] = int8_t( std::clamp( fValue, -fLimit, fLimit ) );
+          }
+          x = nTo;
+        }
+      };
+      spans( []( uint8_t nGaps ) { return ( nGaps & 15 ) < FAR_GAP; }, false );
+      spans( []( uint8_t nGaps ) { return ( nGaps & 15 ) == 0; }, true );
+    }
+  };
+
+  if( pPool )
+  {
+    pPool->parallelFor( size_t( window.w ), COLUMN_GRAIN, columns );
+    pPool->parallelFor( size_t( out.h ), ROW_GRAIN, rows );
+  }
+  else
+  {
+    columns( 0, size_t( window.w ) );
+    rows( 0, size_t( out.h ) );
+  }
+}
+
+float DistanceField::distance( const olc::vf2d & vPos ) const
+{
+  olc::vf2d vGradient;
+  return distance( vPos, vGradient );
+}
+
+float DistanceField::distance( const olc::vf2d & vPos, olc::vf2d & vGradient ) const
+{
+  vGradient = { 0.0f, 0.0f };
+  if( field.empty() ) return range();
+
+  // Tile centres either side, held at the edge of the map
+  float   u  = vPos.x / vBlock.x - 0.5f;
+  float   v  = vPos.y / vBlock.y - 0.5f;
+  int32_t x0 = std::clamp( int32_t( std::floor( u ) ), 0, nWidth - 1 );
+  int32_t y0 = std::clamp( int32_t( std::floor( v ) ), 0, nHeight - 1 );
+  int32_t x1 = std::min( x0 + 1, nWidth - 1 );
+  int32_t y1 = std::min( y0 + 1, nHeight - 1 );
+  float   fx = std::clamp( u - x0, 0.0f, 1.0f );
+  float   fy = std::clamp( v - y0, 0.0f, 1.0f );
+
+  float d00    = field[size_t( y0 ) * nWidth + x0];
+  float d10    = field[size_t( y0 ) * nWidth + x1];
+  float d01    = field[size_t( y1 ) * nWidth + x0];
+  float d11    = field[size_t( y1 ) * nWidth + x1];
+  float fTop   = d00 + ( d10 - d00 ) * fx;
+  float fBelow = d01 + ( d11 - d01 ) * fx;
+  vGradient    = { ( ( d10 - d00 ) * ( 1.0f - fy ) + ( d11 - d01 ) * fy ) * fUnit / vBlock.x,
+                   ( fBelow - fTop ) * fUnit / vBlock.y };
+  return ( fTop + ( fBelow - fTop ) * fy ) * fUnit;
+}
+
+float DistanceField::range() const
+{
+  return ( RANGE_TILES - 0.5f ) * UNITS_PER_TILE * fUnit;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "TileMap.h"
+#include "Track.h"
+
+// Signed distance in pixels from the edge of one surface, such as the walls or the road: positive outside its tiles
+// and negative inside. Held per tile, at tile centres, as a byte in eighths of a tile and worked out exactly with
+// Felzenszwalb and Huttenlocher's linear time transform, a pass down the columns then one along the rows. Stretches
+// of the map out of range of the edge are filled rather than transformed, which on a race track is most of it.
+//
+// Distances are capped at RANGE_TILES tiles, so an edit only changes the field that far around it and is brought
+// up to date from a window of tiles round the edit rather than the whole map.
+class DistanceField
+{
+public:
+  static constexpr int32_t RANGE_TILES = 15;
+
+  DistanceField( const Track & track, TileLayer layer );
+
+  // Works the whole field out again, after the track has been replaced
+  void rebuild();
+  void rebuild( ThreadPool & pool );
+
+  // Works out again only what tiles changed within rect can reach. A track of a different size is rebuilt.
+  void update( const TileRect & rect );
+
+  // Bilinear between tile centres, with the gradient of that, which points away from the surface
+  float distance( const olc::vf2d & vPos ) const;
+  float distance( const olc::vf2d & vPos, olc::vf2d & vGradient ) const;
+
+  // The value held for a tile, in pixels
+  float at( int32_t x, int32_t y ) const { return field[size_t( y ) * nWidth + x] * fUnit; }
+
+  // Furthest a distance can be either way, in pixels
+  float range() const;
+
+  TileLayer layer() const { return fieldLayer; }
+
+private:
+  void rebuildAll( ThreadPool * pPool );
+  void buildWindow( const TileRect & window, const TileRect & out, uint8_t * pGaps, ThreadPool * pPool );
+
+  const Track &       track;
+  TileLayer           fieldLayer;
+  int32_t             nWidth  = 0;
+  int32_t             nHeight = 0;
+  olc::vf2d           vBlock  = { 1.0f, 1.0f };
+  float               fUnit   = 1.0f;  // Pixels per step of the stored value
+  std::vector<int8_t> field;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Q16.16 fixed point. Stored in 64 bits so positions cover tracks far larger than 32767 pixels, and integer
+// arithmetic gives bit-identical results on every compiler, optimisation level and CPU
+using fixed = int64_t;
+
+constexpr int   FIXED_SHIFT = 16;
+constexpr fixed FIXED_ONE   = fixed( 1 ) << FIXED_SHIFT;
+
+constexpr fixed toFixed( int32_t v ) { return fixed( v ) * FIXED_ONE; }
+constexpr fixed fixedMul( fixed a, fixed b ) { return ( a * b ) >> FIXED_SHIFT; }
+constexpr float fixedToFloat( fixed v ) { return float( v ) / float( FIXED_ONE ); }
+
+// Only for converting from the float state, never inside the deterministic simulation
+inline fixed floatToFixed( float v ) { return fixed( v * float( FIXED_ONE ) ); }
+
+// Binary angles: a full turn is 2^32, so wrapping the heading is plain unsigned overflow
+constexpr double BINARY_ANGLE_TURN = 4294967296.0;
+
+// Table-based sine and cosine of a binary angle, in Q16.16
+fixed fixedSin( uint32_t angle );
+inline fixed fixedCos( uint32_t angle ) { return fixedSin( angle + 0x40000000u ); }
+
+// Both of a car's heading, worked out once a tick and shared by the physics step and the wheel sampling
+struct SinCos
+{
+  fixed s = 0;
+  fixed c = FIXED_ONE;
+};
+inline SinCos fixedSinCos( uint32_t angle ) { return { fixedSin( angle ), fixedCos( angle ) }; }
@@ -0,0 +1,421 @@
+#include "FlowField.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Neighbours clockwise from east, as drawn on screen with y down
+  const int32_t DX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+  const int32_t DY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+  // Straight and diagonal steps, 5 : 7 being close to 1 : sqrt 2. A tile weighs its surface's friction in quarters,
+  // so a tile of tarmac costs 20 to cross.
+  const uint32_t STEP[8]      = { 5, 7, 5, 7, 5, 7, 5, 7 };
+  const int32_t  WEIGHT_SHIFT = FIXED_SHIFT - 2;
+
+  // More than the dearest single step, so the buckets of Dial's algorithm can wrap round without overlapping
+  const uint32_t RING = 2048;
+
+  const uint8_t DIR_NONE  = 8;
+  const uint8_t DIR_DIRTY = 9;  // Only while a repair is finding which tiles need a new way
+  const uint8_t ON_GATE   = 16;
+
+  // Unit steps in Q16.16, diagonals being 1 / sqrt 2 each way
+  const fixed DIAGONAL = 46341;
+  const fixed DIR_X[8] = { FIXED_ONE, DIAGONAL, 0, -DIAGONAL, -FIXED_ONE, -DIAGONAL, 0, DIAGONAL };
+  const fixed DIR_Y[8] = { 0, DIAGONAL, FIXED_ONE, DIAGONAL, 0, -DIAGONAL, -FIXED_ONE, -DIAGONAL };
+
+  // Pixels ahead of a car its second direction is read from
+  const int32_t LOOK_AHEAD = 20;
+
+  const size_t ROW_GRAIN = 64;
+} // namespace
+
+FlowField::FlowField( const Track & track ) : track( track ) { rebuild(); }
+
+void FlowField::rebuild() { rebuildAll( nullptr ); }
+
+void FlowField::rebuild( ThreadPool & pool ) { rebuildAll( &pool ); }
+
+void FlowField::update( const TileRect & rect ) { updateAll( rect, nullptr ); }
+
+void FlowField::update( const TileRect & rect, ThreadPool & pool ) { updateAll( rect, &pool ); }
+
+void FlowField::rebuildAll( ThreadPool * pPool )
+{
+  nWidth  = track.width();
+  nHeight = track.height();
+  vBlock  = track.blockSize();
+  weights.assign( size_t( nWidth ) * nHeight, 0 );
+  weigh( { 0, 0, nWidth, nHeight } );
+
+  const std::vector<Gate> & gates = track.gates();
+  fields.assign( gates.size(), Field() );
+  for( size_t i = 0; i < gates.size(); i++ ) fields[i].gate = gates[i];
+  auto build = [&]( size_t i ) { solveAll( fields[i] ); };
+
+  // Directions only need the costs, so are worked out a run of rows at a time across every gate
+  auto rows = [&]( size_t nBegin, size_t nEnd ) {
+    for( size_t i = nBegin; i < nEnd; i++ ) point( fields[i / nHeight], int32_t( i % nHeight ), 0, nWidth - 1 );
+  };
+  if( pPool )
+  {
+    pPool->parallelFor( fields.size(), build );
+    pPool->parallelFor( fields.size() * nHeight, ROW_GRAIN, rows );
+  }
+  else
+  {
+    for( size_t i = 0; i < fields.size(); i++ ) build( i );
+    rows( 0, fields.size() * nHeight );
+  }
+}
+
+void FlowField::updateAll( const TileRect & rect, ThreadPool * pPool )
+{
+  const std::vector<Gate> & gates  = track.gates();
+  bool                      bSame  = gates.size() == fields.size();
+  for( size_t i = 0; bSame && i < gates.size(); i++ )
+    bSame = gates[i].a == fields[i].gate.a && gates[i].b == fields[i].gate.b;
+  if( !bSame || track.width() != nWidth || track.height() != nHeight || track.blockSize() != vBlock )
+  {
+    rebuildAll( pPool );
+    return;
+  }
+
+  // Diagonal steps squeeze between two tiles, so the steps past the edit's edge change with it as well
+  int32_t x0 = std::max( rect.x, 0 );
+  int32_t y0 = std::max( rect.y, 0 );
+  int32_t x1 = std::min( rect.x + rect.w, nWidth );
+  int32_t y1 = std::min( rect.y + rect.h, nHeight );
+  if( x0 >= x1 || y0 >= y1 ) return;
+  weigh( { x0, y0, x1 - x0, y1 - y0 } );
+  TileRect grown = { std::max( x0 - 1, 0 ), std::max( y0 - 1, 0 ), 0, 0 };
+  grown.w        = std::min( x1 + 1, nWidth ) - grown.x;
+  grown.h        = std::min( y1 + 1, nHeight ) - grown.y;
+
+  // A field whose barrier the edit moved is worked out again whole
+  auto fix = [&]( size_t i ) {
+    Field & field = fields[i];
+    Field   moved;
+    moved.gate = field.gate;
+    seed( moved );
+    if( moved.barrier == field.barrier ) repair( field, grown );
+    else
+    {
+      solveAll( field );
+      for( int32_t y = 0; y < nHeight; y++ ) point( field, y, 0, nWidth - 1 );
+    }
+  };
+  if( pPool ) pPool->parallelFor( fields.size(), fix );
+  else
+    for( size_t i = 0; i < fields.size(); i++ ) fix( i );
+}
+
+void FlowField::weigh( const TileRect & rect )
+{
+  const TileMap &      tiles    = track.tileMap();
+  const SurfaceTable & surfaces = track.surfaces();
+  for( int32_t y = rect.y; y < rect.y + rect.h; y++ )
+    for( int32_t x = rect.x; x < rect.x + rect.w; x++ )
+    {
+      size_t i = size_t( y ) * nWidth + x;
+      fixed  w = surfaces.surface( tiles.get( int32_t( i ) ) ).friction >> WEIGHT_SHIFT;
+      weights[i] = tiles.test( TileLayer::Wall, x, y ) ? 0 : uint8_t( std::clamp<fixed>( w, 1, 255 ) );
+    }
+}
+
+void FlowField::seed( Field & field ) const
+{
+  // Every tile under the line, stepping a quarter tile at a time, but for those at its ends with their centres
+  // beyond it, which driving straight across from doesn't cross the gate
+  const Gate & gate   = field.gate;
+  olc::vf2d    vAlong = gate.b - gate.a;
+  float        fStep  = 0.25f * std::min( vBlock.x, vBlock.y );
+  int32_t      nSteps = std::max( int32_t( std::ceil( vAlong.mag() / fStep ) ), 1 );
+  field.seeds.clear();
+  for( int32_t i = 0; i <= nSteps; i++ )
+  {
+    olc::vf2d p = gate.a + vAlong * ( float( i ) / nSteps );
+    int32_t   x = int32_t( std::floor( p.x / vBlock.x ) );
+    int32_t   y = int32_t( std::floor( p.y / vBlock.y ) );
+    if( x < 0 || x >= nWidth || y < 0 || y >= nHeight ) continue;
+    float fOn = ( olc::vf2d( ( x + 0.5f ) * vBlock.x, ( y + 0.5f ) * vBlock.y ) - gate.a ).dot( vAlong );
+    if( fOn >= 0.0f && fOn <= vAlong.mag2() ) field.seeds.push_back( uint32_t( y * nWidth + x ) );
+  }
+  std::sort( field.seeds.begin(), field.seeds.end() );
+  field.seeds.erase( std::unique( field.seeds.begin(), field.seeds.end() ), field.seeds.end() );
+
+  // Beyond its ends the line carries on as a barrier, over the rest of the road and then the grass until it meets
+  // road again or a wall, so a car already past the gate has to drive a lap to reach it rather than come back round
+  const TileMap & tiles = track.tileMap();
+  field.barrier.clear();
+  for( olc::vf2d vEnd : { gate.a, gate.b } )
+  {
+    olc::vf2d vOut     = ( vEnd == gate.a ? -vAlong : vAlong ).norm() * fStep;
+    bool      bOffRoad = false;
+    for( olc::vf2d p = vEnd;; p += vOut )
+    {
+      int32_t x = int32_t( std::floor( p.x / vBlock.x ) );
+      int32_t y = int32_t( std::floor( p.y / vBlock.y ) );
+      if( x < 0 || x >= nWidth || y < 0 || y >= nHeight || tiles.test( TileLayer::Wall, x, y ) ) break;
+      uint32_t nTile = uint32_t( y * nWidth + x );
+      if( std::binary_search( field.seeds.begin(), field.seeds.end(), nTile ) ) continue;
+      bool bRoad = tiles.test( TileLayer::Road, x, y );
+      if( bOffRoad && bRoad ) break;
+      bOffRoad |= !bRoad;
+      field.barrier.push_back( nTile );
+    }
+  }
+  std::sort( field.barrier.begin(), field.barrier.end() );
+  field.barrier.erase( std::unique( field.barrier.begin(), field.barrier.end() ), field.barrier.end() );
+
+  // Forwards over a gate is from the left of a -> b to its right
+  float fAngle  = std::atan2( vAlong.x, -vAlong.y );
+  field.nAcross = uint8_t( int32_t( std::lround( fAngle / ( 0.25f * PI ) ) + 8 ) % 8 );
+}
+
+void FlowField::solveAll( Field & field ) const
+{
+  field.cost.assign( weights.size(), UNREACHED );
+  field.dir.assign( weights.size(), DIR_NONE );
+  seed( field );
+  for( uint32_t nTile : field.barrier ) field.cost[nTile] = BARRIER;
+
+  std::vector<Start> starts;
+  for( uint32_t nTile : field.seeds )
+  {
+    if( weights[nTile] == 0 ) continue;
+    field.cost[nTile] = 0;
+    starts.push_back( { 0, nTile } );
+  }
+  Bounds changed;
+  solve( field, starts, changed );
+}
+
+void FlowField::solve( Field & field, std::vector<Start> & starts, Bounds & changed ) const
+{
+  // Dial's algorithm: every step costs less than RING, so a ring of buckets by cost holds all that is queued. Starts
+  // are fed in as the search reaches their cost.
+  std::sort( starts.begin(), starts.end(), []( const Start & a, const Start & b ) {
+    return a.nCost < b.nCost || ( a.nCost == b.nCost && a.nTile < b.nTile );
+  } );
+  std::vector<std::vector<uint32_t>> buckets( RING );
+  size_t                             nQueued = 0;
+  size_t                             nNext   = 0;
+  uint32_t                           nCost   = 0;
+  while( nQueued > 0 || nNext < starts.size() )
+  {
+    if( nQueued == 0 ) nCost = starts[nNext].nCost;
+    for( ; nNext < starts.size() && starts[nNext].nCost == nCost; nNext++, nQueued++ )
+      buckets[nCost % RING].push_back( starts[nNext].nTile );
+
+    // Nothing queued from this bucket lands back in it, as every step costs something
+    std::vector<uint32_t> & bucket = buckets[nCost % RING];
+    for( uint32_t u : bucket )
+    {
+      if( field.cost[u] != nCost ) continue;
+      int32_t x = int32_t( u % nWidth );
+      int32_t y = int32_t( u / nWidth );
+      for( int32_t k = 0; k < 8; k++ )
+      {
+        int32_t nx = x + DX[k];
+        int32_t ny = y + DY[k];
+        if( nx < 0 || nx >= nWidth || ny < 0 || ny >= nHeight ) continue;
+
+        // The way from v runs back through u
+        uint32_t v = uint32_t( ny * nWidth + nx );
+        uint32_t c = nCost + STEP[k] * weights[u];
+        if( c >= field.cost[v] || !canStep( field, v, u, ( k + 4 ) & 7 ) ) continue;
+        field.cost[v] = c;
+        buckets[c % RING].push_back( v );
+        nQueued++;
+        changed.x0 = std::min( changed.x0, nx );
+        changed.y0 = std::min( changed.y0, ny );
+        changed.x1 = std::max( changed.x1, nx );
+        changed.y1 = std::max( changed.y1, ny );
+      }
+    }
+    nQueued -= bucket.size();
+    bucket.clear();
+    nCost++;
+  }
+}
+
+void FlowField::repair( Field & field, const TileRect & rect ) const
+{
+  // The edit and every tile whose way to the gate ran through it need a new way, found by following the directions
+  // back from the edit
+  Bounds                changed;
+  std::vector<uint32_t> dirty;
+  for( int32_t y = rect.y; y < rect.y + rect.h; y++ )
+    for( int32_t x = rect.x; x < rect.x + rect.w; x++ )
+    {
+      uint32_t u = uint32_t( y * nWidth + x );
+      if( field.cost[u] == BARRIER ) continue;
+      field.dir[u] = DIR_DIRTY;
+      dirty.push_back( u );
+    }
+  for( size_t i = 0; i < dirty.size(); i++ )
+  {
+    int32_t x  = int32_t( dirty[i] % nWidth );
+    int32_t y  = int32_t( dirty[i] / nWidth );
+    changed.x0 = std::min( changed.x0, x );
+    changed.y0 = std::min( changed.y0, y );
+    changed.x1 = std::max( changed.x1, x );
+    changed.y1 = std::max( changed.y1, y );
+    for( int32_t k = 0; k < 8; k++ )
+    {
+      int32_t nx = x + DX[k];
+      int32_t ny = y + DY[k];
+      if( nx < 0 || nx >= nWidth || ny < 0 || ny >= nHeight ) continue;
+      uint32_t v = uint32_t( ny * nWidth + nx );
+      if( field.dir[v] != ( ( k + 4 ) & 7 ) || field.cost[v] == BARRIER ) continue;
+      field.dir[v] = DIR_DIRTY;
+      dirty.push_back( v );
+    }
+  }
+  for( uint32_t u : dirty ) field.cost[u] = UNREACHED;
+
+  // Open gate tiles start from nothing, and the tiles round the repair from the ways they already have, which the
+  // search also shortens where the edit opened a quicker one
+  std::vector<Start> starts;
+  for( uint32_t nTile : field.seeds )
+  {
+    if( field.dir[nTile] != DIR_DIRTY || weights[nTile] == 0 ) continue;
+    field.cost[nTile] = 0;
+    starts.push_back( { 0, nTile } );
+  }
+  for( uint32_t u : dirty )
+  {
+    int32_t x = int32_t( u % nWidth );
+    int32_t y = int32_t( u / nWidth );
+    for( int32_t k = 0; k < 8; k++ )
+    {
+      int32_t nx = x + DX[k];
+      int32_t ny = y + DY[k];
+      if( nx < 0 || nx >= nWidth || ny < 0 || ny >= nHeight ) continue;
+      uint32_t v = uint32_t( ny * nWidth + nx );
+      if( field.dir[v] != DIR_DIRTY && field.cost[v] < BARRIER ) starts.push_back( { field.cost[v], v } );
+    }
+  }
+  solve( field, starts, changed );
+
+  // Directions change wherever a cost did and next to it
+  int32_t x0 = std::max( changed.x0 - 1, 0 );
+  int32_t x1 = std::min( changed.x1 + 1, nWidth - 1 );
+  for( int32_t y = std::max( changed.y0 - 1, 0 ); y <= std::min( changed.y1 + 1, nHeight - 1 ); y++ )
+    point( field, y, x0, x1 );
+}
+
+void FlowField::point( Field & field, int32_t y, int32_t x0, int32_t x1 ) const
+{
+  for( int32_t x = x0; x <= x1; x++ )
+  {
+    uint32_t t = uint32_t( y * nWidth + x );
+    if( field.cost[t] == UNREACHED ) field.dir[t] = DIR_NONE;
+    else if( field.cost[t] == 0 )
+      field.dir[t] = ON_GATE | field.nAcross;
+    else
+    {
+      // Downhill to the cheapest neighbour, the first clockwise from east on a tie. Cars that stray onto the barrier
+      // are sent off it the cheapest way, which is back to the gate's side.
+      bool     bBarrier = field.cost[t] == BARRIER;
+      uint32_t nBest    = UNREACHED;
+      uint8_t  nDir     = DIR_NONE;
+      for( int32_t k = 0; k < 8; k++ )
+      {
+        int32_t nx = x + DX[k];
+        int32_t ny = y + DY[k];
+        if( nx < 0 || nx >= nWidth || ny < 0 || ny >= nHeight ) continue;
+        uint32_t n = uint32_t( ny * nWidth + nx );
+        if( field.cost[n] >= BARRIER ) continue;
+        uint32_t c = field.cost[n] + STEP[k] * weights[n];
+        if( c >= nBest || ( !bBarrier && !canStep( field, t, n, k ) ) ) continue;
+        nBest = c;
+        nDir  = uint8_t( k );
+      }
+      field.dir[t] = nDir;
+    }
+  }
+}
+
+bool FlowField::canStep( const Field & field, uint32_t nFrom, uint32_t nTo, int32_t k ) const
+{
+  auto open = [&]( uint32_t n ) { return weights[n] != 0 && field.cost[n] != BARRIER; };
+  if( !open( nFrom ) || !open( nTo ) ) return false;
+
+  // Onto the gate only from the side it is driven over from
+  bool bOntoGate = field.cost[nTo] == 0;
+  if( bOntoGate && field.cost[nFrom] != 0 && !approaches( field, nFrom ) ) return false;
+  if( ( k & 1 ) == 0 ) return true;
+
+  // Diagonals don't cut the corner of a wall or the barrier, or slip between two gate tiles to the far side
+  uint32_t nSideX = uint32_t( int32_t( nFrom ) + DX[k] );
+  uint32_t nSideY = uint32_t( int32_t( nFrom ) + DY[k] * nWidth );
+  if( !open( nSideX ) || !open( nSideY ) ) return false;
+  return bOntoGate || ( field.cost[nSideX] != 0 && field.cost[nSideY] != 0 );
+}
+
+bool FlowField::approaches( const Field & field, uint32_t nTile ) const
+{
+  olc::vf2d vCentre = { ( nTile % nWidth + 0.5f ) * vBlock.x, ( nTile / nWidth + 0.5f ) * vBlock.y };
+  return ( field.gate.b - field.gate.a ).cross( vCentre - field.gate.a ) <= 0.0f;
+}
+
+olc::vf2d FlowField::direction( uint32_t nGate, const olc::vf2d & vPos ) const
+{
+  if( nGate >= fields.size() || weights.empty() ) return { 0.0f, 0.0f };
+  int32_t x   = std::clamp( int32_t( std::floor( vPos.x / vBlock.x ) ), 0, nWidth - 1 );
+  int32_t y   = std::clamp( int32_t( std::floor( vPos.y / vBlock.y ) ), 0, nHeight - 1 );
+  uint8_t dir = fields[nGate].dir[size_t( y ) * nWidth + x] & ~ON_GATE;
+  if( dir >= 8 ) return { 0.0f, 0.0f };
+  return { fixedToFloat( DIR_X[dir] ), fixedToFloat( DIR_Y[dir] ) };
+}
+
+uint8_t FlowField::steer( const CarStateFx & car, uint32_t nGate, fixed maxSpeed ) const
+{
+  if( nGate >= fields.size() || weights.empty() ) return 0;
+  const Field & field = fields[nGate];
+  auto          dirAt = [&]( fixed x, fixed y ) {
+    olc::vi2d cord = track.worldCordToTileCord( { int32_t( x >> FIXED_SHIFT ), int32_t( y >> FIXED_SHIFT ) } );
+    cord.x         = std::clamp( cord.x, 0, nWidth - 1 );
+    cord.y         = std::clamp( cord.y, 0, nHeight - 1 );
+    return uint8_t( field.dir[size_t( cord.y ) * nWidth + cord.x] & ~ON_GATE );
+  };
+
+  // The way on from the car and from a little ahead of it, so it turns in before a bend rather than at it. Ahead is
+  // left out when it points back more than a right angle from here, as it does over the gate or through a hairpin.
+  fixed   hx    = fixedSin( car.angle );
+  fixed   hy    = -fixedCos( car.angle );
+  uint8_t here  = dirAt( car.x, car.y );
+  uint8_t ahead = dirAt( car.x + hx * LOOK_AHEAD, car.y + hy * LOOK_AHEAD );
+  if( here >= 8 ) return 0;
+  fixed   wx    = DIR_X[here];
+  fixed   wy    = DIR_Y[here];
+  int32_t nTurn = ( ahead - here ) & 7;  // Eighths of a turn clockwise
+  if( ahead < 8 && ( nTurn < 3 || nTurn > 5 ) )
+  {
+    wx += DIR_X[ahead];
+    wy += DIR_Y[ahead];
+  }
+
+  // Positive across is the way on being clockwise of the heading, which turning right follows
+  fixed   along  = fixedMul( hx, wx ) + fixedMul( hy, wy );
+  fixed   across = fixedMul( hx, wy ) - fixedMul( hy, wx );
+  uint8_t input  = 0;
+  if( along <= 0 ) input |= across >= 0 ? INPUT_RIGHT : INPUT_LEFT;
+  else if( across > along / 8 )
+    input |= INPUT_RIGHT;
+  else if( across < -along / 8 )
+    input |= INPUT_LEFT;
+
+  // Flat out within about 27 degrees of the way on, slowing for anything sharper
+  if( along > 2 * std::abs( across ) )
+  {
+    if( car.vel < maxSpeed ) input |= INPUT_ACCEL;
+  }
+  else if( car.vel > maxSpeed / 2 )
+    input |= INPUT_BRAKE;
+  return input;
+}
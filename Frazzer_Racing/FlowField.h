@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Physics.h"
+#include "ThreadPool.h"
+#include "TileMap.h"
+#include "Track.h"
+
+// The way to each checkpoint gate from every tile, for AI cars. Each gate has its own field, worked out once for the
+// whole track by Dijkstra's algorithm out from the tiles the gate crosses, so any number of cars steer with a lookup
+// or two however far they are from the gate. Walls can't be driven through, and a tile costs its surface's friction
+// to cross, so the way round keeps to the road unless cutting across the grass is a lot shorter.
+//
+// A gate is only reached from the side it is driven over from, and its line carries on past its ends over the grass
+// as a barrier, so from just past it the way on is a lap. Edits repair each field rather than rebuilding it: only
+// tiles whose way to the gate ran through the edit, or that the edit opens a shorter way for, are worked out again.
+class FlowField
+{
+public:
+  static constexpr uint32_t UNREACHED = UINT32_MAX;
+
+  explicit FlowField( const Track & track );
+
+  // Works every gate's field out again, after the track, its gates or its surfaces have been replaced. With a pool
+  // the gates are shared between its threads.
+  void rebuild();
+  void rebuild( ThreadPool & pool );
+
+  // Brings the fields up to date after the tiles within rect changed. New gates or a new size rebuild them.
+  void update( const TileRect & rect );
+  void update( const TileRect & rect, ThreadPool & pool );
+
+  size_t gateCount() const { return fields.size(); }
+
+  // Unit step from the tile at vPos towards gate nGate, across the gate on its own tiles, zero where there is no way
+  olc::vf2d direction( uint32_t nGate, const olc::vf2d & vPos ) const;
+
+  // Cost of the way to the gate from the tile at (x, y), in twentieths of a tile of tarmac, or UNREACHED
+  uint32_t cost( uint32_t nGate, int32_t x, int32_t y ) const
+  {
+    uint32_t nCost = fields[nGate].cost[size_t( y ) * nWidth + x];
+    return nCost == BARRIER ? UNREACHED : nCost;
+  }
+
+  // Controls for a car making for gate nGate: turning towards the way on from where it is and from a little ahead,
+  // accelerating up to fMaxSpeed when roughly facing it and braking for sharp turns. Fixed point, so the same
+  // everywhere.
+  uint8_t steer( const CarStateFx & car, uint32_t nGate, fixed maxSpeed ) const;
+
+private:
+  static constexpr uint32_t BARRIER = UINT32_MAX - 1;
+
+  // dir holds the neighbour to step to, 0 to 7 clockwise from east, DIR_NONE, or that with ON_GATE set for the tiles
+  // the gate crosses, which step over it
+  struct Field
+  {
+    Gate                  gate;
+    uint8_t               nAcross = 0;  // Neighbour nearest straight across the gate
+    std::vector<uint32_t> seeds;        // Tiles the gate crosses, walls included
+    std::vector<uint32_t> barrier;      // Tiles its line carries on over beyond its ends
+    std::vector<uint32_t> cost;
+    std::vector<uint8_t>  dir;
+  };
+
+  struct Start
+  {
+    uint32_t nCost;
+    uint32_t nTile;
+  };
+
+  // Tiles a repair touched, inclusive
+  struct Bounds
+  {
+    int32_t x0 = INT32_MAX;
+    int32_t y0 = INT32_MAX;
+    int32_t x1 = -1;
+    int32_t y1 = -1;
+  };
+
+  void rebuildAll( ThreadPool * pPool );
+  void updateAll( const TileRect & rect, ThreadPool * pPool );
+  void weigh( const TileRect & rect );
+  void seed( Field & field ) const;
+  void solveAll( Field & field ) const;
+  void solve( Field & field, std::vector<Start> & starts, Bounds & changed ) const;
+  void repair( Field & field, const TileRect & rect ) const;
+  void point( Field & field, int32_t y, int32_t x0, int32_t x1 ) const;
+  bool canStep( const Field & field, uint32_t nFrom, uint32_t nTo, int32_t k ) const;
+  bool approaches( const Field & field, uint32_t nTile ) const;
+
+  const Track &        track;
+  int32_t              nWidth  = 0;
+  int32_t              nHeight = 0;
+  olc::vi2d            vBlock  = { 1, 1 };
+  std::vector<uint8_t> weights;  // Cost per step onto each tile, 0 for walls
+  std::vector<Field>   fields;
+};
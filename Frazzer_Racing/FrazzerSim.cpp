@@ -0,0 +1,216 @@
+#include "FrazzerSim.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "ThreadPool.h"
+#include "Track.h"
+#include "VecEnv.h"
+
+#if defined( _WIN32 )
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+static_assert( FR_INPUT_LEFT == INPUT_LEFT && FR_INPUT_RIGHT == INPUT_RIGHT && FR_INPUT_ACCEL == INPUT_ACCEL
+                 && FR_INPUT_BRAKE == INPUT_BRAKE,
+               "C action bits must match CarInput" );
+
+struct FrSim
+{
+  Track                       track;
+  std::unique_ptr<ThreadPool> pool;
+  std::unique_ptr<VecEnv>     env;
+  FrSimBuffers                buffers = {};
+
+  // Shared memory block, when made by fr_create_shm
+  void *      pShm     = nullptr;
+  uint64_t    nShmSize = 0;
+  std::string sShmName;
+#if defined( _WIN32 )
+  HANDLE hMapping = nullptr;
+#endif
+};
+
+namespace
+{
+  uint64_t alignUp( uint64_t n ) { return ( n + 63 ) & ~uint64_t( 63 ); }
+
+  FrShmHeader shmLayout( uint32_t nEnvs )
+  {
+    FrShmHeader header        = {};
+    header.abiVersion         = FR_SIM_ABI_VERSION;
+    header.nEnvs              = nEnvs;
+    header.obsSize            = OBS_SIZE;
+    header.observationsOffset = alignUp( sizeof( FrShmHeader ) );
+    header.rewardsOffset      = alignUp( header.observationsOffset + uint64_t( nEnvs ) * OBS_SIZE * sizeof( float ) );
+    header.donesOffset        = alignUp( header.rewardsOffset + uint64_t( nEnvs ) * sizeof( float ) );
+    header.actionsOffset      = alignUp( header.donesOffset + nEnvs );
+    header.totalBytes         = alignUp( header.actionsOffset + nEnvs );
+    return header;
+  }
+
+  void releaseShm( FrSim * sim )
+  {
+    if( sim->pShm == nullptr ) return;
+#if defined( _WIN32 )
+    UnmapViewOfFile( sim->pShm );
+    CloseHandle( sim->hMapping );
+#else
+    munmap( sim->pShm, sim->nShmSize );
+    shm_unlink( sim->sShmName.c_str() );
+#endif
+    sim->pShm = nullptr;
+  }
+} // namespace
+
+uint32_t fr_abi_version( void ) { return FR_SIM_ABI_VERSION; }
+
+uint32_t fr_obs_size( void ) { return OBS_SIZE; }
+
+FrSim * fr_create( uint32_t nEnvs, uint32_t nThreads, uint32_t nMaxTicks, const FrSimBuffers * buffers )
+{
+  if( nEnvs == 0 || nMaxTicks == 0 ) return nullptr;
+
+  // No exceptions may cross the C boundary
+  try
+  {
+    auto sim   = std::make_unique<FrSim>();
+    sim->track = Track( 80, 40 );
+    sim->track.buildDefault();
+    sim->pool = std::make_unique<ThreadPool>( nThreads );
+    sim->env  = std::make_unique<VecEnv>( sim->track, nEnvs, *sim->pool, nMaxTicks );
+
+    EnvBuffers external;
+    if( buffers ) external = { buffers->observations, buffers->rewards, buffers->dones };
+    sim->env->setBuffers( external );
+    sim->env->reset();
+
+    const EnvBuffers & used = sim->env->buffers();
+    sim->buffers            = { used.observations, used.rewards, used.dones };
+    return sim.release();
+  }
+  catch( ... )
+  {
+    return nullptr;
+  }
+}
+
+uint64_t fr_shm_bytes( uint32_t nEnvs ) { return shmLayout( nEnvs ).totalBytes; }
+
+FrSim * fr_create_shm( uint32_t nEnvs, uint32_t nThreads, uint32_t nMaxTicks, const char * name )
+{
+  if( name == nullptr || nEnvs == 0 ) return nullptr;
+  FrShmHeader header = shmLayout( nEnvs );
+
+  void * pShm = nullptr;
+#if defined( _WIN32 )
+  HANDLE hMapping = CreateFileMappingA( INVALID_HANDLE_VALUE,
+                                        nullptr,
+                                        PAGE_READWRITE,
+                                        DWORD( header.totalBytes >> 32 ),
+                                        DWORD( header.totalBytes ),
+                                        name );
+  if( hMapping == nullptr ) return nullptr;
+
+  // Never share a block another simulation owns, its fr_destroy would pull it out from under this one
+  if( GetLastError() == ERROR_ALREADY_EXISTS )
+  {
+    CloseHandle( hMapping );
+    return nullptr;
+  }
+  pShm = MapViewOfFile( hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size_t( header.totalBytes ) );
+  if( pShm == nullptr )
+  {
+    CloseHandle( hMapping );
+    return nullptr;
+  }
+#else
+  // Fails with EEXIST rather than attaching to, and later unlinking, a block another simulation owns
+  int fd = shm_open( name, O_CREAT | O_EXCL | O_RDWR, 0600 );
+  if( fd < 0 ) return nullptr;
+  if( ftruncate( fd, off_t( header.totalBytes ) ) != 0 )
+  {
+    close( fd );
+    shm_unlink( name );
+    return nullptr;
+  }
+  pShm = mmap( nullptr, size_t( header.totalBytes ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( pShm == MAP_FAILED )
+  {
+    shm_unlink( name );
+    return nullptr;
+  }
+#endif
+
+  uint8_t *    pBase   = static_cast<uint8_t *>( pShm );
+  FrSimBuffers buffers = { reinterpret_cast<float *>( pBase + header.observationsOffset ),
+                           reinterpret_cast<float *>( pBase + header.rewardsOffset ),
+                           pBase + header.donesOffset };
+  FrSim *      sim     = fr_create( nEnvs, nThreads, nMaxTicks, &buffers );
+  if( sim == nullptr )
+  {
+#if defined( _WIN32 )
+    UnmapViewOfFile( pShm );
+    CloseHandle( hMapping );
+#else
+    munmap( pShm, size_t( header.totalBytes ) );
+    shm_unlink( name );
+#endif
+    return nullptr;
+  }
+
+  sim->pShm     = pShm;
+  sim->nShmSize = header.totalBytes;
+  sim->sShmName = name;
+#if defined( _WIN32 )
+  sim->hMapping = hMapping;
+#endif
+
+  // The magic goes in last, after a release fence, so a reader polling for it sees a complete header even on weakly
+  // ordered CPUs
+  header.magic = 0;
+  std::memcpy( pShm, &header, sizeof( header ) );
+  std::atomic_thread_fence( std::memory_order_release );
+  reinterpret_cast<volatile FrShmHeader *>( pShm )->magic = FR_SHM_MAGIC;
+  return sim;
+}
+
+const FrSimBuffers * fr_buffers( const FrSim * sim ) { return sim ? &sim->buffers : nullptr; }
+
+uint8_t * fr_shm_actions( FrSim * sim )
+{
+  if( sim == nullptr || sim->pShm == nullptr ) return nullptr;
+  return static_cast<uint8_t *>( sim->pShm ) + shmLayout( uint32_t( sim->env->size() ) ).actionsOffset;
+}
+
+void fr_reset( FrSim * sim, int32_t env )
+{
+  if( sim == nullptr ) return;
+  if( env < 0 ) sim->env->reset();
+  else if( size_t( env ) < sim->env->size() )
+  {
+    sim->env->reset( size_t( env ) );
+    sim->buffers.rewards[env] = 0.0f;
+    sim->buffers.dones[env]   = 0;
+  }
+}
+
+void fr_step( FrSim * sim, const uint8_t * actions )
+{
+  if( sim == nullptr || actions == nullptr ) return;
+  sim->env->step( actions );
+}
+
+void fr_destroy( FrSim * sim )
+{
+  if( sim == nullptr ) return;
+  releaseShm( sim );
+  delete sim;
+}
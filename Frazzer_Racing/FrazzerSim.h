@@ -0,0 +1,94 @@
+#pragma once
+
+// Plain C interface to the race simulation for training harnesses in other languages or processes. Nothing here
+// depends on the engine or on C++ types, and the layout of FrSimBuffers and the shared memory block only changes
+// with FR_SIM_ABI_VERSION.
+//
+//   FrSim * sim = fr_create( 1024, 0, 3600, NULL );
+//   fr_step( sim, actions );  // actions[i] holds the W/A/S/D bits for env i
+//   const float * obs = fr_buffers( sim )->observations;
+//   fr_destroy( sim );
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined( _WIN32 ) && defined( FRAZZER_SIM_EXPORTS )
+#  define FR_API __declspec( dllexport )
+#elif defined( _WIN32 ) && defined( FRAZZER_SIM_IMPORTS )
+#  define FR_API __declspec( dllimport )
+#elif defined( __GNUC__ )
+#  define FR_API __attribute__( ( visibility( "default" ) ) )
+#else
+#  define FR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FR_SIM_ABI_VERSION 1
+
+// Action bits
+#define FR_INPUT_LEFT  1
+#define FR_INPUT_RIGHT 2
+#define FR_INPUT_ACCEL 4
+#define FR_INPUT_BRAKE 8
+
+typedef struct FrSim FrSim;
+
+// observations holds fr_obs_size() floats per env, rewards and dones one entry per env
+typedef struct FrSimBuffers
+{
+  float *   observations;
+  float *   rewards;
+  uint8_t * dones;
+} FrSimBuffers;
+
+// Start of a shared memory block made by fr_create_shm, each array starting on a 64 byte boundary at the given offset
+typedef struct FrShmHeader
+{
+  uint32_t magic;  // FR_SHM_MAGIC once the block is ready, read it with acquire ordering before the rest
+  uint32_t abiVersion;
+  uint32_t nEnvs;
+  uint32_t obsSize;
+  uint64_t observationsOffset;
+  uint64_t rewardsOffset;
+  uint64_t donesOffset;
+  uint64_t actionsOffset;  // nEnvs bytes the harness may write actions into
+  uint64_t totalBytes;
+} FrShmHeader;
+
+#define FR_SHM_MAGIC 0x4D485346u  // "FSHM"
+
+FR_API uint32_t fr_abi_version( void );
+FR_API uint32_t fr_obs_size( void );
+
+// nThreads 0 uses every core, episodes end after nMaxTicks. With buffers NULL, or any field in it NULL, the simulation
+// uses arrays of its own. Returns NULL on failure.
+FR_API FrSim * fr_create( uint32_t nEnvs, uint32_t nThreads, uint32_t nMaxTicks, const FrSimBuffers * buffers );
+
+// As fr_create, writing into a named shared memory block (POSIX shm_open name, or a Windows file mapping name) that
+// another process can map. The block starts with an FrShmHeader and is removed by fr_destroy. Returns NULL if a block
+// of that name already exists.
+FR_API FrSim * fr_create_shm( uint32_t nEnvs, uint32_t nThreads, uint32_t nMaxTicks, const char * name );
+
+// Bytes a shared memory block for nEnvs needs
+FR_API uint64_t fr_shm_bytes( uint32_t nEnvs );
+
+// The arrays step writes into, valid until fr_destroy
+FR_API const FrSimBuffers * fr_buffers( const FrSim * sim );
+
+// The actions array inside a shared memory block, NULL for other simulations
+FR_API uint8_t * fr_shm_actions( FrSim * sim );
+
+// env < 0 resets every env
+FR_API void fr_reset( FrSim * sim, int32_t env );
+
+// One tick of every env. Envs that finish are flagged in dones and already reset.
+FR_API void fr_step( FrSim * sim, const uint8_t * actions );
+
+FR_API void fr_destroy( FrSim * sim );
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,446 @@
+#include "Game.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+
+#include "Assets.h"
+#include "Simulation.h"
+#include "TrackGenerator.h"
+
+namespace
+{
+  // m:ss.mmm, or dashes before there is a time
+  std::string lapTimeText( int64_t nUs )
+  {
+    if( nUs < 0 ) return "-:--.---";
+    char sText[32];
+    std::snprintf( sText, sizeof( sText ), "%d:%06.3f", int( nUs / 60000000 ), ( nUs % 60000000 ) / 1e6 );
+    return sText;
+  }
+
+  // The race view doesn't scroll, so generated tracks fit the screen and only have room for a few corners
+  TrackGenParams screenTrackParams()
+  {
+    TrackGenParams params;
+    params.nControlPoints = 8;
+    params.nMaxWidth      = 5;
+    params.fGap           = 2.0f;
+    return params;
+  }
+} // namespace
+
+void Game::playReplay( const Replay & replay )
+{
+  playback  = replay;
+  bPlayback = true;
+}
+
+void Game::addGhost( const Replay & replay )
+{
+  const olc::Pixel TINTS[] = { { 255, 255, 255, 96 },
+                               { 120, 200, 255, 96 },
+                               { 255, 220, 80, 96 },
+                               { 255, 120, 200, 96 } };
+  ghosts.add( replay, TINTS[ghosts.size() % std::size( TINTS )] );
+}
+
+bool Game::joinNetRace( uint16_t nPort, const NetAddress & remote, int nPlayer )
+{
+  if( !socket.open( nPort ) ) return false;
+  netRemote    = remote;
+  nLocalPlayer = nPlayer;
+  return true;
+}
+
+void Game::useTrack( const std::string & sFile )
+{
+  sTrackFile = sFile;
+  bLoadTrack = true;
+}
+
+void Game::startEditing( const olc::vi2d & vNewSize )
+{
+  bEditing  = true;
+  vNewTrack = vNewSize;
+}
+
+void Game::useRandomTrack( uint64_t nSeed )
+{
+  nTrackSeed   = nSeed;
+  bRandomTrack = true;
+}
+
+bool Game::OnUserCreate()
+{
+  track = Track( ScreenWidth() / vBlockSize.x, ScreenHeight() / vBlockSize.y, vBlockSize );
+  if( vNewTrack.x > 2 && vNewTrack.y > 2 )
+  {
+    track = Track( vNewTrack.x, vNewTrack.y, vBlockSize );
+    track.buildEmpty();
+  }
+  else if( bLoadTrack )
+  {
+    // The tile art is drawn for one block size only
+    if( !loadTrack( sTrackFile, track, pool ) || track.blockSize() != vBlockSize )
+    {
+      std::cerr << "Could not load track " << sTrackFile << ", using the default\n";
+      track = Track( ScreenWidth() / vBlockSize.x, ScreenHeight() / vBlockSize.y, vBlockSize );
+      track.buildDefault();
+    }
+  }
+  else if( bRandomTrack )
+    generateRandomTrack();
+  else
+    track.buildDefault();
+
+  // Load Sprites, baked into the executable by AssetBaker
+  sprCar = assets::makeSprite( assets::car );
+
+  // Tiles are stored palette-indexed, 1 byte per pixel
+  if( !indexSprite( viewOf( assets::tiles ), tileSheet ) ) return false;
+  std::vector<IndexedView> atlas = sliceAtlas( viewOf( tileSheet ), vBlockSize );
+  auto tileAt = [&]( int x, int y ) { return atlas[y * ( assets::tiles.width / vBlockSize.x ) + x]; };
+  tileViews[size_t( mapTiles::Wall )]           = tileAt( 0, 0 );
+  tileViews[size_t( mapTiles::Road )]           = tileAt( 0, 1 );
+  tileViews[size_t( mapTiles::Road_T_Edge )]    = tileAt( 3, 0 );
+  tileViews[size_t( mapTiles::Road_B_Edge )]    = tileAt( 3, 1 );
+  tileViews[size_t( mapTiles::Road_L_Edge )]    = tileAt( 4, 1 );
+  tileViews[size_t( mapTiles::Road_R_Edge )]    = tileAt( 4, 0 );
+  tileViews[size_t( mapTiles::Road_TL_Corner )] = tileAt( 1, 0 );
+  tileViews[size_t( mapTiles::Road_TR_Corner )] = tileAt( 2, 0 );
+  tileViews[size_t( mapTiles::Road_BL_Corner )] = tileAt( 1, 1 );
+  tileViews[size_t( mapTiles::Road_BR_Corner )] = tileAt( 2, 1 );
+
+  // Track themes are palette swaps of the same tiles
+  const olc::Pixel KERB    = { 255, 0, 0 };
+  const olc::Pixel ASPHALT = { 19, 10, 6 };
+
+  themes = {
+    { olc::DARK_GREEN, tileSheet.palette },
+    { { 0, 40, 20 }, recolour( tileSheet.palette, { { KERB, { 0, 120, 255 } }, { ASPHALT, { 8, 8, 24 } } } ) },
+    { { 194, 160, 90 }, recolour( tileSheet.palette, { { KERB, { 255, 140, 0 } }, { ASPHALT, { 70, 52, 36 } } } ) },
+  };
+
+  // Create decals
+  decCar = std::make_unique<olc::Decal>( sprCar.get() );
+
+  // Pre-rotated car for the software renderer
+  carCache = RotationCache( viewOf( assets::car ), { 5.0f, 10.0f }, 128 );
+
+  // The editor draws its chunks with the same tiles and theme as the race
+  auto drawEditorTile = [this]( const SpriteView & target, const olc::vi2d & pos, mapTiles tile ) {
+    drawTile( target, pos, tile );
+  };
+  editor      = std::make_unique<TrackEditor>( track, sTrackFile, pool, drawEditorTile );
+  checkpoints = std::make_unique<Checkpoints>( track );
+  standings   = std::make_unique<Standings>( track );
+  wallField   = std::make_unique<DistanceField>( track, TileLayer::Wall );
+
+  if( socket.isOpen() )
+  {
+    state   = startingGrid( 2, track );
+    car     = toFloat( state.cars[nLocalPlayer] );
+    session = std::make_unique<RollbackSession>( track, state, nLocalPlayer, socket, netRemote, checkpoints.get() );
+  }
+  else if( bPlayback )
+  {
+    if( playback.trackChecksum != track.checksum() ) std::cerr << "Replay was recorded on a different track\n";
+    state.cars[0] = playback.start;
+    state.tick    = playback.startTick;
+    state.laps[0] = playback.startLaps;
+    car           = toFloat( state.cars[0] );
+    playbackReader = ReplayReader( playback );
+  }
+  state.trackChecksum = track.checksum();
+  if( !socket.isOpen() && !bPlayback )
+  {
+    car           = startCar;
+    state.cars[0] = toFixed( car );
+    recorder.begin( state );
+  }
+
+  return true;
+}
+
+bool Game::OnUserUpdate( float fElapsedTime )
+{
+  // Get User input
+  uint8_t input = 0;
+  if( GetKey( olc::Key::A ).bHeld ) input |= INPUT_LEFT;
+  if( GetKey( olc::Key::D ).bHeld ) input |= INPUT_RIGHT;
+  if( GetKey( olc::Key::W ).bHeld ) input |= INPUT_ACCEL;
+  if( GetKey( olc::Key::S ).bHeld ) input |= INPUT_BRAKE;
+  if( GetKey( olc::Key::T ).bPressed ) nTheme = ( nTheme + 1 ) % themes.size();
+  if( GetKey( olc::Key::F2 ).bPressed ) bSoftwareCar = !bSoftwareCar;
+  // Rewinding, restarting, switching physics and editing are for single player races only
+  bool bSolo = !bPlayback && !session;
+
+  // F4 swaps between racing and editing, a changed track restarts the race on it
+  if( GetKey( olc::Key::F4 ).bPressed && bSolo )
+  {
+    bEditing = !bEditing;
+    if( !bEditing && editor->modified() ) restartOnNewTrack();
+  }
+  if( GetKey( olc::Key::N ).bPressed && bSolo && bRandomTrack && !bEditing )
+  {
+    nTrackSeed++;
+    generateRandomTrack();
+    editor->reset();
+    restartOnNewTrack();
+  }
+  if( bEditing && bSolo )
+  {
+    if( GetKey( olc::Key::T ).bPressed ) editor->redrawAll();
+    editor->update( *this );
+    return true;
+  }
+
+  if( GetKey( olc::Key::F3 ).bPressed && bSolo )
+  {
+    // Only the fixed point path can be recorded, so switching to float ends the recording
+    bFixedPhysics = !bFixedPhysics;
+    resetLapTimes();
+    if( bFixedPhysics )
+    {
+      state.cars[0] = toFixed( car );
+      recorder.begin( state );
+    }
+    else
+      recorder.stop();
+  }
+  if( GetKey( olc::Key::F5 ).bPressed && recorder.recording() ) saveReplay( recorder.current(), "replay.frr" );
+
+  // R restarts the run, and the ghosts with it
+  if( GetKey( olc::Key::R ).bPressed && bSolo )
+  {
+    car           = startCar;
+    state.cars[0] = toFixed( car );
+    state.tick    = 0;
+    resetLapTimes();
+    if( bFixedPhysics ) recorder.begin( state );
+    history.clear();
+    ghosts.restart();
+  }
+
+  // F6 quick saves, F9 loads it back
+  if( GetKey( olc::Key::F6 ).bPressed && bFixedPhysics && bSolo ) saveGameState( state, "quicksave.frs" );
+  if( GetKey( olc::Key::F9 ).bPressed && bFixedPhysics && bSolo )
+  {
+    GameState loaded;
+    if( loadGameState( "quicksave.frs", loaded ) && loaded.trackChecksum == state.trackChecksum )
+    {
+      state = loaded;
+      recorder.begin( state );
+      history.clear();
+      ghosts.seek( state.tick, track );
+    }
+  }
+
+  // Arrow keys skip 5 seconds through a replay
+  if( bPlayback )
+  {
+    int32_t nSkip = 0;
+    if( GetKey( olc::Key::LEFT ).bPressed ) nSkip = -5 * TICK_RATE;
+    if( GetKey( olc::Key::RIGHT ).bPressed ) nSkip = 5 * TICK_RATE;
+    if( nSkip != 0 )
+    {
+      uint32_t nTarget = uint32_t( std::max( int32_t( playbackReader.tick() ) + nSkip, 0 ) );
+      playbackReader.seek( nTarget, track, *checkpoints, state.cars[0], state.laps[0] );
+      state.tick = playback.startTick + playbackReader.tick();
+    }
+  }
+
+  // Update Car, keeping it on screen
+  if( bFixedPhysics )
+  {
+    // Whole ticks only, so the result doesn't depend on the frame rate
+    fTickAccumulator += fElapsedTime;
+    while( fTickAccumulator >= 1.0f / TICK_RATE )
+    {
+      fTickAccumulator -= 1.0f / TICK_RATE;
+
+      // Network races tick through the rollback session, which may re-simulate earlier ticks and times the gates
+      // as it does so
+      if( session )
+      {
+        session->advance( input );
+        state = session->current();
+        standings->update( state );
+        continue;
+      }
+
+      // Backspace rewinds through the last 10 seconds, one stored state per tick
+      if( GetKey( olc::Key::BACK ).bHeld && bSolo )
+      {
+        bRewound |= history.pop( state );
+        continue;
+      }
+      if( bRewound )
+      {
+        // Driving on from a rewind starts a new recording from here, the lap times having been rewound too
+        recorder.begin( state );
+        ghosts.seek( state.tick, track );
+        bRewound = false;
+      }
+
+      if( bPlayback && !playbackReader.next( input ) ) continue;
+      GameState before = state;
+      history.push( state );
+      recorder.record( input, state.cars[0], state.laps[0] );
+      simulateTick( state, &input, track );
+      checkpoints->update( state.laps, before, state );
+      ghosts.tick( track );
+    }
+    car = toFloat( state.cars[nLocalPlayer] );
+  }
+  else
+  {
+    olc::vf2d vBefore = car.pos;
+    int64_t   nFromUs = nFloatClockUs;
+    stepCar( car, input, fElapsedTime, sampleWheels( toFixed( car ), track ) );
+    clampCar( car, track.blockSize(), track.worldSize() - track.blockSize() );
+    nFloatClockUs += int64_t( fElapsedTime * 1e6f );
+    checkWallCollision();
+    checkpoints->update( state.laps[0], vBefore, car.pos, nFromUs, nFloatClockUs );
+  }
+
+  Clear( olc::VERY_DARK_GREY );
+
+  // Draw Map, only as much of it as fits on screen
+  SpriteView screen  = viewOf( GetDrawTarget() );
+  int32_t    nTilesX = std::min( track.width(), ( ScreenWidth() + vBlockSize.x - 1 ) / vBlockSize.x );
+  int32_t    nTilesY = std::min( track.height(), ( ScreenHeight() + vBlockSize.y - 1 ) / vBlockSize.y );
+  for( int y = 0; y < nTilesY; y++ )
+    for( int x = 0; x < nTilesX; x++ )
+      drawTile( screen, olc::vi2d( x, y ) * vBlockSize, track[track.cordToIndex( x, y )] );
+
+  // Gates over the map, the start line in white and the one to make for next in yellow
+  for( size_t i = 0; i < track.gates().size(); i++ )
+  {
+    const Gate & gate = track.gates()[i];
+    olc::Pixel  colour = i == state.laps[nLocalPlayer].nNextGate ? olc::YELLOW : i == 0 ? olc::WHITE : olc::GREY;
+    DrawLine( olc::vi2d( gate.a ), olc::vi2d( gate.b ), colour );
+  }
+
+  // Draw Ghosts, then the player's car over them
+  ghosts.draw( *this, decCar.get(), { 5.0f, 10.0f }, fTickAccumulator * TICK_RATE );
+
+  // Draw the other player
+  for( uint32_t i = 0; session && i < state.nCars; i++ )
+  {
+    if( int( i ) == nLocalPlayer ) continue;
+    CarState other = toFloat( state.cars[i] );
+    DrawRotatedDecal( other.pos, decCar.get(), other.angle, { 5.0f, 10.0f }, { 1.0f, 1.0f }, { 255, 140, 140 } );
+  }
+
+  // Draw Car
+  if( bSoftwareCar ) carCache.draw( screen, car.pos, car.angle );
+  else
+    DrawRotatedDecal( car.pos, decCar.get(), car.angle, { 5.0f, 10.0f } );
+
+  DrawString( 11, 11, std::to_string( car.angle ) );
+  DrawString( 11, 20, std::to_string( car.vel ) );
+  DrawString( 11,
+              29,
+              std::to_string( sin( car.angle ) * car.vel ) + " " + std::to_string( -cos( car.angle ) * car.vel ) );
+  DrawString( 11, 38, bFixedPhysics ? "Q16.16 physics" : "float physics" );
+  if( session )
+  {
+    const RollbackStats & net = session->stats();
+    DrawString( 11,
+                47,
+                "Rollbacks " + std::to_string( net.nRollbacks ) + ", max resim " + std::to_string( net.nMaxResim )
+                  + " ticks / " + std::to_string( net.fMaxResimMs ) + " ms, stalls " + std::to_string( net.nStalls ) );
+  }
+  else if( bPlayback ) DrawString( 11, 47, "Replay tick " + std::to_string( playbackReader.tick() ) + ", arrows seek" );
+  else if( recorder.recording() )
+    DrawString( 11, 47, "Recording, F5 saves replay.frr" );
+  drawLapTimes();
+
+  return true;
+}
+
+void Game::drawTile( const SpriteView & target, const olc::vi2d & pos, mapTiles tile ) const
+{
+  const TrackTheme & theme = themes[nTheme];
+  if( tile == mapTiles::None ) fillRect( target, pos, vBlockSize, theme.grass );
+  else
+    drawIndexed( target, pos, tileViews[size_t( tile )], theme.palette );
+}
+
+void Game::restartOnNewTrack()
+{
+  // Painting only moves the walls near what was painted
+  if( editor->modified() ) wallField->update( editor->editedArea() );
+  else
+    wallField->rebuild();
+
+  // Recordings and ghosts belong to the old layout
+  editor->clearModified();
+  car                 = startCar;
+  state               = GameState();
+  state.cars[0]       = toFixed( car );
+  state.trackChecksum = track.checksum();
+  fTickAccumulator    = 0.0f;
+  resetLapTimes();
+  checkpoints->rebuild();
+  standings->rebuild();
+  history.clear();
+  ghosts.clear();
+  if( bFixedPhysics ) recorder.begin( state );
+}
+
+void Game::checkWallCollision()
+{
+  // Car is 10 x 20, so nothing within half its diagonal of the centre means no corner can be in a wall
+  if( wallField->distance( car.pos ) > 11.5f ) return;
+
+  // Each corner in a wall is pushed back out along the field's gradient, and the speed driven into the wall is lost
+  // so a glancing blow slides along it while a head on one stops the car
+  olc::vf2d vHeading = { std::sin( car.angle ), -std::cos( car.angle ) };
+  olc::vf2d vSide    = { std::cos( car.angle ), std::sin( car.angle ) };
+  for( olc::vf2d vCorner : { olc::vf2d( 5, 10 ), olc::vf2d( -5, 10 ), olc::vf2d( 5, -10 ), olc::vf2d( -5, -10 ) } )
+  {
+    olc::vf2d vNormal;
+    float     fDistance = wallField->distance( car.pos + vSide * vCorner.x + vHeading * vCorner.y, vNormal );
+    if( fDistance >= 0.0f || vNormal.mag2() == 0.0f ) continue;
+    vNormal = vNormal.norm();
+    car.pos -= vNormal * fDistance;
+    float fInto = vHeading.dot( vNormal );
+    if( fInto * car.vel < 0.0f ) car.vel *= 1.0f - fInto * fInto;
+  }
+}
+
+void Game::generateRandomTrack()
+{
+  // The game's pool is already running, so the countdown only pays for generating
+  GeneratedTrack generated = generateTrack( track, nTrackSeed, pool, screenTrackParams() );
+  startCar                 = CarState();
+  startCar.pos             = generated.vStart;
+  startCar.angle           = generated.fStartAngle;
+}
+
+void Game::resetLapTimes()
+{
+  std::fill( std::begin( state.laps ), std::end( state.laps ), LapTimes() );
+  nFloatClockUs = 0;
+}
+
+void Game::drawLapTimes()
+{
+  if( track.gates().empty() ) return;
+  const LapTimes & times = state.laps[nLocalPlayer];
+  int32_t          x     = ScreenWidth() - 160;
+  uint32_t         nLap  = times.nLaps + ( times.nLapStartUs >= 0 ? 1 : 0 );
+  DrawString( x, 11, "Lap  " + std::to_string( nLap ) );
+  DrawString( x, 20, "Last " + lapTimeText( times.nLastLapUs ) );
+  DrawString( x, 29, "Best " + lapTimeText( times.nBestLapUs ) );
+  DrawString( x, 38, "S" + std::to_string( times.nLastSector + 1 ) + "   " + lapTimeText( times.nLastSectorUs ) );
+  if( session && standings->order().size() == state.nCars )
+  {
+    uint32_t nPlace = standings->place( nLocalPlayer ) + 1;
+    DrawString( x, 47, "Pos  " + std::to_string( nPlace ) + "/" + std::to_string( state.nCars ) );
+  }
+}
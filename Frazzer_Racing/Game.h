@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Checkpoints.h"
+#include "DistanceField.h"
+#include "GameState.h"
+#include "Ghost.h"
+#include "IndexedSprite.h"
+#include "Net.h"
+#include "Physics.h"
+#include "Replay.h"
+#include "Rollback.h"
+#include "RotationCache.h"
+#include "SpriteView.h"
+#include "Standings.h"
+#include "ThreadPool.h"
+#include "Track.h"
+#include "TrackEditor.h"
+#include "olcPixelGameEngine.h"
+
+// Palette swap for the track tiles plus the grass drawn for mapTiles::None
+struct TrackTheme
+{
+  olc::Pixel grass;
+  Palette    palette;
+};
+
+class Game : public olc::PixelGameEngine
+{
+public:
+  Game() { sAppName = "Frazzer Racing"; }
+
+  // Watch a recording in real time instead of driving
+  void playReplay( const Replay & replay );
+
+  // Race against a previous recording, drawn as a translucent car
+  void addGhost( const Replay & replay );
+
+  // Head to head against another machine, nPlayer being 0 on one and 1 on the other
+  bool       joinNetRace( uint16_t nPort, const NetAddress & remote, int nPlayer );
+  UdpSocket & netSocket() { return socket; }
+
+  // Race on a track file, which is also where the editor saves
+  void useTrack( const std::string & sFile );
+
+  // Start in the editor, on a new empty track if a size is given
+  void startEditing( const olc::vi2d & vNewSize = { 0, 0 } );
+
+  // Race on generated tracks, N moving on to the next seed
+  void useRandomTrack( uint64_t nSeed );
+
+private:
+  CarState   car;
+  CarState   startCar;  // Where runs start, placed on the road of generated tracks
+  GameState  state;  // cars[0] is the player
+  bool       bFixedPhysics    = true;
+  float      fTickAccumulator = 0.0f;
+
+  ReplayRecorder recorder;
+  Replay         playback;
+  ReplayReader   playbackReader;
+  bool           bPlayback = false;
+  GhostCars      ghosts;
+  SnapshotRing   history  = SnapshotRing( 10 * TICK_RATE );
+  bool           bRewound = false;
+
+  UdpSocket                        socket;
+  NetAddress                       netRemote;
+  int                              nLocalPlayer = 0;
+  std::unique_ptr<RollbackSession> session;
+
+  std::unique_ptr<olc::Sprite> sprCar;
+  std::unique_ptr<olc::Decal>  decCar;
+  RotationCache                carCache;
+  bool                         bSoftwareCar = false;
+  IndexedSprite                tileSheet;
+  std::array<IndexedView, 11>  tileViews;
+  std::vector<TrackTheme>      themes;
+  size_t                       nTheme = 0;
+  ThreadPool                   pool;  // For loading and generating tracks, started once rather than per use
+  Track                        track;
+  olc::vi2d                    vBlockSize = { 10, 10 };
+  std::string                  sTrackFile = "track.frt";
+  bool                         bLoadTrack = false;
+  olc::vi2d                    vNewTrack  = { 0, 0 };
+  std::unique_ptr<TrackEditor> editor;
+  bool                         bEditing     = false;
+  bool                         bRandomTrack = false;
+  uint64_t                     nTrackSeed   = 0;
+
+  std::unique_ptr<Checkpoints>   checkpoints;
+  std::unique_ptr<Standings>     standings;
+  std::unique_ptr<DistanceField> wallField;
+  int64_t                        nFloatClockUs = 0;  // Race clock of the float physics, fixed physics uses the tick
+
+  void drawTile( const SpriteView & target, const olc::vi2d & pos, mapTiles tile ) const;
+  void restartOnNewTrack();
+  void generateRandomTrack();
+  void resetLapTimes();
+  void drawLapTimes();
+
+public:
+  bool OnUserCreate() override;
+  bool OnUserUpdate( float fElapsedTime ) override;
+
+  void checkWallCollision();
+};
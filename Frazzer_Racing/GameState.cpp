@@ -0,0 +1,113 @@
+#include "GameState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+  const uint32_t SAVE_MAGIC = 0x53535246;  // "FRSS"
+
+  struct SaveHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+  };
+} // namespace
+
+uint32_t hashGameState( const GameState & state )
+{
+  uint32_t hash = 2166136261u;
+  auto     mix  = [&]( uint64_t v ) {
+    for( int i = 0; i < 8; i++ ) hash = ( hash ^ ( ( v >> ( i * 8 ) ) & 0xFF ) ) * 16777619u;
+  };
+  mix( state.tick );
+  mix( state.trackChecksum );
+  mix( state.nCars );
+  for( uint32_t i = 0; i < state.nCars && i < MAX_CARS; i++ )
+  {
+    mix( uint64_t( state.cars[i].x ) );
+    mix( uint64_t( state.cars[i].y ) );
+    mix( uint64_t( state.cars[i].vel ) );
+    mix( state.cars[i].angle );
+
+    const LapTimes & laps = state.laps[i];
+    mix( laps.nLaps );
+    mix( laps.nNextGate );
+    mix( laps.nLastSector );
+    mix( uint64_t( laps.nLapStartUs ) );
+    mix( uint64_t( laps.nSectorStartUs ) );
+    mix( uint64_t( laps.nLastLapUs ) );
+    mix( uint64_t( laps.nBestLapUs ) );
+    mix( uint64_t( laps.nLastSectorUs ) );
+  }
+  return hash;
+}
+
+bool saveGameState( const GameState & state, const std::string & sFile )
+{
+  SaveHeader    header = { SAVE_MAGIC, GAME_STATE_VERSION, uint32_t( sizeof( GameState ) ) };
+  std::ofstream ofs( sFile, std::ios::binary );
+  if( !ofs.is_open() ) return false;
+  ofs.write( (const char *)&header, sizeof( header ) );
+  ofs.write( (const char *)&state, sizeof( state ) );
+  return ofs.good();
+}
+
+bool loadGameState( const std::string & sFile, GameState & state )
+{
+  std::ifstream ifs( sFile, std::ios::binary );
+  if( !ifs.is_open() ) return false;
+
+  SaveHeader header;
+  if( !ifs.read( (char *)&header, sizeof( header ) ) ) return false;
+  if( header.magic != SAVE_MAGIC || header.version != GAME_STATE_VERSION || header.size != sizeof( GameState ) )
+    return false;
+
+  GameState loaded;
+  if( !ifs.read( (char *)&loaded, sizeof( loaded ) ) || loaded.nCars > MAX_CARS ) return false;
+  state = loaded;
+  return true;
+}
+
+void SnapshotRing::push( const GameState & state )
+{
+  if( slots.empty() ) return;
+  std::memcpy( static_cast<void *>( &slots[nHead] ), &state, sizeof( GameState ) );
+  nHead  = ( nHead + 1 ) % slots.size();
+  nCount = std::min( nCount + 1, slots.size() );
+}
+
+bool SnapshotRing::pop( GameState & state )
+{
+  if( nCount == 0 ) return false;
+  nHead = ( nHead + slots.size() - 1 ) % slots.size();
+  nCount--;
+  std::memcpy( static_cast<void *>( &state ), &slots[nHead], sizeof( GameState ) );
+  return true;
+}
+
+bool SnapshotRing::find( uint32_t tick, GameState & state ) const
+{
+  if( nCount == 0 ) return false;
+
+  // Pushed once per tick, so the newest state says how far back `tick` is
+  const GameState & newest = slots[( nHead + slots.size() - 1 ) % slots.size()];
+  uint32_t          nBack  = newest.tick - tick;
+  if( tick > newest.tick || nBack >= nCount ) return false;
+
+  const GameState & slot = slots[( nHead + slots.size() - 1 - nBack ) % slots.size()];
+  if( slot.tick != tick ) return false;
+  std::memcpy( static_cast<void *>( &state ), &slot, sizeof( GameState ) );
+  return true;
+}
+
+void SnapshotRing::discardFrom( uint32_t tick )
+{
+  while( nCount > 0 && slots[( nHead + slots.size() - 1 ) % slots.size()].tick >= tick )
+  {
+    nHead = ( nHead + slots.size() - 1 ) % slots.size();
+    nCount--;
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Physics.h"
+
+constexpr int MAX_CARS = 8;
+
+// A car's progress through the gates and its latest times, in microseconds on the race clock, -1 until set.
+// Sector i runs from gate i to gate i + 1, the last one back to the start line.
+struct LapTimes
+{
+  uint32_t nLaps          = 0;  // Completed
+  uint32_t nNextGate      = 0;  // Crossing the start line first starts the clock on lap 1
+  uint32_t nLastSector    = 0;  // Which sector nLastSectorUs timed
+  uint32_t pad            = 0;
+  int64_t  nLapStartUs    = -1;
+  int64_t  nSectorStartUs = -1;
+  int64_t  nLastLapUs     = -1;
+  int64_t  nBestLapUs     = -1;
+  int64_t  nLastSectorUs  = -1;
+};
+
+// Everything that changes while racing, in one flat block so it can be copied, compared and written with memcpy.
+// The track is not part of it: it is fixed for a race and identified by its checksum. Bump GAME_STATE_VERSION
+// whenever the layout changes so old save files are rejected rather than misread. Padding is explicit and zeroed
+// here and in the structs inside, so a save file never holds stray bytes.
+struct GameState
+{
+  uint32_t   tick          = 0;
+  uint32_t   trackChecksum = 0;
+  uint32_t   nCars         = 1;
+  uint32_t   pad           = 0;
+  CarStateFx cars[MAX_CARS];
+  LapTimes   laps[MAX_CARS];  // So rewinds, rollbacks and loads take the timing back with the cars
+};
+
+constexpr uint32_t GAME_STATE_VERSION = 2;  // 2 added lap times
+
+static_assert( std::is_trivially_copyable_v<GameState>, "GameState must stay memcpy-able" );
+static_assert( sizeof( CarStateFx ) == 32 && sizeof( LapTimes ) == 56, "Implicit padding in a GameState member" );
+static_assert( sizeof( GameState ) == 16 + MAX_CARS * ( 32 + 56 ), "Implicit padding in GameState" );
+
+// FNV-1a over the fields, ignoring padding, so two machines can compare states
+uint32_t hashGameState( const GameState & state );
+
+// Save files are the raw block behind a small header, so they only load on machines of the same endianness
+bool saveGameState( const GameState & state, const std::string & sFile );
+bool loadGameState( const std::string & sFile, GameState & state );
+
+// Fixed size history of states, allocated once. Pushing past capacity overwrites the oldest state.
+class SnapshotRing
+{
+public:
+  explicit SnapshotRing( size_t nCapacity = 0 ) : slots( nCapacity ) {}
+
+  void push( const GameState & state );
+
+  // Removes and returns the newest state, false when empty
+  bool pop( GameState & state );
+
+  // The stored state for a tick, false if it has been overwritten or was never pushed
+  bool find( uint32_t tick, GameState & state ) const;
+
+  // Forget every state from `tick` onwards, for when history is rewritten
+  void discardFrom( uint32_t tick );
+
+  void   clear() { nCount = 0; }
+  size_t size() const { return nCount; }
+  size_t capacity() const { return slots.size(); }
+
+private:
+  std::vector<GameState> slots;
+  size_t                 nHead  = 0;  // Next slot to write
+  size_t                 nCount = 0;
+};
@@ -0,0 +1,114 @@
+#include "Ghost.h"
+
+#include "Simulation.h"
+
+void GhostCars::add( const Replay & replay, olc::Pixel tint )
+{
+  replays.push_back( replay );
+  readers.emplace_back( replays.back() );
+  prev.push_back( replay.start );
+  cur.push_back( replay.start );
+  headings.push_back( fixedSinCos( replay.start.angle ) );
+  wheels.emplace_back();
+  tints.push_back( tint );
+  active.push_back( nRaceTick == replay.startTick && replay.nTicks > 0 );
+}
+
+void GhostCars::clear()
+{
+  replays.clear();
+  readers.clear();
+  prev.clear();
+  cur.clear();
+  headings.clear();
+  wheels.clear();
+  tints.clear();
+  active.clear();
+  nRaceTick = 0;
+}
+
+void GhostCars::restart()
+{
+  nRaceTick = 0;
+  for( size_t i = 0; i < replays.size(); i++ )
+  {
+    readers[i]  = ReplayReader( replays[i] );
+    prev[i]     = replays[i].start;
+    cur[i]      = replays[i].start;
+    headings[i] = fixedSinCos( cur[i].angle );
+    active[i]   = playing( i, 0 );
+  }
+}
+
+void GhostCars::seek( uint32_t tick, const Track & track )
+{
+  nRaceTick = tick;
+  for( size_t i = 0; i < replays.size(); i++ )
+  {
+    if( tick < replays[i].startTick )
+    {
+      readers[i] = ReplayReader( replays[i] );
+      cur[i]     = replays[i].start;
+    }
+    else
+      readers[i].seek( tick - replays[i].startTick, track, cur[i] );
+    headings[i] = fixedSinCos( cur[i].angle );
+    prev[i]     = cur[i];
+    active[i]   = playing( i, tick );
+  }
+}
+
+void GhostCars::tick( const Track & track )
+{
+  // Every ghost's wheels are sampled in one pass, then the ones still playing step on
+  sampleWheels( cur.data(), headings.data(), cur.size(), track, wheels.data() );
+  nRaceTick++;
+  for( size_t i = 0; i < replays.size(); i++ )
+  {
+    uint8_t input;
+    prev[i] = cur[i];
+    if( active[i] && readers[i].next( input ) )
+    {
+      stepCarFx( cur[i], input, wheels[i], headings[i] );
+      clampCarFx( cur[i], track.blockSize(), track.worldSize() - track.blockSize() );
+      active[i] = playing( i, nRaceTick );
+    }
+    else
+    {
+      // Waiting ghosts appear at their start once the race reaches it
+      active[i] = nRaceTick == replays[i].startTick && playing( i, nRaceTick );
+    }
+  }
+}
+
+bool GhostCars::playing( size_t i, uint32_t tick ) const
+{
+  return tick >= replays[i].startTick && tick - replays[i].startTick < replays[i].nTicks;
+}
+
+const std::vector<GhostPose> & GhostCars::poses( float fAlpha )
+{
+  const float ANGLE_SCALE = float( 2.0 * 3.14159265358979 / BINARY_ANGLE_TURN );
+  const float POS_SCALE   = 1.0f / float( FIXED_ONE );
+
+  frame.clear();
+  for( size_t i = 0; i < replays.size(); i++ )
+  {
+    if( !active[i] ) continue;
+
+    // Blend in fixed point, the signed difference of binary angles takes the short way round
+    const CarStateFx & a = prev[i];
+    const CarStateFx & b = cur[i];
+    float fX             = float( a.x ) + float( b.x - a.x ) * fAlpha;
+    float fY             = float( a.y ) + float( b.y - a.y ) * fAlpha;
+    float fAngle         = float( a.angle ) + float( int32_t( b.angle - a.angle ) ) * fAlpha;
+    frame.push_back( { { fX * POS_SCALE, fY * POS_SCALE }, fAngle * ANGLE_SCALE, tints[i] } );
+  }
+  return frame;
+}
+
+void GhostCars::draw( olc::PixelGameEngine & pge, olc::Decal * decal, const olc::vf2d & vCentre, float fAlpha )
+{
+  for( const GhostPose & pose : poses( fAlpha ) )
+    pge.DrawRotatedDecal( pose.pos, decal, pose.angle, vCentre, { 1.0f, 1.0f }, pose.tint );
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "Physics.h"
+#include "Replay.h"
+#include "Track.h"
+#include "olcPixelGameEngine.h"
+
+// Where to draw one ghost this frame
+struct GhostPose
+{
+  olc::vf2d  pos;
+  float      angle;
+  olc::Pixel tint;
+};
+
+// Translucent cars driven by stored replays. Each ghost streams its inputs through a ReplayReader and is simulated
+// one tick at a time alongside the player, so memory stays constant however long the recording is. States are kept
+// side by side for a whole frame's poses to be produced in one pass. Ghosts follow the race clock, so one recorded
+// from startTick waits at its start until the race reaches that tick.
+class GhostCars
+{
+public:
+  // Starts at the current race tick, ghosts recorded from a later one wait for it
+  void add( const Replay & replay, olc::Pixel tint );
+  void clear();
+
+  // Back to race tick 0
+  void restart();
+
+  // Every ghost to where its recording was at the given race tick, for when the player rewinds or loads a save
+  void seek( uint32_t tick, const Track & track );
+
+  // Advance every ghost by one fixed tick, ghosts whose recording has ended stop being drawn
+  void tick( const Track & track );
+
+  // Poses blended fAlpha of the way from the previous tick to the current one
+  const std::vector<GhostPose> & poses( float fAlpha );
+
+  // One tinted DrawRotatedDecal per ghost, all sharing the player's decal
+  void draw( olc::PixelGameEngine & pge, olc::Decal * decal, const olc::vf2d & vCentre, float fAlpha );
+
+  size_t size() const { return replays.size(); }
+
+private:
+  // Whether ghost i is on the track at the race tick
+  bool playing( size_t i, uint32_t tick ) const;
+
+
+  std::deque<Replay>        replays;  // Readers point into these, so they must not move
+  std::vector<ReplayReader> readers;
+  std::vector<CarStateFx>   prev;
+  std::vector<CarStateFx>   cur;
+  std::vector<SinCos>       headings;  // Of cur
+  std::vector<WheelGrip>    wheels;
+  std::vector<olc::Pixel>   tints;
+  std::vector<uint8_t>      active;
+  std::vector<GhostPose>    frame;
+  uint32_t                  nRaceTick = 0;
+};
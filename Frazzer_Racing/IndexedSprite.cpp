@@ -0,0 +1,211 @@
+#include "IndexedSprite.h"
+
+#include "CpuFeatures.h"
+
+#include <cstring>
+#include <unordered_map>
+
+bool indexSprite( const ConstSpriteView & src, IndexedSprite & out )
+{
+  out.width  = src.width;
+  out.height = src.height;
+  out.indices.resize( size_t( src.width ) * src.height );
+  out.palette = Palette();
+
+  std::unordered_map<uint32_t, uint8_t> lookup;
+  for( int32_t y = 0; y < src.height; y++ )
+  {
+    for( int32_t x = 0; x < src.width; x++ )
+    {
+      olc::Pixel p  = src.at( x, y );
+      auto       it = lookup.find( p.n );
+      if( it == lookup.end() )
+      {
+        if( out.palette.size == out.palette.colours.size() ) return false;
+        it = lookup.emplace( p.n, uint8_t( out.palette.size ) ).first;
+        out.palette.colours[out.palette.size++] = p;
+      }
+      out.indices[size_t( y ) * src.width + x] = it->second;
+    }
+  }
+  return true;
+}
+
+IndexedView viewOf( const IndexedSprite & spr ) { return { spr.indices.data(), spr.width, spr.height, spr.width }; }
+
+Palette recolour( const Palette & base, const std::vector<std::pair<olc::Pixel, olc::Pixel>> & swaps )
+{
+  Palette pal = base;
+  for( uint32_t i = 0; i < pal.size; i++ )
+    for( const auto & [from, to] : swaps )
+      if( pal.colours[i] == from ) pal.colours[i] = to;
+  return pal;
+}
+
+namespace
+{
+#ifdef FR_X86_SIMD
+  // Palettes of up to 16 colours fit one SSSE3 register per channel, so a pshufb looks up 16 pixels at once
+  struct ChannelTables
+  {
+    __m128i r, g, b, a;
+  };
+
+  ChannelTables makeChannelTables( const Palette & palette )
+  {
+    alignas( 16 ) uint8_t t[4][16] = {};
+    for( uint32_t i = 0; i < palette.size; i++ )
+    {
+      t[0][i] = palette.colours[i].r;
+      t[1][i] = palette.colours[i].g;
+      t[2][i] = palette.colours[i].b;
+      t[3][i] = palette.colours[i].a;
+    }
+    return { _mm_load_si128( (const __m128i *)t[0] ),
+             _mm_load_si128( (const __m128i *)t[1] ),
+             _mm_load_si128( (const __m128i *)t[2] ),
+             _mm_load_si128( (const __m128i *)t[3] ) };
+  }
+
+  // Expands 16 indices into 16 pixels, pOut holds the destination pixels on entry when masking
+  FR_TARGET_SSSE3 void shuffle16( const uint8_t * pIdx, olc::Pixel * pOut, const ChannelTables & t, bool bMask )
+  {
+    __m128i idx = _mm_loadu_si128( (const __m128i *)pIdx );
+    __m128i r   = _mm_shuffle_epi8( t.r, idx );
+    __m128i g   = _mm_shuffle_epi8( t.g, idx );
+    __m128i b   = _mm_shuffle_epi8( t.b, idx );
+    __m128i a   = _mm_shuffle_epi8( t.a, idx );
+
+    // Interleave the planes back into RGBA
+    __m128i rgLo  = _mm_unpacklo_epi8( r, g );
+    __m128i rgHi  = _mm_unpackhi_epi8( r, g );
+    __m128i baLo  = _mm_unpacklo_epi8( b, a );
+    __m128i baHi  = _mm_unpackhi_epi8( b, a );
+    __m128i px[4] = { _mm_unpacklo_epi16( rgLo, baLo ),
+                      _mm_unpackhi_epi16( rgLo, baLo ),
+                      _mm_unpacklo_epi16( rgHi, baHi ),
+                      _mm_unpackhi_epi16( rgHi, baHi ) };
+
+    for( int i = 0; i < 4; i++ )
+    {
+      __m128i * pDst = (__m128i *)( pOut + i * 4 );
+      if( bMask )
+      {
+        // Opaque where alpha == 255, keep the destination elsewhere
+        __m128i m = _mm_cmpeq_epi32( _mm_srli_epi32( px[i], 24 ), _mm_set1_epi32( 255 ) );
+        px[i]     = _mm_or_si128( _mm_and_si128( m, px[i] ), _mm_andnot_si128( m, _mm_loadu_si128( pDst ) ) );
+      }
+      _mm_storeu_si128( pDst, px[i] );
+    }
+  }
+
+  FR_TARGET_SSSE3 void expandShuffle( const uint8_t *       pSrc,
+                                      olc::Pixel *          pDst,
+                                      int32_t               n,
+                                      const ChannelTables & t,
+                                      bool                  bMask )
+  {
+    int32_t x = 0;
+    for( ; x + 16 <= n; x += 16 ) shuffle16( pSrc + x, pDst + x, t, bMask );
+
+    // Short spans such as a 10 pixel tile row go through one padded block rather than the scalar loop
+    if( x < n )
+    {
+      uint8_t    idx[16] = {};
+      olc::Pixel out[16];
+      std::memcpy( idx, pSrc + x, n - x );
+      if( bMask ) std::copy( pDst + x, pDst + n, out );
+      shuffle16( idx, out, t, bMask );
+      std::copy( out, out + ( n - x ), pDst + x );
+    }
+  }
+
+  // Larger palettes gather 8 pixels at a time, pOut holds the destination pixels on entry when masking
+  FR_TARGET_AVX2 void gather8( const uint8_t * pIdx, olc::Pixel * pOut, const Palette & palette, bool bMask )
+  {
+    __m256i   idx  = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i *)pIdx ) );
+    __m256i   px   = _mm256_i32gather_epi32( (const int *)palette.colours.data(), idx, 4 );
+    __m256i * pDst = (__m256i *)pOut;
+    if( bMask )
+    {
+      __m256i m = _mm256_cmpeq_epi32( _mm256_srli_epi32( px, 24 ), _mm256_set1_epi32( 255 ) );
+      px        = _mm256_blendv_epi8( _mm256_loadu_si256( pDst ), px, m );
+    }
+    _mm256_storeu_si256( pDst, px );
+  }
+
+  FR_TARGET_AVX2 void expandGather( const uint8_t * pSrc,
+                                    olc::Pixel *    pDst,
+                                    int32_t         n,
+                                    const Palette & palette,
+                                    bool            bMask )
+  {
+    int32_t x = 0;
+    for( ; x + 8 <= n; x += 8 ) gather8( pSrc + x, pDst + x, palette, bMask );
+    if( x < n )
+    {
+      uint8_t    idx[8] = {};
+      olc::Pixel out[8];
+      std::memcpy( idx, pSrc + x, n - x );
+      if( bMask ) std::copy( pDst + x, pDst + n, out );
+      gather8( idx, out, palette, bMask );
+      std::copy( out, out + ( n - x ), pDst + x );
+    }
+  }
+#endif
+} // namespace
+
+void drawIndexed( const SpriteView &  target,
+                  const olc::vi2d &   pos,
+                  const IndexedView & src,
+                  const Palette &     palette,
+                  olc::Pixel::Mode    mode )
+{
+  olc::vi2d   vClip = { std::max( -pos.x, 0 ), std::max( -pos.y, 0 ) };
+  IndexedView s     = src.sub( vClip, { target.width - pos.x - vClip.x, target.height - pos.y - vClip.y } );
+  if( s.data == nullptr ) return;
+  olc::vi2d vDst = pos + vClip;
+
+  bool bMask = mode == olc::Pixel::MASK;
+#ifdef FR_X86_SIMD
+  bool          bShuffle = palette.size <= 16 && mode != olc::Pixel::ALPHA && cpuHasSsse3();
+  bool          bGather  = !bShuffle && mode != olc::Pixel::ALPHA && cpuHasAvx2();
+  ChannelTables tables;
+  if( bShuffle ) tables = makeChannelTables( palette );
+#endif
+
+  for( int32_t y = 0; y < s.height; y++ )
+  {
+    const uint8_t * pSrc = s.row( y );
+    olc::Pixel *     pDst = target.row( vDst.y + y ) + vDst.x;
+
+#ifdef FR_X86_SIMD
+    if( bShuffle )
+    {
+      expandShuffle( pSrc, pDst, s.width, tables, bMask );
+      continue;
+    }
+    if( bGather )
+    {
+      expandGather( pSrc, pDst, s.width, palette, bMask );
+      continue;
+    }
+#endif
+
+    // ALPHA, or a CPU without the kernels above
+    for( int32_t x = 0; x < s.width; x++ )
+    {
+      olc::Pixel p = palette.colours[pSrc[x]];
+      if( mode == olc::Pixel::ALPHA )
+      {
+        uint32_t a = p.a;
+        uint32_t c = 255 - a;
+        pDst[x]    = olc::Pixel( uint8_t( ( p.r * a + pDst[x].r * c ) / 255 ),
+                              uint8_t( ( p.g * a + pDst[x].g * c ) / 255 ),
+                              uint8_t( ( p.b * a + pDst[x].b * c ) / 255 ) );
+      }
+      else if( !bMask || p.a == 255 )
+        pDst[x] = p;
+    }
+  }
+}
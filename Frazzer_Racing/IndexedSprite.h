@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "SpriteView.h"
+#include "olcPixelGameEngine.h"
+
+// Colour table for 8-bit indexed images, indices never reach past size
+struct Palette
+{
+  std::array<olc::Pixel, 256> colours;
+  uint32_t                    size = 0;
+};
+
+// One byte per pixel, expanded through a palette while drawing
+struct IndexedSprite
+{
+  int32_t              width  = 0;
+  int32_t              height = 0;
+  std::vector<uint8_t> indices;
+  Palette              palette;
+};
+
+using IndexedView = BasicSpriteView<const uint8_t>;
+
+// Builds an indexed copy of an RGBA image, fails if it has more than 256 distinct colours
+bool indexSprite( const ConstSpriteView & src, IndexedSprite & out );
+
+IndexedView viewOf( const IndexedSprite & spr );
+
+// Copy of a palette with every colour in `swaps.first` replaced by `swaps.second`, used for palette-swap themes
+Palette recolour( const Palette & base, const std::vector<std::pair<olc::Pixel, olc::Pixel>> & swaps );
+
+// Expands palette indices to RGBA straight into the target, honouring olc::Pixel::NORMAL, MASK and ALPHA
+void drawIndexed( const SpriteView &  target,
+                  const olc::vi2d &   pos,
+                  const IndexedView & src,
+                  const Palette &     palette,
+                  olc::Pixel::Mode    mode = olc::Pixel::NORMAL );
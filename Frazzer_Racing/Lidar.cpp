@@ -0,0 +1,227 @@
+#include "Lidar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "CpuFeatures.h"
+
+namespace
+{
+  // Each car is a few microseconds of rays, so hand threads a handful at a time
+  const size_t CAST_GRAIN = 16;
+
+  // The 4 byte gathers at the last cell read this far past the end of the grid
+  const size_t GATHER_SLACK = 4;
+
+  const float ANGLE_TO_RADIANS = float( 2.0 * 3.14159265358979 / BINARY_ANGLE_TURN );
+  const float INF              = std::numeric_limits<float>::infinity();
+
+  // A ray offset rotated onto the heading, which points along (sin, -cos). Products of floats are exact in double, so
+  // whether or not the compiler fuses them into FMAs every build gets the same direction to the bit.
+  olc::vf2d rotateRay( float fSin, float fCos, float fOffCos, float fOffSin )
+  {
+    return { float( double( fSin ) * fOffCos + double( fCos ) * fOffSin ),
+             float( double( fSin ) * fOffSin - double( fCos ) * fOffCos ) };
+  }
+} // namespace
+
+Lidar::Lidar( const Track & track, const LidarParams & params ) : track( track ), lidarParams( params )
+{
+  uint32_t nRays = params.nRays;
+  bool     bFull = params.fFov >= 2.0f * PI - 1e-4f;
+  float    fStep = bFull ? params.fFov / nRays : nRays > 1 ? params.fFov / ( nRays - 1 ) : 0.0f;
+  float    fFrom = bFull ? 0.0f : -0.5f * params.fFov;
+  for( uint32_t i = 0; i < nRays; i++ )
+  {
+    float fOffset = fFrom + fStep * i;
+    rayCos.push_back( std::cos( fOffset ) );
+    raySin.push_back( std::sin( fOffset ) );
+  }
+  rebuild();
+}
+
+void Lidar::rebuild()
+{
+  nStride = track.width() + 2;
+  blocked.assign( size_t( nStride ) * ( track.height() + 2 ) + GATHER_SLACK, 1 );
+  for( int32_t y = 0; y < track.height(); y++ )
+  {
+    for( int32_t x = 0; x < track.width(); x++ )
+    {
+      mapTiles tile = track[track.cordToIndex( x, y )];
+      blocked[size_t( y + 1 ) * nStride + x + 1] =
+        tile == mapTiles::Wall || ( lidarParams.bOffRoad && tile == mapTiles::None );
+    }
+  }
+}
+
+void Lidar::cast( const CarStateFx * pCars, size_t nCars, float * pOut ) const
+{
+  for( size_t i = 0; i < nCars; i++ ) castCar( pCars[i], pOut + i * lidarParams.nRays );
+}
+
+void Lidar::cast( const CarStateFx * pCars, size_t nCars, float * pOut, ThreadPool & pool ) const
+{
+  pool.parallelFor( nCars, CAST_GRAIN, [&]( size_t nBegin, size_t nEnd ) {
+    for( size_t i = nBegin; i < nEnd; i++ ) castCar( pCars[i], pOut + i * lidarParams.nRays );
+  } );
+}
+
+olc::vf2d Lidar::rayDirection( const CarStateFx & car, uint32_t nRay ) const
+{
+  float fAngle = float( car.angle ) * ANGLE_TO_RADIANS;
+  return rotateRay( std::sin( fAngle ), std::cos( fAngle ), rayCos[nRay], raySin[nRay] );
+}
+
+float Lidar::castRay( const olc::vf2d & vPos, const olc::vf2d & vDir ) const
+{
+  olc::vi2d vBlock = track.blockSize();
+  int32_t   x      = std::clamp( int32_t( std::floor( vPos.x / vBlock.x ) ), -1, track.width() );
+  int32_t   y      = std::clamp( int32_t( std::floor( vPos.y / vBlock.y ) ), -1, track.height() );
+  int32_t   nIndex = ( y + 1 ) * nStride + x + 1;
+
+  // Distance along the ray to the next vertical and horizontal tile boundary, and between successive ones
+  int32_t nStepX  = vDir.x < 0 ? -1 : 1;
+  int32_t nStepY  = vDir.y < 0 ? -nStride : nStride;
+  float   fDeltaX = vDir.x == 0 ? INF : std::abs( vBlock.x / vDir.x );
+  float   fDeltaY = vDir.y == 0 ? INF : std::abs( vBlock.y / vDir.y );
+  float   fNextX  = vDir.x == 0 ? INF : ( float( ( vDir.x < 0 ? x : x + 1 ) * vBlock.x ) - vPos.x ) / vDir.x;
+  float   fNextY  = vDir.y == 0 ? INF : ( float( ( vDir.y < 0 ? y : y + 1 ) * vBlock.y ) - vPos.y ) / vDir.y;
+
+  float t = 0.0f;
+  while( t < lidarParams.fMaxRange )
+  {
+    if( blocked[nIndex] ) return t;
+    if( fNextX < fNextY )
+    {
+      t = fNextX;
+      fNextX += fDeltaX;
+      nIndex += nStepX;
+    }
+    else
+    {
+      t = fNextY;
+      fNextY += fDeltaY;
+      nIndex += nStepY;
+    }
+  }
+  return lidarParams.fMaxRange;
+}
+
+#ifdef FR_X86_SIMD
+namespace
+{
+  // Lidar::castCar eight rays at a time, compiled for AVX2 on its own
+  FR_TARGET_AVX2 void castCarAvx2( const CarStateFx &  car,
+                                   const Track &       track,
+                                   const LidarParams & params,
+                                   int32_t             nStride,
+                                   const uint8_t *     pBlocked,
+                                   const float *       pRayCos,
+                                   const float *       pRaySin,
+                                   float *             pOut )
+  {
+    olc::vi2d vBlock = track.blockSize();
+    olc::vf2d vPos   = { fixedToFloat( car.x ), fixedToFloat( car.y ) };
+    float     fAngle = float( car.angle ) * ANGLE_TO_RADIANS;
+    int32_t   x      = std::clamp( int32_t( std::floor( vPos.x / vBlock.x ) ), -1, track.width() );
+    int32_t   y      = std::clamp( int32_t( std::floor( vPos.y / vBlock.y ) ), -1, track.height() );
+
+    const __m256  zero     = _mm256_setzero_ps();
+    const __m256  inf      = _mm256_set1_ps( INF );
+    const __m256  signMask = _mm256_set1_ps( -0.0f );
+    const __m256  maxRange = _mm256_set1_ps( params.fMaxRange );
+    const __m256  blockX   = _mm256_set1_ps( float( vBlock.x ) );
+    const __m256  blockY   = _mm256_set1_ps( float( vBlock.y ) );
+    const __m256  posX     = _mm256_set1_ps( vPos.x );
+    const __m256  posY     = _mm256_set1_ps( vPos.y );
+    const __m256  lowX     = _mm256_set1_ps( float( x * vBlock.x ) );
+    const __m256  highX    = _mm256_set1_ps( float( ( x + 1 ) * vBlock.x ) );
+    const __m256  lowY     = _mm256_set1_ps( float( y * vBlock.y ) );
+    const __m256  highY    = _mm256_set1_ps( float( ( y + 1 ) * vBlock.y ) );
+    const __m256i one      = _mm256_set1_epi32( 1 );
+    const __m256i byteMask = _mm256_set1_epi32( 0xFF );
+    const __m256i strideY  = _mm256_set1_epi32( nStride );
+    const __m256i lanes    = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+    const int *   pGrid    = (const int *)pBlocked;
+    const float   fSin     = std::sin( fAngle );
+    const float   fCos     = std::cos( fAngle );
+
+    for( uint32_t nRay = 0; nRay < params.nRays; nRay += 8 )
+    {
+      // Directions as the scalar path has them, unused lanes pointing straight up
+      uint32_t nLanes = std::min( params.nRays - nRay, 8u );
+      __m256i  valid  = _mm256_cmpgt_epi32( _mm256_set1_epi32( int( nLanes ) ), lanes );
+      alignas( 32 ) float fDirX[8] = {};
+      alignas( 32 ) float fDirY[8] = { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f };
+      for( uint32_t k = 0; k < nLanes; k++ )
+      {
+        olc::vf2d vDir = rotateRay( fSin, fCos, pRayCos[nRay + k], pRaySin[nRay + k] );
+        fDirX[k]       = vDir.x;
+        fDirY[k]       = vDir.y;
+      }
+      __m256 dirX = _mm256_load_ps( fDirX );
+      __m256 dirY = _mm256_load_ps( fDirY );
+
+      // Same set up as castRay, a lane per ray and the same IEEE operations in the same order, so each lane reads what
+      // castRay would to the bit. Steps are +-1 or +-stride, from the sign of the direction.
+      __m256  negX    = _mm256_cmp_ps( dirX, zero, _CMP_LT_OQ );
+      __m256  negY    = _mm256_cmp_ps( dirY, zero, _CMP_LT_OQ );
+      __m256  flatX   = _mm256_cmp_ps( dirX, zero, _CMP_EQ_OQ );
+      __m256  flatY   = _mm256_cmp_ps( dirY, zero, _CMP_EQ_OQ );
+      __m256i stepX   = _mm256_sign_epi32( one, _mm256_or_si256( _mm256_castps_si256( negX ), one ) );
+      __m256i stepY   = _mm256_sign_epi32( strideY, _mm256_or_si256( _mm256_castps_si256( negY ), one ) );
+      __m256  deltaX  = _mm256_blendv_ps( _mm256_andnot_ps( signMask, _mm256_div_ps( blockX, dirX ) ), inf, flatX );
+      __m256  deltaY  = _mm256_blendv_ps( _mm256_andnot_ps( signMask, _mm256_div_ps( blockY, dirY ) ), inf, flatY );
+      __m256  nextX   = _mm256_div_ps( _mm256_sub_ps( _mm256_blendv_ps( highX, lowX, negX ), posX ), dirX );
+      __m256  nextY   = _mm256_div_ps( _mm256_sub_ps( _mm256_blendv_ps( highY, lowY, negY ), posY ), dirY );
+      nextX           = _mm256_blendv_ps( nextX, inf, flatX );
+      nextY           = _mm256_blendv_ps( nextY, inf, flatY );
+      __m256i index   = _mm256_set1_epi32( ( y + 1 ) * nStride + x + 1 );
+      __m256  t       = zero;
+      __m256  range   = maxRange;
+      __m256i active  = valid;
+
+      // Every lane walks one tile per iteration until all have hit something or run out of range
+      while( !_mm256_testz_si256( active, active ) )
+      {
+        __m256i cell = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), pGrid, index, active, 1 );
+        __m256i open = _mm256_cmpeq_epi32( _mm256_and_si256( cell, byteMask ), _mm256_setzero_si256() );
+        __m256i hit  = _mm256_andnot_si256( open, active );
+        range        = _mm256_blendv_ps( range, t, _mm256_castsi256_ps( hit ) );
+        active       = _mm256_andnot_si256( hit, active );
+
+        __m256 alongX = _mm256_cmp_ps( nextX, nextY, _CMP_LT_OQ );
+        t             = _mm256_blendv_ps( nextY, nextX, alongX );
+        index         = _mm256_add_epi32( index, _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( stepY ),
+                                                                                     _mm256_castsi256_ps( stepX ),
+                                                                                     alongX ) ) );
+        nextX         = _mm256_add_ps( nextX, _mm256_and_ps( alongX, deltaX ) );
+        nextY         = _mm256_add_ps( nextY, _mm256_andnot_ps( alongX, deltaY ) );
+        active        = _mm256_and_si256( active, _mm256_castps_si256( _mm256_cmp_ps( t, maxRange, _CMP_LT_OQ ) ) );
+      }
+
+      _mm256_maskstore_ps( pOut + nRay, valid, range );
+    }
+  }
+} // namespace
+#endif
+
+void Lidar::castCar( const CarStateFx & car, float * pOut ) const
+{
+#ifdef FR_X86_SIMD
+  if( cpuHasAvx2() )
+  {
+    castCarAvx2( car, track, lidarParams, nStride, blocked.data(), rayCos.data(), raySin.data(), pOut );
+    return;
+  }
+#endif
+
+  olc::vf2d vPos   = { fixedToFloat( car.x ), fixedToFloat( car.y ) };
+  float     fAngle = float( car.angle ) * ANGLE_TO_RADIANS;
+  float     fSin   = std::sin( fAngle );
+  float     fCos   = std::cos( fAngle );
+  for( uint32_t i = 0; i < lidarParams.nRays; i++ )
+    pOut[i] = castRay( vPos, rotateRay( fSin, fCos, rayCos[i], raySin[i] ) );
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Physics.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+struct LidarParams
+{
+  uint32_t nRays     = 64;
+  float    fFov      = 2.0f * PI;  // Radians, centred on the heading. A full turn spreads the rays all the way round.
+  float    fMaxRange = 300.0f;     // Pixels
+  bool     bOffRoad  = true;       // Grass stops a ray as well as walls
+};
+
+// Distance sensors for agents: a fan of rays round each car, walked tile by tile through the track (DDA) until they
+// reach a blocking tile. A car already on a blocking tile reads 0 on every ray. Rays are batched per car, eight at a
+// time in AVX2 lanes when available, and cars are spread over the thread pool. Both paths give the same ranges to the
+// bit, so observations don't depend on the build.
+class Lidar
+{
+public:
+  Lidar( const Track & track, const LidarParams & params = LidarParams() );
+
+  // Re-reads the tiles, call after the track has been edited
+  void rebuild();
+
+  // out holds nRays ranges per car in pixels, ray 0 pointing straight ahead and the rest clockwise
+  void cast( const CarStateFx * pCars, size_t nCars, float * pOut ) const;
+  void cast( const CarStateFx * pCars, size_t nCars, float * pOut, ThreadPool & pool ) const;
+
+  // One ray from a world position along a unit direction
+  float castRay( const olc::vf2d & vPos, const olc::vf2d & vDir ) const;
+
+  // Direction cast() sends ray nRay of a car along, so castRay from the car's position reads exactly what cast() does
+  olc::vf2d rayDirection( const CarStateFx & car, uint32_t nRay ) const;
+
+  const LidarParams & params() const { return lidarParams; }
+
+private:
+  void castCar( const CarStateFx & car, float * pOut ) const;
+
+  const Track &        track;
+  LidarParams          lidarParams;
+  int32_t              nStride = 0;  // Track width plus a blocking border on each side
+  std::vector<uint8_t> blocked;      // 1 where a ray stops, with slack at the end for 4 byte gathers
+  std::vector<float>   rayCos;       // Ray offsets from the heading
+  std::vector<float>   raySin;
+};
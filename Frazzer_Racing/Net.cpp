@@ -0,0 +1,172 @@
+#include "Net.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#if defined( _WIN32 )
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#  pragma comment( lib, "ws2_32.lib" )
+using socklen_t = int;
+#else
+#  include <arpa/inet.h>
+#  include <fcntl.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
+
+namespace
+{
+  double nowMs()
+  {
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+
+#if defined( _WIN32 )
+  // Winsock needs starting once per process
+  bool startNetworking()
+  {
+    static bool bStarted = [] {
+      WSADATA wsa;
+      return WSAStartup( MAKEWORD( 2, 2 ), &wsa ) == 0;
+    }();
+    return bStarted;
+  }
+#endif
+} // namespace
+
+bool parseAddress( const std::string & sText, NetAddress & address )
+{
+  unsigned a = 127, b = 0, c = 0, d = 1, nPort = 0;
+  if( std::sscanf( sText.c_str(), "%u.%u.%u.%u:%u", &a, &b, &c, &d, &nPort ) != 5 )
+  {
+    a = 127, b = 0, c = 0, d = 1;
+    if( std::sscanf( sText.c_str(), "%u", &nPort ) != 1 ) return false;
+  }
+  if( a > 255 || b > 255 || c > 255 || d > 255 || nPort == 0 || nPort > 65535 ) return false;
+  address.ip   = ( a << 24 ) | ( b << 16 ) | ( c << 8 ) | d;
+  address.port = uint16_t( nPort );
+  return true;
+}
+
+std::string toString( const NetAddress & address )
+{
+  return std::to_string( address.ip >> 24 ) + "." + std::to_string( ( address.ip >> 16 ) & 0xFF ) + "."
+         + std::to_string( ( address.ip >> 8 ) & 0xFF ) + "." + std::to_string( address.ip & 0xFF ) + ":"
+         + std::to_string( address.port );
+}
+
+UdpSocket::~UdpSocket() { close(); }
+
+bool UdpSocket::open( uint16_t nRequestedPort )
+{
+  close();
+#if defined( _WIN32 )
+  if( !startNetworking() ) return false;
+  SOCKET s = ::socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+  if( s == INVALID_SOCKET ) return false;
+  u_long nNonBlocking = 1;
+  ioctlsocket( s, FIONBIO, &nNonBlocking );
+#else
+  int s = ::socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+  if( s < 0 ) return false;
+  fcntl( s, F_SETFL, fcntl( s, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+  handle = intptr_t( s );
+
+  sockaddr_in addr     = {};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+  addr.sin_port        = htons( nRequestedPort );
+  socklen_t nLen       = sizeof( addr );
+  if( ::bind( s, (sockaddr *)&addr, nLen ) != 0 || ::getsockname( s, (sockaddr *)&addr, &nLen ) != 0 )
+  {
+    close();
+    return false;
+  }
+  nPort = ntohs( addr.sin_port );
+  return true;
+}
+
+void UdpSocket::close()
+{
+  if( handle == -1 ) return;
+#if defined( _WIN32 )
+  ::closesocket( SOCKET( handle ) );
+#else
+  ::close( int( handle ) );
+#endif
+  handle = -1;
+  nPort  = 0;
+  delayed.clear();
+}
+
+bool UdpSocket::isOpen() const { return handle != -1; }
+
+void UdpSocket::simulateLink( uint32_t nLatency, uint32_t nJitter, float fLoss, uint32_t nSeed )
+{
+  nLatencyMs   = nLatency;
+  nJitterMs    = nJitter;
+  fLossPercent = fLoss;
+  rng.seed( nSeed );
+}
+
+void UdpSocket::send( const NetAddress & to, const uint8_t * data, size_t nBytes )
+{
+  flushDelayed();
+  if( fLossPercent > 0.0f && std::uniform_real_distribution<float>( 0.0f, 100.0f )( rng ) < fLossPercent ) return;
+  if( nLatencyMs == 0 && nJitterMs == 0 )
+  {
+    sendNow( to, data, nBytes );
+    return;
+  }
+
+  // Jitter can reorder packets, just like a real link
+  double fDue = nowMs() + nLatencyMs + ( nJitterMs ? rng() % ( nJitterMs + 1 ) : 0 );
+  auto   it   = std::upper_bound(
+    delayed.begin(), delayed.end(), fDue, []( double f, const Delayed & d ) { return f < d.fDue; } );
+  delayed.insert( it, { fDue, to, std::vector<uint8_t>( data, data + nBytes ) } );
+}
+
+int UdpSocket::receive( uint8_t * data, size_t nCapacity, NetAddress & from )
+{
+  flushDelayed();
+  if( handle == -1 ) return -1;
+
+  sockaddr_in addr = {};
+  socklen_t   nLen = sizeof( addr );
+#if defined( _WIN32 )
+  int nBytes = ::recvfrom( SOCKET( handle ), (char *)data, int( nCapacity ), 0, (sockaddr *)&addr, &nLen );
+#else
+  int nBytes = int( ::recvfrom( int( handle ), data, nCapacity, 0, (sockaddr *)&addr, &nLen ) );
+#endif
+  if( nBytes < 0 ) return -1;
+  from = { ntohl( addr.sin_addr.s_addr ), ntohs( addr.sin_port ) };
+  return nBytes;
+}
+
+void UdpSocket::sendNow( const NetAddress & to, const uint8_t * data, size_t nBytes )
+{
+  if( handle == -1 ) return;
+  sockaddr_in addr     = {};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl( to.ip );
+  addr.sin_port        = htons( to.port );
+#if defined( _WIN32 )
+  ::sendto( SOCKET( handle ), (const char *)data, int( nBytes ), 0, (const sockaddr *)&addr, sizeof( addr ) );
+#else
+  ::sendto( int( handle ), data, nBytes, 0, (const sockaddr *)&addr, sizeof( addr ) );
+#endif
+}
+
+void UdpSocket::flushDelayed()
+{
+  double fNow = nowMs();
+  while( !delayed.empty() && delayed.front().fDue <= fNow )
+  {
+    sendNow( delayed.front().to, delayed.front().data.data(), delayed.front().data.size() );
+    delayed.pop_front();
+  }
+}
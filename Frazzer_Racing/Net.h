@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+// IPv4 address and port, both in host byte order
+struct NetAddress
+{
+  uint32_t ip   = 0;
+  uint16_t port = 0;
+
+  bool operator==( const NetAddress & o ) const { return ip == o.ip && port == o.port; }
+  bool operator!=( const NetAddress & o ) const { return !( *this == o ); }
+};
+
+// "a.b.c.d:port", a bare port means loopback
+bool        parseAddress( const std::string & sText, NetAddress & address );
+std::string toString( const NetAddress & address );
+
+// Non-blocking UDP socket. Outgoing packets can be put through a simulated bad link (latency, jitter and loss) so
+// network code can be tested over loopback.
+class UdpSocket
+{
+public:
+  UdpSocket() = default;
+  ~UdpSocket();
+  UdpSocket( const UdpSocket & )             = delete;
+  UdpSocket & operator=( const UdpSocket & ) = delete;
+
+  // Port 0 picks any free port
+  bool     open( uint16_t nPort );
+  void     close();
+  bool     isOpen() const;
+  uint16_t port() const { return nPort; }
+
+  void send( const NetAddress & to, const uint8_t * data, size_t nBytes );
+
+  // Size of the next waiting packet, copied into `data`, or -1 when there is none
+  int receive( uint8_t * data, size_t nCapacity, NetAddress & from );
+
+  // Applies to packets sent from now on, seeded so a test run can be repeated
+  void simulateLink( uint32_t nLatencyMs, uint32_t nJitterMs, float fLossPercent, uint32_t nSeed = 1 );
+
+private:
+  struct Delayed
+  {
+    double               fDue;
+    NetAddress           to;
+    std::vector<uint8_t> data;
+  };
+
+  void sendNow( const NetAddress & to, const uint8_t * data, size_t nBytes );
+  void flushDelayed();
+
+  intptr_t            handle = -1;  // SOCKET on Windows, file descriptor elsewhere
+  uint16_t            nPort  = 0;
+  uint32_t            nLatencyMs = 0, nJitterMs = 0;
+  float               fLossPercent = 0.0f;
+  std::mt19937        rng;
+  std::deque<Delayed> delayed;  // Ordered by due time
+};
@@ -0,0 +1,103 @@
+#include "Physics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Per tick rates for the fixed point path, rounded once at compile time
+  constexpr uint32_t ROT_PER_TICK      = uint32_t( ROT_RATE / TICK_RATE / ( 2.0 * 3.14159265358979 ) * BINARY_ANGLE_TURN
+                                                   + 0.5 );
+  constexpr fixed    ACCEL_PER_TICK    = fixed( double( ACCEL_RATE ) * FIXED_ONE / TICK_RATE + 0.5 );
+  constexpr fixed    FRICTION_PER_TICK = fixed( double( FRICTION ) * FIXED_ONE / TICK_RATE + 0.5 );
+} // namespace
+
+void stepCar( CarState & car, uint8_t input, float fElapsedTime ) { stepCar( car, input, fElapsedTime, WheelGrip() ); }
+
+void stepCar( CarState & car, uint8_t input, float fElapsedTime, const WheelGrip & wheels )
+{
+  float fGrip = fixedToFloat( wheels.grip );
+  if( input & INPUT_LEFT ) car.angle -= ROT_RATE * fGrip * fElapsedTime;
+  if( input & INPUT_RIGHT ) car.angle += ROT_RATE * fGrip * fElapsedTime;
+  if( input & INPUT_ACCEL ) car.vel += ACCEL_RATE * fGrip * fElapsedTime;
+  if( input & INPUT_BRAKE ) car.vel -= ACCEL_RATE * fGrip * fElapsedTime;
+
+  // Car friction, stopping at zero rather than jittering around it
+  float fFriction = FRICTION * fixedToFloat( wheels.friction ) * fElapsedTime;
+  if( car.vel > fFriction ) car.vel -= fFriction;
+  else if( car.vel < -fFriction )
+    car.vel += fFriction;
+  else
+    car.vel = 0.0f;
+
+  olc::vf2d vel = { std::sin( car.angle ) * car.vel, -std::cos( car.angle ) * car.vel };
+  car.pos += vel * fElapsedTime;
+
+  // Make Sure Angle Stays in range
+  if( car.angle < 0 ) car.angle += 2 * PI;
+  else if( car.angle > 2 * PI )
+    car.angle -= 2 * PI;
+}
+
+void clampCar( CarState & car, const olc::vf2d & vMin, const olc::vf2d & vMax )
+{
+  car.pos = car.pos.max( vMin ).min( vMax );
+}
+
+void stepCarFx( CarStateFx & car, uint8_t input ) { stepCarFx( car, input, WheelGrip() ); }
+
+void stepCarFx( CarStateFx & car, uint8_t input, const WheelGrip & wheels )
+{
+  SinCos heading;
+  stepCarFx( car, input, wheels, heading );
+}
+
+void stepCarFx( CarStateFx & car, uint8_t input, const WheelGrip & wheels, SinCos & heading )
+{
+  // Multiplying by FIXED_ONE is exact, so tarmac keeps the tarmac rates to the bit
+  uint32_t rot      = uint32_t( ( uint64_t( ROT_PER_TICK ) * uint64_t( wheels.grip ) ) >> FIXED_SHIFT );
+  fixed    accel    = fixedMul( ACCEL_PER_TICK, wheels.grip );
+  fixed    friction = fixedMul( FRICTION_PER_TICK, wheels.friction );
+
+  // Heading wraps by unsigned overflow
+  if( input & INPUT_LEFT ) car.angle -= rot;
+  if( input & INPUT_RIGHT ) car.angle += rot;
+  if( input & INPUT_ACCEL ) car.vel += accel;
+  if( input & INPUT_BRAKE ) car.vel -= accel;
+
+  if( car.vel > friction ) car.vel -= friction;
+  else if( car.vel < -friction )
+    car.vel += friction;
+  else
+    car.vel = 0;
+
+  // Every tick rather than only when steering, a branch on the input costing more than the lookups
+  heading = fixedSinCos( car.angle );
+  car.x += fixedMul( heading.s, car.vel ) / TICK_RATE;
+  car.y -= fixedMul( heading.c, car.vel ) / TICK_RATE;
+}
+
+void clampCarFx( CarStateFx & car, const olc::vi2d & vMin, const olc::vi2d & vMax )
+{
+  car.x = std::clamp( car.x, toFixed( vMin.x ), toFixed( vMax.x ) );
+  car.y = std::clamp( car.y, toFixed( vMin.y ), toFixed( vMax.y ) );
+}
+
+CarStateFx toFixed( const CarState & car )
+{
+  CarStateFx fx;
+  fx.x     = floatToFixed( car.pos.x );
+  fx.y     = floatToFixed( car.pos.y );
+  fx.vel   = floatToFixed( car.vel );
+  fx.angle = uint32_t( int64_t( car.angle / ( 2.0 * 3.14159265358979 ) * BINARY_ANGLE_TURN ) );
+  return fx;
+}
+
+CarState toFloat( const CarStateFx & car )
+{
+  CarState s;
+  s.pos   = { fixedToFloat( car.x ), fixedToFloat( car.y ) };
+  s.vel   = fixedToFloat( car.vel );
+  s.angle = float( car.angle / BINARY_ANGLE_TURN * 2.0 * 3.14159265358979 );
+  return s;
+}
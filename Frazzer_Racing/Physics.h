@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Fixed.h"
+#include "Surface.h"
+#include "olcPixelGameEngine.h"
+
+constexpr float ROT_RATE   = 2.0f;
+constexpr float ACCEL_RATE = 50.f;
+constexpr float FRICTION   = 25.f;
+constexpr float PI         = 3.14159f;
+
+// The fixed point simulation always advances in whole ticks of 1 / TICK_RATE seconds
+constexpr int TICK_RATE = 60;
+
+// Controls held during a tick, small enough to store as a nibble
+enum CarInput : uint8_t
+{
+  INPUT_LEFT  = 1 << 0,
+  INPUT_RIGHT = 1 << 1,
+  INPUT_ACCEL = 1 << 2,
+  INPUT_BRAKE = 1 << 3,
+};
+
+struct CarState
+{
+  olc::vf2d pos   = { 130, 200 };
+  float     vel   = 0.0f;
+  float     angle = 0.0f;
+};
+
+// Deterministic counterpart of CarState: Q16.16 position and speed, binary angle heading
+struct CarStateFx
+{
+  fixed    x     = 0;
+  fixed    y     = 0;
+  fixed    vel   = 0;  // Pixels per second
+  uint32_t angle = 0;
+  uint32_t pad   = 0;  // Spelled out so copies and save files carry no uninitialised bytes
+};
+
+// Float physics with libm trig, variable time step, on tarmac unless given the surface under the wheels
+void stepCar( CarState & car, uint8_t input, float fElapsedTime );
+void stepCar( CarState & car, uint8_t input, float fElapsedTime, const WheelGrip & wheels );
+void clampCar( CarState & car, const olc::vf2d & vMin, const olc::vf2d & vMax );
+
+// Fixed point physics, one tick of 1 / TICK_RATE seconds, bit-identical everywhere. Grip scales steering and
+// acceleration and friction the slowing, so tarmac gives exactly the plain step.
+void stepCarFx( CarStateFx & car, uint8_t input );
+void stepCarFx( CarStateFx & car, uint8_t input, const WheelGrip & wheels );
+
+// As above, also leaving the sine and cosine of the car's new heading in `heading`, so the next tick's wheels are
+// sampled without working them out again
+void stepCarFx( CarStateFx & car, uint8_t input, const WheelGrip & wheels, SinCos & heading );
+void clampCarFx( CarStateFx & car, const olc::vi2d & vMin, const olc::vi2d & vMax );
+
+CarStateFx toFixed( const CarState & car );
+CarState   toFloat( const CarStateFx & car );
@@ -0,0 +1,795 @@
+#include "RacingLine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+#include "BitStream.h"
+#include "DistanceField.h"
+#include "TrackGenerator.h"
+
+namespace
+{
+  const uint32_t LINE_MAGIC      = 0x4C525246;  // "FRRL"
+  const uint32_t LINE_VERSION    = 1;
+  const uint32_t MAX_LINE_POINTS = 1 << 20;
+
+  // The coarsest level is kept to this many points or more and to points no further apart than the widest bends of
+  // a generated track are wide, and points are checked this many at a time
+  const size_t MIN_LEVEL_POINTS  = 48;
+  const float  MAX_LEVEL_SPACING = 32.0f;
+  const size_t POINT_GRAIN       = 1024;
+
+  // Each point's part in its own second difference and its neighbours', and a trace of pull back to the curve solved
+  // about so a loop that touches the edge nowhere still has a single best line
+  const double WEIGHTS[3] = { 6.0, -4.0, 1.0 };
+  const double REGULARISE = 1e-12;
+
+  // Points this close to the edge count as touching it, and a level is settled once no point moves this far in a
+  // step, in pixels. Steps are halved at most MAX_HALVINGS times looking for a better line.
+  const double AT_EDGE      = 1e-9;
+  const double SETTLED      = 1e-4;
+  const int    MAX_HALVINGS = 30;
+
+  // Where each point stands in the solve
+  const uint8_t FREE  = 0;
+  const uint8_t AT_LO = 1;
+  const uint8_t AT_HI = 2;
+  const uint8_t HELD  = 3;  // No room to move
+
+  // Points of the curve each level is solved about per point of the level
+  const float SMOOTH_STEPS = 4.0f;
+
+  // Normals are taken across this much of the curve solved about, and bends measured across twice this much of the
+  // line, so corners of the centreline's polygon and the last wobbles of the solve don't read as tight bends
+  const float NORMAL_REACH = 8.0f;
+  const float BEND_REACH   = 12.0f;
+
+  // Furthest the road is looked for either side of the line, and for room from a point with none, in pixels
+  const float MAX_REACH = 1000.0f;
+  const float MAX_SHIFT = 16.0f;
+
+  // Positions and speeds are kept to sixteenths
+  const int QUANTUM_SHIFT = FIXED_SHIFT - 4;
+
+  // The follower aims this far along the line plus how far the car travels in LOOK_AHEAD_TIME, and brakes once this
+  // far over the speed there
+  const fixed    LOOK_AHEAD      = toFixed( 10 );
+  const fixed    LOOK_AHEAD_TIME = FIXED_ONE / 5;
+  const fixed    SPEED_SLACK     = toFixed( 2 );
+  const uint32_t MAX_PASSED      = 8;   // Points a car can get past in one tick
+  const uint32_t MAX_AHEAD       = 64;  // Points the aim is looked for over
+
+  // One level of the solve: the curve it is solved about resampled evenly, with how far each point may move along its
+  // normal
+  struct Level
+  {
+    std::vector<olc::vf2d> centre;
+    std::vector<olc::vf2d> normal;
+    std::vector<double>    lo;
+    std::vector<double>    hi;
+    std::vector<double>    offset;
+    std::vector<uint8_t>   status;
+  };
+
+  uint32_t floatBits( float f )
+  {
+    uint32_t bits;
+    std::memcpy( &bits, &f, sizeof( bits ) );
+    return bits;
+  }
+
+  int64_t isqrt( int64_t n )
+  {
+    // Corrected after rounding, so the result doesn't depend on the platform's double
+    int64_t r = int64_t( std::sqrt( double( n ) ) );
+    while( r > 0 && r * r > n ) r--;
+    while( ( r + 1 ) * ( r + 1 ) <= n ) r++;
+    return r;
+  }
+
+  uint32_t zigzag( int64_t n ) { return uint32_t( n < 0 ? ( uint64_t( -n ) << 1 ) - 1 : uint64_t( n ) << 1 ); }
+  int64_t  unzigzag( uint32_t n ) { return n & 1 ? -int64_t( n >> 1 ) - 1 : int64_t( n >> 1 ); }
+
+  fixed quantise( float f ) { return fixed( std::lround( f * 16.0f ) ) << QUANTUM_SHIFT; }
+
+  float loopLength( const std::vector<olc::vf2d> & loop )
+  {
+    float fLength = 0.0f;
+    for( size_t i = 0; i < loop.size(); i++ ) fLength += ( loop[( i + 1 ) % loop.size()] - loop[i] ).mag();
+    return fLength;
+  }
+
+  // nPoints spaced evenly along the closed loop by distance, from its first point
+  void sampleEvenly( const std::vector<olc::vf2d> & loop, float fLength, size_t nPoints, std::vector<olc::vf2d> & out )
+  {
+    out.resize( nPoints );
+    float  fStep  = fLength / nPoints;
+    float  fStart = 0.0f;  // Distance round the loop of the start of segment k
+    size_t k      = 0;
+    for( size_t i = 0; i < nPoints; i++ )
+    {
+      float     fAt      = i * fStep;
+      olc::vf2d a        = loop[k];
+      olc::vf2d b        = loop[( k + 1 ) % loop.size()];
+      float     fSegment = ( b - a ).mag();
+      while( fAt > fStart + fSegment && k + 1 < loop.size() )
+      {
+        fStart += fSegment;
+        k++;
+        a        = b;
+        b        = loop[( k + 1 ) % loop.size()];
+        fSegment = ( b - a ).mag();
+      }
+      out[i] = fSegment > 0.0f ? a + ( b - a ) * std::min( ( fAt - fStart ) / fSegment, 1.0f ) : a;
+    }
+  }
+
+  // Room for the line along vNormal through vFrom, between offsets fLo and fHi that are fMargin from the edge of the
+  // road. A point already too close to the edge, as the curve through the level before's line can be, gets the room
+  // nearest it instead, and one with none near it is held where it is.
+  void roadRoom( const DistanceField & road,
+                 const olc::vf2d &     vFrom,
+                 const olc::vf2d &     vNormal,
+                 float                 fMargin,
+                 double &              fLo,
+                 double &              fHi )
+  {
+    auto over = [&]( float t ) { return road.distance( vFrom + vNormal * t ) + fMargin; };
+    auto edge = [&]( float t, float fStep ) {
+      float fLast = over( t );
+      for( float d = fStep; std::abs( d ) < MAX_REACH; d += fStep )
+      {
+        float fNext = over( t + d );
+        if( fNext >= 0.0f ) return t + d - fStep * ( 1.0f - fLast / ( fLast - fNext ) );
+        fLast = fNext;
+      }
+      return t + fStep * MAX_REACH;
+    };
+
+    float fStart = 0.0f;
+    fLo = fHi = 0.0f;
+    for( float d = 1.0f; over( fStart ) >= 0.0f; d += 1.0f )
+    {
+      if( d > MAX_SHIFT ) return;
+      fStart = over( d ) < 0.0f ? d : over( -d ) < 0.0f ? -d : 0.0f;
+    }
+    fLo = edge( fStart, -1.0f );
+    fHi = edge( fStart, 1.0f );
+  }
+
+  // Calls func( i ) for i in [0, n), shared over the pool if there is one
+  template <typename Func> void forEach( ThreadPool * pPool, size_t n, const Func & func )
+  {
+    if( pPool ) pPool->parallelFor( n, func );
+    else
+      for( size_t i = 0; i < n; i++ ) func( i );
+  }
+
+  void buildLevel( const DistanceField &          road,
+                   const std::vector<olc::vf2d> & loop,
+                   float                          fLength,
+                   size_t                         nPoints,
+                   const RacingLineParams &       params,
+                   ThreadPool *                   pPool,
+                   Level &                        level )
+  {
+    sampleEvenly( loop, fLength, nPoints, level.centre );
+    level.normal.resize( nPoints );
+    level.lo.resize( nPoints );
+    level.hi.resize( nPoints );
+    size_t nReach = std::max<size_t>( 1, size_t( NORMAL_REACH * nPoints / fLength + 0.5f ) );
+    size_t nPieces = ( nPoints + POINT_GRAIN - 1 ) / POINT_GRAIN;
+    forEach( pPool, nPieces, [&]( size_t nPiece ) {
+      for( size_t i = nPiece * POINT_GRAIN; i < std::min( nPoints, ( nPiece + 1 ) * POINT_GRAIN ); i++ )
+      {
+        olc::vf2d vAlong = level.centre[( i + nReach ) % nPoints] - level.centre[( i + nPoints - nReach ) % nPoints];
+        olc::vf2d vNormal = vAlong.mag2() > 0.0f ? vAlong.perp().norm() : olc::vf2d( 0.0f, 0.0f );
+        level.normal[i]   = vNormal;
+
+        roadRoom( road, level.centre[i], vNormal, params.fMargin, level.lo[i], level.hi[i] );
+      }
+    } );
+  }
+
+  // The sum of squared second differences of the line is a quadratic in the offsets, a.H.a + 2 b.a + const, with H
+  // nonzero only within two points of its diagonal: H( j, k ) = WEIGHTS[|j - k|] * n( j ).n( k ) round the loop
+  double bend( const Level & level, size_t j, size_t k )
+  {
+    size_t n     = level.centre.size();
+    size_t nDist = std::min( ( j + n - k ) % n, ( k + n - j ) % n );
+    if( nDist > 2 ) return 0.0;
+    const olc::vf2d & a = level.normal[j];
+    const olc::vf2d & b = level.normal[k];
+    return WEIGHTS[nDist] * ( double( a.x ) * b.x + double( a.y ) * b.y ) + ( nDist == 0 ? REGULARISE : 0.0 );
+  }
+
+  // Gradient of the quadratic at point j, halved: positive when moving j along its normal bends the line more
+  double slope( const Level & level, const std::vector<double> & b, size_t j )
+  {
+    size_t n = level.centre.size();
+    double r = b[j];
+    for( size_t k = j + n - 2; k <= j + n + 2; k++ ) r += bend( level, j, k % n ) * level.offset[k % n];
+    return r;
+  }
+
+  // LDL^T of a symmetric matrix nonzero only within two of its diagonal, given the diagonal and the entries one and
+  // two to its left, solved for right hand sides in place
+  struct Banded
+  {
+    std::vector<double> d, l1, l2;
+
+    void factor( const std::vector<double> & diag, const std::vector<double> & off1, const std::vector<double> & off2 )
+    {
+      size_t m = diag.size();
+      d.assign( m, 0.0 );
+      l1.assign( m, 0.0 );
+      l2.assign( m, 0.0 );
+      for( size_t i = 0; i < m; i++ )
+      {
+        if( i >= 2 ) l2[i] = off2[i] / d[i - 2];
+        if( i >= 1 ) l1[i] = ( off1[i] - ( i >= 2 ? l2[i] * d[i - 2] * l1[i - 1] : 0.0 ) ) / d[i - 1];
+        d[i] = diag[i] - ( i >= 1 ? l1[i] * l1[i] * d[i - 1] : 0.0 ) - ( i >= 2 ? l2[i] * l2[i] * d[i - 2] : 0.0 );
+      }
+    }
+
+    void solve( std::vector<double> & x ) const
+    {
+      size_t m = d.size();
+      for( size_t i = 1; i < m; i++ ) x[i] -= l1[i] * x[i - 1] + ( i >= 2 ? l2[i] * x[i - 2] : 0.0 );
+      for( size_t i = 0; i < m; i++ ) x[i] /= d[i];
+      for( size_t i = m - 1; i-- > 0; ) x[i] -= l1[i + 1] * x[i + 1] + ( i + 2 < m ? l2[i + 2] * x[i + 2] : 0.0 );
+    }
+  };
+
+  // Exact offsets of the free points f into out, in order round the loop, with every other point held where it is.
+  // Cyclic stretches are the whole loop less a few lone held points, so wrap round onto themselves: their last two
+  // points are then found from the 2 x 2 system left once the rest are solved in terms of them.
+  void solveStretch( const Level &               level,
+                     const std::vector<size_t> & f,
+                     bool                        bCyclic,
+                     const std::vector<double> & b,
+                     std::vector<double> &       out )
+  {
+    size_t              n = level.centre.size();
+    size_t              m = f.size();
+    std::vector<double> rhs( m );
+    for( size_t i = 0; i < m; i++ )
+    {
+      rhs[i] = -b[f[i]];
+      for( size_t k = f[i] + n - 2; k <= f[i] + n + 2; k++ )
+        if( level.status[k % n] != FREE ) rhs[i] -= bend( level, f[i], k % n ) * level.offset[k % n];
+    }
+
+    size_t              nInner = bCyclic && m >= 3 ? m - 2 : m;
+    std::vector<double> diag( nInner ), off1( nInner, 0.0 ), off2( nInner, 0.0 );
+    for( size_t i = 0; i < nInner; i++ )
+    {
+      diag[i] = bend( level, f[i], f[i] );
+      if( i >= 1 ) off1[i] = bend( level, f[i], f[i - 1] );
+      if( i >= 2 ) off2[i] = bend( level, f[i], f[i - 2] );
+    }
+    Banded banded;
+    banded.factor( diag, off1, off2 );
+    std::vector<double> x( rhs.begin(), rhs.begin() + nInner );
+    banded.solve( x );
+    if( nInner < m )
+    {
+      std::vector<double> column[2], y[2];
+      for( size_t t = 0; t < 2; t++ )
+      {
+        column[t].resize( nInner );
+        for( size_t i = 0; i < nInner; i++ ) column[t][i] = bend( level, f[i], f[nInner + t] );
+        y[t] = column[t];
+        banded.solve( y[t] );
+      }
+      double s[2][2], r[2];
+      for( size_t t = 0; t < 2; t++ )
+      {
+        r[t] = rhs[nInner + t];
+        for( size_t i = 0; i < nInner; i++ ) r[t] -= column[t][i] * x[i];
+        for( size_t u = 0; u < 2; u++ )
+        {
+          s[t][u] = bend( level, f[nInner + t], f[nInner + u] );
+          for( size_t i = 0; i < nInner; i++ ) s[t][u] -= column[t][i] * y[u][i];
+        }
+      }
+      double fDet = s[0][0] * s[1][1] - s[0][1] * s[1][0];
+      double x0   = ( r[0] * s[1][1] - r[1] * s[0][1] ) / fDet;
+      double x1   = ( s[0][0] * r[1] - s[1][0] * r[0] ) / fDet;
+      for( size_t i = 0; i < nInner; i++ ) x[i] -= y[0][i] * x0 + y[1][i] * x1;
+      x.push_back( x0 );
+      x.push_back( x1 );
+    }
+    for( size_t i = 0; i < m; i++ ) out[f[i]] = x[i];
+  }
+
+  // Projected Newton, after Bertsekas. Points at the edge that the line presses against are held there, the rest are
+  // solved for exactly, and the line moves towards that solution as far as halving the step finds it bending less,
+  // every point kept on the road. Many points can reach or leave the edge in one step, so it takes a handful of
+  // steps however long the line. Two held points in a row cut the loop, and the stretches between are solved at once
+  // over the pool.
+  uint32_t solveLevel( Level & level, const RacingLineParams & params, ThreadPool * pPool )
+  {
+    size_t              n = level.centre.size();
+    std::vector<double> ex( n ), ey( n ), b( n ), target( n ), trial( n );
+    for( size_t i = 0; i < n; i++ )
+    {
+      const olc::vf2d & a = level.centre[( i + n - 1 ) % n];
+      const olc::vf2d & c = level.centre[( i + 1 ) % n];
+      ex[i]               = double( a.x ) - 2.0 * level.centre[i].x + c.x;
+      ey[i]               = double( a.y ) - 2.0 * level.centre[i].y + c.y;
+    }
+    for( size_t j = 0; j < n; j++ )
+    {
+      size_t p = ( j + n - 1 ) % n, q = ( j + 1 ) % n;
+      b[j]     = level.normal[j].x * ( ex[p] - 2.0 * ex[j] + ex[q] ) +
+             level.normal[j].y * ( ey[p] - 2.0 * ey[j] + ey[q] );
+    }
+    level.status.resize( n );
+    for( size_t i = 0; i < n; i++ ) level.offset[i] = std::clamp( level.offset[i], level.lo[i], level.hi[i] );
+
+    // Summed a piece at a time in a fixed order, so the result doesn't depend on the thread count
+    size_t              nPieces = ( n + POINT_GRAIN - 1 ) / POINT_GRAIN;
+    std::vector<double> sums( nPieces );
+    auto                pieces  = [&]( const std::function<double( size_t )> & func ) {
+      forEach( pPool, nPieces, [&]( size_t nPiece ) {
+        double fSum = 0.0;
+        for( size_t i = nPiece * POINT_GRAIN; i < std::min( n, ( nPiece + 1 ) * POINT_GRAIN ); i++ ) fSum += func( i );
+        sums[nPiece] = fSum;
+      } );
+      double fTotal = 0.0;
+      for( double f : sums ) fTotal += f;
+      return fTotal;
+    };
+    auto energy = [&]( const std::vector<double> & x ) {
+      return pieces( [&]( size_t i ) {
+        double r = 2.0 * b[i];
+        for( size_t k = i + n - 2; k <= i + n + 2; k++ ) r += bend( level, i, k % n ) * x[k % n];
+        return x[i] * r;
+      } );
+    };
+
+    double   fEnergy     = energy( level.offset );
+    uint32_t nIterations = 0;
+    while( nIterations < params.nMaxIterations )
+    {
+      nIterations++;
+      pieces( [&]( size_t i ) {
+        double fSlope   = slope( level, b, i );
+        level.status[i] = level.lo[i] >= level.hi[i]                                    ? HELD
+                          : level.offset[i] <= level.lo[i] + AT_EDGE && fSlope > 0.0 ? AT_LO
+                          : level.offset[i] >= level.hi[i] - AT_EDGE && fSlope < 0.0 ? AT_HI
+                                                                                      : FREE;
+        return 0.0;
+      } );
+
+      std::vector<std::vector<size_t>> stretches;
+      size_t                           nCut = n;
+      for( size_t i = 0; i < n && nCut == n; i++ )
+        if( level.status[i] != FREE && level.status[( i + 1 ) % n] != FREE ) nCut = i;
+      if( nCut == n )
+      {
+        stretches.emplace_back();
+        for( size_t i = 0; i < n; i++ )
+          if( level.status[i] == FREE ) stretches.back().push_back( i );
+      }
+      else
+      {
+        size_t nHeld = 2;
+        for( size_t k = 2; k < n + 2; k++ )
+        {
+          size_t i = ( nCut + k ) % n;
+          if( level.status[i] != FREE ) nHeld++;
+          else
+          {
+            if( nHeld >= 2 ) stretches.emplace_back();
+            stretches.back().push_back( i );
+            nHeld = 0;
+          }
+        }
+      }
+      bool bCyclic = nCut == n;
+      forEach( pPool, stretches.size(), [&]( size_t s ) {
+        if( !stretches[s].empty() ) solveStretch( level, stretches[s], bCyclic, b, target );
+      } );
+
+      // Halving the step until the line bends less, clamped to the road
+      double fStep = 1.0, fTrial = fEnergy;
+      for( int nHalvings = 0; nHalvings < MAX_HALVINGS; nHalvings++, fStep *= 0.5 )
+      {
+        pieces( [&]( size_t i ) {
+          double x = level.offset[i];
+          if( level.status[i] == FREE ) x = std::clamp( x + ( target[i] - x ) * fStep, level.lo[i], level.hi[i] );
+          trial[i] = x;
+          return 0.0;
+        } );
+        fTrial = energy( trial );
+        if( fTrial < fEnergy ) break;
+      }
+      if( !( fTrial < fEnergy ) ) break;
+
+      double fMove = 0.0;
+      for( size_t i = 0; i < n; i++ ) fMove = std::max( fMove, std::abs( trial[i] - level.offset[i] ) );
+      level.offset.swap( trial );
+      fEnergy = fTrial;
+      if( fMove < SETTLED ) break;
+    }
+    return nIterations;
+  }
+
+  // Fastest the line can be driven at each point, and the seconds that takes round the loop
+  float speedProfile( const Track &                  track,
+                      const std::vector<olc::vf2d> & pos,
+                      float                          fSpacing,
+                      const RacingLineParams &       params,
+                      std::vector<float> &           speed )
+  {
+    size_t n = pos.size();
+    speed.resize( n );
+    std::vector<float> gaps( n );
+    for( size_t i = 0; i < n; i++ ) gaps[i] = ( pos[( i + 1 ) % n] - pos[i] ).mag();
+
+    // Turning at a fixed rate, the fastest through a bend of curvature k is the turn rate over k
+    const Surface & road   = track.surfaces().surface( mapTiles::Road );
+    float           fGrip  = fixedToFloat( road.grip );
+    float           fAccel = std::max( ACCEL_RATE * fGrip - FRICTION * fixedToFloat( road.friction ), 1.0f );
+    float           fBrake = ACCEL_RATE * fGrip + FRICTION * fixedToFloat( road.friction );
+    size_t          nReach = std::max<size_t>( 1, size_t( BEND_REACH / fSpacing + 0.5f ) );
+    size_t          nSlow  = 0;
+    for( size_t i = 0; i < n; i++ )
+    {
+      const olc::vf2d & a      = pos[( i + n - nReach ) % n];
+      const olc::vf2d & b      = pos[i];
+      const olc::vf2d & c      = pos[( i + nReach ) % n];
+      float             fSides = ( b - a ).mag() * ( c - b ).mag() * ( c - a ).mag();
+      float             fBend  = fSides > 0.0f ? 2.0f * std::abs( ( b - a ).cross( c - a ) ) / fSides : 0.0f;
+      speed[i]                 = params.fMaxSpeed;
+      if( fBend > 0.0f ) speed[i] = std::min( speed[i], params.fCornerSpeed * ROT_RATE * fGrip / fBend );
+      if( speed[i] < speed[nSlow] ) nSlow = i;
+    }
+
+    // From the slowest point, which nothing can change, up to speed forwards and down to it backwards
+    for( size_t j = 1; j <= n; j++ )
+    {
+      size_t i    = ( nSlow + j ) % n;
+      size_t prev = ( i + n - 1 ) % n;
+      speed[i]    = std::min( speed[i], std::sqrt( speed[prev] * speed[prev] + 2.0f * fAccel * gaps[prev] ) );
+    }
+    for( size_t j = 1; j <= n; j++ )
+    {
+      size_t i    = ( nSlow + n - j ) % n;
+      size_t next = ( i + 1 ) % n;
+      speed[i]    = std::min( speed[i], std::sqrt( speed[next] * speed[next] + 2.0f * fBrake * gaps[i] ) );
+    }
+
+    float fTime = 0.0f;
+    for( size_t i = 0; i < n; i++ ) fTime += gaps[i] / std::max( 0.5f * ( speed[i] + speed[( i + 1 ) % n] ), 1e-3f );
+    return fTime;
+  }
+
+  // Douglas-Peucker round the loop, keeping the start and whatever it takes to stay within the tolerances of both the
+  // path and the speeds along it
+  std::vector<size_t> simplify( const std::vector<olc::vf2d> & pos,
+                                const std::vector<float> &     speed,
+                                const RacingLineParams &       params )
+  {
+    size_t             n = pos.size();
+    std::vector<float> along( n + 1, 0.0f );
+    for( size_t i = 0; i < n; i++ ) along[i + 1] = along[i] + ( pos[( i + 1 ) % n] - pos[i] ).mag();
+
+    auto error = [&]( size_t a, size_t b, size_t k ) {
+      olc::vf2d vA = pos[a % n], vB = pos[b % n], vK = pos[k % n];
+      olc::vf2d vAB = vB - vA;
+      float     t   = vAB.mag2() > 0.0f ? std::clamp( ( vK - vA ).dot( vAB ) / vAB.mag2(), 0.0f, 1.0f ) : 0.0f;
+      float     u   = along[b] > along[a] ? ( along[k] - along[a] ) / ( along[b] - along[a] ) : 0.0f;
+      float     fV  = speed[a % n] + ( speed[b % n] - speed[a % n] ) * u;
+      return std::max( ( vA + vAB * t - vK ).mag() / std::max( params.fSimplify, 1e-3f ),
+                       std::abs( fV - speed[k % n] ) / std::max( params.fSimplifySpeed, 1e-3f ) );
+    };
+
+    // Split first at the point furthest from the start, as the loop ends where it begins
+    size_t nFar = 1;
+    for( size_t i = 1; i < n; i++ )
+      if( ( pos[i] - pos[0] ).mag2() > ( pos[nFar] - pos[0] ).mag2() ) nFar = i;
+
+    std::vector<bool>                      keep( n + 1, false );
+    std::vector<std::pair<size_t, size_t>> spans = { { 0, nFar }, { nFar, n } };
+    keep[0] = keep[nFar] = keep[n] = true;
+    while( !spans.empty() )
+    {
+      auto [a, b] = spans.back();
+      spans.pop_back();
+      size_t nWorst = 0;
+      float  fWorst = 1.0f;
+      for( size_t k = a + 1; k < b; k++ )
+      {
+        float fError = error( a, b, k );
+        if( fError > fWorst )
+        {
+          fWorst = fError;
+          nWorst = k;
+        }
+      }
+      if( nWorst == 0 ) continue;
+      keep[nWorst] = true;
+      spans.push_back( { a, nWorst } );
+      spans.push_back( { nWorst, b } );
+    }
+
+    std::vector<size_t> kept;
+    for( size_t i = 0; i < n; i++ )
+      if( keep[i] ) kept.push_back( i );
+    return kept;
+  }
+
+  RacingLine build( const Track & track, const RacingLineParams & params, RacingLineStats * pStats, ThreadPool * pPool )
+  {
+    RacingLine line;
+    line.trackKey = racingLineKey( track, params );
+    RacingLineStats                stats;
+    const std::vector<olc::vf2d> & loop    = track.centreline();
+    float                          fLength = loopLength( loop );
+    if( loop.size() < 3 || fLength <= 0.0f )
+    {
+      if( pStats ) *pStats = stats;
+      return line;
+    }
+
+    // Each level has half the points of the next, down to the coarsest
+    std::vector<size_t> sizes;
+    size_t nFine = std::max( MIN_LEVEL_POINTS, size_t( fLength / std::max( params.fSpacing, 0.1f ) + 0.5f ) );
+    for( size_t nPoints = nFine; nPoints >= MIN_LEVEL_POINTS; nPoints /= 2 )
+    {
+      sizes.insert( sizes.begin(), nPoints );
+      if( fLength / ( nPoints / 2 ) > MAX_LEVEL_SPACING ) break;
+    }
+
+    // Bilinear between tile centres, so the edge is smooth rather than a staircase the line catches on
+    DistanceField road( track, TileLayer::Road );
+
+    // Each level is solved about a smooth curve through the line the level before found, so the points touching the
+    // edge are mostly already there and the normals turn smoothly, however sharp the corners of the centreline
+    Level                  level;
+    std::vector<olc::vf2d> reference = loop, pos;
+    for( size_t nLevel = 0; nLevel < sizes.size(); nLevel++ )
+    {
+      size_t n = sizes[nLevel];
+      if( nLevel > 0 ) sampleLoop( pos, loopLength( pos ) / ( n * SMOOTH_STEPS ), reference );
+      buildLevel( road, reference, loopLength( reference ), n, params, pPool, level );
+      level.offset.assign( n, 0.0 );
+      stats.nIterations += solveLevel( level, params, pPool );
+      pos.resize( n );
+      for( size_t i = 0; i < n; i++ ) pos[i] = level.centre[i] + level.normal[i] * float( level.offset[i] );
+    }
+    stats.nLevels = uint32_t( sizes.size() );
+    stats.nPoints = uint32_t( pos.size() );
+    for( uint8_t nStatus : level.status ) stats.nTouching += nStatus == AT_LO || nStatus == AT_HI;
+
+    std::vector<float> speed;
+    stats.fLapTime = speedProfile( track, pos, loopLength( pos ) / pos.size(), params, speed );
+    for( size_t i : simplify( pos, speed, params ) )
+      line.points.push_back( { quantise( pos[i].x ), quantise( pos[i].y ), quantise( speed[i] ) } );
+    if( pStats ) *pStats = stats;
+    return line;
+  }
+} // namespace
+
+RacingLine buildRacingLine( const Track & track, const RacingLineParams & params, RacingLineStats * pStats )
+{
+  return build( track, params, pStats, nullptr );
+}
+
+RacingLine buildRacingLine( const Track &            track,
+                            ThreadPool &             pool,
+                            const RacingLineParams & params,
+                            RacingLineStats *        pStats )
+{
+  return build( track, params, pStats, &pool );
+}
+
+uint32_t racingLineKey( const Track & track, const RacingLineParams & params )
+{
+  uint32_t hash = 2166136261u;
+  auto     mix  = [&]( uint32_t v ) {
+    for( int i = 0; i < 4; i++ ) hash = ( hash ^ ( ( v >> ( i * 8 ) ) & 0xFF ) ) * 16777619u;
+  };
+  mix( LINE_VERSION );
+  mix( track.checksum() );
+  mix( uint32_t( track.blockSize().x ) );
+  mix( uint32_t( track.blockSize().y ) );
+  mix( uint32_t( track.centreline().size() ) );
+  for( const olc::vf2d & point : track.centreline() )
+  {
+    mix( floatBits( point.x ) );
+    mix( floatBits( point.y ) );
+  }
+  for( float f : { params.fSpacing,
+                   params.fMargin,
+                   params.fMaxSpeed,
+                   params.fCornerSpeed,
+                   params.fSimplify,
+                   params.fSimplifySpeed } )
+    mix( floatBits( f ) );
+  mix( params.nMaxIterations );
+  return hash;
+}
+
+bool saveRacingLine( const RacingLine & line, const std::string & sFile )
+{
+  BitWriter writer;
+  writer.write( LINE_MAGIC, 32 );
+  writer.write( LINE_VERSION, 32 );
+  writer.write( line.trackKey, 32 );
+  writer.write( uint32_t( line.points.size() ), 32 );
+
+  // Neighbouring points are close together and speeds change slowly, so differences take a few bits each
+  int64_t last[3] = { 0, 0, 0 };
+  for( const RacingLinePoint & point : line.points )
+  {
+    int64_t values[3] = { point.x >> QUANTUM_SHIFT, point.y >> QUANTUM_SHIFT, point.speed >> QUANTUM_SHIFT };
+    for( int k = 0; k < 3; k++ )
+    {
+      int64_t nDelta = values[k] - last[k];
+      if( nDelta < INT32_MIN || nDelta >= INT32_MAX ) return false;
+      writer.writeGamma( zigzag( nDelta ) + 1 );
+      last[k] = values[k];
+    }
+  }
+
+  std::ofstream ofs( sFile, std::ios::binary );
+  if( !ofs.is_open() ) return false;
+  ofs.write( (const char *)writer.bytes().data(), writer.bytes().size() );
+  return ofs.good();
+}
+
+bool loadRacingLine( const std::string & sFile, RacingLine & line )
+{
+  std::ifstream ifs( sFile, std::ios::binary );
+  if( !ifs.is_open() ) return false;
+  std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( ifs ) ), std::istreambuf_iterator<char>() );
+
+  BitReader reader( data.data(), data.size() );
+  if( reader.read( 32 ) != LINE_MAGIC ) return false;
+  if( reader.read( 32 ) != LINE_VERSION ) return false;
+  uint32_t nKey    = reader.read( 32 );
+  uint32_t nPoints = reader.read( 32 );
+
+  // Every point takes at least 3 bits
+  if( reader.overrun() || nPoints > MAX_LINE_POINTS || ( data.size() * 8 - reader.bitPos() ) / 3 < nPoints )
+    return false;
+  std::vector<RacingLinePoint> points( nPoints );
+  int64_t                      last[3] = { 0, 0, 0 };
+  for( RacingLinePoint & point : points )
+  {
+    for( int k = 0; k < 3; k++ )
+    {
+      uint32_t nCode = reader.readGamma();
+      if( nCode == 0 ) return false;
+      last[k] += unzigzag( nCode - 1 );
+    }
+    point = { last[0] << QUANTUM_SHIFT, last[1] << QUANTUM_SHIFT, last[2] << QUANTUM_SHIFT };
+  }
+  if( reader.overrun() ) return false;
+  line.trackKey = nKey;
+  line.points   = std::move( points );
+  return true;
+}
+
+std::string racingLineFile( const std::string & sTrackFile ) { return sTrackFile + ".line"; }
+
+RacingLine cachedRacingLine( const Track &            track,
+                             const std::string &      sTrackFile,
+                             ThreadPool &             pool,
+                             const RacingLineParams & params )
+{
+  RacingLine  line;
+  std::string sFile = racingLineFile( sTrackFile );
+  if( loadRacingLine( sFile, line ) && line.trackKey == racingLineKey( track, params ) ) return line;
+
+  // Tracks without a centreline have nothing worth caching
+  line = buildRacingLine( track, pool, params );
+  if( !line.points.empty() ) saveRacingLine( line, sFile );
+  return line;
+}
+
+uint32_t nearestSegment( const RacingLine & line, const CarStateFx & car )
+{
+  // In sixteenths, where the squares fit comfortably
+  int64_t  cx       = car.x >> QUANTUM_SHIFT;
+  int64_t  cy       = car.y >> QUANTUM_SHIFT;
+  uint32_t nNearest = 0;
+  int64_t  nBest    = INT64_MAX;
+  for( uint32_t i = 0; i < line.points.size(); i++ )
+  {
+    int64_t dx = ( line.points[i].x >> QUANTUM_SHIFT ) - cx;
+    int64_t dy = ( line.points[i].y >> QUANTUM_SHIFT ) - cy;
+    if( dx * dx + dy * dy < nBest )
+    {
+      nBest    = dx * dx + dy * dy;
+      nNearest = i;
+    }
+  }
+  return nNearest;
+}
+
+uint8_t steerAlong( const RacingLine & line, const CarStateFx & car, uint32_t & nSegment )
+{
+  uint32_t n = uint32_t( line.points.size() );
+  if( n < 2 ) return 0;
+  struct Point
+  {
+    int64_t x, y, speed;
+  };
+  auto at = [&]( uint32_t i ) {
+    const RacingLinePoint & p = line.points[i % n];
+    return Point{ p.x >> QUANTUM_SHIFT, p.y >> QUANTUM_SHIFT, p.speed >> QUANTUM_SHIFT };
+  };
+  int64_t cx = car.x >> QUANTUM_SHIFT;
+  int64_t cy = car.y >> QUANTUM_SHIFT;
+
+  // On to the next segment once the car is level with the end of this one
+  nSegment %= n;
+  for( uint32_t k = 0; k < MAX_PASSED; k++ )
+  {
+    Point a = at( nSegment ), b = at( nSegment + 1 );
+    if( ( cx - b.x ) * ( b.x - a.x ) + ( cy - b.y ) * ( b.y - a.y ) < 0 ) break;
+    nSegment = ( nSegment + 1 ) % n;
+  }
+
+  // Where the car is level with on this segment, as a fraction out of 2^16
+  Point   a    = at( nSegment ), b = at( nSegment + 1 );
+  int64_t nLen2 = ( b.x - a.x ) * ( b.x - a.x ) + ( b.y - a.y ) * ( b.y - a.y );
+  int64_t t     = 0;
+  if( nLen2 > 0 )
+  {
+    int64_t nAlong = ( cx - a.x ) * ( b.x - a.x ) + ( cy - a.y ) * ( b.y - a.y );
+    t              = std::clamp<int64_t>( nAlong * 65536 / nLen2, 0, 65536 );
+  }
+  fixed target = ( ( a.speed + ( ( b.speed - a.speed ) * t >> 16 ) ) << QUANTUM_SHIFT );
+
+  // The aim is the look ahead further along the line from there
+  int64_t nAhead = ( LOOK_AHEAD + fixedMul( std::max<fixed>( car.vel, 0 ), LOOK_AHEAD_TIME ) ) >> QUANTUM_SHIFT;
+  int64_t fromX  = a.x + ( ( b.x - a.x ) * t >> 16 );
+  int64_t fromY  = a.y + ( ( b.y - a.y ) * t >> 16 );
+  int64_t aimX   = b.x;
+  int64_t aimY   = b.y;
+  for( uint32_t k = 0; k < MAX_AHEAD; k++ )
+  {
+    Point   to   = at( nSegment + 1 + k );
+    int64_t nGap = isqrt( ( to.x - fromX ) * ( to.x - fromX ) + ( to.y - fromY ) * ( to.y - fromY ) );
+    aimX         = to.x;
+    aimY         = to.y;
+    if( nGap >= nAhead )
+    {
+      if( nGap > 0 )
+      {
+        aimX = fromX + ( to.x - fromX ) * nAhead / nGap;
+        aimY = fromY + ( to.y - fromY ) * nAhead / nGap;
+      }
+      break;
+    }
+    nAhead -= nGap;
+    fromX = to.x;
+    fromY = to.y;
+  }
+
+  // Positive across is the aim being clockwise of the heading, which turning right follows
+  fixed   hx     = fixedSin( car.angle );
+  fixed   hy     = -fixedCos( car.angle );
+  int64_t along  = hx * ( aimX - cx ) + hy * ( aimY - cy );
+  int64_t across = hx * ( aimY - cy ) - hy * ( aimX - cx );
+  uint8_t input  = 0;
+  if( along <= 0 ) input |= across >= 0 ? INPUT_RIGHT : INPUT_LEFT;
+  else if( across > along / 32 )
+    input |= INPUT_RIGHT;
+  else if( across < -along / 32 )
+    input |= INPUT_LEFT;
+
+  if( car.vel < target ) input |= INPUT_ACCEL;
+  else if( car.vel > target + SPEED_SLACK )
+    input |= INPUT_BRAKE;
+  return input;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Physics.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+struct RacingLineParams
+{
+  float    fSpacing       = 4.0f;  // Pixels between the points the line is solved on
+  float    fMargin        = 6.0f;  // Road kept between the line and the grass, a little over half a car
+  uint32_t nMaxIterations = 100;   // Per level, should the points touching the edge not settle
+  float    fMaxSpeed      = 150.0f;
+  float    fCornerSpeed   = 0.9f;   // Of the fastest a car can turn through each bend, leaving it room to correct
+  float    fSimplify      = 0.25f;  // Furthest the saved line strays from the solved one, in pixels
+  float    fSimplifySpeed = 1.0f;   // And its speeds, in pixels per second
+};
+
+// A point on the line and the speed to be doing there. Q16.16 like the simulation but kept to sixteenths, so a saved
+// line loads back exactly.
+struct RacingLinePoint
+{
+  fixed x     = 0;
+  fixed y     = 0;
+  fixed speed = 0;
+};
+
+// Closed loop from the start line in the direction of racing, with only as many points as it takes to follow the
+// solved line to within RacingLineParams::fSimplify
+struct RacingLine
+{
+  uint32_t                     trackKey = 0;  // racingLineKey of what it was built from
+  std::vector<RacingLinePoint> points;
+};
+
+struct RacingLineStats
+{
+  uint32_t nLevels     = 0;
+  uint32_t nIterations = 0;     // Over every level
+  uint32_t nPoints     = 0;     // Solved on at the finest level, before simplifying
+  uint32_t nTouching   = 0;     // Of those, held at the edge of the road
+  float    fLapTime    = 0.0f;  // Driving the line at its speeds, in seconds
+};
+
+// Fast line round a track, for AI cars to follow rather than the middle of the road. The line is the one bending least
+// within the road: each point may only move along the normal of the curve it is solved about, between edges read off
+// the road's distance field less fMargin, and the sum of the squared second differences of the points is minimised
+// by projected Newton. Each step solves the free points exactly, a banded system per stretch between points held at
+// the edge, with the stretches shared out over the pool. It is solved coarse to fine, each level about a smooth curve
+// through the line the level before found, so the slow bends settle on a few points and the finest level only has
+// local work to do.
+//
+// Speeds come from the bends: turning at a fixed rate, a car can take a bend of radius r at up to ROT_RATE * r, and
+// from those limits the speed is brought up and down the line at what tarmac allows accelerating and braking. Tracks
+// without a centreline get an empty line.
+RacingLine buildRacingLine( const Track &            track,
+                            const RacingLineParams & params = RacingLineParams(),
+                            RacingLineStats *        pStats = nullptr );
+RacingLine buildRacingLine( const Track &            track,
+                            ThreadPool &             pool,
+                            const RacingLineParams & params = RacingLineParams(),
+                            RacingLineStats *        pStats = nullptr );
+
+// FNV-1a over the track's checksum, block size and centreline and the params, so a line is rebuilt when any of what it
+// was solved from changes
+uint32_t racingLineKey( const Track & track, const RacingLineParams & params = RacingLineParams() );
+
+// Line files hold the key then each point as the gamma coded difference from the one before, in sixteenths
+bool saveRacingLine( const RacingLine & line, const std::string & sFile );
+bool loadRacingLine( const std::string & sFile, RacingLine & line );
+
+// The line cached beside a track file, sTrackFile + ".line", worked out and saved again if it is missing or was built
+// from something else
+std::string racingLineFile( const std::string & sTrackFile );
+RacingLine  cachedRacingLine( const Track &            track,
+                              const std::string &      sTrackFile,
+                              ThreadPool &             pool,
+                              const RacingLineParams & params = RacingLineParams() );
+
+// Segment of the line nearest a car, to start following it from
+uint32_t nearestSegment( const RacingLine & line, const CarStateFx & car );
+
+// Controls for a car following the line, nSegment being the segment it is on, moved along as the car passes each point.
+// It steers for a point a little further along the line the faster it goes, and speeds up or brakes to the speed
+// there is to be doing where it is. Fixed point, so the same everywhere.
+uint8_t steerAlong( const RacingLine & line, const CarStateFx & car, uint32_t & nSegment );
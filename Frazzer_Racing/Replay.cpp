@@ -0,0 +1,277 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "Checkpoints.h"
+#include "Simulation.h"
+
+namespace
+{
+  const uint32_t REPLAY_MAGIC   = 0x50525246;  // "FRRP"
+  const uint32_t REPLAY_VERSION = 4;  // 2 added the keyframe index, 3 surfaces under the wheels, 4 lap times
+
+  // Replays from before surfaces drove differently off the road, so can't be played back
+  const uint32_t REPLAY_OLDEST = 3;
+
+  const uint32_t KEYFRAME_BYTES_V3 = 36;
+  const uint32_t KEYFRAME_BYTES    = 88;
+
+  void writeLaps( BitWriter & writer, const LapTimes & laps )
+  {
+    writer.write( laps.nLaps, 32 );
+    writer.write( laps.nNextGate, 32 );
+    writer.write( laps.nLastSector, 32 );
+    writer.write64( uint64_t( laps.nLapStartUs ) );
+    writer.write64( uint64_t( laps.nSectorStartUs ) );
+    writer.write64( uint64_t( laps.nLastLapUs ) );
+    writer.write64( uint64_t( laps.nBestLapUs ) );
+    writer.write64( uint64_t( laps.nLastSectorUs ) );
+  }
+
+  LapTimes readLaps( BitReader & reader )
+  {
+    LapTimes laps;
+    laps.nLaps          = reader.read( 32 );
+    laps.nNextGate      = reader.read( 32 );
+    laps.nLastSector    = reader.read( 32 );
+    laps.nLapStartUs    = int64_t( reader.read64() );
+    laps.nSectorStartUs = int64_t( reader.read64() );
+    laps.nLastLapUs     = int64_t( reader.read64() );
+    laps.nBestLapUs     = int64_t( reader.read64() );
+    laps.nLastSectorUs  = int64_t( reader.read64() );
+    return laps;
+  }
+} // namespace
+
+bool saveReplay( const Replay & replay, const std::string & sFile )
+{
+  BitWriter header;
+  header.write( REPLAY_MAGIC, 32 );
+  header.write( REPLAY_VERSION, 32 );
+  header.write( TICK_RATE, 32 );
+  header.write( replay.trackChecksum, 32 );
+  header.write( replay.nTicks, 32 );
+  header.write64( uint64_t( replay.start.x ) );
+  header.write64( uint64_t( replay.start.y ) );
+  header.write64( uint64_t( replay.start.vel ) );
+  header.write( replay.start.angle, 32 );
+  header.write( replay.startTick, 32 );
+  writeLaps( header, replay.startLaps );
+  header.write( uint32_t( replay.stream.size() ), 32 );
+
+  // The index follows the stream, tick numbers are implied by the interval
+  BitWriter index;
+  index.write( replay.keyframeInterval, 32 );
+  index.write( uint32_t( replay.keyframes.size() ), 32 );
+  for( const ReplayKeyframe & key : replay.keyframes )
+  {
+    index.write64( uint64_t( key.car.x ) );
+    index.write64( uint64_t( key.car.y ) );
+    index.write64( uint64_t( key.car.vel ) );
+    index.write( key.car.angle, 32 );
+    writeLaps( index, key.laps );
+    index.write( key.bitPos, 32 );
+    index.write( key.runSkip, 32 );
+  }
+
+  std::ofstream ofs( sFile, std::ios::binary );
+  if( !ofs.is_open() ) return false;
+  ofs.write( (const char *)header.bytes().data(), header.bytes().size() );
+  ofs.write( (const char *)replay.stream.data(), replay.stream.size() );
+  ofs.write( (const char *)index.bytes().data(), index.bytes().size() );
+  return ofs.good();
+}
+
+bool loadReplay( const std::string & sFile, Replay & replay )
+{
+  std::ifstream ifs( sFile, std::ios::binary );
+  if( !ifs.is_open() ) return false;
+  std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( ifs ) ), std::istreambuf_iterator<char>() );
+
+  BitReader reader( data.data(), data.size() );
+  if( reader.read( 32 ) != REPLAY_MAGIC ) return false;
+  uint32_t nVersion = reader.read( 32 );
+  if( nVersion < REPLAY_OLDEST || nVersion > REPLAY_VERSION ) return false;
+  if( reader.read( 32 ) != uint32_t( TICK_RATE ) ) return false;
+  replay.trackChecksum = reader.read( 32 );
+  replay.nTicks        = reader.read( 32 );
+  replay.start.x       = fixed( reader.read64() );
+  replay.start.y       = fixed( reader.read64() );
+  replay.start.vel     = fixed( reader.read64() );
+  replay.start.angle   = reader.read( 32 );
+  replay.startTick     = nVersion >= 4 ? reader.read( 32 ) : 0;
+  replay.startLaps     = nVersion >= 4 ? readLaps( reader ) : LapTimes();
+  uint32_t nBytes      = reader.read( 32 );
+
+  size_t nOffset = reader.bitPos() / 8;
+  if( reader.overrun() || data.size() - nOffset < nBytes ) return false;
+  replay.stream.assign( data.begin() + nOffset, data.begin() + nOffset + nBytes );
+
+  replay.keyframes.clear();
+  BitReader index( data.data(), data.size(), ( nOffset + nBytes ) * 8 );
+  replay.keyframeInterval = index.read( 32 );
+  uint32_t nKeyframes     = index.read( 32 );
+  uint32_t nKeyBytes      = nVersion >= 4 ? KEYFRAME_BYTES : KEYFRAME_BYTES_V3;
+  if( index.overrun() || ( data.size() - nOffset - nBytes - 8 ) / nKeyBytes < nKeyframes ) return false;
+  replay.keyframes.resize( nKeyframes );
+  for( uint32_t i = 0; i < nKeyframes; i++ )
+  {
+    ReplayKeyframe & key = replay.keyframes[i];
+    key.tick             = i * replay.keyframeInterval;
+    key.car.x            = fixed( index.read64() );
+    key.car.y            = fixed( index.read64() );
+    key.car.vel          = fixed( index.read64() );
+    key.car.angle        = index.read( 32 );
+    key.laps             = nVersion >= 4 ? readLaps( index ) : LapTimes();
+    key.bitPos           = index.read( 32 );
+    key.runSkip          = index.read( 32 );
+  }
+  if( index.overrun() ) return false;
+
+  // Older keyframes don't know the lap times, so those replays seek from the start instead
+  if( nVersion < 4 )
+  {
+    replay.keyframeInterval = 0;
+    replay.keyframes.clear();
+  }
+  return true;
+}
+
+void ReplayRecorder::begin( const CarStateFx & start, uint32_t trackChecksum, uint32_t nKeyframeInterval )
+{
+  replay                  = Replay();
+  replay.start            = start;
+  replay.trackChecksum    = trackChecksum;
+  replay.keyframeInterval = nKeyframeInterval;
+  writer                  = BitWriter();
+  runLength               = 0;
+  bRecording              = true;
+}
+
+void ReplayRecorder::begin( const GameState & state, uint32_t nKeyframeInterval )
+{
+  begin( state.cars[0], state.trackChecksum, nKeyframeInterval );
+  replay.startTick = state.tick;
+  replay.startLaps = state.laps[0];
+}
+
+void ReplayRecorder::record( uint8_t input, const CarStateFx & car, const LapTimes & laps )
+{
+  if( !bRecording ) return;
+
+  input &= 0x0F;
+  if( runLength > 0 && input != runInput )
+  {
+    writer.write( runInput, 4 );
+    writer.writeGamma( runLength );
+    runLength = 0;
+  }
+
+  // The pending run is written at the current end of the stream once it finishes
+  if( replay.keyframeInterval > 0 && replay.nTicks % replay.keyframeInterval == 0 )
+    replay.keyframes.push_back( { replay.nTicks, car, laps, uint32_t( writer.bitCount() ), runLength } );
+
+  runInput = input;
+  runLength++;
+  replay.nTicks++;
+}
+
+Replay ReplayRecorder::current() const
+{
+  Replay    r = replay;
+  BitWriter w = writer;
+  if( runLength > 0 )
+  {
+    w.write( runInput, 4 );
+    w.writeGamma( runLength );
+  }
+  r.stream = w.bytes();
+  return r;
+}
+
+ReplayReader::ReplayReader( const Replay & replay )
+  : pReplay( &replay ), reader( replay.stream.data(), replay.stream.size() )
+{}
+
+bool ReplayReader::next( uint8_t & input )
+{
+  if( pReplay == nullptr || nTick >= pReplay->nTicks ) return false;
+
+  if( runRemain == 0 )
+  {
+    runInput  = uint8_t( reader.read( 4 ) );
+    runRemain = reader.readGamma();
+    if( reader.overrun() || runRemain == 0 ) return false;
+  }
+  input = runInput;
+  runRemain--;
+  nTick++;
+  return true;
+}
+
+void ReplayReader::seek( uint32_t nTarget, const Track & track, CarStateFx & car )
+{
+  seekTo( nTarget, track, nullptr, car, nullptr );
+}
+
+void ReplayReader::seek( uint32_t            nTarget,
+                         const Track &       track,
+                         const Checkpoints & checkpoints,
+                         CarStateFx &        car,
+                         LapTimes &          laps )
+{
+  seekTo( nTarget, track, &checkpoints, car, &laps );
+}
+
+void ReplayReader::seekTo( uint32_t            nTarget,
+                           const Track &       track,
+                           const Checkpoints * pCheckpoints,
+                           CarStateFx &        car,
+                           LapTimes *          pLaps )
+{
+  if( pReplay == nullptr ) return;
+  nTarget = std::min( nTarget, pReplay->nTicks );
+
+  // Keyframes are evenly spaced, so the nearest earlier one is found by division
+  car       = pReplay->start;
+  if( pLaps ) *pLaps = pReplay->startLaps;
+  nTick     = 0;
+  runRemain = 0;
+  reader    = BitReader( pReplay->stream.data(), pReplay->stream.size() );
+  if( pReplay->keyframeInterval > 0 && !pReplay->keyframes.empty() )
+  {
+    size_t                 nKey = std::min<size_t>( nTarget / pReplay->keyframeInterval,
+                                                    pReplay->keyframes.size() - 1 );
+    const ReplayKeyframe & key  = pReplay->keyframes[nKey];
+    car                         = key.car;
+    nTick                       = key.tick;
+    if( pLaps ) *pLaps = key.laps;
+    reader = BitReader( pReplay->stream.data(), pReplay->stream.size(), key.bitPos );
+    if( nTick < pReplay->nTicks )
+    {
+      runInput  = uint8_t( reader.read( 4 ) );
+      runRemain = reader.readGamma() - key.runSkip;
+    }
+  }
+
+  // Lap times run on the race clock, which the recording joined at startTick
+  SinCos  heading = fixedSinCos( car.angle );
+  uint8_t input;
+  while( nTick < nTarget && next( input ) )
+  {
+    CarStateFx before = car;
+    simulateTick( car, heading, input, track );
+    if( pCheckpoints && pLaps ) pCheckpoints->update( pLaps, &before, &car, 1, pReplay->startTick + nTick - 1 );
+  }
+}
+
+CarStateFx simulateReplay( const Replay & replay, const Track & track )
+{
+  CarStateFx   car     = replay.start;
+  SinCos       heading = fixedSinCos( car.angle );
+  ReplayReader reader( replay );
+  uint8_t      input;
+  while( reader.next( input ) ) simulateTick( car, heading, input, track );
+  return car;
+}
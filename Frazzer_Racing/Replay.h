@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "BitStream.h"
+#include "GameState.h"
+#include "Physics.h"
+#include "Track.h"
+
+class Checkpoints;
+
+// Full simulation state at the start of a tick plus where that tick sits in the input stream, so playback can
+// resume from here without simulating everything before it
+struct ReplayKeyframe
+{
+  uint32_t   tick = 0;
+  CarStateFx car;
+  LapTimes   laps;
+  uint32_t   bitPos  = 0;  // Start of the run holding this tick
+  uint32_t   runSkip = 0;  // Ticks of that run already played
+};
+
+// Ten seconds between keyframes costs 216 bytes a minute and bounds a seek to 600 simulated ticks
+const uint32_t DEFAULT_KEYFRAME_INTERVAL = 10 * TICK_RATE;
+
+// A recorded race: the starting state plus every tick's held controls. The input stream is run-length encoded,
+// each run being the 4 input bits followed by its length as an Elias gamma code. Keyframes every
+// keyframeInterval ticks are kept in a side index, keyframes[i] being tick i * keyframeInterval. Ticks count from the
+// start of the recording, which was startTick on the race clock.
+struct Replay
+{
+  uint32_t                    trackChecksum = 0;
+  CarStateFx                  start;
+  uint32_t                    startTick = 0;
+  LapTimes                    startLaps;
+  uint32_t                    nTicks = 0;
+  std::vector<uint8_t>        stream;
+  uint32_t                    keyframeInterval = 0;  // 0 for no index
+  std::vector<ReplayKeyframe> keyframes;
+};
+
+bool saveReplay( const Replay & replay, const std::string & sFile );
+bool loadReplay( const std::string & sFile, Replay & replay );
+
+class ReplayRecorder
+{
+public:
+  // A smaller interval makes seeking faster and the file bigger, 0 records no keyframes
+  void begin( const CarStateFx & start,
+              uint32_t           trackChecksum,
+              uint32_t           nKeyframeInterval = DEFAULT_KEYFRAME_INTERVAL );
+
+  // Car 0 of a race from where it is, with the race clock and its lap times
+  void begin( const GameState & state, uint32_t nKeyframeInterval = DEFAULT_KEYFRAME_INTERVAL );
+  void stop() { bRecording = false; }
+
+  // `car` and `laps` are the state the input is about to be applied to, laps being kept at the keyframes
+  void record( uint8_t input, const CarStateFx & car, const LapTimes & laps = LapTimes() );
+
+  bool   recording() const { return bRecording; }
+  Replay current() const;  // Everything so far, including the run still in progress
+
+private:
+  Replay    replay;
+  BitWriter writer;
+  bool      bRecording = false;
+  uint8_t   runInput   = 0;
+  uint32_t  runLength  = 0;
+};
+
+class ReplayReader
+{
+public:
+  ReplayReader() = default;
+  explicit ReplayReader( const Replay & replay );
+
+  // Input for the next tick, false once the recording is exhausted
+  bool     next( uint8_t & input );
+  uint32_t tick() const { return nTick; }
+
+  // Puts the reader at nTarget (clamped to the end) and sets `car` to the state there, by restoring the nearest
+  // earlier keyframe and simulating the ticks after it
+  void seek( uint32_t nTarget, const Track & track, CarStateFx & car );
+
+  // As above, also timing the ticks simulated through the gates so `laps` is as the car had them at nTarget
+  void seek( uint32_t            nTarget,
+             const Track &       track,
+             const Checkpoints & checkpoints,
+             CarStateFx &        car,
+             LapTimes &          laps );
+
+private:
+  void seekTo( uint32_t            nTarget,
+               const Track &       track,
+               const Checkpoints * pCheckpoints,
+               CarStateFx &        car,
+               LapTimes *          pLaps );
+
+  const Replay * pReplay = nullptr;
+  BitReader      reader;
+  uint32_t       nTick     = 0;
+  uint8_t        runInput  = 0;
+  uint32_t       runRemain = 0;
+};
+
+// Re-simulates a whole replay headless as fast as possible and returns the final car state
+CarStateFx simulateReplay( const Replay & replay, const Track & track );
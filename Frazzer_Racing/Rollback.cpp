@@ -0,0 +1,148 @@
+#include "Rollback.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "BitStream.h"
+#include "Simulation.h"
+
+namespace
+{
+  const uint32_t PACKET_MAGIC = 0x4652;  // "FR"
+  const uint32_t MAX_RESEND   = 128;     // Inputs per packet, 4 bits each
+} // namespace
+
+RollbackSession::RollbackSession( const Track &       track,
+                                  const GameState &   start,
+                                  int                 nLocalPlayer,
+                                  UdpSocket &         socket,
+                                  const NetAddress &  remote,
+                                  const Checkpoints * pCheckpoints )
+  : track( track )
+  , pCheckpoints( pCheckpoints )
+  , socket( socket )
+  , remote( remote )
+  , nLocalPlayer( nLocalPlayer )
+  , state( start )
+  , history( MAX_ROLLBACK + 1 )
+  , nRemoteConfirmed( start.tick )
+  , nRemoteAcked( start.tick )
+  , nStartTick( start.tick )
+{
+  state.nCars = std::max<uint32_t>( state.nCars, 2 );
+}
+
+bool RollbackSession::advance( uint8_t localInput )
+{
+  receive();
+  if( state.tick >= nRemoteConfirmed + MAX_ROLLBACK )
+  {
+    counters.nStalls++;
+    send();
+    return false;
+  }
+
+  localInputs[state.tick % INPUT_WINDOW] = localInput & 0x0F;
+  uint8_t remoteInput = state.tick < nRemoteConfirmed ? remoteInputs[state.tick % INPUT_WINDOW] : predictRemote();
+  simulate( remoteInput );
+  send();
+  return true;
+}
+
+void RollbackSession::poll()
+{
+  receive();
+  send();
+}
+
+uint8_t RollbackSession::predictRemote() const
+{
+  return nRemoteConfirmed > nStartTick ? remoteInputs[( nRemoteConfirmed - 1 ) % INPUT_WINDOW] : 0;
+}
+
+void RollbackSession::simulate( uint8_t remoteInput )
+{
+  uint8_t inputs[2];
+  inputs[nLocalPlayer]     = localInputs[state.tick % INPUT_WINDOW];
+  inputs[1 - nLocalPlayer] = remoteInput;
+  remoteInputs[state.tick % INPUT_WINDOW] = remoteInput;
+
+  history.push( state );
+  GameState before = state;
+  simulateTick( state, inputs, track );
+  if( pCheckpoints ) pCheckpoints->update( state.laps, before, state );
+}
+
+void RollbackSession::rollback( uint32_t nFrom )
+{
+  auto     start = std::chrono::steady_clock::now();
+  uint32_t nTo   = state.tick;
+
+  // Stalling keeps nFrom within MAX_ROLLBACK ticks, so its snapshot is always still in the ring
+  history.find( nFrom, state );
+  history.discardFrom( nFrom );
+  while( state.tick < nTo )
+  {
+    uint8_t remoteInput = state.tick < nRemoteConfirmed ? remoteInputs[state.tick % INPUT_WINDOW] : predictRemote();
+    simulate( remoteInput );
+  }
+
+  double fMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+  counters.nRollbacks++;
+  counters.nResimTicks += nTo - nFrom;
+  counters.nMaxResim   = std::max( counters.nMaxResim, nTo - nFrom );
+  counters.fResimMs += fMs;
+  counters.fMaxResimMs = std::max( counters.fMaxResimMs, fMs );
+}
+
+void RollbackSession::receive()
+{
+  uint32_t   nMispredicted = UINT32_MAX;
+  uint8_t    packet[512];
+  NetAddress from;
+  int        nBytes;
+  while( ( nBytes = socket.receive( packet, sizeof( packet ), from ) ) >= 0 )
+  {
+    if( from != remote ) continue;
+    BitReader reader( packet, size_t( nBytes ) );
+    if( reader.read( 16 ) != PACKET_MAGIC ) continue;
+    uint32_t nAck   = reader.read( 32 );
+    uint32_t nFirst = reader.read( 32 );
+    uint32_t nCount = reader.read( 8 );
+    if( reader.overrun() ) continue;
+    counters.nPacketsRecvd++;
+    nRemoteAcked = std::max( nRemoteAcked, std::min( nAck, state.tick ) );
+
+    // Only inputs carrying on from what we already have are taken, anything after a gap gets resent
+    for( uint32_t i = 0; i < nCount; i++ )
+    {
+      uint32_t tick  = nFirst + i;
+      uint8_t  input = uint8_t( reader.read( 4 ) );
+      if( reader.overrun() || tick > nRemoteConfirmed ) break;
+      if( tick < nRemoteConfirmed ) continue;
+
+      // Ticks we have already simulated used a prediction, which may have been wrong
+      if( tick < state.tick && remoteInputs[tick % INPUT_WINDOW] != input )
+        nMispredicted = std::min( nMispredicted, tick );
+      remoteInputs[tick % INPUT_WINDOW] = input;
+      nRemoteConfirmed++;
+    }
+  }
+
+  if( nMispredicted != UINT32_MAX ) rollback( nMispredicted );
+}
+
+void RollbackSession::send()
+{
+  uint32_t nFirst = std::max( nRemoteAcked, state.tick - std::min( state.tick - nStartTick, INPUT_WINDOW - 1 ) );
+  uint32_t nCount = std::min( state.tick - nFirst, MAX_RESEND );
+
+  BitWriter writer;
+  writer.write( PACKET_MAGIC, 16 );
+  writer.write( nRemoteConfirmed, 32 );
+  writer.write( nFirst, 32 );
+  writer.write( nCount, 8 );
+  for( uint32_t i = 0; i < nCount; i++ ) writer.write( localInputs[( nFirst + i ) % INPUT_WINDOW], 4 );
+  socket.send( remote, writer.bytes().data(), writer.bytes().size() );
+  counters.nPacketsSent++;
+}
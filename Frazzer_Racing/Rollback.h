@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+
+#include "Checkpoints.h"
+#include "GameState.h"
+#include "Net.h"
+#include "Track.h"
+
+struct RollbackStats
+{
+  uint32_t nRollbacks    = 0;
+  uint32_t nResimTicks   = 0;  // Over all rollbacks
+  uint32_t nMaxResim     = 0;  // Most ticks re-simulated by one rollback
+  double   fResimMs      = 0.0;
+  double   fMaxResimMs   = 0.0;
+  uint32_t nStalls       = 0;  // Ticks not advanced because the remote player was too far behind
+  uint32_t nPacketsSent  = 0;
+  uint32_t nPacketsRecvd = 0;
+};
+
+// Two player race over UDP without input delay. Local input is applied straight away and the remote player is
+// predicted to keep holding what they last sent. When their real input for an already simulated tick differs, the
+// state from before that tick is restored from a snapshot ring and the ticks since are simulated again, all within
+// the call that received it. Every packet resends the inputs the other side has not acknowledged, so losses are
+// covered by the next packet.
+class RollbackSession
+{
+public:
+  static constexpr uint32_t MAX_ROLLBACK = 60;  // Ticks we may run ahead of the remote player's confirmed input
+
+  // With checkpoints, every tick simulated times the cars through the gates into the state's laps, so ticks
+  // re-simulated after a misprediction are timed again as they really went
+  RollbackSession( const Track &       track,
+                   const GameState &   start,
+                   int                 nLocalPlayer,
+                   UdpSocket &         socket,
+                   const NetAddress &  remote,
+                   const Checkpoints * pCheckpoints = nullptr );
+
+  // Simulates one tick with this input. Returns false without simulating when the remote player has fallen
+  // MAX_ROLLBACK ticks behind, the caller should try again next tick.
+  bool advance( uint8_t localInput );
+
+  // Sends and receives without advancing, rolling back if new input arrived. Used while waiting or finishing.
+  void poll();
+
+  const GameState &     current() const { return state; }
+  uint32_t              confirmedTicks() const { return nRemoteConfirmed; }  // Remote input known before this tick
+  uint32_t              ackedTicks() const { return nRemoteAcked; }          // Local input the remote has confirmed
+  const RollbackStats & stats() const { return counters; }
+
+private:
+  static constexpr uint32_t INPUT_WINDOW = 256;  // Inputs kept per player, comfortably more than MAX_ROLLBACK
+
+  void    receive();
+  void    send();
+  void    simulate( uint8_t remoteInput );
+  void    rollback( uint32_t nFrom );
+  uint8_t predictRemote() const;
+
+  const Track &       track;
+  const Checkpoints * pCheckpoints;
+  UdpSocket &         socket;
+  NetAddress          remote;
+  int                 nLocalPlayer;
+  GameState           state;
+  SnapshotRing        history;
+  RollbackStats       counters;
+  std::array<uint8_t, INPUT_WINDOW> localInputs  = {};
+  std::array<uint8_t, INPUT_WINDOW> remoteInputs = {};  // Confirmed, or the prediction that was simulated
+  uint32_t                          nRemoteConfirmed = 0;
+  uint32_t                          nRemoteAcked     = 0;
+  uint32_t                          nStartTick       = 0;
+};
@@ -0,0 +1,107 @@
+#include "RotationCache.h"
+
+#include <cmath>
+
+RotationCache::RotationCache( const ConstSpriteView & src, const olc::vf2d & vCentre, int nBuckets )
+{
+  const float TWO_PI = 6.2831853f;
+  frames.resize( nBuckets );
+
+  for( int n = 0; n < nBuckets; n++ )
+  {
+    float fAngle = TWO_PI * n / nBuckets;
+    float c      = std::cos( fAngle );
+    float s      = std::sin( fAngle );
+
+    // Bounds of the rotated source rectangle around the centre
+    olc::vf2d vMin = { 1e9f, 1e9f };
+    olc::vf2d vMax = { -1e9f, -1e9f };
+    for( olc::vf2d corner : { olc::vf2d( 0, 0 ),
+                              olc::vf2d( float( src.width ), 0 ),
+                              olc::vf2d( 0, float( src.height ) ),
+                              olc::vf2d( float( src.width ), float( src.height ) ) } )
+    {
+      olc::vf2d d = corner - vCentre;
+      olc::vf2d r = { d.x * c - d.y * s, d.x * s + d.y * c };
+      vMin        = vMin.min( r );
+      vMax        = vMax.max( r );
+    }
+    olc::vi2d vLo = { int32_t( std::floor( vMin.x ) ), int32_t( std::floor( vMin.y ) ) };
+    olc::vi2d vHi = { int32_t( std::ceil( vMax.x ) ), int32_t( std::ceil( vMax.y ) ) };
+
+    // Inverse map every pixel centre back into the source, nearest neighbour
+    std::vector<olc::Pixel> full( size_t( vHi.x - vLo.x ) * ( vHi.y - vLo.y ), olc::BLANK );
+    olc::vi2d               vUsedMin = vHi;
+    olc::vi2d               vUsedMax = vLo - olc::vi2d( 1, 1 );
+    for( int32_t y = vLo.y; y < vHi.y; y++ )
+    {
+      for( int32_t x = vLo.x; x < vHi.x; x++ )
+      {
+        float   dx = x + 0.5f;
+        float   dy = y + 0.5f;
+        float   sx = dx * c + dy * s + vCentre.x;
+        float   sy = -dx * s + dy * c + vCentre.y;
+        int32_t ix = int32_t( std::floor( sx ) );
+        int32_t iy = int32_t( std::floor( sy ) );
+        if( ix < 0 || iy < 0 || ix >= src.width || iy >= src.height || src.at( ix, iy ).a == 0 ) continue;
+
+        full[size_t( y - vLo.y ) * ( vHi.x - vLo.x ) + ( x - vLo.x )] = src.at( ix, iy );
+        vUsedMin = vUsedMin.min( { x, y } );
+        vUsedMax = vUsedMax.max( { x, y } );
+      }
+    }
+
+    // Crop to the pixels actually covered
+    RotatedFrame & f = frames[n];
+    f.vOffset        = vUsedMin;
+    f.width          = std::max( vUsedMax.x - vUsedMin.x + 1, 0 );
+    f.height         = std::max( vUsedMax.y - vUsedMin.y + 1, 0 );
+    f.nMaskWords     = ( f.width + 63 ) / 64;
+    f.pixels.assign( size_t( f.width ) * f.height, olc::BLANK );
+    f.mask.assign( size_t( f.nMaskWords ) * f.height, 0 );
+    for( int32_t y = 0; y < f.height; y++ )
+    {
+      for( int32_t x = 0; x < f.width; x++ )
+      {
+        olc::Pixel p = full[size_t( y + f.vOffset.y - vLo.y ) * ( vHi.x - vLo.x ) + ( x + f.vOffset.x - vLo.x )];
+        if( p.a == 0 ) continue;
+        f.pixels[size_t( y ) * f.width + x] = p;
+        f.mask[size_t( y ) * f.nMaskWords + x / 64] |= uint64_t( 1 ) << ( x % 64 );
+      }
+    }
+  }
+}
+
+const RotatedFrame & RotationCache::frame( float fAngle ) const
+{
+  const float TWO_PI = 6.2831853f;
+  int         n      = int( frames.size() );
+  int         i      = int( std::floor( fAngle / TWO_PI * n + 0.5f ) ) % n;
+  return frames[i < 0 ? i + n : i];
+}
+
+void RotationCache::draw( const SpriteView & target, const olc::vf2d & pos, float fAngle ) const
+{
+  if( frames.empty() ) return;
+
+  const RotatedFrame & f  = frame( fAngle );
+  olc::vi2d            vO = olc::vi2d( int32_t( std::floor( pos.x ) ), int32_t( std::floor( pos.y ) ) ) + f.vOffset;
+
+  // Clip the frame to the target
+  int32_t x0 = std::max( -vO.x, 0 );
+  int32_t y0 = std::max( -vO.y, 0 );
+  int32_t x1 = std::min( f.width, target.width - vO.x );
+  int32_t y1 = std::min( f.height, target.height - vO.y );
+
+  for( int32_t y = y0; y < y1; y++ )
+  {
+    const olc::Pixel * pSrc  = f.pixels.data() + size_t( y ) * f.width;
+    const uint64_t *   pMask = f.mask.data() + size_t( y ) * f.nMaskWords;
+    olc::Pixel *       pDst  = target.row( vO.y + y ) + vO.x;
+    for( int32_t x = x0; x < x1; x++ )
+    {
+      bool bCovered = ( ( pMask[x / 64] >> ( x % 64 ) ) & 1 ) != 0;
+      pDst[x]       = bCovered ? pSrc[x] : pDst[x];
+    }
+  }
+}
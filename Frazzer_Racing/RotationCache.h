@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "SpriteView.h"
+#include "olcPixelGameEngine.h"
+
+// A sprite pre-rendered at one angle, cropped to its opaque pixels
+struct RotatedFrame
+{
+  olc::vi2d               vOffset;  // Top left of the frame relative to the rotation centre
+  int32_t                 width  = 0;
+  int32_t                 height = 0;
+  int32_t                 nMaskWords = 0;  // 64 bit mask words per row
+  std::vector<olc::Pixel> pixels;
+  std::vector<uint64_t>   mask;  // 1 bit per pixel, set where the frame covers the target
+};
+
+// Software stand-in for DrawRotatedDecal: the sprite is rotated into N angle buckets once at load, so drawing
+// at any angle is a single masked blit with no trig or sampling per pixel
+class RotationCache
+{
+public:
+  RotationCache() = default;
+  RotationCache( const ConstSpriteView & src, const olc::vf2d & vCentre, int nBuckets = 64 );
+
+  const RotatedFrame & frame( float fAngle ) const;
+
+  // Same placement and rotation direction as DrawRotatedDecal( pos, decal, fAngle, vCentre )
+  void draw( const SpriteView & target, const olc::vf2d & pos, float fAngle ) const;
+
+private:
+  std::vector<RotatedFrame> frames;
+};
@@ -0,0 +1,301 @@
+#include "Server.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "BitStream.h"
+#include "Simulation.h"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  const uint32_t CLIENT_TIMEOUT_TICKS = 5 * TICK_RATE;
+
+  double secondsSince( Clock::time_point start )
+  {
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+  }
+
+  void writeHeader( BitWriter & writer, ServerPacket type )
+  {
+    writer.write( SERVER_MAGIC, 16 );
+    writer.write( uint32_t( type ), 8 );
+  }
+
+  bool readHeader( BitReader & reader, ServerPacket & type )
+  {
+    if( reader.read( 16 ) != SERVER_MAGIC ) return false;
+    type = ServerPacket( reader.read( 8 ) );
+    return !reader.overrun();
+  }
+} // namespace
+
+RaceServer::RaceServer( const Track & track, size_t nSessions, ThreadPool & pool )
+  : track( track ), pool( pool ), sessions( nSessions )
+{
+  for( ServerSession & session : sessions ) session.state = startingGrid( MAX_CARS, track );
+}
+
+bool RaceServer::open( uint16_t nPort ) { return socket.open( nPort ); }
+
+void RaceServer::receive()
+{
+  uint8_t    packet[512];
+  NetAddress from;
+  int        nBytes;
+  while( ( nBytes = socket.receive( packet, sizeof( packet ), from ) ) >= 0 )
+  {
+    counters.nPacketsIn++;
+    BitReader    reader( packet, size_t( nBytes ) );
+    ServerPacket type;
+    if( !readHeader( reader, type ) ) continue;
+
+    if( type == ServerPacket::Join )
+    {
+      join( from, reader.read( 32 ) );
+      continue;
+    }
+
+    // Everything else names a slot, and must come from whoever holds it
+    uint32_t nSession = reader.read( 32 );
+    uint32_t nSlot    = reader.read( 8 );
+    if( reader.overrun() || nSession >= sessions.size() || nSlot >= MAX_CARS ) continue;
+    ServerSession & session = sessions[nSession];
+    if( !session.connected[nSlot] || session.clients[nSlot] != from ) continue;
+
+    session.lastHeard[nSlot] = nServerTick;
+    if( type == ServerPacket::Input )
+    {
+      // Only the latest input matters to the server
+      uint32_t nAck  = reader.read( 32 );
+      uint8_t  input = uint8_t( reader.read( 4 ) );
+      if( reader.overrun() ) continue;
+      session.inputs[nSlot] = input;
+      if( nAck != NO_BASELINE && ( session.acked[nSlot] == NO_BASELINE || nAck > session.acked[nSlot] ) )
+        session.acked[nSlot] = std::min( nAck, session.state.tick );
+    }
+    else if( type == ServerPacket::Leave )
+      session.connected[nSlot] = false;
+  }
+}
+
+void RaceServer::join( const NetAddress & from, uint32_t nWanted )
+{
+  // A repeated join, because our welcome was lost, gets the same slot back
+  uint32_t nSession = ANY_SESSION;
+  uint32_t nSlot    = FULL_SLOT;
+  for( uint32_t s = 0; s < sessions.size() && nSlot == FULL_SLOT; s++ )
+    for( uint32_t c = 0; c < MAX_CARS && nSlot == FULL_SLOT; c++ )
+      if( sessions[s].connected[c] && sessions[s].clients[c] == from ) nSession = s, nSlot = c;
+
+  for( uint32_t s = 0; s < sessions.size() && nSlot == FULL_SLOT; s++ )
+  {
+    if( nWanted != ANY_SESSION && s != nWanted ) continue;
+    for( uint32_t c = 0; c < MAX_CARS && nSlot == FULL_SLOT; c++ )
+    {
+      if( sessions[s].connected[c] ) continue;
+      ServerSession & session = sessions[s];
+      session.connected[c]    = true;
+      session.clients[c]      = from;
+      session.lastHeard[c]    = nServerTick;
+      session.inputs[c]       = 0;
+      session.acked[c]        = NO_BASELINE;
+      nSession                = s;
+      nSlot                   = c;
+    }
+  }
+
+  BitWriter writer;
+  writeHeader( writer, ServerPacket::Welcome );
+  writer.write( nSession, 32 );
+  writer.write( nSlot, 8 );
+  socket.send( from, writer.bytes().data(), writer.bytes().size() );
+  counters.nPacketsOut++;
+}
+
+void RaceServer::simulate( ServerSession & session )
+{
+  auto start = Clock::now();
+
+  uint8_t inputs[MAX_CARS];
+  for( uint32_t i = 0; i < MAX_CARS; i++ )
+  {
+    if( session.connected[i] && nServerTick - session.lastHeard[i] > CLIENT_TIMEOUT_TICKS )
+      session.connected[i] = false;
+    inputs[i] = session.connected[i] ? session.inputs[i] : scriptedInput( int( session.state.tick + i * 45 ) );
+  }
+  simulateTick( session.state, inputs, track );
+
+  // Quantise once, then delta each client against what it last acknowledged
+  session.encoder.capture( session.state.tick, session.state.cars, session.state.nCars );
+  for( uint32_t i = 0; i < MAX_CARS; i++ )
+  {
+    if( !session.connected[i] ) continue;
+    BitWriter writer;
+    writeHeader( writer, ServerPacket::State );
+    writer.write( uint32_t( &session - sessions.data() ), 32 );
+    session.encoder.encode( session.acked[i], writer );
+    session.packets[i] = writer.bytes();
+  }
+
+  session.fBusySeconds += secondsSince( start );
+}
+
+void RaceServer::tick()
+{
+  auto start = Clock::now();
+
+  receive();
+  for( ServerSession & session : sessions ) session.fBusySeconds = 0.0;
+  pool.parallelFor( sessions.size(), [&]( size_t i ) { simulate( sessions[i] ); } );
+
+  counters.nClients = 0;
+  for( ServerSession & session : sessions )
+  {
+    counters.fSessionSec += session.fBusySeconds;
+    for( uint32_t i = 0; i < MAX_CARS; i++ )
+    {
+      if( !session.connected[i] ) continue;
+      socket.send( session.clients[i], session.packets[i].data(), session.packets[i].size() );
+      counters.nPacketsOut++;
+      counters.nClients++;
+    }
+  }
+
+  double fTick = secondsSince( start );
+  counters.nTicks++;
+  counters.fWallSec += fTick;
+  counters.fMaxTickSec = std::max( counters.fMaxTickSec, fTick );
+  if( fTick > 1.0 / TICK_RATE ) counters.nOverruns++;
+  nServerTick++;
+}
+
+void RaceServer::run( uint32_t nTicks, uint32_t nReportTicks )
+{
+  const auto TICK_PERIOD = std::chrono::microseconds( 1'000'000 / TICK_RATE );
+  auto       nextTick    = Clock::now();
+  for( uint32_t i = 0; nTicks == 0 || i < nTicks; i++ )
+  {
+    tick();
+
+    if( nReportTicks > 0 && counters.nTicks == nReportTicks )
+    {
+      // Sessions per core: how many sessions' worth of simulation one core fits into a tick
+      double fPerSession = counters.fSessionSec / ( double( counters.nTicks ) * sessions.size() );
+      std::printf( "%zu sessions, %u clients: %.2f us per session tick, ticks mean %.3f ms max %.3f ms, %u overruns, "
+                   "~%.0f sessions per core\n",
+                   sessions.size(),
+                   counters.nClients,
+                   fPerSession * 1e6,
+                   counters.fWallSec / counters.nTicks * 1e3,
+                   counters.fMaxTickSec * 1e3,
+                   counters.nOverruns,
+                   1.0 / TICK_RATE / fPerSession );
+      resetStats();
+    }
+
+    nextTick += TICK_PERIOD;
+    std::this_thread::sleep_until( nextTick );
+  }
+}
+
+int runTestClients( const NetAddress & server, uint32_t nClients, uint32_t nTicks )
+{
+  struct TestClient
+  {
+    UdpSocket       socket;
+    uint32_t        nSession  = ANY_SESSION;
+    uint32_t        nSlot     = FULL_SLOT;
+    uint32_t        nStates   = 0;
+    uint32_t        nLastTick = 0;
+    bool            bMoved    = false;
+    SnapshotDecoder decoder;
+    size_t          nBytes = 0;
+  };
+
+  std::vector<std::unique_ptr<TestClient>> clients;
+  for( uint32_t i = 0; i < nClients; i++ )
+  {
+    clients.push_back( std::make_unique<TestClient>() );
+    if( !clients.back()->socket.open( 0 ) )
+    {
+      std::fprintf( stderr, "Could not open a UDP socket for client %u\n", i );
+      return 1;
+    }
+  }
+
+  const auto TICK_PERIOD = std::chrono::microseconds( 1'000'000 / TICK_RATE );
+  auto       nextTick    = Clock::now();
+  uint8_t    packet[512];
+  for( uint32_t tick = 0; tick < nTicks; tick++ )
+  {
+    for( uint32_t i = 0; i < nClients; i++ )
+    {
+      TestClient & client = *clients[i];
+      NetAddress   from;
+      int          nBytes;
+      while( ( nBytes = client.socket.receive( packet, sizeof( packet ), from ) ) >= 0 )
+      {
+        BitReader    reader( packet, size_t( nBytes ) );
+        ServerPacket type;
+        if( from != server || !readHeader( reader, type ) ) continue;
+        uint32_t nSession = reader.read( 32 );
+        if( type == ServerPacket::Welcome )
+        {
+          client.nSession = nSession;
+          client.nSlot    = reader.read( 8 );
+        }
+        else if( type == ServerPacket::State && nSession == client.nSession )
+        {
+          Snapshot snap;
+          if( !client.decoder.decode( reader, snap ) ) continue;
+          if( snap.tick > client.nLastTick && client.nStates > 0 ) client.bMoved = true;
+          client.nLastTick = snap.tick;
+          client.nStates++;
+          client.nBytes += size_t( nBytes );
+        }
+      }
+
+      BitWriter writer;
+      if( client.nSlot == FULL_SLOT )
+      {
+        writeHeader( writer, ServerPacket::Join );
+        writer.write( ANY_SESSION, 32 );
+      }
+      else
+      {
+        writeHeader( writer, tick + 1 < nTicks ? ServerPacket::Input : ServerPacket::Leave );
+        writer.write( client.nSession, 32 );
+        writer.write( client.nSlot, 8 );
+        writer.write( client.decoder.ackTick(), 32 );
+        writer.write( scriptedInput( int( tick + i * 30 ) ), 4 );
+      }
+      client.socket.send( server, writer.bytes().data(), writer.bytes().size() );
+    }
+
+    nextTick += TICK_PERIOD;
+    std::this_thread::sleep_until( nextTick );
+  }
+
+  uint32_t nJoined = 0, nMoved = 0;
+  uint64_t nStates = 0, nBytes = 0;
+  for( const auto & client : clients )
+  {
+    nJoined += client->nSlot != FULL_SLOT;
+    nMoved += client->bMoved;
+    nStates += client->nStates;
+    nBytes += client->nBytes;
+  }
+  std::printf( "%u of %u clients joined, %u saw their race advance, %.1f state packets per client over %u ticks, "
+               "%.1f bytes each\n",
+               nJoined,
+               nClients,
+               nMoved,
+               double( nStates ) / nClients,
+               nTicks,
+               nStates ? double( nBytes ) / nStates : 0.0 );
+  return nJoined == nClients && nMoved == nClients ? 0 : 1;
+}
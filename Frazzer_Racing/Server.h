@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "GameState.h"
+#include "Net.h"
+#include "SnapshotCodec.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// Packets between race clients and the server, each starting with SERVER_MAGIC and one of these
+enum class ServerPacket : uint8_t {
+  Join    = 1,  // client: session wanted, or ANY_SESSION
+  Welcome = 2,  // server: session and car slot, or FULL_SLOT
+  Input   = 3,  // client: session, slot, last snapshot tick decoded and the 4 input bits
+  State   = 4,  // server: session and a SnapshotEncoder snapshot against the client's last acknowledged one
+  Leave   = 5,  // client: session and slot
+};
+
+constexpr uint16_t SERVER_MAGIC = 0x5346;  // "FS"
+constexpr uint32_t ANY_SESSION  = 0xFFFFFFFF;
+constexpr uint8_t  FULL_SLOT    = 0xFF;
+
+// One race on the server. Slots without a client are driven by a scripted bot so every session does real work.
+struct ServerSession
+{
+  GameState                                  state;
+  std::array<uint8_t, MAX_CARS>              inputs    = {};
+  std::array<NetAddress, MAX_CARS>           clients   = {};
+  std::array<uint32_t, MAX_CARS>             lastHeard = {};  // Server tick of the last packet from each client
+  std::array<bool, MAX_CARS>                 connected = {};
+  std::array<uint32_t, MAX_CARS>             acked     = {};  // Snapshot tick each client last decoded
+  SnapshotEncoder                            encoder;
+  std::array<std::vector<uint8_t>, MAX_CARS> packets;  // This tick's state per client, built on the worker
+  double                                     fBusySeconds = 0.0;
+};
+
+struct ServerStats
+{
+  uint32_t nTicks        = 0;
+  double   fSessionSec   = 0.0;  // Simulating and encoding, summed over sessions
+  double   fWallSec      = 0.0;  // Whole ticks including networking
+  double   fMaxTickSec   = 0.0;
+  uint32_t nOverruns     = 0;    // Ticks that took longer than 1 / TICK_RATE
+  uint32_t nPacketsIn    = 0;
+  uint32_t nPacketsOut   = 0;
+  uint32_t nClients      = 0;
+};
+
+// Many independent races in one process with no window or renderer. Every session is ticked at TICK_RATE in
+// lockstep, with the simulation spread over a thread pool. Networking stays on the calling thread: packets are read
+// before the sessions run and each session's state packet, encoded on its worker, is sent afterwards.
+class RaceServer
+{
+public:
+  RaceServer( const Track & track, size_t nSessions, ThreadPool & pool );
+
+  bool     open( uint16_t nPort );
+  uint16_t port() const { return socket.port(); }
+
+  // One fixed tick of every session
+  void tick();
+
+  // Ticks at TICK_RATE for nTicks (0 runs forever), printing a load report every nReportTicks
+  void run( uint32_t nTicks, uint32_t nReportTicks );
+
+  const ServerStats & stats() const { return counters; }
+  void                resetStats() { counters = ServerStats(); }
+
+private:
+  void receive();
+  void join( const NetAddress & from, uint32_t nWanted );
+  void simulate( ServerSession & session );
+
+  const Track &              track;
+  ThreadPool &               pool;
+  UdpSocket                  socket;
+  std::vector<ServerSession> sessions;
+  uint32_t                   nServerTick = 0;
+  ServerStats                counters;
+};
+
+// Stand-in players for testing a server locally: each client joins, sends scripted input every tick and counts the
+// state packets that come back
+int runTestClients( const NetAddress & server, uint32_t nClients, uint32_t nTicks );
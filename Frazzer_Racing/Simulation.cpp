@@ -0,0 +1,71 @@
+#include "Simulation.h"
+
+#include <algorithm>
+
+namespace
+{
+  // Wheels are sampled for this many cars at a time, kept on the stack
+  const size_t SAMPLE_BATCH = 64;
+} // namespace
+
+void simulateTick( CarStateFx & car, uint8_t input, const Track & track )
+{
+  SinCos heading = fixedSinCos( car.angle );
+  simulateTick( car, heading, input, track );
+}
+
+void simulateTick( CarStateFx & car, SinCos & heading, uint8_t input, const Track & track )
+{
+  WheelGrip wheels;
+  sampleWheels( &car, &heading, 1, track, &wheels );
+  stepCarFx( car, input, wheels, heading );
+  clampCarFx( car, track.blockSize(), track.worldSize() - track.blockSize() );
+}
+
+void simulateTick( CarStateFx * pCars, SinCos * pHeadings, const uint8_t * inputs, size_t nCars, const Track & track )
+{
+  olc::vi2d vMin = track.blockSize();
+  olc::vi2d vMax = track.worldSize() - track.blockSize();
+  WheelGrip wheels[SAMPLE_BATCH];
+  for( size_t i = 0; i < nCars; i += SAMPLE_BATCH )
+  {
+    size_t n = std::min( nCars - i, SAMPLE_BATCH );
+    sampleWheels( pCars + i, pHeadings + i, n, track, wheels );
+    for( size_t k = 0; k < n; k++ )
+    {
+      stepCarFx( pCars[i + k], inputs[i + k], wheels[k], pHeadings[i + k] );
+      clampCarFx( pCars[i + k], vMin, vMax );
+    }
+  }
+}
+
+void simulateTick( GameState & state, const uint8_t * inputs, const Track & track )
+{
+  // Headings aren't part of the state, so they are worked out here once for the sampling and the step to share
+  SinCos headings[MAX_CARS];
+  for( uint32_t i = 0; i < state.nCars; i++ ) headings[i] = fixedSinCos( state.cars[i].angle );
+  simulateTick( state.cars, headings, inputs, state.nCars, track );
+  state.tick++;
+}
+
+GameState startingGrid( uint32_t nCars, const Track & track )
+{
+  GameState state;
+  state.nCars         = std::min<uint32_t>( nCars, MAX_CARS );
+  state.trackChecksum = track.checksum();
+  for( uint32_t i = 0; i < state.nCars; i++ )
+  {
+    CarState car;
+    car.pos       = { 120.0f + ( i % 2 ) * 20.0f, 200.0f + ( i / 2 ) * 25.0f };
+    state.cars[i] = toFixed( car );
+  }
+  return state;
+}
+
+uint8_t scriptedInput( int tick )
+{
+  uint8_t input = INPUT_ACCEL;
+  if( ( tick / 90 ) % 3 == 1 ) input |= INPUT_LEFT;
+  if( ( tick / 150 ) % 4 == 3 ) input = INPUT_BRAKE | INPUT_RIGHT;
+  return input;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "GameState.h"
+#include "Physics.h"
+#include "Track.h"
+
+// One deterministic tick of a car on a track: fixed point physics on the surface under its wheels, then keeping it
+// inside the border wall
+void simulateTick( CarStateFx & car, uint8_t input, const Track & track );
+
+// As above for a car ticked over and over, `heading` being the sine and cosine of its heading kept from tick to tick
+void simulateTick( CarStateFx & car, SinCos & heading, uint8_t input, const Track & track );
+
+// One tick of cars driving on their own, every car's wheels sampled in one pass before any of them moves.
+// pHeadings[i] is the sine and cosine of pCars[i]'s heading, kept up to date for the next tick.
+void simulateTick( CarStateFx * pCars, SinCos * pHeadings, const uint8_t * inputs, size_t nCars, const Track & track );
+
+// One tick of a whole race, inputs[i] driving cars[i]
+void simulateTick( GameState & state, const uint8_t * inputs, const Track & track );
+
+// Cars lined up in pairs on the start straight of the default track, car 0 on pole
+GameState startingGrid( uint32_t nCars, const Track & track );
+
+// Deterministic driving round the default track for benchmarks and headless tests
+uint8_t scriptedInput( int tick );
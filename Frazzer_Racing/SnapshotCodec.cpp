@@ -0,0 +1,142 @@
+#include "SnapshotCodec.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+  uint32_t zigzag( int32_t v ) { return ( uint32_t( v ) << 1 ) ^ uint32_t( v >> 31 ); }
+  int32_t  unzigzag( uint32_t v ) { return int32_t( v >> 1 ) ^ -int32_t( v & 1 ); }
+
+  // Gamma codes start at 1
+  void    writeSigned( BitWriter & out, int32_t v ) { out.writeGamma( zigzag( v ) + 1 ); }
+  int32_t readSigned( BitReader & in ) { return unzigzag( in.readGamma() - 1 ); }
+
+  // Positions wrap rather than overflow, so far apart positions and corrupt packets stay defined and the decoder
+  // undoes exactly what the encoder did
+  int32_t wrapDelta( int32_t to, int32_t from ) { return int32_t( uint32_t( to ) - uint32_t( from ) ); }
+  int32_t wrapAdd( int32_t v, int32_t d ) { return int32_t( uint32_t( v ) + uint32_t( d ) ); }
+
+  // Wider fields would shift by the whole width of the value or more, and no angle bits by -1
+  QuantiseParams clamped( QuantiseParams params )
+  {
+    params.nPosFracBits = std::min( params.nPosFracBits, QuantiseParams::MAX_POS_FRAC_BITS );
+    params.nAngleBits   = std::clamp( params.nAngleBits, 1u, QuantiseParams::MAX_ANGLE_BITS );
+    return params;
+  }
+} // namespace
+
+QuantisedCar quantise( const CarStateFx & car, const QuantiseParams & params )
+{
+  // Round to nearest, angles wrap round so the top of the range is the same as 0
+  int      nShift = FIXED_SHIFT - int( params.nPosFracBits );
+  fixed    half   = fixed( 1 ) << ( nShift - 1 );
+  uint32_t nTurn  = 32 - params.nAngleBits;
+  uint32_t angle  = uint32_t( ( uint64_t( car.angle ) + ( uint64_t( 1 ) << ( nTurn - 1 ) ) ) >> nTurn );
+  return { int32_t( ( car.x + half ) >> nShift ),
+           int32_t( ( car.y + half ) >> nShift ),
+           angle & ( ( 1u << params.nAngleBits ) - 1 ) };
+}
+
+CarState dequantise( const QuantisedCar & car, const QuantiseParams & params )
+{
+  CarState s;
+  float    fPosScale = 1.0f / float( 1 << params.nPosFracBits );
+  s.pos              = { car.x * fPosScale, car.y * fPosScale };
+  s.vel              = 0.0f;
+  s.angle            = float( car.angle * ( 2.0 * 3.14159265358979 / double( 1u << params.nAngleBits ) ) );
+  return s;
+}
+
+SnapshotEncoder::SnapshotEncoder( const QuantiseParams & params, size_t nHistory )
+  : params( clamped( params ) ), history( std::max<size_t>( nHistory, 1 ) )
+{}
+
+void SnapshotEncoder::capture( uint32_t tick, const CarStateFx * cars, size_t nCars )
+{
+  nLatest         = tick % history.size();
+  Snapshot & snap = history[nLatest];
+  snap.tick       = tick;
+  snap.cars.resize( nCars );
+  for( size_t i = 0; i < nCars; i++ ) snap.cars[i] = quantise( cars[i], params );
+}
+
+void SnapshotEncoder::encode( uint32_t nBaselineTick, BitWriter & out ) const
+{
+  const Snapshot & snap = history[nLatest];
+  const Snapshot * base = nullptr;
+  if( nBaselineTick != NO_BASELINE && nBaselineTick != snap.tick )
+  {
+    base = &history[nBaselineTick % history.size()];
+    if( base->tick != nBaselineTick || base->cars.empty() ) base = nullptr;
+  }
+
+  // Most cars move a few pixels a tick, a little over 3 bytes each
+  out.reserve( out.bytes().size() + 16 + snap.cars.size() * 4 );
+  out.write( snap.tick, 32 );
+  out.write( base ? base->tick : NO_BASELINE, 32 );
+  out.writeGamma( uint32_t( snap.cars.size() ) + 1 );
+
+  uint32_t nAngleMask = ( 1u << params.nAngleBits ) - 1;
+  for( size_t i = 0; i < snap.cars.size(); i++ )
+  {
+    QuantisedCar from = base && i < base->cars.size() ? base->cars[i] : QuantisedCar();
+    QuantisedCar to   = snap.cars[i];
+    if( base && from == to )
+    {
+      out.write( 0, 1 );
+      continue;
+    }
+
+    // Angle deltas are taken the short way round the circle
+    int32_t nHalfTurn = int32_t( 1u << ( params.nAngleBits - 1 ) );
+    int32_t nTurn     = int32_t( ( to.angle - from.angle ) & nAngleMask );
+    out.write( 1, 1 );
+    writeSigned( out, wrapDelta( to.x, from.x ) );
+    writeSigned( out, wrapDelta( to.y, from.y ) );
+    writeSigned( out, nTurn >= nHalfTurn ? nTurn - nHalfTurn - nHalfTurn : nTurn );
+  }
+}
+
+SnapshotDecoder::SnapshotDecoder( const QuantiseParams & params, size_t nHistory )
+  : params( clamped( params ) ), history( std::max<size_t>( nHistory, 1 ) )
+{}
+
+bool SnapshotDecoder::decode( BitReader & in, Snapshot & out )
+{
+  uint32_t tick          = in.read( 32 );
+  uint32_t nBaselineTick = in.read( 32 );
+  uint32_t nCars         = in.readGamma() - 1;
+  if( in.overrun() || nCars > ( 1u << 20 ) ) return false;
+
+  const Snapshot * base = nullptr;
+  if( nBaselineTick != NO_BASELINE )
+  {
+    base = &history[nBaselineTick % history.size()];
+    if( base->tick != nBaselineTick || base->cars.empty() ) return false;
+  }
+
+  uint32_t nAngleMask = ( 1u << params.nAngleBits ) - 1;
+
+  // Decode into a scratch snapshot, the baseline slot may be the one being replaced
+  Snapshot snap;
+  snap.tick = tick;
+  snap.cars.resize( nCars );
+  for( uint32_t i = 0; i < nCars; i++ )
+  {
+    QuantisedCar car = base && i < base->cars.size() ? base->cars[i] : QuantisedCar();
+    if( in.read( 1 ) )
+    {
+      car.x = wrapAdd( car.x, readSigned( in ) );
+      car.y = wrapAdd( car.y, readSigned( in ) );
+      car.angle = ( car.angle + uint32_t( readSigned( in ) ) ) & nAngleMask;
+    }
+    snap.cars[i] = car;
+  }
+  if( in.overrun() ) return false;
+
+  history[tick % history.size()] = snap;
+  out                             = std::move( snap );
+  if( nAck == NO_BASELINE || tick > nAck ) nAck = tick;
+  return true;
+}
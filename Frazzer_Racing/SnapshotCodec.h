@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "BitStream.h"
+#include "Physics.h"
+
+// How much of a car spectators get to see. Positions keep nPosFracBits of sub-pixel precision, angles nAngleBits of a
+// turn. Velocity is left out: spectators only draw cars.
+struct QuantiseParams
+{
+  static constexpr uint32_t MAX_POS_FRAC_BITS = FIXED_SHIFT - 1;
+  static constexpr uint32_t MAX_ANGLE_BITS    = 31;
+
+  uint32_t nPosFracBits = 3;   // 1/8 pixel, up to MAX_POS_FRAC_BITS
+  uint32_t nAngleBits   = 10;  // ~0.35 degrees, 1 to MAX_ANGLE_BITS
+};
+
+struct QuantisedCar
+{
+  int32_t  x     = 0;
+  int32_t  y     = 0;
+  uint32_t angle = 0;
+
+  bool operator==( const QuantisedCar & o ) const { return x == o.x && y == o.y && angle == o.angle; }
+};
+
+struct Snapshot
+{
+  uint32_t                  tick = 0;
+  std::vector<QuantisedCar> cars;
+};
+
+constexpr uint32_t NO_BASELINE = 0xFFFFFFFF;
+
+// params must be within the limits above, which the encoder and decoder hold theirs to
+QuantisedCar quantise( const CarStateFx & car, const QuantiseParams & params );
+CarState     dequantise( const QuantisedCar & car, const QuantiseParams & params );
+
+// Spectator snapshots delta-compressed against whichever earlier snapshot each client last acknowledged. Every car
+// costs one bit when unchanged, otherwise zigzagged Elias gamma codes of how far it moved and turned. Snapshots too
+// old to still be in the history are sent in full, as deltas from zero.
+class SnapshotEncoder
+{
+public:
+  // Params outside their limits are clamped to them, and the history holds at least one snapshot
+  explicit SnapshotEncoder( const QuantiseParams & params = QuantiseParams(), size_t nHistory = 64 );
+
+  // Quantises a new tick into the history, replacing the one nHistory ticks earlier
+  void capture( uint32_t tick, const CarStateFx * cars, size_t nCars );
+
+  // The latest captured snapshot, against nBaselineTick when still held, written after whatever `out` holds
+  void encode( uint32_t nBaselineTick, BitWriter & out ) const;
+
+  const Snapshot & latest() const { return history[nLatest]; }
+
+private:
+  QuantiseParams        params;
+  std::vector<Snapshot> history;  // Slot tick % size
+  size_t                nLatest = 0;
+};
+
+// Client side: keeps what it has decoded so later deltas have their baselines. ackTick() is what to send back.
+class SnapshotDecoder
+{
+public:
+  // Clamped as the encoder's are, so the two agree on what they were given
+  explicit SnapshotDecoder( const QuantiseParams & params = QuantiseParams(), size_t nHistory = 64 );
+
+  // False if the packet is corrupt or its baseline is no longer held, in which case nothing changes
+  bool decode( BitReader & in, Snapshot & out );
+
+  uint32_t ackTick() const { return nAck; }
+
+private:
+  QuantiseParams        params;
+  std::vector<Snapshot> history;  // Slot tick % size
+  uint32_t              nAck = NO_BASELINE;
+};
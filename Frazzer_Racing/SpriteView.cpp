@@ -0,0 +1,98 @@
+#include "SpriteView.h"
+
+#include <cstring>
+
+SpriteView viewOf( olc::Sprite * spr )
+{
+  if( spr == nullptr ) return {};
+  return { spr->GetData(), spr->width, spr->height, spr->width };
+}
+
+ConstSpriteView viewOf( const assets::BakedImage & image )
+{
+  // olc::Pixel is a single packed uint32_t, the same layout AssetBaker writes
+  static_assert( sizeof( olc::Pixel ) == sizeof( uint32_t ) );
+  return { reinterpret_cast<const olc::Pixel *>( image.pixels ), image.width, image.height, image.width };
+}
+
+ConstSpriteView fontGlyph( olc::PixelGameEngine & pge, char c )
+{
+  if( c < 32 ) return {};
+  int32_t ox = ( c - 32 ) % 16;
+  int32_t oy = ( c - 32 ) / 16;
+  return ConstSpriteView( viewOf( pge.GetFontSprite() ) ).sub( { ox * 8, oy * 8 }, { 8, 8 } );
+}
+
+void drawView( const SpriteView & target, const olc::vi2d & pos, const ConstSpriteView & src, olc::Pixel::Mode mode )
+{
+  // Clip the source against the target once, then work row by row
+  olc::vi2d       vClip = { std::max( -pos.x, 0 ), std::max( -pos.y, 0 ) };
+  ConstSpriteView s     = src.sub( vClip, { target.width - pos.x - vClip.x, target.height - pos.y - vClip.y } );
+  if( s.data == nullptr ) return;
+  olc::vi2d vDst = pos + vClip;
+
+  for( int32_t y = 0; y < s.height; y++ )
+  {
+    const olc::Pixel * pSrc = s.row( y );
+    olc::Pixel *       pDst = target.row( vDst.y + y ) + vDst.x;
+    switch( mode )
+    {
+      case olc::Pixel::MASK:
+        for( int32_t x = 0; x < s.width; x++ )
+          if( pSrc[x].a == 255 ) pDst[x] = pSrc[x];
+        break;
+      case olc::Pixel::ALPHA:
+        for( int32_t x = 0; x < s.width; x++ )
+        {
+          uint32_t a = pSrc[x].a;
+          uint32_t c = 255 - a;
+          pDst[x]    = olc::Pixel( uint8_t( ( pSrc[x].r * a + pDst[x].r * c ) / 255 ),
+                                uint8_t( ( pSrc[x].g * a + pDst[x].g * c ) / 255 ),
+                                uint8_t( ( pSrc[x].b * a + pDst[x].b * c ) / 255 ) );
+        }
+        break;
+      default: std::memcpy( pDst, pSrc, sizeof( olc::Pixel ) * s.width ); break;
+    }
+  }
+}
+
+void fillRect( const SpriteView & target, const olc::vi2d & pos, const olc::vi2d & size, olc::Pixel p )
+{
+  SpriteView t = target.sub( pos, size );
+  for( int32_t y = 0; y < t.height; y++ ) std::fill_n( t.row( y ), t.width, p );
+}
+
+void drawString( olc::PixelGameEngine & pge,
+                 const SpriteView &     target,
+                 const olc::vi2d &      pos,
+                 const std::string &    sText,
+                 olc::Pixel             col )
+{
+  olc::vi2d vCursor = pos;
+  for( char c : sText )
+  {
+    if( c == '\n' )
+    {
+      vCursor = { pos.x, vCursor.y + 8 };
+      continue;
+    }
+
+    ConstSpriteView glyph = fontGlyph( pge, c );
+    SpriteView      dst   = target.sub( vCursor, { glyph.width, glyph.height } );
+    olc::vi2d       vSkip = { std::max( -vCursor.x, 0 ), std::max( -vCursor.y, 0 ) };
+    for( int32_t y = 0; y < dst.height; y++ )
+      for( int32_t x = 0; x < dst.width; x++ )
+        if( glyph.at( x + vSkip.x, y + vSkip.y ).r > 0 ) dst.at( x, y ) = col;
+    vCursor.x += 8;
+  }
+}
+
+void drawView( olc::PixelGameEngine & pge, const olc::vi2d & pos, const ConstSpriteView & src )
+{
+  drawView( viewOf( pge.GetDrawTarget() ), pos, src, pge.GetPixelMode() );
+}
+
+void fillRect( olc::PixelGameEngine & pge, const olc::vi2d & pos, const olc::vi2d & size, olc::Pixel p )
+{
+  fillRect( viewOf( pge.GetDrawTarget() ), pos, size, p );
+}
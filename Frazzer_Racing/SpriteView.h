@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Assets.h"
+#include "olcPixelGameEngine.h"
+
+// Non-owning window onto rows of pixels: a baked image, a tile in an atlas, a font glyph or a render target.
+// Sub-views share the parent's data and stride, so nothing is ever copied.
+template<typename T>
+struct BasicSpriteView
+{
+  T *     data   = nullptr;
+  int32_t width  = 0;
+  int32_t height = 0;
+  int32_t stride = 0;
+
+  BasicSpriteView() = default;
+  BasicSpriteView( T * data, int32_t width, int32_t height, int32_t stride )
+    : data( data ), width( width ), height( height ), stride( stride )
+  {}
+
+  // A view onto writable pixels can always be read from
+  template<typename U, typename = std::enable_if_t<std::is_same_v<T, const U>>>
+  BasicSpriteView( const BasicSpriteView<U> & v )
+    : data( v.data ), width( v.width ), height( v.height ), stride( v.stride )
+  {}
+
+  T * row( int32_t y ) const { return data + y * stride; }
+  T & at( int32_t x, int32_t y ) const { return data[y * stride + x]; }
+
+  // Region of this view, clipped to its bounds
+  BasicSpriteView sub( const olc::vi2d & pos, const olc::vi2d & size ) const
+  {
+    int32_t x0 = std::max( pos.x, 0 );
+    int32_t y0 = std::max( pos.y, 0 );
+    int32_t x1 = std::min( pos.x + size.x, width );
+    int32_t y1 = std::min( pos.y + size.y, height );
+    if( x1 <= x0 || y1 <= y0 ) return {};
+    return { data + y0 * stride + x0, x1 - x0, y1 - y0, stride };
+  }
+};
+
+using SpriteView      = BasicSpriteView<olc::Pixel>;
+using ConstSpriteView = BasicSpriteView<const olc::Pixel>;
+
+SpriteView      viewOf( olc::Sprite * spr );
+ConstSpriteView viewOf( const assets::BakedImage & image );
+
+// Splits an atlas into equally sized cells, cell (x, y) lands at index y * columns + x
+template<typename T>
+std::vector<BasicSpriteView<T>> sliceAtlas( const BasicSpriteView<T> & atlas, const olc::vi2d & vCellSize )
+{
+  std::vector<BasicSpriteView<T>> cells;
+  for( int y = 0; y + vCellSize.y <= atlas.height; y += vCellSize.y )
+    for( int x = 0; x + vCellSize.x <= atlas.width; x += vCellSize.x )
+      cells.push_back( atlas.sub( { x, y }, vCellSize ) );
+  return cells;
+}
+
+// 8x8 glyph of the engine font for a printable ASCII character
+ConstSpriteView fontGlyph( olc::PixelGameEngine & pge, char c );
+
+// Draw routines, clipped to the target and honouring olc::Pixel::NORMAL, MASK and ALPHA
+void drawView( const SpriteView &      target,
+               const olc::vi2d &       pos,
+               const ConstSpriteView & src,
+               olc::Pixel::Mode        mode = olc::Pixel::NORMAL );
+void fillRect( const SpriteView & target, const olc::vi2d & pos, const olc::vi2d & size, olc::Pixel p );
+void drawString( olc::PixelGameEngine & pge,
+                 const SpriteView &     target,
+                 const olc::vi2d &      pos,
+                 const std::string &    sText,
+                 olc::Pixel             col = olc::WHITE );
+
+// Same, drawing to the engine's current draw target with its current pixel mode
+void drawView( olc::PixelGameEngine & pge, const olc::vi2d & pos, const ConstSpriteView & src );
+void fillRect( olc::PixelGameEngine & pge, const olc::vi2d & pos, const olc::vi2d & size, olc::Pixel p );
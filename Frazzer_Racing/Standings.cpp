@@ -0,0 +1,194 @@
+#include "Standings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+  // Pixels, the same grid as the checkpoints
+  const float CELL_SIZE = 64.0f;
+
+  // Each cell lists every segment within this many pixels of it, so the nearest point is found exactly for cars
+  // this close to the centreline, well beyond the edge of the widest road. Cars further away search the whole line.
+  const float REACH = 64.0f;
+
+  // How far a car may be past its next gate before the gate counts it, as the centreline and the gate needn't
+  // agree exactly on where a lap starts. Capped at half the shortest sector.
+  const float PAST_GATE_SLACK = 64.0f;
+
+  // An insertion sort moving cars further than this on average gives way to a full sort
+  const size_t MAX_SHIFTS_PER_CAR = 16;
+
+  const size_t UPDATE_GRAIN = 256;
+} // namespace
+
+Standings::Standings( const Track & track ) : track( track ) { rebuild(); }
+
+void Standings::rebuild()
+{
+  line = track.centreline();
+  if( line.size() < 2 )
+  {
+    line.clear();
+    for( const Gate & gate : track.gates() ) line.push_back( ( gate.a + gate.b ) * 0.5f );
+  }
+  if( line.size() < 2 ) line.clear();
+
+  size_t n = line.size();
+  arc.assign( n + 1, 0.0f );
+  for( size_t i = 0; i < n; i++ ) arc[i + 1] = arc[i] + ( line[( i + 1 ) % n] - line[i] ).mag();
+  fLapLength = arc.back();
+  fOrigin    = 0.0f;
+
+  // Segment i runs from point i to the next, going in every cell within reach of its bounding box
+  olc::vi2d vWorld = track.worldSize();
+  nCellsX          = std::max( int32_t( std::ceil( vWorld.x / CELL_SIZE ) ), 1 );
+  nCellsY          = std::max( int32_t( std::ceil( vWorld.y / CELL_SIZE ) ), 1 );
+  auto forCells    = [&]( size_t i, auto func ) {
+    olc::vf2d vLo = line[i].min( line[( i + 1 ) % n] ) - olc::vf2d( REACH, REACH );
+    olc::vf2d vHi = line[i].max( line[( i + 1 ) % n] ) + olc::vf2d( REACH, REACH );
+    int32_t   cx0 = std::clamp( int32_t( std::floor( vLo.x / CELL_SIZE ) ), 0, nCellsX - 1 );
+    int32_t   cx1 = std::clamp( int32_t( std::floor( vHi.x / CELL_SIZE ) ), 0, nCellsX - 1 );
+    int32_t   cy0 = std::clamp( int32_t( std::floor( vLo.y / CELL_SIZE ) ), 0, nCellsY - 1 );
+    int32_t   cy1 = std::clamp( int32_t( std::floor( vHi.y / CELL_SIZE ) ), 0, nCellsY - 1 );
+    for( int32_t cy = cy0; cy <= cy1; cy++ )
+      for( int32_t cx = cx0; cx <= cx1; cx++ ) func( size_t( cy ) * nCellsX + cx );
+  };
+  cellStart.assign( size_t( nCellsX ) * nCellsY + 1, 0 );
+  for( size_t i = 0; i < n; i++ ) forCells( i, [&]( size_t nCell ) { cellStart[nCell + 1]++; } );
+  for( size_t i = 1; i < cellStart.size(); i++ ) cellStart[i] += cellStart[i - 1];
+  cellSegments.resize( cellStart.back() );
+  std::vector<uint32_t> fill( cellStart.begin(), cellStart.end() - 1 );
+  for( uint32_t i = 0; i < n; i++ )
+  {
+    Segment segment = { line[i], line[( i + 1 ) % n] - line[i], arc[i], arc[i + 1] - arc[i] };
+    forCells( i, [&]( size_t nCell ) { cellSegments[fill[nCell]++] = segment; } );
+  }
+
+  // Progress counts from the start line wherever the line happens to begin, and each gate is placed along it
+  const std::vector<Gate> & gates = track.gates();
+  gateArc.clear();
+  if( n > 0 && !gates.empty() ) fOrigin = progressAt( ( gates[0].a + gates[0].b ) * 0.5f );
+  for( const Gate & gate : gates ) gateArc.push_back( n > 0 ? progressAt( ( gate.a + gate.b ) * 0.5f ) : 0.0f );
+  if( !gateArc.empty() ) gateArc[0] = 0.0f;
+
+  fSlack = PAST_GATE_SLACK;
+  for( size_t i = 0; i < gateArc.size(); i++ )
+  {
+    float fNext = i + 1 < gateArc.size() ? gateArc[i + 1] : fLapLength;
+    fSlack      = std::min( fSlack, 0.5f * ( fNext - gateArc[i] ) );
+  }
+  fSlack = std::max( fSlack, 0.0f );
+}
+
+float Standings::progressAt( const olc::vf2d & vPos ) const
+{
+  size_t n = line.size();
+  if( n == 0 ) return 0.0f;
+
+  float fBest = std::numeric_limits<float>::infinity();
+  float fArc  = 0.0f;
+  auto  test  = [&]( const olc::vf2d & a, const olc::vf2d & vAB, float fFrom, float fLength ) {
+    float t   = std::clamp( ( vPos - a ).dot( vAB ) / std::max( vAB.mag2(), 1e-6f ), 0.0f, 1.0f );
+    float fD2 = ( a + vAB * t - vPos ).mag2();
+    if( fD2 < fBest )
+    {
+      fBest = fD2;
+      fArc  = fFrom + t * fLength;
+    }
+  };
+  int32_t cx    = std::clamp( int32_t( std::floor( vPos.x / CELL_SIZE ) ), 0, nCellsX - 1 );
+  int32_t cy    = std::clamp( int32_t( std::floor( vPos.y / CELL_SIZE ) ), 0, nCellsY - 1 );
+  size_t  nCell = size_t( cy ) * nCellsX + cx;
+  for( uint32_t k = cellStart[nCell]; k < cellStart[nCell + 1]; k++ )
+  {
+    const Segment & segment = cellSegments[k];
+    test( segment.a, segment.vAB, segment.fArc, segment.fLength );
+  }
+  if( fBest > REACH * REACH )
+    for( size_t i = 0; i < n; i++ ) test( line[i], line[( i + 1 ) % n] - line[i], arc[i], arc[i + 1] - arc[i] );
+
+  float s = fArc - fOrigin;
+  if( s < 0.0f ) s += fLapLength;
+  return s >= fLapLength ? 0.0f : s;
+}
+
+double Standings::distance( const olc::vf2d & vPos, const LapTimes & times ) const
+{
+  // Without a line to measure along only the laps count
+  uint32_t nStarted = times.nLaps + ( times.nLapStartUs >= 0 ? 1 : 0 );
+  if( fLapLength <= 0.0f ) return double( nStarted );
+
+  // Where the next gate is in the race, then back from it to the car, less than a lap
+  double   L        = fLapLength;
+  uint32_t nNext    = gateArc.empty() ? 0 : times.nNextGate % gateArc.size();
+  double   fNextArc = nNext == 0 ? 0.0 : gateArc[nNext];
+  double   fNext    = nNext == 0 ? nStarted * L : ( std::max( nStarted, 1u ) - 1 ) * L + fNextArc;
+  double   fBehind  = std::fmod( fNextArc - progressAt( vPos ) + fSlack, L );
+  if( fBehind < 0.0 ) fBehind += L;
+  return fNext - ( fBehind - fSlack );
+}
+
+void Standings::update( const CarStateFx * pCars, const LapTimes * pTimes, size_t nCars )
+{
+  distances.resize( nCars );
+  for( size_t i = 0; i < nCars; i++ )
+    distances[i] = distance( { fixedToFloat( pCars[i].x ), fixedToFloat( pCars[i].y ) }, pTimes[i] );
+  rank();
+}
+
+void Standings::update( const CarStateFx * pCars, const LapTimes * pTimes, size_t nCars, ThreadPool & pool )
+{
+  distances.resize( nCars );
+  pool.parallelFor( nCars, UPDATE_GRAIN, [&]( size_t nBegin, size_t nEnd ) {
+    for( size_t i = nBegin; i < nEnd; i++ )
+      distances[i] = distance( { fixedToFloat( pCars[i].x ), fixedToFloat( pCars[i].y ) }, pTimes[i] );
+  } );
+  rank();
+}
+
+void Standings::update( const GameState & state )
+{
+  update( state.cars, state.laps, state.nCars );
+}
+
+void Standings::rank()
+{
+  size_t nCars = distances.size();
+  auto   ahead = [&]( uint32_t a, uint32_t b ) {
+    return distances[a] > distances[b] || ( distances[a] == distances[b] && a < b );
+  };
+
+  // Last tick's order is nearly right, so insertion sort only moves the cars that changed places. A shuffled field,
+  // such as after a restart, is sorted from scratch instead.
+  size_t nShifts = 0;
+  nLastMoves     = 0;
+  if( ranking.size() == nCars )
+  {
+    for( size_t i = 1; i < nCars && nShifts <= MAX_SHIFTS_PER_CAR * nCars; i++ )
+    {
+      uint32_t nCar = ranking[i];
+      size_t   j    = i;
+      for( ; j > 0 && ahead( nCar, ranking[j - 1] ); j-- ) ranking[j] = ranking[j - 1];
+      ranking[j] = nCar;
+      nShifts += i - j;
+      nLastMoves += j != i;
+    }
+  }
+  else
+  {
+    ranking.resize( nCars );
+    std::iota( ranking.begin(), ranking.end(), 0 );
+    nShifts = std::numeric_limits<size_t>::max();
+  }
+  if( nShifts > MAX_SHIFTS_PER_CAR * nCars )
+  {
+    std::sort( ranking.begin(), ranking.end(), ahead );
+    nLastMoves = nCars;
+  }
+
+  places.resize( nCars );
+  for( size_t i = 0; i < nCars; i++ ) places[ranking[i]] = uint32_t( i );
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Checkpoints.h"
+#include "GameState.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// Live race order. A car's distance raced is its lap count plus how far along the track's centreline it is, the
+// nearest point found among the few segments a grid cell lists, so the cost per car doesn't grow with the track.
+// The order is kept by insertion sort, cheap as only a few cars change places from one tick to the next.
+//
+// Tracks without a centreline use the loop through their gate midpoints.
+class Standings
+{
+public:
+  explicit Standings( const Track & track );
+
+  // Re-reads the centreline and gates, call after the track has changed
+  void rebuild();
+
+  // Arc length from the start line to the point on the centreline nearest vPos
+  float progressAt( const olc::vf2d & vPos ) const;
+  float lapLength() const { return fLapLength; }
+
+  // Pixels raced from the start line on lap 1, negative on the grid behind it. The car is placed on the lap leading
+  // up to the next gate it has to make, so reversing back over a gate or missing one doesn't gain a lap.
+  double distance( const olc::vf2d & vPos, const LapTimes & times ) const;
+
+  // Works out every car's distance and brings the order up to date
+  void update( const CarStateFx * pCars, const LapTimes * pTimes, size_t nCars );
+  void update( const CarStateFx * pCars, const LapTimes * pTimes, size_t nCars, ThreadPool & pool );
+  void update( const GameState & state );
+
+  // Car indices from the leader back, ties going to the lower index
+  const std::vector<uint32_t> & order() const { return ranking; }
+
+  // Place of a car from 0 for the leader
+  uint32_t place( uint32_t nCar ) const { return places[nCar]; }
+  double   distanceOf( uint32_t nCar ) const { return distances[nCar]; }
+
+  // Cars moved by the last update, every car when it had to sort from scratch
+  size_t lastMoves() const { return nLastMoves; }
+
+private:
+  // Copied into every cell it is near, so finding the nearest point reads one run of memory
+  struct Segment
+  {
+    olc::vf2d a;
+    olc::vf2d vAB;
+    float     fArc;     // Along the line to a
+    float     fLength;
+  };
+
+  void rank();
+
+  const Track &          track;
+  std::vector<olc::vf2d> line;
+  std::vector<float>     arc;        // Along the line to each point, the last entry being the whole loop
+  std::vector<float>     gateArc;    // Along the line to each gate's midpoint
+  float                  fLapLength = 0.0f;
+  float                  fOrigin    = 0.0f;  // Along the line to the start line
+  float                  fSlack     = 0.0f;  // How far past its next gate a car may be before it has crossed it
+  int32_t                nCellsX    = 0;
+  int32_t                nCellsY    = 0;
+  std::vector<uint32_t>  cellStart;  // Segments near cell c are cellSegments[cellStart[c], cellStart[c + 1])
+  std::vector<Segment>   cellSegments;
+
+  std::vector<double>   distances;
+  std::vector<uint32_t> ranking;
+  std::vector<uint32_t> places;
+  size_t                nLastMoves = 0;
+};
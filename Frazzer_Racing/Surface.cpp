@@ -0,0 +1,263 @@
+#include "Surface.h"
+
+#include <algorithm>
+
+#include "CpuFeatures.h"
+#include "Physics.h"
+#include "Track.h"
+
+namespace
+{
+  // Wheel centres are this far either side of the middle of the car, across then forwards, in pixels
+  const int32_t WHEEL_ACROSS  = 4;
+  const int32_t WHEEL_FORWARD = 7;
+
+  const int32_t T          = SurfaceTable::TEXELS;
+  const int     TEXEL_BITS = 2;
+  static_assert( T == 1 << TEXEL_BITS, "texel lookups shift rather than divide" );
+
+  // Texel columns are found with a 32 bit reciprocal of the block size over TEXELS, exact for worlds below
+  // 2^29 / blockSize pixels across
+  const int RECIP_SHIFT = 29;
+
+  // Headings are worked out for this many cars at a time when the caller doesn't have them
+  const size_t HEADING_BATCH = 64;
+
+  // Multiples of tarmac as exact fractions, the table being part of the deterministic simulation
+  constexpr fixed times( int32_t nNumerator, int32_t nDenominator ) { return FIXED_ONE * nNumerator / nDenominator; }
+
+  // What a wheel lookup needs from the track, gathered once per call
+  struct WheelLookup
+  {
+    const uint32_t * pVisual   = nullptr;
+    const int32_t *  pFriction = nullptr;
+    const int32_t *  pGrip     = nullptr;
+    int32_t          nWidth    = 0;
+    int32_t          nMaxX     = 0;  // Last pixel of the world
+    int32_t          nMaxY     = 0;
+    uint32_t         nRecipX   = 0;  // ceil( TEXELS * 2^RECIP_SHIFT / blockSize )
+    uint32_t         nRecipY   = 0;
+  };
+
+  // Each wheel comes down to one index, tile * TEXELS^2 + texel: the tile it picks out of the visual layer, whose
+  // kind with the texel then picks the friction
+  WheelGrip sampleCar( const WheelLookup & look, const CarStateFx & car, const SinCos & heading )
+  {
+    // The two rotated half extents, across being ( cos, sin ) and forwards ( sin, -cos ) as the car is drawn
+    fixed ax        = heading.c * WHEEL_ACROSS;
+    fixed ay        = heading.s * WHEEL_ACROSS;
+    fixed fx        = heading.s * WHEEL_FORWARD;
+    fixed fy        = -heading.c * WHEEL_FORWARD;
+    fixed nFriction = 0;
+    fixed nGrip     = 0;
+    for( int32_t w = 0; w < 4; w++ )
+    {
+      fixed    wx = car.x + ( w & 1 ? ax : -ax ) + ( w & 2 ? fx : -fx );
+      fixed    wy = car.y + ( w & 1 ? ay : -ay ) + ( w & 2 ? fy : -fy );
+      uint64_t px = uint64_t( std::clamp<fixed>( wx >> FIXED_SHIFT, 0, look.nMaxX ) );
+      uint64_t py = uint64_t( std::clamp<fixed>( wy >> FIXED_SHIFT, 0, look.nMaxY ) );
+      uint32_t qx = uint32_t( ( px * look.nRecipX ) >> RECIP_SHIFT );  // Texel column across the whole world
+      uint32_t qy = uint32_t( ( py * look.nRecipY ) >> RECIP_SHIFT );
+
+      size_t   nIndex = ( size_t( qy >> TEXEL_BITS ) * look.nWidth + ( qx >> TEXEL_BITS ) ) * T * T
+                      + ( qy & ( T - 1 ) ) * T + ( qx & ( T - 1 ) );
+      size_t   nTile  = nIndex / ( T * T );
+      uint32_t nKind  = ( look.pVisual[nTile / 8] >> ( ( nTile % 8 ) * 4 ) ) & 0xF;
+      nFriction += look.pFriction[nKind * T * T + nIndex % ( T * T )];
+      nGrip += look.pGrip[nKind];
+    }
+    return { nFriction / 4, nGrip / 4 };
+  }
+
+#ifdef FR_X86_SIMD
+  // a * recip >> RECIP_SHIFT in every lane, from the full 64 bit products
+  FR_TARGET_AVX2 __m256i mulRecip( __m256i a, __m256i recip )
+  {
+    __m256i even = _mm256_srli_epi64( _mm256_mul_epu32( a, recip ), RECIP_SHIFT );
+    __m256i odd  = _mm256_srli_epi64( _mm256_mul_epu32( _mm256_srli_epi64( a, 32 ), recip ), RECIP_SHIFT );
+    return _mm256_blend_epi32( even, _mm256_slli_epi64( odd, 32 ), 0xAA );
+  }
+
+  // v[0] in the low four lanes, v[1] in the high four
+  FR_TARGET_AVX2 __m256i pairLanes( const int32_t * v )
+  {
+    return _mm256_setr_epi32( v[0], v[0], v[0], v[0], v[1], v[1], v[1], v[1] );
+  }
+
+  // Two cars at once, a lane per wheel, doing what sampleCar does in 32 bit lanes so the results match it to the bit.
+  // Positions are split into whole pixels and a fraction, which with the wheel offset fits in 32 bits. Whole pixels
+  // are held to within 16 of the world first, further than any wheel is from the middle, so the clamp is unchanged.
+  FR_TARGET_AVX2 void sampleCarPair( const WheelLookup & look,
+                                     const CarStateFx *  pCars,
+                                     const SinCos *      pHeadings,
+                                     WheelGrip *         pOut )
+  {
+    const __m256i signAcross  = _mm256_setr_epi32( -1, 1, -1, 1, -1, 1, -1, 1 );
+    const __m256i signForward = _mm256_setr_epi32( -1, -1, 1, 1, -1, -1, 1, 1 );
+    const __m256i texelMask   = _mm256_set1_epi32( T - 1 );
+
+    int32_t ix[2], iy[2], fx[2], fy[2], ax[2], ay[2], wx[2], wy[2];
+    for( int k = 0; k < 2; k++ )
+    {
+      const CarStateFx & car = pCars[k];
+      ix[k] = int32_t( std::clamp<fixed>( car.x >> FIXED_SHIFT, -16, look.nMaxX + 16 ) );
+      iy[k] = int32_t( std::clamp<fixed>( car.y >> FIXED_SHIFT, -16, look.nMaxY + 16 ) );
+      fx[k] = int32_t( car.x & ( FIXED_ONE - 1 ) );
+      fy[k] = int32_t( car.y & ( FIXED_ONE - 1 ) );
+      ax[k] = int32_t( pHeadings[k].c * WHEEL_ACROSS );
+      ay[k] = int32_t( pHeadings[k].s * WHEEL_ACROSS );
+      wx[k] = int32_t( pHeadings[k].s * WHEEL_FORWARD );
+      wy[k] = int32_t( -pHeadings[k].c * WHEEL_FORWARD );
+    }
+
+    __m256i offX = _mm256_add_epi32( _mm256_sign_epi32( pairLanes( ax ), signAcross ),
+                                     _mm256_sign_epi32( pairLanes( wx ), signForward ) );
+    __m256i offY = _mm256_add_epi32( _mm256_sign_epi32( pairLanes( ay ), signAcross ),
+                                     _mm256_sign_epi32( pairLanes( wy ), signForward ) );
+    __m256i px   = _mm256_srai_epi32( _mm256_add_epi32( pairLanes( fx ), offX ), FIXED_SHIFT );
+    __m256i py   = _mm256_srai_epi32( _mm256_add_epi32( pairLanes( fy ), offY ), FIXED_SHIFT );
+    px           = _mm256_add_epi32( px, pairLanes( ix ) );
+    py           = _mm256_add_epi32( py, pairLanes( iy ) );
+    px           = _mm256_min_epi32( _mm256_max_epi32( px, _mm256_setzero_si256() ), _mm256_set1_epi32( look.nMaxX ) );
+    py           = _mm256_min_epi32( _mm256_max_epi32( py, _mm256_setzero_si256() ), _mm256_set1_epi32( look.nMaxY ) );
+    __m256i qx   = mulRecip( px, _mm256_set1_epi32( int32_t( look.nRecipX ) ) );
+    __m256i qy   = mulRecip( py, _mm256_set1_epi32( int32_t( look.nRecipY ) ) );
+
+    __m256i tile  = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_srli_epi32( qy, TEXEL_BITS ),
+                                                          _mm256_set1_epi32( look.nWidth ) ),
+                                     _mm256_srli_epi32( qx, TEXEL_BITS ) );
+    __m256i texV  = _mm256_slli_epi32( _mm256_and_si256( qy, texelMask ), TEXEL_BITS );
+    __m256i texU  = _mm256_and_si256( qx, texelMask );
+    __m256i index = _mm256_or_si256( _mm256_slli_epi32( tile, 2 * TEXEL_BITS ), _mm256_or_si256( texV, texU ) );
+
+    // Eight tiles to a visual word, so the word is index / 128 and the kind's shift ( index / 16 % 8 ) * 4
+    const int * pWords = (const int *)look.pVisual;
+    __m256i     word   = _mm256_i32gather_epi32( pWords, _mm256_srli_epi32( index, 2 * TEXEL_BITS + 3 ), 4 );
+    __m256i     shift  = _mm256_and_si256( _mm256_srli_epi32( index, 2 * TEXEL_BITS - 2 ), _mm256_set1_epi32( 28 ) );
+    __m256i     kind   = _mm256_and_si256( _mm256_srlv_epi32( word, shift ), _mm256_set1_epi32( 0xF ) );
+    __m256i     texel  = _mm256_or_si256( _mm256_slli_epi32( kind, 2 * TEXEL_BITS ),
+                                          _mm256_and_si256( index, _mm256_set1_epi32( T * T - 1 ) ) );
+
+    // Sixteen grips fit in two registers, so those are permuted out rather than gathered
+    __m256i gripLow  = _mm256_loadu_si256( (const __m256i *)look.pGrip );
+    __m256i gripHigh = _mm256_loadu_si256( (const __m256i *)( look.pGrip + 8 ) );
+    __m256i high     = _mm256_cmpgt_epi32( kind, _mm256_set1_epi32( 7 ) );
+    __m256i grips    = _mm256_blendv_epi8( _mm256_permutevar8x32_epi32( gripLow, kind ),
+                                           _mm256_permutevar8x32_epi32( gripHigh, kind ),
+                                           high );
+
+    alignas( 32 ) int32_t friction[8];
+    alignas( 32 ) int32_t grip[8];
+    _mm256_store_si256( (__m256i *)friction, _mm256_i32gather_epi32( look.pFriction, texel, 4 ) );
+    _mm256_store_si256( (__m256i *)grip, grips );
+
+    // Summed in 64 bits as sampleCar does, four texels of INT32_MAX friction not fitting in 32
+    for( int k = 0; k < 2; k++ )
+    {
+      fixed nFriction = 0;
+      fixed nGrip     = 0;
+      for( int w = 0; w < 4; w++ )
+      {
+        nFriction += friction[k * 4 + w];
+        nGrip += grip[k * 4 + w];
+      }
+      pOut[k] = { nFriction / 4, nGrip / 4 };
+    }
+  }
+#endif
+} // namespace
+
+SurfaceTable::SurfaceTable()
+{
+  texture.fill( NEUTRAL );
+  // Full acceleration still just beats the friction on every surface, so no car is ever stuck
+  surfaces[size_t( mapTiles::None )] = { times( 8, 5 ), times( 9, 10 ) };
+  surfaces[size_t( mapTiles::Wall )] = { times( 9, 5 ), times( 19, 20 ) };
+  for( mapTiles tile : { mapTiles::Road_L_Edge,
+                         mapTiles::Road_R_Edge,
+                         mapTiles::Road_T_Edge,
+                         mapTiles::Road_B_Edge,
+                         mapTiles::Road_TL_Corner,
+                         mapTiles::Road_TR_Corner,
+                         mapTiles::Road_BL_Corner,
+                         mapTiles::Road_BR_Corner } )
+    surfaces[size_t( tile )] = { times( 6, 5 ), FIXED_ONE };
+  for( int32_t t = 0; t < TILE_TYPES; t++ ) bake( mapTiles( t ) );
+}
+
+void SurfaceTable::set( mapTiles tile, const Surface & surface )
+{
+  // Negative friction would speed the car up and negative grip steer it backwards
+  surfaces[size_t( tile )] = { std::max<fixed>( surface.friction, 0 ), std::max<fixed>( surface.grip, 0 ) };
+  bake( tile );
+}
+
+void SurfaceTable::setTexture( mapTiles tile, const uint8_t * pTexels )
+{
+  uint8_t * pTexture = texture.data() + size_t( tile ) * TEXELS * TEXELS;
+  if( pTexels ) std::copy( pTexels, pTexels + TEXELS * TEXELS, pTexture );
+  else
+    std::fill( pTexture, pTexture + TEXELS * TEXELS, NEUTRAL );
+  bake( tile );
+}
+
+void SurfaceTable::bake( mapTiles tile )
+{
+  size_t t    = size_t( tile );
+  tileGrip[t] = int32_t( std::min<fixed>( surfaces[t].grip, INT32_MAX ) );
+  for( size_t i = t * TEXELS * TEXELS; i < ( t + 1 ) * TEXELS * TEXELS; i++ )
+    texelFriction[i] = int32_t( std::min<fixed>( surfaces[t].friction * texture[i] / NEUTRAL, INT32_MAX ) );
+}
+
+WheelGrip sampleWheels( const CarStateFx & car, const Track & track )
+{
+  WheelGrip grip;
+  SinCos    heading = fixedSinCos( car.angle );
+  sampleWheels( &car, &heading, 1, track, &grip );
+  return grip;
+}
+
+void sampleWheels( const CarStateFx * pCars, size_t nCars, const Track & track, WheelGrip * pOut )
+{
+  SinCos headings[HEADING_BATCH];
+  for( size_t i = 0; i < nCars; i += HEADING_BATCH )
+  {
+    size_t n = std::min( nCars - i, HEADING_BATCH );
+    for( size_t k = 0; k < n; k++ ) headings[k] = fixedSinCos( pCars[i + k].angle );
+    sampleWheels( pCars + i, headings, n, track, pOut + i );
+  }
+}
+
+void sampleWheels( const CarStateFx * pCars,
+                   const SinCos *     pHeadings,
+                   size_t             nCars,
+                   const Track &      track,
+                   WheelGrip *        pOut )
+{
+  if( track.width() <= 0 || track.height() <= 0 )
+  {
+    std::fill( pOut, pOut + nCars, WheelGrip() );
+    return;
+  }
+
+  const SurfaceTable & table  = track.surfaces();
+  olc::vi2d            vBlock = track.blockSize();
+  olc::vi2d            vWorld = track.worldSize();
+  WheelLookup          look;
+  look.pVisual   = track.tileMap().visualWords();
+  look.pFriction = table.frictions();
+  look.pGrip     = table.grips();
+  look.nWidth    = track.width();
+  look.nMaxX     = vWorld.x - 1;
+  look.nMaxY     = vWorld.y - 1;
+  look.nRecipX   = uint32_t( ( ( uint64_t( T ) << RECIP_SHIFT ) + vBlock.x - 1 ) / vBlock.x );
+  look.nRecipY   = uint32_t( ( ( uint64_t( T ) << RECIP_SHIFT ) + vBlock.y - 1 ) / vBlock.y );
+
+  size_t i = 0;
+#ifdef FR_X86_SIMD
+  // Lane indices are 32 bit
+  if( cpuHasAvx2() && size_t( track.width() ) * size_t( track.height() ) < ( size_t( 1 ) << 28 ) )
+    for( ; i + 2 <= nCars; i += 2 ) sampleCarPair( look, pCars + i, pHeadings + i, pOut + i );
+#endif
+  for( ; i < nCars; i++ ) pOut[i] = sampleCar( look, pCars[i], pHeadings[i] );
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Fixed.h"
+#include "TileMap.h"
+
+class Track;
+struct CarStateFx;
+
+// How a kind of tile drives, as Q16.16 multiples of tarmac so tarmac is exactly FIXED_ONE and drives as it always has
+struct Surface
+{
+  fixed friction = FIXED_ONE;  // Of the rolling friction slowing the car
+  fixed grip     = FIXED_ONE;  // Of the steering and of the acceleration and braking
+};
+
+// The surface under a car, averaged over its four wheels
+struct WheelGrip
+{
+  fixed friction = FIXED_ONE;
+  fixed grip     = FIXED_ONE;
+};
+
+// Surfaces looked up by the 4 bit visual tile, with an optional texture of friction across each kind of tile, such as
+// a rumble strip along the outside of a kerb. Friction is kept multiplied out per texel, so a wheel costs the same
+// two lookups into a kilobyte or so however many surfaces and textures there are.
+class SurfaceTable
+{
+public:
+  static constexpr int32_t TILE_TYPES = 16;
+  static constexpr int32_t TEXELS     = 4;   // Per side of a tile
+  static constexpr uint8_t NEUTRAL    = 64;  // Texel leaving the tile's friction as it is, 128 doubling it
+
+  // Grass slows the car and gives less grip, kerbs slow it a little and walls most. Textures start out neutral.
+  SurfaceTable();
+
+  const Surface & surface( mapTiles tile ) const { return surfaces[size_t( tile )]; }
+  void            set( mapTiles tile, const Surface & surface );
+
+  // TEXELS x TEXELS friction multipliers across the tile, row by row from the top left, or nullptr for a plain tile
+  void setTexture( mapTiles tile, const uint8_t * pTexels );
+
+  // Friction of texel (u, v) of tile t, found at ( t * TEXELS + v ) * TEXELS + u
+  fixed friction( uint32_t nTexel ) const { return texelFriction[nTexel]; }
+  fixed grip( uint32_t nTile ) const { return tileGrip[nTile]; }
+
+  // The same as flat tables, for sampling many wheels at once
+  const int32_t * frictions() const { return texelFriction.data(); }
+  const int32_t * grips() const { return tileGrip.data(); }
+
+private:
+  void bake( mapTiles tile );
+
+  std::array<Surface, TILE_TYPES>                   surfaces;
+  std::array<uint8_t, TILE_TYPES * TEXELS * TEXELS> texture;
+  std::array<int32_t, TILE_TYPES * TEXELS * TEXELS> texelFriction;
+  std::array<int32_t, TILE_TYPES>                   tileGrip;
+};
+
+// The track's surfaces under each wheel, the car being 10 x 20. Wheels off the map read the tile at its edge. There
+// are no branches on the surface or position, so a field of cars costs the same wherever it is driving. Each wheel is
+// one index into the tiles and texels, eight wheels at a time on CPUs with AVX2, exact for worlds below
+// 2^29 / blockSize pixels across.
+WheelGrip sampleWheels( const CarStateFx & car, const Track & track );
+void      sampleWheels( const CarStateFx * pCars, size_t nCars, const Track & track, WheelGrip * pOut );
+
+// As above with the sine and cosine of each car's heading already known, pHeadings[i] being that of pCars[i]
+void sampleWheels( const CarStateFx * pCars,
+                   const SinCos *     pHeadings,
+                   size_t             nCars,
+                   const Track &      track,
+                   WheelGrip *        pOut );
@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool( size_t nThreads )
+{
+  if( nThreads == 0 ) nThreads = std::max( 1u, std::thread::hardware_concurrency() );
+  shares = std::make_unique<Share[]>( nThreads );
+  for( size_t i = 1; i < nThreads; i++ ) workers.emplace_back( &ThreadPool::workerLoop, this, i );
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    bQuit = true;
+  }
+  wake.notify_all();
+  for( std::thread & t : workers ) t.join();
+}
+
+void ThreadPool::parallelFor( size_t n, size_t nGrainSize, const std::function<void( size_t, size_t )> & func )
+{
+  if( n == 0 ) return;
+  nGrainSize = std::max<size_t>( nGrainSize, 1 );
+  if( workers.empty() || n <= nGrainSize )
+  {
+    func( 0, n );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    for( size_t i = 0; i < size(); i++ )
+    {
+      shares[i].next = n * i / size();
+      shares[i].end  = n * ( i + 1 ) / size();
+    }
+    pFunc  = &func;
+    nGrain = nGrainSize;
+    nBusy  = workers.size();
+    nGeneration++;
+  }
+  wake.notify_all();
+  runShares( 0 );
+
+  std::unique_lock<std::mutex> lock( mutex );
+  done.wait( lock, [&] { return nBusy == 0; } );
+  pFunc = nullptr;
+}
+
+void ThreadPool::parallelFor( size_t n, const std::function<void( size_t )> & func )
+{
+  parallelFor( n, 1, [&]( size_t nBegin, size_t nEnd ) {
+    for( size_t i = nBegin; i < nEnd; i++ ) func( i );
+  } );
+}
+
+void ThreadPool::runShares( size_t nIndex )
+{
+  // Our own share first, then the others in turn starting with our neighbour
+  for( size_t k = 0; k < size(); k++ )
+  {
+    Share & share = shares[( nIndex + k ) % size()];
+    while( true )
+    {
+      size_t nBegin = share.next.fetch_add( nGrain );
+      if( nBegin >= share.end ) break;
+      ( *pFunc )( nBegin, std::min( nBegin + nGrain, share.end ) );
+    }
+  }
+}
+
+void ThreadPool::workerLoop( size_t nIndex )
+{
+  uint64_t nSeen = 0;
+  while( true )
+  {
+    {
+      std::unique_lock<std::mutex> lock( mutex );
+      wake.wait( lock, [&] { return bQuit || nGeneration != nSeen; } );
+      if( bQuit ) return;
+      nSeen = nGeneration;
+    }
+
+    runShares( nIndex );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    if( --nBusy == 0 ) done.notify_one();
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops. The calling thread joins in, so a pool of size 1 has no
+// workers and runs everything inline.
+//
+// A loop's range is split evenly between the threads up front. Each thread works through its own share a grain at
+// a time and, once that runs out, steals grains from the others, so uneven work still balances without every thread
+// contending on one counter.
+class ThreadPool
+{
+public:
+  // 0 uses every hardware thread
+  explicit ThreadPool( size_t nThreads = 0 );
+  ~ThreadPool();
+  ThreadPool( const ThreadPool & )             = delete;
+  ThreadPool & operator=( const ThreadPool & ) = delete;
+
+  size_t size() const { return workers.size() + 1; }
+
+  // Calls func( begin, end ) over [0, n) in pieces of up to nGrain items, returning once all have finished
+  void parallelFor( size_t n, size_t nGrain, const std::function<void( size_t, size_t )> & func );
+
+  // Calls func( i ) for every i in [0, n)
+  void parallelFor( size_t n, const std::function<void( size_t )> & func );
+
+private:
+  // One thread's share of the current loop, padded so neighbouring counters don't share a cache line
+  struct alignas( 64 ) Share
+  {
+    std::atomic<size_t> next = 0;
+    size_t              end  = 0;
+  };
+
+  void workerLoop( size_t nIndex );
+  void runShares( size_t nIndex );
+
+  std::vector<std::thread>                      workers;
+  std::unique_ptr<Share[]>                      shares;
+  std::mutex                                    mutex;
+  std::condition_variable                       wake;
+  std::condition_variable                       done;
+  const std::function<void( size_t, size_t )> * pFunc       = nullptr;
+  size_t                                        nGrain      = 1;
+  size_t                                        nBusy       = 0;  // Workers still inside the current loop
+  uint64_t                                      nGeneration = 0;
+  bool                                          bQuit       = false;
+};
@@ -0,0 +1,125 @@
+#include "TileMap.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace
+{
+  uint32_t popcount( uint64_t v )
+  {
+#ifdef _MSC_VER
+    return uint32_t( __popcnt64( v ) );
+#else
+    return uint32_t( __builtin_popcountll( v ) );
+#endif
+  }
+
+  // Bits [from, to) of a word, to in 1..64
+  uint64_t spanMask( int32_t from, int32_t to )
+  {
+    uint64_t high = to == 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << to ) - 1;
+    return high & ~( ( uint64_t( 1 ) << from ) - 1 );
+  }
+
+  // Calls func( word, mask ) for every word of the rect's rows in a bitplane, returning early once it says so
+  template<typename Func>
+  void forRectWords( const uint64_t * pPlane,
+                     int32_t          nRowWords,
+                     int32_t          x0,
+                     int32_t          x1,
+                     int32_t          y0,
+                     int32_t          y1,
+                     Func             func )
+  {
+    int32_t  nFirst    = x0 >> 6;
+    int32_t  nLast     = ( x1 - 1 ) >> 6;
+    uint64_t firstMask = spanMask( x0 & 63, nFirst == nLast ? ( ( x1 - 1 ) & 63 ) + 1 : 64 );
+    uint64_t lastMask  = spanMask( 0, ( ( x1 - 1 ) & 63 ) + 1 );
+    for( int32_t y = y0; y < y1; y++ )
+    {
+      const uint64_t * pRow = pPlane + size_t( y ) * nRowWords;
+      if( func( pRow[nFirst] & firstMask ) ) return;
+      for( int32_t w = nFirst + 1; w < nLast; w++ )
+        if( func( pRow[w] ) ) return;
+      if( nLast > nFirst && func( pRow[nLast] & lastMask ) ) return;
+    }
+  }
+} // namespace
+
+TileMap::TileMap( int32_t width, int32_t height )
+  : nWidth( width ),
+    nHeight( height ),
+    nRowWords( ( width + 63 ) >> 6 ),
+    visual( ( size_t( width ) * height + 15 ) >> 4 )
+{
+  for( auto & plane : planes ) plane.resize( size_t( nRowWords ) * height );
+  clear();
+}
+
+void TileMap::clear()
+{
+  std::fill( visual.begin(), visual.end(), 0 );
+  for( auto & plane : planes ) std::fill( plane.begin(), plane.end(), 0 );
+
+  // mapTiles::None is off-road
+  for( int32_t y = 0; y < nHeight && nWidth > 0; y++ )
+  {
+    uint64_t * pRow = planes[size_t( TileLayer::OffRoad )].data() + size_t( y ) * nRowWords;
+    std::fill( pRow, pRow + nRowWords, ~uint64_t( 0 ) );
+    pRow[nRowWords - 1] = spanMask( 0, ( ( nWidth - 1 ) & 63 ) + 1 );
+  }
+}
+
+void TileMap::set( int32_t x, int32_t y, mapTiles tile )
+{
+  int32_t    index = y * nWidth + x;
+  uint64_t & word  = visual[index >> 4];
+  int32_t    shift = ( index & 15 ) * 4;
+  word             = ( word & ~( uint64_t( 0xF ) << shift ) ) | ( uint64_t( tile ) << shift );
+
+  size_t   nAt = size_t( y ) * nRowWords + ( x >> 6 );
+  uint64_t bit = uint64_t( 1 ) << ( x & 63 );
+  bool     bIn[size_t( TileLayer::Count )] = { tile == mapTiles::Wall,
+                                                 tile != mapTiles::Wall && tile != mapTiles::None,
+                                                 tile == mapTiles::None };
+  for( size_t i = 0; i < size_t( TileLayer::Count ); i++ )
+    planes[i][nAt] = ( planes[i][nAt] & ~bit ) | ( bIn[i] ? bit : 0 );
+}
+
+bool TileMap::any( TileLayer layer, const TileRect & rect ) const
+{
+  int32_t x0 = std::max( rect.x, 0 ), x1 = std::min( rect.x + rect.w, nWidth );
+  int32_t y0 = std::max( rect.y, 0 ), y1 = std::min( rect.y + rect.h, nHeight );
+  if( x1 <= x0 || y1 <= y0 ) return false;
+
+  bool bAny = false;
+  forRectWords( planes[size_t( layer )].data(), nRowWords, x0, x1, y0, y1, [&]( uint64_t word ) {
+    bAny = word != 0;
+    return bAny;
+  } );
+  return bAny;
+}
+
+uint32_t TileMap::count( TileLayer layer, const TileRect & rect ) const
+{
+  int32_t x0 = std::max( rect.x, 0 ), x1 = std::min( rect.x + rect.w, nWidth );
+  int32_t y0 = std::max( rect.y, 0 ), y1 = std::min( rect.y + rect.h, nHeight );
+  if( x1 <= x0 || y1 <= y0 ) return 0;
+
+  uint32_t nCount = 0;
+  forRectWords( planes[size_t( layer )].data(), nRowWords, x0, x1, y0, y1, [&]( uint64_t word ) {
+    nCount += popcount( word );
+    return false;
+  } );
+  return nCount;
+}
+
+size_t TileMap::memoryBytes() const
+{
+  size_t nBytes = visual.size() * sizeof( uint64_t );
+  for( const auto & plane : planes ) nBytes += plane.size() * sizeof( uint64_t );
+  return nBytes;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "olcPixelGameEngine.h"
+
+// Xlib defines None as a macro, which would swallow mapTiles::None on Linux builds
+#ifdef None
+#  undef None
+#endif
+
+enum class mapTiles {
+  None,
+  Wall,
+  Road,
+  Road_L_Edge,
+  Road_R_Edge,
+  Road_T_Edge,
+  Road_B_Edge,
+  Road_TL_Corner,
+  Road_TR_Corner,
+  Road_BL_Corner,
+  Road_BR_Corner
+};
+
+// Surfaces with their own bitplane. Road covers every tarmac tile, edges and corners included.
+enum class TileLayer {
+  Wall,
+  Road,
+  OffRoad,
+  Count
+};
+
+// Inclusive of (x, y), exclusive of (x + w, y + h). Queries clip it to the map.
+struct TileRect
+{
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+};
+
+// Tile grid stored as a visual layer of 4 bit tiles, 16 to a word, plus one bit per tile for each TileLayer.
+// Bitplane rows start on a word boundary, so a rect query is a masked OR or popcount over a few words per row.
+class TileMap
+{
+public:
+  TileMap() = default;
+  TileMap( int32_t width, int32_t height );
+
+  int32_t width() const { return nWidth; }
+  int32_t height() const { return nHeight; }
+
+  // Index is y * width + x
+  mapTiles get( int32_t index ) const { return mapTiles( ( visual[index >> 4] >> ( ( index & 15 ) * 4 ) ) & 0xF ); }
+  void     set( int32_t index, mapTiles tile ) { set( index % nWidth, index / nWidth, tile ); }
+  void     set( int32_t x, int32_t y, mapTiles tile );
+
+  // The visual layer as little endian 32 bit words for gathering, tile i in bits ( i % 8 ) * 4 of word i / 8
+  const uint32_t * visualWords() const { return (const uint32_t *)visual.data(); }
+
+  // Every tile back to mapTiles::None
+  void clear();
+
+  bool test( TileLayer layer, int32_t x, int32_t y ) const
+  {
+    return ( planes[size_t( layer )][size_t( y ) * nRowWords + ( x >> 6 )] >> ( x & 63 ) ) & 1;
+  }
+
+  bool     any( TileLayer layer, const TileRect & rect ) const;
+  uint32_t count( TileLayer layer, const TileRect & rect ) const;
+
+  // Row y of a bitplane, bit x % 64 of word x / 64 set for tile x
+  const uint64_t * row( TileLayer layer, int32_t y ) const { return planes[size_t( layer )].data() + y * nRowWords; }
+
+  size_t memoryBytes() const;
+
+private:
+  int32_t               nWidth    = 0;
+  int32_t               nHeight   = 0;
+  int32_t               nRowWords = 0;
+  std::vector<uint64_t> visual;
+  std::vector<uint64_t> planes[size_t( TileLayer::Count )];
+};
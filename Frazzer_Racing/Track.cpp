@@ -0,0 +1,209 @@
+#include "Track.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "Autotile.h"
+#include "BitStream.h"
+
+namespace
+{
+  const uint32_t TRACK_MAGIC   = 0x4B545246;  // "FRTK"
+  const uint32_t TRACK_VERSION = 3;  // 1 had no gates, 2 no centreline
+
+  // Largest map a track file may ask for, so a corrupt header can't allocate gigabytes
+  const int64_t  MAX_TRACK_TILES = int64_t( 1 ) << 30;
+  const uint32_t MAX_TRACK_GATES = 1 << 16;
+  const uint32_t MAX_TRACK_LINE  = 1 << 20;
+
+  uint32_t floatBits( float f )
+  {
+    uint32_t bits;
+    std::memcpy( &bits, &f, sizeof( bits ) );
+    return bits;
+  }
+
+  float bitsFloat( uint32_t bits )
+  {
+    float f;
+    std::memcpy( &f, &bits, sizeof( f ) );
+    return f;
+  }
+
+  bool readTrack( const std::string & sFile, Track & track )
+  {
+    std::ifstream ifs( sFile, std::ios::binary );
+    if( !ifs.is_open() ) return false;
+    std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( ifs ) ), std::istreambuf_iterator<char>() );
+
+    BitReader reader( data.data(), data.size() );
+    if( reader.read( 32 ) != TRACK_MAGIC ) return false;
+    uint32_t nVersion = reader.read( 32 );
+    if( nVersion < 1 || nVersion > TRACK_VERSION ) return false;
+    int32_t   nWidth  = int32_t( reader.read( 32 ) );
+    int32_t   nHeight = int32_t( reader.read( 32 ) );
+    olc::vi2d vBlock  = { int32_t( reader.read( 32 ) ), int32_t( reader.read( 32 ) ) };
+    if( nWidth <= 0 || nHeight <= 0 || int64_t( nWidth ) * nHeight > MAX_TRACK_TILES || vBlock.x <= 0 || vBlock.y <= 0 )
+      return false;
+
+    // Runs of one painted tile, row by row
+    Track   loaded( nWidth, nHeight, vBlock );
+    int64_t nTiles = int64_t( nWidth ) * nHeight;
+    for( int64_t i = 0; i < nTiles; )
+    {
+      mapTiles tile = paintedTile( mapTiles( reader.read( 4 ) ) );
+      uint32_t nRun = reader.readGamma();
+      if( reader.overrun() || nRun == 0 || i + nRun > nTiles ) return false;
+
+      // A new track is all grass already, which is most of any track
+      if( tile == mapTiles::None ) i += nRun;
+      else
+        for( int64_t end = i + nRun; i < end; i++ )
+          loaded.set( { int32_t( i % nWidth ), int32_t( i / nWidth ) }, tile );
+    }
+
+    // Each gate is four floats, so a count the rest of the file can't hold is rejected before allocating
+    uint32_t nGates = nVersion >= 2 ? reader.read( 32 ) : 0;
+    if( reader.overrun() || nGates > MAX_TRACK_GATES || ( data.size() * 8 - reader.bitPos() ) / 128 < nGates )
+      return false;
+    std::vector<Gate> gates( nGates );
+    for( Gate & gate : gates )
+    {
+      gate.a = { bitsFloat( reader.read( 32 ) ), bitsFloat( reader.read( 32 ) ) };
+      gate.b = { bitsFloat( reader.read( 32 ) ), bitsFloat( reader.read( 32 ) ) };
+    }
+    uint32_t nLine = nVersion >= 3 ? reader.read( 32 ) : 0;
+    if( reader.overrun() || nLine > MAX_TRACK_LINE || ( data.size() * 8 - reader.bitPos() ) / 64 < nLine ) return false;
+    std::vector<olc::vf2d> line( nLine );
+    for( olc::vf2d & point : line ) point = { bitsFloat( reader.read( 32 ) ), bitsFloat( reader.read( 32 ) ) };
+    if( reader.overrun() ) return false;
+    loaded.setGates( std::move( gates ) );
+    loaded.setCentreline( std::move( line ) );
+    track = std::move( loaded );
+    return true;
+  }
+} // namespace
+
+Gate gateAcross( const olc::vf2d & vPos, const olc::vf2d & vDir, float fHalfWidth )
+{
+  // From the right of the heading to its left, which driving along vDir crosses forwards
+  olc::vf2d vSide = olc::vf2d( vDir.y, -vDir.x ).norm() * fHalfWidth;
+  return { vPos - vSide, vPos + vSide };
+}
+
+Track::Track( int32_t width, int32_t height, const olc::vi2d & vBlockSize )
+  : nWidth( width )
+  , nHeight( height )
+  , vBlockSize( vBlockSize )
+  , nRecipX( ( ( uint64_t( 1 ) << 32 ) + vBlockSize.x - 1 ) / vBlockSize.x )
+  , nRecipY( ( ( uint64_t( 1 ) << 32 ) + vBlockSize.y - 1 ) / vBlockSize.y )
+  , tiles( width, height )
+{}
+
+void Track::buildDefault()
+{
+  for( int y = 0; y < nHeight; y++ )
+  {
+    for( int x = 0; x < nWidth; x++ )
+    {
+      if( x == 0 || y == 0 || x == nWidth - 1 || y == nHeight - 1 )
+        tiles.set( x, y, mapTiles::Wall );
+      else if( x >= 10 && x <= 70 && y >= 5 && y <= 9 )
+        tiles.set( x, y, mapTiles::Road );
+      else if( x >= 10 && x <= 70 && y >= 30 && y <= 34 )
+        tiles.set( x, y, mapTiles::Road );
+      else if( x >= 10 && x <= 15 && y >= 5 && y <= 34 )
+        tiles.set( x, y, mapTiles::Road );
+      else if( x >= 65 && x <= 70 && y >= 5 && y <= 34 )
+        tiles.set( x, y, mapTiles::Road );
+      else
+        tiles.set( x, y, mapTiles::None );
+    }
+  }
+  autotile( *this );
+
+  // Start line just ahead of the grid on the left leg, then a sector split on each of the other three sides
+  gateList = { gateAcross( { 130.0f, 190.0f }, { 0.0f, -1.0f }, 40.0f ),
+               gateAcross( { 400.0f, 75.0f }, { 1.0f, 0.0f }, 35.0f ),
+               gateAcross( { 680.0f, 200.0f }, { 0.0f, 1.0f }, 40.0f ),
+               gateAcross( { 400.0f, 325.0f }, { -1.0f, 0.0f }, 35.0f ) };
+  centrePoints = { { 130.0f, 190.0f }, { 130.0f, 75.0f }, { 680.0f, 75.0f }, { 680.0f, 325.0f }, { 130.0f, 325.0f } };
+}
+
+void Track::buildEmpty()
+{
+  tiles.clear();
+  gateList.clear();
+  centrePoints.clear();
+  for( int x = 0; x < nWidth; x++ )
+  {
+    tiles.set( x, 0, mapTiles::Wall );
+    tiles.set( x, nHeight - 1, mapTiles::Wall );
+  }
+  for( int y = 0; y < nHeight; y++ )
+  {
+    tiles.set( 0, y, mapTiles::Wall );
+    tiles.set( nWidth - 1, y, mapTiles::Wall );
+  }
+}
+
+uint32_t Track::checksum() const
+{
+  uint32_t hash = 2166136261u;
+  auto     mix  = [&]( uint32_t v ) {
+    for( int i = 0; i < 4; i++ ) hash = ( hash ^ ( ( v >> ( i * 8 ) ) & 0xFF ) ) * 16777619u;
+  };
+  mix( nWidth );
+  mix( nHeight );
+  for( int i = 0; i < nWidth * nHeight; i++ ) mix( uint32_t( tiles.get( i ) ) );
+  return hash;
+}
+
+bool saveTrack( const Track & track, const std::string & sFile )
+{
+  BitWriter writer;
+  writer.write( TRACK_MAGIC, 32 );
+  writer.write( TRACK_VERSION, 32 );
+  writer.write( uint32_t( track.width() ), 32 );
+  writer.write( uint32_t( track.height() ), 32 );
+  writer.write( uint32_t( track.blockSize().x ), 32 );
+  writer.write( uint32_t( track.blockSize().y ), 32 );
+
+  int32_t nTiles = track.width() * track.height();
+  for( int32_t i = 0; i < nTiles; )
+  {
+    mapTiles tile = paintedTile( track[i] );
+    int32_t  nRun = 1;
+    while( i + nRun < nTiles && paintedTile( track[i + nRun] ) == tile ) nRun++;
+    writer.write( uint32_t( tile ), 4 );
+    writer.writeGamma( uint32_t( nRun ) );
+    i += nRun;
+  }
+
+  writer.write( uint32_t( track.gates().size() ), 32 );
+  for( const Gate & gate : track.gates() )
+    for( float f : { gate.a.x, gate.a.y, gate.b.x, gate.b.y } ) writer.write( floatBits( f ), 32 );
+  writer.write( uint32_t( track.centreline().size() ), 32 );
+  for( const olc::vf2d & point : track.centreline() )
+    for( float f : { point.x, point.y } ) writer.write( floatBits( f ), 32 );
+
+  std::ofstream ofs( sFile, std::ios::binary );
+  if( !ofs.is_open() ) return false;
+  ofs.write( (const char *)writer.bytes().data(), writer.bytes().size() );
+  return ofs.good();
+}
+
+bool loadTrack( const std::string & sFile, Track & track )
+{
+  if( !readTrack( sFile, track ) ) return false;
+  autotile( track );
+  return true;
+}
+
+bool loadTrack( const std::string & sFile, Track & track, ThreadPool & pool )
+{
+  if( !readTrack( sFile, track ) ) return false;
+  autotile( track, pool );
+  return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Surface.h"
+#include "ThreadPool.h"
+#include "TileMap.h"
+#include "olcPixelGameEngine.h"
+
+// A checkpoint line across the road, in world pixels. Cars pass it forwards by crossing from the left of a -> b to
+// its right, as drawn on screen.
+struct Gate
+{
+  olc::vf2d a;
+  olc::vf2d b;
+};
+
+// The gate across the road at vPos for cars heading along vDir, reaching fHalfWidth to either side
+Gate gateAcross( const olc::vf2d & vPos, const olc::vf2d & vDir, float fHalfWidth );
+
+// The tile grid a race is driven on, independent of any window so it can be simulated headless
+class Track
+{
+public:
+  Track() = default;
+  Track( int32_t width, int32_t height, const olc::vi2d & vBlockSize = { 10, 10 } );
+
+  // The oval with a wall around the border, kerbs added by the autotiler
+  void buildDefault();
+
+  // Grass inside the border wall with no gates or centreline, for painting a new track on
+  void buildEmpty();
+
+  mapTiles operator[]( int index ) const { return tiles.get( index ); }
+  void     set( olc::vi2d cord, mapTiles tile ) { tiles.set( cord.x, cord.y, tile ); }
+
+  const TileMap & tileMap() const { return tiles; }
+
+  // Checkpoint gates in the order they are driven, gate 0 being the start and finish line
+  const std::vector<Gate> & gates() const { return gateList; }
+  void                      setGates( std::vector<Gate> gates ) { gateList = std::move( gates ); }
+
+  // The middle of the road as a closed loop in world pixels, from the start line in the direction of racing. Empty
+  // for tracks painted without one.
+  const std::vector<olc::vf2d> & centreline() const { return centrePoints; }
+  void setCentreline( std::vector<olc::vf2d> points ) { centrePoints = std::move( points ); }
+
+  // How each kind of tile drives. Not saved with the track or in its checksum, every track driving on the same
+  // table unless a game sets its own.
+  const SurfaceTable & surfaces() const { return surfaceTable; }
+  void                 setSurfaces( const SurfaceTable & table ) { surfaceTable = table; }
+
+  int32_t   width() const { return nWidth; }
+  int32_t   height() const { return nHeight; }
+  olc::vi2d blockSize() const { return vBlockSize; }
+  olc::vi2d worldSize() const { return olc::vi2d( nWidth, nHeight ) * vBlockSize; }
+
+  // Multiplies by a 32.32 reciprocal of the block size rather than dividing, exact for coordinates below
+  // 2^32 / blockSize. Negative coordinates map to tile -1.
+  olc::vi2d worldCordToTileCord( olc::vi2d cord ) const
+  {
+    return { cord.x < 0 ? -1 : int32_t( ( uint64_t( cord.x ) * nRecipX ) >> 32 ),
+             cord.y < 0 ? -1 : int32_t( ( uint64_t( cord.y ) * nRecipY ) >> 32 ) };
+  }
+  int       cordToIndex( olc::vi2d pos ) const { return cordToIndex( pos.x, pos.y ); }
+  int       cordToIndex( int x, int y ) const { return y * nWidth + x; }
+  bool      inRange( olc::vi2d cord ) const
+  {
+    return cord.x >= 0 && cord.x < nWidth && cord.y >= 0 && cord.y < nHeight;
+  }
+
+  // Tarmac, including the kerbed edge and corner tiles
+  bool isRoad( olc::vi2d cord ) const { return inRange( cord ) && tiles.test( TileLayer::Road, cord.x, cord.y ); }
+  bool isWall( olc::vi2d cord ) const { return inRange( cord ) && tiles.test( TileLayer::Wall, cord.x, cord.y ); }
+
+  // FNV-1a over the size and tiles, so recordings can check they are replayed on the same track
+  uint32_t checksum() const;
+
+private:
+  int32_t                nWidth     = 0;
+  int32_t                nHeight    = 0;
+  olc::vi2d              vBlockSize = { 10, 10 };
+  uint64_t               nRecipX    = 0;  // ceil( 2^32 / vBlockSize )
+  uint64_t               nRecipY    = 0;
+  TileMap                tiles;
+  std::vector<Gate>      gateList;
+  std::vector<olc::vf2d> centrePoints;
+  SurfaceTable           surfaceTable;
+};
+
+// Track files hold the size, the painted tiles run-length coded, the gates and the centreline. Kerbs are re-derived
+// when loading, across the pool if one is given.
+bool saveTrack( const Track & track, const std::string & sFile );
+bool loadTrack( const std::string & sFile, Track & track );
+bool loadTrack( const std::string & sFile, Track & track, ThreadPool & pool );
@@ -0,0 +1,351 @@
+#include "TrackEditor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "Autotile.h"
+
+namespace
+{
+  const float   MIN_ZOOM          = 0.25f;
+  const float   MAX_ZOOM          = 4.0f;
+  const float   PAN_SPEED         = 400.0f;  // Screen pixels per second
+  const int32_t MAX_BRUSH         = 16;
+  const size_t  MAX_UNDO          = 1000;
+  const size_t  MAX_CACHED_CHUNKS = 96;  // Enough to cover the screen fully zoomed out, with room to pan
+
+  int64_t chunkKey( olc::vi2d chunk ) { return ( int64_t( chunk.y ) << 32 ) | uint32_t( chunk.x ); }
+
+  const char * brushName( mapTiles tile )
+  {
+    return tile == mapTiles::Road ? "Road" : tile == mapTiles::Wall ? "Wall" : "Grass";
+  }
+} // namespace
+
+TrackEditor::TrackEditor( Track & track, const std::string & sFile, ThreadPool & pool, TileDrawer drawTile )
+  : track( track ), sFile( sFile ), pool( pool ), drawTile( std::move( drawTile ) )
+{}
+
+void TrackEditor::beginStroke()
+{
+  endStroke();
+  bStroke = true;
+}
+
+void TrackEditor::paint( olc::vi2d cord, mapTiles tile )
+{
+  if( !track.inRange( cord ) ) return;
+  int32_t  index  = track.cordToIndex( cord );
+  mapTiles before = paintedTile( track[index] );
+  if( before == tile ) return;
+
+  bool bOwnStroke = !bStroke;
+  if( bOwnStroke ) beginStroke();
+
+  // A tile painted twice in one stroke keeps its original before
+  auto it = strokeSlots.find( index );
+  if( it == strokeSlots.end() )
+  {
+    strokeSlots.emplace( index, stroke.size() );
+    stroke.push_back( { index, uint8_t( before ), uint8_t( tile ) } );
+  }
+  else
+    stroke[it->second].after = uint8_t( tile );
+  apply( index, tile );
+
+  if( bOwnStroke ) endStroke();
+}
+
+void TrackEditor::endStroke()
+{
+  bStroke = false;
+  strokeSlots.clear();
+  if( stroke.empty() ) return;
+
+  undoStack.push_back( std::move( stroke ) );
+  stroke.clear();
+  redoStack.clear();
+  if( undoStack.size() > MAX_UNDO ) undoStack.erase( undoStack.begin() );
+}
+
+bool TrackEditor::undo()
+{
+  endStroke();
+  if( undoStack.empty() ) return false;
+  TileEdit edit = std::move( undoStack.back() );
+  undoStack.pop_back();
+  for( auto it = edit.rbegin(); it != edit.rend(); ++it ) apply( it->index, mapTiles( it->before ) );
+  redoStack.push_back( std::move( edit ) );
+  return true;
+}
+
+bool TrackEditor::redo()
+{
+  endStroke();
+  if( redoStack.empty() ) return false;
+  TileEdit edit = std::move( redoStack.back() );
+  redoStack.pop_back();
+  for( const TileChange & change : edit ) apply( change.index, mapTiles( change.after ) );
+  undoStack.push_back( std::move( edit ) );
+  return true;
+}
+
+bool TrackEditor::save()
+{
+  endStroke();
+  bool bSaved = saveTrack( track, sFile );
+  sStatus     = ( bSaved ? "Saved " : "Could not save " ) + sFile;
+  return bSaved;
+}
+
+void TrackEditor::reset()
+{
+  stroke.clear();
+  strokeSlots.clear();
+  bStroke = false;
+  undoStack.clear();
+  redoStack.clear();
+  chunks.clear();
+}
+
+bool TrackEditor::load()
+{
+  endStroke();
+  Track loaded;
+  if( !loadTrack( sFile, loaded, pool ) )
+  {
+    sStatus = "Could not load " + sFile;
+    return false;
+  }
+  if( loaded.blockSize() != track.blockSize() )
+  {
+    sStatus = "Could not load " + sFile + ", its tiles are a different size";
+    return false;
+  }
+
+  track = std::move( loaded );
+  reset();
+  resetView();
+  bModified = true;
+  edited    = { 0, 0, track.width(), track.height() };
+  sStatus   = "Loaded " + sFile;
+  return true;
+}
+
+size_t TrackEditor::undoBytes() const
+{
+  size_t nBytes = 0;
+  for( const TileEdit & edit : undoStack ) nBytes += edit.size() * sizeof( TileChange );
+  for( const TileEdit & edit : redoStack ) nBytes += edit.size() * sizeof( TileChange );
+  return nBytes;
+}
+
+void TrackEditor::apply( int32_t index, mapTiles tile )
+{
+  olc::vi2d cord = { index % track.width(), index / track.width() };
+  track.set( cord, tile );
+  autotileAround( track, cord );
+  for( int32_t j = -1; j <= 1; j++ )
+    for( int32_t i = -1; i <= 1; i++ ) markDirty( cord + olc::vi2d( i, j ) );
+
+  // The kerbs round the tile may have changed with it
+  olc::vi2d vFrom = cord - olc::vi2d( 1, 1 );
+  olc::vi2d vTo   = cord + olc::vi2d( 2, 2 );
+  if( bModified )
+  {
+    vFrom = vFrom.min( { edited.x, edited.y } );
+    vTo   = vTo.max( { edited.x + edited.w, edited.y + edited.h } );
+  }
+  edited    = { vFrom.x, vFrom.y, vTo.x - vFrom.x, vTo.y - vFrom.y };
+  bModified = true;
+}
+
+void TrackEditor::markDirty( olc::vi2d cord )
+{
+  if( !track.inRange( cord ) ) return;
+
+  // Chunks that aren't cached will be drawn from scratch if they ever come into view
+  auto it = chunks.find( chunkKey( cord / CHUNK_TILES ) );
+  if( it == chunks.end() ) return;
+
+  Chunk &  chunk  = it->second;
+  uint16_t nLocal = uint16_t( ( cord.y % CHUNK_TILES ) * CHUNK_TILES + cord.x % CHUNK_TILES );
+  if( chunk.queued[nLocal] ) return;
+  chunk.queued[nLocal] = true;
+  chunk.dirty.push_back( nLocal );
+}
+
+void TrackEditor::refresh()
+{
+  for( auto & [key, chunk] : chunks )
+  {
+    if( chunk.dirty.empty() ) continue;
+    olc::vi2d vChunk = { int32_t( uint32_t( key ) ), int32_t( key >> 32 ) };
+    for( uint16_t nLocal : chunk.dirty ) drawChunkTile( chunk, vChunk, nLocal );
+    chunk.dirty.clear();
+    chunk.queued.reset();
+    chunk.bUpload = true;
+  }
+}
+
+TrackEditor::Chunk & TrackEditor::chunkAt( olc::vi2d vChunk )
+{
+  auto [it, bNew] = chunks.try_emplace( chunkKey( vChunk ) );
+  Chunk & chunk   = it->second;
+  if( bNew )
+  {
+    olc::vi2d vSize = track.blockSize() * CHUNK_TILES;
+    chunk.sprite    = std::make_unique<olc::Sprite>( vSize.x, vSize.y );
+    for( int32_t i = 0; i < CHUNK_TILES * CHUNK_TILES; i++ ) drawChunkTile( chunk, vChunk, i );
+  }
+  chunk.nLastUsed = nFrame;
+  return chunk;
+}
+
+void TrackEditor::drawChunkTile( Chunk & chunk, olc::vi2d vChunk, int32_t nLocal )
+{
+  olc::vi2d vLocal = { nLocal % CHUNK_TILES, nLocal / CHUNK_TILES };
+  olc::vi2d cord   = vChunk * CHUNK_TILES + vLocal;
+  olc::vi2d vPos   = vLocal * track.blockSize();
+
+  // Chunks hanging off the edge of the map stay transparent there
+  SpriteView view = viewOf( chunk.sprite.get() );
+  if( track.inRange( cord ) ) drawTile( view, vPos, track[track.cordToIndex( cord )] );
+  else
+    fillRect( view, vPos, track.blockSize(), olc::BLANK );
+}
+
+void TrackEditor::evictChunks()
+{
+  if( chunks.size() <= MAX_CACHED_CHUNKS ) return;
+
+  // Oldest first, never the ones on screen this frame
+  std::vector<std::pair<uint64_t, int64_t>> ages;
+  for( const auto & [key, chunk] : chunks )
+    if( chunk.nLastUsed != nFrame ) ages.emplace_back( chunk.nLastUsed, key );
+  std::sort( ages.begin(), ages.end() );
+  for( size_t i = 0; i < ages.size() && chunks.size() > MAX_CACHED_CHUNKS; i++ ) chunks.erase( ages[i].second );
+}
+
+void TrackEditor::resetView()
+{
+  vOffset = { 0.0f, 0.0f };
+  fZoom   = 1.0f;
+}
+
+void TrackEditor::cacheView( const olc::vi2d & vScreen )
+{
+  forVisibleChunks( vScreen, []( olc::vi2d, Chunk & ) {} );
+}
+
+template<typename Func>
+void TrackEditor::forVisibleChunks( const olc::vi2d & vScreen, Func func )
+{
+  refresh();
+  olc::vi2d vChunkSize = track.blockSize() * CHUNK_TILES;
+  olc::vf2d vView      = olc::vf2d( vScreen ) / fZoom;
+  olc::vi2d vTiles     = { track.width(), track.height() };
+  olc::vi2d vChunks    = ( vTiles + olc::vi2d( 1, 1 ) * ( CHUNK_TILES - 1 ) ) / CHUNK_TILES;
+  int32_t   cx0        = std::max( int32_t( std::floor( vOffset.x / vChunkSize.x ) ), 0 );
+  int32_t   cy0        = std::max( int32_t( std::floor( vOffset.y / vChunkSize.y ) ), 0 );
+  int32_t   cx1        = std::min( int32_t( std::floor( ( vOffset.x + vView.x ) / vChunkSize.x ) ), vChunks.x - 1 );
+  int32_t   cy1        = std::min( int32_t( std::floor( ( vOffset.y + vView.y ) / vChunkSize.y ) ), vChunks.y - 1 );
+  for( int32_t cy = cy0; cy <= cy1; cy++ )
+    for( int32_t cx = cx0; cx <= cx1; cx++ ) func( olc::vi2d( cx, cy ), chunkAt( { cx, cy } ) );
+}
+
+olc::vi2d TrackEditor::tileUnderMouse( olc::PixelGameEngine & pge ) const
+{
+  olc::vf2d vWorld = olc::vf2d( pge.GetMousePos() ) / fZoom + vOffset;
+  return { int32_t( std::floor( vWorld.x / track.blockSize().x ) ),
+           int32_t( std::floor( vWorld.y / track.blockSize().y ) ) };
+}
+
+void TrackEditor::update( olc::PixelGameEngine & pge )
+{
+  nFrame++;
+  bool bCtrl = pge.GetKey( olc::Key::CTRL ).bHeld;
+
+  if( pge.GetKey( olc::Key::K1 ).bPressed ) brush = mapTiles::Road;
+  if( pge.GetKey( olc::Key::K2 ).bPressed ) brush = mapTiles::Wall;
+  if( pge.GetKey( olc::Key::K3 ).bPressed ) brush = mapTiles::None;
+  if( pge.GetKey( olc::Key::MINUS ).bPressed ) nBrushSize = std::max( nBrushSize - 1, 1 );
+  if( pge.GetKey( olc::Key::EQUALS ).bPressed ) nBrushSize = std::min( nBrushSize + 1, MAX_BRUSH );
+
+  if( bCtrl && pge.GetKey( olc::Key::Z ).bPressed ) sStatus = undo() ? "Undone" : "Nothing to undo";
+  if( bCtrl && pge.GetKey( olc::Key::Y ).bPressed ) sStatus = redo() ? "Redone" : "Nothing to redo";
+  if( bCtrl && pge.GetKey( olc::Key::S ).bPressed ) save();
+  if( bCtrl && pge.GetKey( olc::Key::L ).bPressed ) load();
+
+  // Zoom about the mouse, so the tile under it stays put
+  olc::vf2d vMouse = pge.GetMousePos();
+  if( int32_t nWheel = pge.GetMouseWheel() )
+  {
+    olc::vf2d vAnchor = vMouse / fZoom + vOffset;
+    fZoom             = std::clamp( fZoom * ( nWheel > 0 ? 1.25f : 0.8f ), MIN_ZOOM, MAX_ZOOM );
+    vOffset           = vAnchor - vMouse / fZoom;
+  }
+
+  float fPan = PAN_SPEED * pge.GetElapsedTime() / fZoom;
+  if( pge.GetKey( olc::Key::LEFT ).bHeld ) vOffset.x -= fPan;
+  if( pge.GetKey( olc::Key::RIGHT ).bHeld ) vOffset.x += fPan;
+  if( pge.GetKey( olc::Key::UP ).bHeld ) vOffset.y -= fPan;
+  if( pge.GetKey( olc::Key::DOWN ).bHeld ) vOffset.y += fPan;
+  if( pge.GetMouse( 2 ).bHeld ) vOffset -= ( vMouse - olc::vf2d( vLastMouse ) ) / fZoom;
+  vLastMouse = pge.GetMousePos();
+
+  // Paint along the line from the last painted tile, so a fast mouse leaves no gaps
+  bool      bLeft  = pge.GetMouse( 0 ).bHeld;
+  bool      bRight = pge.GetMouse( 1 ).bHeld;
+  olc::vi2d vTile  = tileUnderMouse( pge );
+  if( ( bLeft || bRight ) && !bCtrl )
+  {
+    if( !bStroke )
+    {
+      beginStroke();
+      vLastPaint = vTile;
+    }
+    mapTiles  tile    = bLeft ? brush : mapTiles::None;
+    olc::vi2d vDelta  = vTile - vLastPaint;
+    olc::vi2d vCentre = olc::vi2d( 1, 1 ) * ( ( nBrushSize - 1 ) / 2 );
+    int32_t   nSteps  = std::max( std::abs( vDelta.x ), std::abs( vDelta.y ) );
+    for( int32_t s = 0; s <= nSteps; s++ )
+    {
+      olc::vi2d vAt = vLastPaint + ( nSteps ? vDelta * s / nSteps : olc::vi2d( 0, 0 ) ) - vCentre;
+      for( int32_t j = 0; j < nBrushSize; j++ )
+        for( int32_t i = 0; i < nBrushSize; i++ ) paint( vAt + olc::vi2d( i, j ), tile );
+    }
+    vLastPaint = vTile;
+  }
+  else if( bStroke )
+    endStroke();
+
+  // Draw the chunks in view, bringing their cached sprites up to date first
+  pge.Clear( olc::VERY_DARK_GREY );
+  olc::vi2d vChunkSize = track.blockSize() * CHUNK_TILES;
+  forVisibleChunks( { pge.ScreenWidth(), pge.ScreenHeight() }, [&]( olc::vi2d vChunk, Chunk & chunk ) {
+    if( !chunk.decal ) chunk.decal = std::make_unique<olc::Decal>( chunk.sprite.get() );
+    else if( chunk.bUpload )
+      chunk.decal->Update();
+    chunk.bUpload  = false;
+    olc::vf2d vPos = ( olc::vf2d( vChunk * vChunkSize ) - vOffset ) * fZoom;
+    pge.DrawDecal( vPos, chunk.decal.get(), { fZoom, fZoom } );
+  } );
+  evictChunks();
+
+  // Brush outline and status
+  olc::vi2d vBrushTile = vTile - olc::vi2d( 1, 1 ) * ( ( nBrushSize - 1 ) / 2 );
+  olc::vf2d vBrushPos  = ( olc::vf2d( vBrushTile * track.blockSize() ) - vOffset ) * fZoom;
+  pge.FillRectDecal( vBrushPos, olc::vf2d( track.blockSize() * nBrushSize ) * fZoom, { 255, 255, 255, 80 } );
+
+  pge.DrawStringDecal( { 11, 11 },
+                       "EDITOR (F4 to race)  brush " + std::string( brushName( brush ) ) + " x"
+                         + std::to_string( nBrushSize ) + "  zoom " + std::to_string( int( fZoom * 100 ) ) + "%" );
+  pge.DrawStringDecal( { 11, 20 },
+                       "tile " + std::to_string( vTile.x ) + "," + std::to_string( vTile.y ) + " of "
+                         + std::to_string( track.width() ) + "x" + std::to_string( track.height() ) + "  undo "
+                         + std::to_string( undoStack.size() ) + " (" + std::to_string( undoBytes() )
+                         + " bytes)  chunks " + std::to_string( chunks.size() ) );
+  if( !sStatus.empty() ) pge.DrawStringDecal( { 11, 29 }, sStatus );
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SpriteView.h"
+#include "ThreadPool.h"
+#include "Track.h"
+#include "olcPixelGameEngine.h"
+
+// A painted tile before and after one change, kerbs are re-derived rather than stored
+struct TileChange
+{
+  int32_t index;
+  uint8_t before;
+  uint8_t after;
+};
+
+// Everything one mouse stroke changed, undone and redone as a unit
+using TileEdit = std::vector<TileChange>;
+
+// Mouse driven painting of Road, Wall and grass onto a track, with undo and redo.
+//
+// The map is drawn from a cache of chunk sprites, each CHUNK_TILES tiles square, built only for chunks that come into
+// view and evicted least recently used. An edit queues just the tiles it touched (and the kerbs around them) for
+// redrawing in the cached chunks they fall in, so the cost of an edit never depends on the size of the track.
+//
+// Left mouse paints the brush, right mouse paints grass. 1 / 2 / 3 pick Road, Wall or grass, - and = resize the brush,
+// the wheel zooms, arrows or the middle mouse pan. Ctrl+Z undoes, Ctrl+Y redoes, Ctrl+S saves and Ctrl+L reloads.
+class TrackEditor
+{
+public:
+  // Draws one tile into a chunk sprite, so the editor uses whatever art and theme the game is using
+  using TileDrawer = std::function<void( const SpriteView & target, const olc::vi2d & pos, mapTiles tile )>;
+
+  static constexpr int32_t CHUNK_TILES = 32;
+
+  // Loads go through pool, which must outlive the editor
+  TrackEditor( Track & track, const std::string & sFile, ThreadPool & pool, TileDrawer drawTile );
+
+  // Input and drawing for one frame while editing
+  void update( olc::PixelGameEngine & pge );
+
+  // Everything painted between beginStroke and endStroke is one undo step
+  void beginStroke();
+  void paint( olc::vi2d cord, mapTiles tile );
+  void endStroke();
+  bool undo();
+  bool redo();
+
+  // Files with a different block size are refused, the tile art is only drawn for the track's
+  bool save();
+  bool load();
+
+  // Brings cached chunks up to date with the edits so far, only redrawing the tiles that changed
+  void refresh();
+
+  // Refreshes, and builds any chunks missing from the cache, for a screen of the given size at the current view
+  void cacheView( const olc::vi2d & vScreen );
+
+  // Throws away every cached chunk, after the tile art or theme has changed
+  void redrawAll() { chunks.clear(); }
+
+  // Forgets the undo history, any stroke in progress and the cached chunks, after the game swaps in another track
+  void reset();
+
+  // Set once the track has been changed, until cleared by whoever reacts to it, along with the tiles it covered
+  bool             modified() const { return bModified; }
+  const TileRect & editedArea() const { return edited; }
+  void             clearModified()
+  {
+    bModified = false;
+    edited    = TileRect();
+  }
+
+  size_t cachedChunks() const { return chunks.size(); }
+  size_t undoBytes() const;
+
+private:
+  struct Chunk
+  {
+    std::unique_ptr<olc::Sprite>           sprite;
+    std::unique_ptr<olc::Decal>            decal;
+    std::vector<uint16_t>                  dirty;   // Tiles to redraw, y * CHUNK_TILES + x within the chunk
+    std::bitset<CHUNK_TILES * CHUNK_TILES> queued;  // Which tiles are already in dirty
+    bool                                   bUpload   = false;
+    uint64_t                               nLastUsed = 0;
+  };
+
+  void      apply( int32_t index, mapTiles tile );
+  void      markDirty( olc::vi2d cord );
+  Chunk &   chunkAt( olc::vi2d chunk );
+  void      drawChunkTile( Chunk & chunk, olc::vi2d chunkCord, int32_t nLocal );
+  void      evictChunks();
+  template<typename Func>
+  void      forVisibleChunks( const olc::vi2d & vScreen, Func func );
+  void      resetView();
+  olc::vi2d tileUnderMouse( olc::PixelGameEngine & pge ) const;
+
+  Track &      track;
+  std::string  sFile;
+  ThreadPool & pool;
+  TileDrawer   drawTile;
+
+  std::vector<TileEdit>               undoStack;
+  std::vector<TileEdit>               redoStack;
+  TileEdit                            stroke;
+  std::unordered_map<int32_t, size_t> strokeSlots;  // Tile index to its entry in stroke
+  bool                                bStroke   = false;
+  bool                                bModified = false;
+  TileRect                            edited;
+  std::unordered_map<int64_t, Chunk>  chunks;
+  uint64_t                            nFrame = 0;
+
+  olc::vf2d   vOffset    = { 0.0f, 0.0f };  // World position at the top left of the screen
+  float       fZoom      = 1.0f;
+  mapTiles    brush      = mapTiles::Road;
+  int32_t     nBrushSize = 1;
+  olc::vi2d   vLastPaint = { 0, 0 };
+  olc::vi2d   vLastMouse = { 0, 0 };
+  std::string sStatus;
+};
@@ -0,0 +1,315 @@
+#include "TrackGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "Autotile.h"
+#include "Physics.h"
+
+namespace
+{
+  // Scoring samples a point every half road width or so, spread further apart on big maps so a candidate costs the
+  // same to score whatever the size
+  const float MAX_SCORE_POINTS = 2048.0f;
+
+  struct Candidate
+  {
+    int32_t                nWidth = 0;
+    std::vector<olc::vf2d> controls;
+    std::vector<olc::vf2d> points;
+    float                  fStep = 0.0f;  // Sampling distance of points
+    TrackScore             score;
+  };
+
+  // Centre of the map and how far the centreline may go from it either way, in tiles
+  struct Room
+  {
+    olc::vf2d vCentre;
+    olc::vf2d vHalf;
+  };
+
+  // splitmix64, so neighbouring seeds and candidates get unrelated streams
+  uint32_t candidateSeed( uint64_t nSeed, uint32_t nCandidate )
+  {
+    uint64_t z = nSeed + 0x9E3779B97F4A7C15ull * ( uint64_t( nCandidate ) + 1 );
+    z          = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    z          = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+    return uint32_t( ( z ^ ( z >> 31 ) ) >> 32 );
+  }
+
+  // Made from the generator's raw output, as the standard distributions differ between libraries
+  float unitFloat( std::mt19937 & rng ) { return float( rng() >> 8 ) / 16777216.0f; }
+
+  Room roomFor( const Track & track, int32_t nWidth, const TrackGenParams & params )
+  {
+    // The road's edge stays nMargin tiles clear of the border wall
+    float fInset = 1.0f + params.nMargin + nWidth * 0.5f;
+    return { { track.width() * 0.5f, track.height() * 0.5f },
+             { std::max( track.width() * 0.5f - fInset, 0.0f ), std::max( track.height() * 0.5f - fInset, 0.0f ) } };
+  }
+
+  Candidate makeCandidate( const Track & track, uint64_t nSeed, uint32_t nCandidate, const TrackGenParams & params )
+  {
+    std::mt19937 rng( candidateSeed( nSeed, nCandidate ) );
+    Candidate    candidate;
+    int32_t      nWidths = std::max( params.nMaxWidth - params.nMinWidth + 1, 1 );
+    candidate.nWidth     = params.nMinWidth + int32_t( rng() % uint32_t( nWidths ) );
+
+    // Evenly round the centre, nudged along the loop and in or out, so the loop never crosses back over itself
+    Room     room    = roomFor( track, candidate.nWidth, params );
+    uint32_t nPoints = std::max( params.nControlPoints, 3u );
+    for( uint32_t i = 0; i < nPoints; i++ )
+    {
+      float fAngle  = ( float( i ) + params.fJitter * ( 2.0f * unitFloat( rng ) - 1.0f ) ) * 2.0f * PI / nPoints;
+      float fRadius = params.fMinRadius + ( params.fMaxRadius - params.fMinRadius ) * unitFloat( rng );
+      candidate.controls.push_back(
+        room.vCentre + olc::vf2d( std::cos( fAngle ) * room.vHalf.x, std::sin( fAngle ) * room.vHalf.y ) * fRadius );
+    }
+    return candidate;
+  }
+
+  // Signed turn at point i of a closed polyline, in radians
+  float turnAt( const std::vector<olc::vf2d> & points, size_t i )
+  {
+    size_t    n    = points.size();
+    olc::vf2d vIn  = points[i] - points[( i + n - 1 ) % n];
+    olc::vf2d vOut = points[( i + 1 ) % n] - points[i];
+    return std::atan2( vIn.cross( vOut ), vIn.dot( vOut ) );
+  }
+
+  uint32_t cellHash( int32_t cx, int32_t cy ) { return uint32_t( cx ) * 73856093u ^ uint32_t( cy ) * 19349663u; }
+
+  TrackScore scoreCandidate( const Track & track, const Candidate & candidate, const TrackGenParams & params )
+  {
+    const std::vector<olc::vf2d> & points = candidate.points;
+    size_t                         n      = points.size();
+    Room                           room   = roomFor( track, candidate.nWidth, params );
+    float                          fClear = candidate.nWidth + params.fGap;  // Centreline to centreline
+
+    // Two stretches fClear apart can have their samples half a step further apart than that
+    float fNear = std::sqrt( fClear * fClear + 0.25f * candidate.fStep * candidate.fStep );
+    std::vector<float>             arc( n + 1, 0.0f );
+    std::vector<uint8_t>           bad( n, 0 );
+
+    // Out of bounds, or turning about a point less than half the road width away, which folds the inside edge back
+    // over itself
+    float fWinding = 0.0f;
+    for( size_t i = 0; i < n; i++ )
+    {
+      float fStep  = ( points[( i + 1 ) % n] - points[i] ).mag();
+      arc[i + 1]   = arc[i] + fStep;
+      float fTurn  = std::abs( turnAt( points, i ) );
+      float fAlong = 0.5f * ( fStep + ( points[i] - points[( i + n - 1 ) % n] ).mag() );
+      fWinding += fTurn;
+      olc::vf2d vFromCentre = points[i] - room.vCentre;
+      bad[i] = fTurn * 0.5f * candidate.nWidth > fAlong || std::abs( vFromCentre.x ) > room.vHalf.x
+               || std::abs( vFromCentre.y ) > room.vHalf.y;
+    }
+    float fLength = arc[n];
+
+    // Stretches closer than fNear that are more than twice that apart along the loop, found through a hash of
+    // fNear sized cells, counting sorted so each cell's points are contiguous
+    size_t nTable = 1;
+    while( nTable < n * 2 ) nTable <<= 1;
+    std::vector<uint32_t> keys( n );
+    std::vector<uint32_t> starts( nTable + 1, 0 );
+    std::vector<uint32_t> order( n );
+    auto                  cellOf = [&]( const olc::vf2d & p ) {
+      return olc::vi2d( int32_t( std::floor( p.x / fNear ) ), int32_t( std::floor( p.y / fNear ) ) );
+    };
+    for( size_t i = 0; i < n; i++ )
+    {
+      olc::vi2d c = cellOf( points[i] );
+      keys[i]     = cellHash( c.x, c.y ) & uint32_t( nTable - 1 );
+      starts[keys[i] + 1]++;
+    }
+    for( size_t k = 0; k < nTable; k++ ) starts[k + 1] += starts[k];
+    std::vector<uint32_t> fill( starts.begin(), starts.end() - 1 );
+    for( size_t i = 0; i < n; i++ ) order[fill[keys[i]]++] = uint32_t( i );
+
+    for( size_t i = 0; i < n; i++ )
+    {
+      olc::vi2d c = cellOf( points[i] );
+      for( int32_t dy = -1; dy <= 1; dy++ )
+      {
+        for( int32_t dx = -1; dx <= 1; dx++ )
+        {
+          uint32_t nKey = cellHash( c.x + dx, c.y + dy ) & uint32_t( nTable - 1 );
+          for( uint32_t k = starts[nKey]; k < starts[nKey + 1]; k++ )
+          {
+            uint32_t j = order[k];
+            if( j <= i ) continue;
+            float fApart = arc[j] - arc[i];
+            if( std::min( fApart, fLength - fApart ) <= 2.0f * fNear ) continue;
+            if( ( points[j] - points[i] ).mag2() < fNear * fNear ) bad[i] = bad[j] = 1;
+          }
+        }
+      }
+    }
+
+    int32_t    nWidths = std::max( params.nMaxWidth - params.nMinWidth, 1 );
+    TrackScore score;
+    score.fLength    = fLength / std::max( 4.0f * ( room.vHalf.x + room.vHalf.y ), 1.0f );
+    score.fCurvature = std::clamp( ( fWinding / ( 2.0f * PI ) - 1.0f ) * 0.5f, 0.0f, 1.0f );
+    score.fOverlap   = float( std::count( bad.begin(), bad.end(), 1 ) ) / std::max<size_t>( n, 1 );
+    score.fWidth     = float( candidate.nWidth - params.nMinWidth ) / nWidths;
+    score.fTotal     = score.fOverlap > 0.0f ? -1.0f - score.fOverlap
+                                             : params.fLengthWeight * score.fLength
+                                             + params.fCurvatureWeight * score.fCurvature
+                                             + params.fWidthWeight * score.fWidth;
+    return score;
+  }
+
+  // A disc of road at every point, kept inside the border wall. Returns the rect painted.
+  TileRect paintRoad( Track & track, const std::vector<olc::vf2d> & points, float fRadius )
+  {
+    olc::vi2d vMin = { track.width(), track.height() };
+    olc::vi2d vMax = { -1, -1 };
+    for( const olc::vf2d & p : points )
+    {
+      int32_t y0 = std::max( int32_t( std::floor( p.y - fRadius ) ), 1 );
+      int32_t y1 = std::min( int32_t( std::floor( p.y + fRadius ) ), track.height() - 2 );
+      for( int32_t y = y0; y <= y1; y++ )
+      {
+        // Tiles whose centre is inside the disc
+        float fDy = y + 0.5f - p.y;
+        if( std::abs( fDy ) > fRadius ) continue;
+        float   fHalf = std::sqrt( fRadius * fRadius - fDy * fDy );
+        int32_t x0    = std::max( int32_t( std::ceil( p.x - fHalf - 0.5f ) ), 1 );
+        int32_t x1    = std::min( int32_t( std::floor( p.x + fHalf - 0.5f ) ), track.width() - 2 );
+        if( x1 < x0 ) continue;
+        for( int32_t x = x0; x <= x1; x++ )
+          if( track[track.cordToIndex( x, y )] != mapTiles::Road ) track.set( { x, y }, mapTiles::Road );
+        vMin = { std::min( vMin.x, x0 ), std::min( vMin.y, y ) };
+        vMax = { std::max( vMax.x, x1 ), std::max( vMax.y, y ) };
+      }
+    }
+    return { vMin.x, vMin.y, vMax.x - vMin.x + 1, vMax.y - vMin.y + 1 };
+  }
+
+  GeneratedTrack generate( Track & track, uint64_t nSeed, const TrackGenParams & params, ThreadPool * pPool )
+  {
+    std::vector<Candidate> candidates( std::max( params.nCandidates, 1u ) );
+    auto                   evaluate = [&]( size_t i ) {
+      Candidate & candidate = candidates[i];
+      candidate             = makeCandidate( track, nSeed, uint32_t( i ), params );
+
+      // The control polygon is a little shorter than the loop through it
+      float fPerimeter = 0.0f;
+      for( size_t k = 0; k < candidate.controls.size(); k++ )
+        fPerimeter += ( candidate.controls[( k + 1 ) % candidate.controls.size()] - candidate.controls[k] ).mag();
+      candidate.fStep = std::max( 0.5f * ( candidate.nWidth + params.fGap ), fPerimeter / MAX_SCORE_POINTS );
+      sampleLoop( candidate.controls, candidate.fStep, candidate.points );
+      candidate.score = scoreCandidate( track, candidate, params );
+    };
+    if( pPool )
+      pPool->parallelFor( candidates.size(), evaluate );
+    else
+      for( size_t i = 0; i < candidates.size(); i++ ) evaluate( i );
+
+    // Ties go to the lowest candidate, so the result doesn't depend on the thread count
+    size_t nBest = 0;
+    for( size_t i = 1; i < candidates.size(); i++ )
+      if( candidates[i].score.fTotal > candidates[nBest].score.fTotal ) nBest = i;
+    Candidate & best = candidates[nBest];
+
+    track.buildEmpty();
+    std::vector<olc::vf2d> fine;
+    sampleLoop( best.controls, std::min( 1.0f, 0.5f * best.nWidth ), fine );
+    TileRect painted = paintRoad( track, fine, 0.5f * best.nWidth );
+    autotileFresh( track, { painted.x - 1, painted.y - 1, painted.w + 2, painted.h + 2 } );
+
+    GeneratedTrack result;
+    result.nCandidate = uint32_t( nBest );
+    result.nWidth     = best.nWidth;
+    result.score      = best.score;
+    result.centreline = std::move( best.points );
+
+    // Start where the loop turns least over a few points
+    std::vector<olc::vf2d> & line   = result.centreline;
+    size_t                   n      = line.size();
+    size_t                   nStart = 0;
+    float                    fLeast = std::numeric_limits<float>::infinity();
+    for( size_t i = 0; i < n; i++ )
+    {
+      float fTurn = std::abs( turnAt( line, ( i + n - 1 ) % n ) ) + std::abs( turnAt( line, i ) )
+                  + std::abs( turnAt( line, ( i + 1 ) % n ) );
+      if( fTurn < fLeast )
+      {
+        fLeast = fTurn;
+        nStart = i;
+      }
+    }
+    if( n < 2 ) return result;
+
+    // Heading points along (sin, -cos)
+    olc::vf2d vBlock   = olc::vf2d( track.blockSize() );
+    olc::vf2d vDir     = line[( nStart + 1 ) % n] - line[nStart];
+    result.vStart      = line[nStart] * vBlock;
+    result.fStartAngle = std::atan2( vDir.x, -vDir.y );
+
+    // The start line is a point ahead of the car and begins the centreline, the other gates split it evenly
+    std::rotate( line.begin(), line.begin() + ( nStart + 1 ) % n, line.end() );
+    std::vector<Gate> gates;
+    uint32_t          nSectors = std::max( params.nSectors, 1u );
+    float             fHalf    = ( 0.5f * best.nWidth + 1.0f ) * std::max( vBlock.x, vBlock.y );
+    float             fLength  = 0.0f;
+    for( size_t i = 0; i < n; i++ ) fLength += ( line[( i + 1 ) % n] - line[i] ).mag();
+    float fAlong = 0.0f;
+    for( size_t i = 0; i < n && gates.size() < nSectors; i++ )
+    {
+      if( fAlong >= fLength * gates.size() / nSectors )
+        gates.push_back( gateAcross( line[i] * vBlock, line[( i + 1 ) % n] - line[i], fHalf ) );
+      fAlong += ( line[( i + 1 ) % n] - line[i] ).mag();
+    }
+    track.setGates( std::move( gates ) );
+    std::vector<olc::vf2d> world( n );
+    for( size_t i = 0; i < n; i++ ) world[i] = line[i] * vBlock;
+    track.setCentreline( std::move( world ) );
+    return result;
+  }
+} // namespace
+
+// Knots spaced by the square root of the distance between control points keep cusps and self intersections out of
+// each segment
+void sampleLoop( const std::vector<olc::vf2d> & controls, float fStep, std::vector<olc::vf2d> & points )
+{
+  points.clear();
+  size_t n = controls.size();
+  for( size_t i = 0; i < n; i++ )
+  {
+    const olc::vf2d & p0 = controls[( i + n - 1 ) % n];
+    const olc::vf2d & p1 = controls[i];
+    const olc::vf2d & p2 = controls[( i + 1 ) % n];
+    const olc::vf2d & p3 = controls[( i + 2 ) % n];
+    float             t0 = 0.0f;
+    float             t1 = t0 + std::sqrt( ( p1 - p0 ).mag() ) + 1e-4f;
+    float             t2 = t1 + std::sqrt( ( p2 - p1 ).mag() ) + 1e-4f;
+    float             t3 = t2 + std::sqrt( ( p3 - p2 ).mag() ) + 1e-4f;
+
+    // Curves bow out beyond the chord, so take a few more steps than it needs
+    int32_t nSteps = std::max( int32_t( std::ceil( 1.25f * ( p2 - p1 ).mag() / fStep ) ), 1 );
+    for( int32_t s = 0; s < nSteps; s++ )
+    {
+      float     t  = t1 + ( t2 - t1 ) * s / nSteps;
+      olc::vf2d a1 = p0 * ( ( t1 - t ) / ( t1 - t0 ) ) + p1 * ( ( t - t0 ) / ( t1 - t0 ) );
+      olc::vf2d a2 = p1 * ( ( t2 - t ) / ( t2 - t1 ) ) + p2 * ( ( t - t1 ) / ( t2 - t1 ) );
+      olc::vf2d a3 = p2 * ( ( t3 - t ) / ( t3 - t2 ) ) + p3 * ( ( t - t2 ) / ( t3 - t2 ) );
+      olc::vf2d b1 = a1 * ( ( t2 - t ) / ( t2 - t0 ) ) + a2 * ( ( t - t0 ) / ( t2 - t0 ) );
+      olc::vf2d b2 = a2 * ( ( t3 - t ) / ( t3 - t1 ) ) + a3 * ( ( t - t1 ) / ( t3 - t1 ) );
+      points.push_back( b1 * ( ( t2 - t ) / ( t2 - t1 ) ) + b2 * ( ( t - t1 ) / ( t2 - t1 ) ) );
+    }
+  }
+}
+
+GeneratedTrack generateTrack( Track & track, uint64_t nSeed, const TrackGenParams & params )
+{
+  return generate( track, nSeed, params, nullptr );
+}
+
+GeneratedTrack generateTrack( Track & track, uint64_t nSeed, ThreadPool & pool, const TrackGenParams & params )
+{
+  return generate( track, nSeed, params, &pool );
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Track.h"
+
+struct TrackGenParams
+{
+  uint32_t nCandidates    = 64;
+  uint32_t nControlPoints = 12;
+  float    fMinRadius     = 0.4f;  // Control point distance from the centre, as a fraction of the room available
+  float    fMaxRadius     = 0.9f;  // The spline bulges out a little beyond its control points
+  float    fJitter        = 0.3f;  // How far control points stray from even spacing round the loop, in spacings
+  int32_t  nMinWidth      = 4;     // Road width in tiles
+  int32_t  nMaxWidth      = 7;
+  int32_t  nMargin        = 2;     // Grass kept between the road and the border wall
+  float    fGap           = 3.0f;  // Grass wanted between stretches of road that aren't next to each other
+  uint32_t nSectors       = 3;     // Gates spread evenly round the loop, the first being the start line
+
+  // Weights of the score terms, overlap isn't weighted as any at all puts a candidate below every clean one
+  float fLengthWeight    = 1.0f;
+  float fCurvatureWeight = 1.0f;
+  float fWidthWeight     = 0.25f;
+};
+
+struct TrackScore
+{
+  float fLength    = 0.0f;  // Centreline length over the perimeter of the room available
+  float fCurvature = 0.0f;  // Turning beyond the one turn every loop makes, 0 for a convex loop up to 1 at two more
+  float fOverlap   = 0.0f;  // Fraction of the centreline too close to another stretch, too tight or out of bounds
+  float fWidth     = 0.0f;  // 0 at nMinWidth up to 1 at nMaxWidth
+  float fTotal     = 0.0f;
+};
+
+struct GeneratedTrack
+{
+  uint32_t               nCandidate = 0;
+  int32_t                nWidth     = 0;  // Road width in tiles
+  TrackScore             score;
+  std::vector<olc::vf2d> centreline;  // Closed loop in tile units from the start line, a point every half road width
+                                      // or further apart
+  olc::vf2d              vStart;      // World position and heading on the straightest part of the loop
+  float                  fStartAngle = 0.0f;
+};
+
+// Road loops from a seed: control points scattered round the centre of the map, joined by a closed centripetal
+// Catmull-Rom spline and painted as Road, with kerbs autotiled round it, gates across it and its centreline set on the
+// track. Every candidate is sampled and scored, spread over the pool when one is given, and only the best is painted.
+// The same seed and params give the same track.
+//
+// The track is cleared to grass inside a border wall first, keeping its size.
+GeneratedTrack generateTrack( Track & track, uint64_t nSeed, const TrackGenParams & params = TrackGenParams() );
+GeneratedTrack generateTrack( Track &                track,
+                              uint64_t               nSeed,
+                              ThreadPool &           pool,
+                              const TrackGenParams & params = TrackGenParams() );
+
+// Closed centripetal Catmull-Rom through the control points, at most about fStep apart
+void sampleLoop( const std::vector<olc::vf2d> & controls, float fStep, std::vector<olc::vf2d> & points );
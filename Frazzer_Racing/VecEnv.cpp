@@ -0,0 +1,92 @@
+#include "VecEnv.h"
+
+#include <cmath>
+
+#include "Simulation.h"
+
+namespace
+{
+  // Envs are cheap enough per tick that a thread should take a few hundred at a time
+  const size_t STEP_GRAIN = 256;
+
+  const float ANGLE_TO_RADIANS = float( 2.0 * 3.14159265358979 / BINARY_ANGLE_TURN );
+} // namespace
+
+VecEnv::VecEnv( const Track & track, size_t nEnvs, ThreadPool & pool, uint32_t nMaxTicks )
+  : track( track )
+  , pool( pool )
+  , nMaxTicks( nMaxTicks )
+  , start( toFixed( CarState() ) )
+  , cars( nEnvs )
+  , headings( nEnvs )
+  , ticks( nEnvs )
+  , ownObservations( nEnvs * OBS_SIZE )
+  , ownRewards( nEnvs )
+  , ownDones( nEnvs )
+{
+  setBuffers( EnvBuffers() );
+  reset();
+}
+
+void VecEnv::setBuffers( const EnvBuffers & buffers )
+{
+  buf.observations = buffers.observations ? buffers.observations : ownObservations.data();
+  buf.rewards      = buffers.rewards ? buffers.rewards : ownRewards.data();
+  buf.dones        = buffers.dones ? buffers.dones : ownDones.data();
+}
+
+void VecEnv::reset()
+{
+  for( size_t i = 0; i < cars.size(); i++ )
+  {
+    reset( i );
+    buf.rewards[i] = 0.0f;
+    buf.dones[i]   = 0;
+  }
+}
+
+void VecEnv::reset( size_t nEnv )
+{
+  // The whole episode state is one car and a tick count, so a reset is a few stores
+  cars[nEnv]     = start;
+  headings[nEnv] = fixedSinCos( start.angle );
+  ticks[nEnv]    = 0;
+  observe( nEnv );
+}
+
+void VecEnv::step( const uint8_t * actions )
+{
+  pool.parallelFor( cars.size(), STEP_GRAIN, [&]( size_t nBegin, size_t nEnd ) {
+    // The grain's wheels are sampled in one pass before its cars move
+    simulateTick( cars.data() + nBegin, headings.data() + nBegin, actions + nBegin, nEnd - nBegin, track );
+    for( size_t i = nBegin; i < nEnd; i++ )
+    {
+      bool bOnRoad = track.isRoad( track.worldCordToTileCord( { int32_t( cars[i].x >> FIXED_SHIFT ),
+                                                                int32_t( cars[i].y >> FIXED_SHIFT ) } ) );
+      float fDistance = fixedToFloat( cars[i].vel ) / TICK_RATE;
+      buf.rewards[i]  = bOnRoad ? fDistance * 0.01f : -0.01f;
+
+      buf.dones[i] = ++ticks[i] >= nMaxTicks;
+      if( buf.dones[i] ) reset( i );
+      else
+        observe( i );
+    }
+  } );
+}
+
+void VecEnv::observe( size_t nEnv )
+{
+  const CarStateFx & car    = cars[nEnv];
+  olc::vi2d          vWorld = track.worldSize();
+  olc::vi2d          vPos   = { int32_t( car.x >> FIXED_SHIFT ), int32_t( car.y >> FIXED_SHIFT ) };
+  float              fAngle = float( car.angle ) * ANGLE_TO_RADIANS;
+
+  float * obs = buf.observations + nEnv * OBS_SIZE;
+  obs[0]      = fixedToFloat( car.x ) / vWorld.x;
+  obs[1]      = fixedToFloat( car.y ) / vWorld.y;
+  obs[2]      = fixedToFloat( car.vel ) / VEL_SCALE;
+  obs[3]      = std::sin( fAngle );
+  obs[4]      = std::cos( fAngle );
+  obs[5]      = track.isRoad( track.worldCordToTileCord( vPos ) ) ? 1.0f : 0.0f;
+  obs[6]      = 1.0f - float( ticks[nEnv] ) / nMaxTicks;
+}
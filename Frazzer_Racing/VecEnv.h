@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Physics.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// Per car: x and y across the track (0-1), speed / VEL_SCALE, sin and cos of heading, 1 when on tarmac, and the
+// fraction of the episode left
+constexpr int   OBS_SIZE  = 7;
+constexpr float VEL_SCALE = 1000.0f;
+
+// Where step() writes. Arrays hold OBS_SIZE floats per env for observations and one entry per env for the others.
+struct EnvBuffers
+{
+  float *   observations = nullptr;
+  float *   rewards      = nullptr;
+  uint8_t * dones        = nullptr;
+};
+
+// N independent single car races for training agents, with no window or renderer. Actions are the CarInput bits.
+// Each step advances every env one fixed tick across the thread pool, then rewards the distance driven on tarmac and
+// penalises time on the grass. Envs reaching nMaxTicks are flagged done and reset within the same step, so their
+// observation is already the first of the next episode.
+class VecEnv
+{
+public:
+  VecEnv( const Track & track, size_t nEnvs, ThreadPool & pool, uint32_t nMaxTicks = 60 * TICK_RATE );
+
+  // Write into caller owned arrays instead of the env's own, fields left null keep using the env's
+  void              setBuffers( const EnvBuffers & buffers );
+  const EnvBuffers & buffers() const { return buf; }
+
+  void reset();
+  void reset( size_t nEnv );
+  void step( const uint8_t * actions );
+
+  size_t size() const { return cars.size(); }
+
+private:
+  void observe( size_t nEnv );
+
+  const Track &           track;
+  ThreadPool &            pool;
+  uint32_t                nMaxTicks;
+  CarStateFx              start;
+  std::vector<CarStateFx> cars;
+  std::vector<SinCos>     headings;  // Of each car, carried from one step to the next
+  std::vector<uint32_t>   ticks;
+  std::vector<float>      ownObservations;
+  std::vector<float>      ownRewards;
+  std::vector<uint8_t>    ownDones;
+  EnvBuffers              buf;
+};
@@ -1,273 +1,274 @@
 #define OLC_PGE_APPLICATION
 
-#include <fstream>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
 #include <string>
-
+#include <thread>
+#include <vector>
+
+#include "Bench.h"
+#include "Game.h"
+#include "Net.h"
+#include "RacingLine.h"
+#include "Rollback.h"
+#include "Server.h"
+#include "Replay.h"
+#include "Simulation.h"
 #include "olcPixelGameEngine.h"
 
-enum class mapTiles {
-  None,
-  Wall,
-  Road,
-  Road_L_Edge,
-  Road_R_Edge,
-  Road_T_Edge,
-  Road_B_Edge,
-  Road_TL_Corner,
-  Road_TR_Corner,
-  Road_BL_Corner,
-  Road_BR_Corner
-};
+const int32_t SCREEN_WIDTH  = 800;
+const int32_t SCREEN_HEIGHT = 400;
 
-class Game : public olc::PixelGameEngine
+// Re-simulates a replay without opening a window and reports the result
+int runHeadlessReplay( const Replay & replay )
 {
-public:
-  Game() { sAppName = "Frazzer Racing"; }
-
-private:
-  const float ROT_RATE   = 2.0f;
-  const float ACCEL_RATE = 50.f;
-  const float FRICTION   = 25.f;
-  const float PI         = 3.14159f;
-
-  olc::vf2d carPos    = { 130, 200 };
-  float     carVel    = 0.0f;
-  float     fCarAngle = 0.0f;
-
-  std::unique_ptr<olc::Sprite> sprCar;
-  std::unique_ptr<olc::Decal>  decCar;
-  std::unique_ptr<olc::Sprite> sprTiles;
-  std::unique_ptr<olc::Decal>  decTiles;
-  std::unique_ptr<mapTiles[]>  map;
-  olc::vi2d                    vBlockSize = { 10, 10 };
+  Track track( SCREEN_WIDTH / 10, SCREEN_HEIGHT / 10 );
+  track.buildDefault();
+  if( replay.trackChecksum != track.checksum() ) std::cerr << "Replay was recorded on a different track\n";
+
+  auto       start = std::chrono::steady_clock::now();
+  CarStateFx car   = simulateReplay( replay, track );
+  double     fMs   = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+  CarState end = toFloat( car );
+  std::cout << replay.nTicks << " ticks (" << replay.nTicks / TICK_RATE << "s of racing, " << replay.stream.size()
+            << " bytes) replayed in " << fMs << " ms\n";
+  std::cout << "Final car: pos " << end.pos.x << ", " << end.pos.y << " vel " << end.vel << " angle " << end.angle
+            << "\n";
+  return 0;
+}
 
-public:
-  bool OnUserCreate() override
+// Scripted two player race against another process, reporting what the rollbacks cost
+int runHeadlessNetRace( const NetAddress & remote, int nPlayer, uint32_t nTicks, UdpSocket & socket )
+{
+  Track track( SCREEN_WIDTH / 10, SCREEN_HEIGHT / 10 );
+  track.buildDefault();
+  RollbackSession session( track, startingGrid( 2, track ), nPlayer, socket, remote );
+  std::cout << "Player " << nPlayer << " on port " << socket.port() << ", racing " << toString( remote ) << "\n";
+
+  // Run at the real tick rate so injected latency means something. Once done, keep answering for a second in case
+  // our last acknowledgement was lost.
+  using Clock                 = std::chrono::steady_clock;
+  const auto    TICK_PERIOD   = std::chrono::microseconds( 1'000'000 / TICK_RATE );
+  const int     LINGER_TICKS  = TICK_RATE;
+  const int     TIMEOUT_TICKS = 10 * TICK_RATE;
+  auto          nextTick      = Clock::now();
+  int           nLinger       = 0;
+  int           nWaiting      = 0;
+  while( nLinger < LINGER_TICKS )
   {
-    map = std::make_unique<mapTiles[]>( ( ScreenWidth() / vBlockSize.x ) * ( ScreenHeight() / vBlockSize.y ) );
-    for( int y = 0; y < ScreenHeight() / vBlockSize.y; y++ )
+    uint32_t tick = session.current().tick;
+    if( tick < nTicks )
+      nWaiting = session.advance( scriptedInput( int( tick ) + nPlayer * 45 ) ) ? 0 : nWaiting + 1;
+    else
     {
-      for( int x = 0; x < ScreenWidth() / vBlockSize.x; x++ )
-      {
-        if( x == 0 || y == 0 || x == ScreenWidth() / vBlockSize.x - 1 || y == ScreenHeight() / vBlockSize.y - 1 )
-          map[cordToIndex( x, y )] = mapTiles::Wall;
-        else if( x >= 10 && x <= 70 && y >= 5 && y <= 9 )
-          map[cordToIndex( x, y )] = mapTiles::Road;
-        else if( x >= 10 && x <= 70 && y >= 30 && y <= 34 )
-          map[cordToIndex( x, y )] = mapTiles::Road;
-        else if( x >= 10 && x <= 15 && y >= 5 && y <= 34 )
-          map[cordToIndex( x, y )] = mapTiles::Road;
-        else if( x >= 65 && x <= 70 && y >= 5 && y <= 34 )
-          map[cordToIndex( x, y )] = mapTiles::Road;
-        else if( x >= 10 && x <= 70 && ( y == 4 || y == 29 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_T_Edge;
-        else if( x >= 10 && x <= 70 && ( y == 10 || y == 35 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_B_Edge;
-        else if( ( x == 9 || x == 64 ) && y >= 5 && y <= 34 )
-          map[cordToIndex( x, y )] = mapTiles::Road_L_Edge;
-        else if( ( x == 16 || x == 71 ) && y >= 5 && y <= 34 )
-          map[cordToIndex( x, y )] = mapTiles::Road_R_Edge;
-        else if( ( x == 9 && y == 4 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_TL_Corner;
-        else if( ( x == 9 && y == 35 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_BL_Corner;
-        else if( ( x == 71 && y == 4 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_TR_Corner;
-        else if( ( x == 71 && y == 35 ) )
-          map[cordToIndex( x, y )] = mapTiles::Road_BR_Corner;
-        else
-          map[cordToIndex( x, y )] = mapTiles::None;
-      }
+      session.poll();
+      bool bDone = session.confirmedTicks() >= nTicks && session.ackedTicks() >= nTicks;
+      nLinger    = bDone ? nLinger + 1 : 0;
+      nWaiting   = bDone ? 0 : nWaiting + 1;
+    }
+    if( nWaiting > TIMEOUT_TICKS )
+    {
+      std::cerr << "No word from the other player for 10 seconds, giving up\n";
+      return 1;
     }
 
-    // Load Sprites
-    sprCar   = std::make_unique<olc::Sprite>( "./gfx/car.png" );
-    sprTiles = std::make_unique<olc::Sprite>( "./gfx/mapTiles.png" );
+    nextTick += TICK_PERIOD;
+    std::this_thread::sleep_until( nextTick );
+  }
 
-    // Create decals
-    decCar = std::make_unique<olc::Decal>( sprCar.get() );
+  const RollbackStats & net = session.stats();
+  std::cout << nTicks << " ticks, " << net.nRollbacks << " rollbacks re-simulating " << net.nResimTicks
+            << " ticks (max " << net.nMaxResim << "), " << net.nStalls << " stalled ticks\n";
+  std::cout << "Rollback cost: mean " << ( net.nRollbacks ? net.fResimMs / net.nRollbacks : 0.0 ) << " ms, max "
+            << net.fMaxResimMs << " ms against a " << 1000.0 / TICK_RATE << " ms frame\n";
+  std::cout << "Packets sent " << net.nPacketsSent << ", received " << net.nPacketsRecvd << "\n";
+  std::cout << "State hash at tick " << session.current().tick << ": " << std::hex << hashGameState( session.current() )
+            << std::dec << "\n";
+  return 0;
+}
 
-    return true;
+// Dedicated server: many races in one process with no window, reporting its load every 5 seconds
+int runServer( uint16_t nPort, uint32_t nSessions, uint32_t nThreads, uint32_t nTicks )
+{
+  Track track( SCREEN_WIDTH / 10, SCREEN_HEIGHT / 10 );
+  track.buildDefault();
+  ThreadPool pool( nThreads );
+  RaceServer server( track, nSessions, pool );
+  if( !server.open( nPort ) )
+  {
+    std::cerr << "Could not open UDP port " << nPort << "\n";
+    return 1;
   }
+  std::cout << "Serving " << nSessions << " races on port " << server.port() << " with " << pool.size()
+            << " threads\n";
+  server.run( nTicks, 5 * TICK_RATE );
+  return 0;
+}
 
-  bool OnUserUpdate( float fElapsedTime ) override
+// Works out the racing line for a saved track and caches it beside the track file
+int runRacingLine( const std::string & sTrack, uint32_t nThreads )
+{
+  using Clock = std::chrono::steady_clock;
+  ThreadPool pool( nThreads );
+  Track      track( SCREEN_WIDTH / 10, SCREEN_HEIGHT / 10 );
+  if( !loadTrack( sTrack, track, pool ) )
   {
-    // Get User input
-    if( GetKey( olc::Key::A ).bHeld ) fCarAngle -= ROT_RATE * fElapsedTime;
-    if( GetKey( olc::Key::D ).bHeld ) fCarAngle += ROT_RATE * fElapsedTime;
-    if( GetKey( olc::Key::W ).bHeld ) carVel += ACCEL_RATE * fElapsedTime;
-    if( GetKey( olc::Key::S ).bHeld ) carVel -= ACCEL_RATE * fElapsedTime;
-
-    // Car friction
-    if( carVel > 0 ) carVel -= FRICTION * fElapsedTime;
-    else if( carVel < 0 )
-      carVel += FRICTION * fElapsedTime;
-
-    // Update Car
-    olc::vf2d vel = { sin( fCarAngle ) * carVel, -cos( fCarAngle ) * carVel };
-    carPos += vel * fElapsedTime;
-
-    // Make Sure Angle Stays in range
-    if( fCarAngle < 0 ) { fCarAngle = 2 * PI - fCarAngle; }
-    else if( fCarAngle > 2 * PI )
-    {
-      fCarAngle = fCarAngle - 2 * PI;
-    }
-
-    // TODO: Collision Check
-    // checkWallCollision ();
-
-    // Keep car on screen
-    if( carPos.x < vBlockSize.x )
-      carPos.x = vBlockSize.x;
-    if( carPos.x > ScreenWidth() - vBlockSize.x ) carPos.x = (float)ScreenWidth() - vBlockSize.x;
-    if( carPos.y < vBlockSize.y ) carPos.y = vBlockSize.y;
-    if( carPos.y > ScreenHeight() - vBlockSize.y ) carPos.y = (float)ScreenHeight() - vBlockSize.y;
-
-    Clear( olc::VERY_DARK_GREY );
+    std::cerr << "Could not load track " << sTrack << "\n";
+    return 1;
+  }
+  RacingLineParams params;
+  RacingLineStats  stats;
+  auto             start = Clock::now();
+  RacingLine       line  = buildRacingLine( track, pool, params, &stats );
+  double           fMs   = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+  if( line.points.empty() )
+  {
+    std::cerr << "Track " << sTrack << " has no centreline to find a line round\n";
+    return 1;
+  }
+  if( !saveRacingLine( line, racingLineFile( sTrack ) ) )
+  {
+    std::cerr << "Could not write " << racingLineFile( sTrack ) << "\n";
+    return 1;
+  }
+  std::cout << "Racing line of " << line.points.size() << " points in " << fMs << " ms on " << pool.size()
+            << " threads, " << stats.nLevels << " levels " << stats.nIterations << " iterations, lap "
+            << stats.fLapTime << " s\n";
+  return 0;
+}
 
-    // Draw Map
-    for( int y = 0; y < ScreenHeight() / vBlockSize.y; y++ )
+int main( int argc, char * argv[] )
+{
+  if( argc == 3 && std::string( argv[1] ) == "--bench" ) return runBench( argv[2] );
+
+  // --replay <file>               watch a recording
+  // --ghost <file>                race against a recording, repeatable
+  // --net <port> <ip:port> <0|1>  head to head over UDP, with --latency <ms> --jitter <ms> --loss <percent> to
+  //                               simulate a bad link
+  // --server <port>               host --sessions <n> races on --threads <n> threads (0 for all cores)
+  // --client <ip:port>            connect --clients <n> scripted test players to a server
+  // --headless                    run replays and network races without a window
+  // --ticks <n>                   length of a headless race, server run or client test
+  // --track <file>                race on a saved track, also where the editor saves
+  // --racing-line                 work out the --track's racing line on --threads <n> threads and save it beside it
+  // --edit [<width> <height>]     start in the track editor, on a new empty track if a size is given
+  // --random [<seed>]             race on generated tracks, N for the next one
+  std::vector<Replay> ghosts;
+  Replay              replay;
+  bool                bReplay = false, bNet = false, bHeadless = false, bServer = false, bClient = false;
+  uint16_t            nPort = 0;
+  NetAddress          remote;
+  int                 nNetPlayer = 0;
+  uint32_t            nLatencyMs = 0, nJitterMs = 0, nTicks = 0;
+  uint32_t            nSessions = 64, nThreads = 0, nClients = 8;
+  float               fLossPercent = 0.0f;
+  std::string         sTrack;
+  bool                bEdit = false, bRacingLine = false;
+  olc::vi2d           vNewTrack = { 0, 0 };
+  bool                bRandom   = false;
+  uint64_t            nSeed     = uint64_t( std::chrono::system_clock::now().time_since_epoch().count() );
+
+  for( int i = 1; i < argc; i++ )
+  {
+    std::string sArg   = argv[i];
+    auto        value  = [&]() { return i + 1 < argc ? std::string( argv[++i] ) : std::string(); };
+    auto        number = [&]() { return uint32_t( std::atoi( value().c_str() ) ); };
+    bool        bValid = true;
+    if( sArg == "--headless" ) bHeadless = true;
+    else if( sArg == "--replay" || sArg == "--ghost" )
     {
-      for( int x = 0; x < ScreenWidth() / vBlockSize.x; x++ )
+      Replay      loaded;
+      std::string sFile = value();
+      if( !loadReplay( sFile, loaded ) )
+      {
+        std::cerr << "Could not load replay " << sFile << "\n";
+        return 1;
+      }
+      if( sArg == "--ghost" ) ghosts.push_back( loaded );
+      else
       {
-        switch( map[cordToIndex( x, y )] )
-        {
-          case mapTiles::None: FillRect( olc::vi2d( x, y ) * vBlockSize, vBlockSize, olc::DARK_GREEN ); break;
-          case mapTiles::Wall:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 0, 0 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 0, 1 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_T_Edge:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 3, 0 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_B_Edge:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 3, 1 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_L_Edge:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 4, 1 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_R_Edge:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 4, 0 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_TL_Corner:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 1, 0 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_TR_Corner:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 2, 0 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_BL_Corner:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 1, 1 ) * vBlockSize,
-                               vBlockSize );
-            break;
-          case mapTiles::Road_BR_Corner:
-            DrawPartialSprite( olc::vi2d( x, y ) * vBlockSize,
-                               sprTiles.get(),
-                               olc::vi2d( 2, 1 ) * vBlockSize,
-                               vBlockSize );
-            break;
-        }
+        replay  = loaded;
+        bReplay = true;
       }
     }
-
-    // Draw Car
-    DrawRotatedDecal( carPos, decCar.get(), fCarAngle, { 5.0f, 10.0f } );
-
-    DrawString( 11, 11, std::to_string( fCarAngle ) );
-    DrawString( 11, 20, std::to_string( carVel ) );
-    DrawString( 11,
-                29,
-                std::to_string( sin( fCarAngle ) * carVel ) + " " + std::to_string( -cos( fCarAngle ) * carVel ) );
-
-    return true;
-  }
-
-  void checkWallCollision ()
-  {
-    olc::vi2d curTilePos = worldCordToTileCord( carPos );
-    bool      hasWall    = false;
-    for( int i = -1; i <= 1; i++ )
+    else if( sArg == "--net" )
+    {
+      nPort      = uint16_t( number() );
+      bValid     = parseAddress( value(), remote );
+      nNetPlayer = number() == 1 ? 1 : 0;
+      bNet       = true;
+    }
+    else if( sArg == "--server" )
+    {
+      nPort   = uint16_t( number() );
+      bServer = true;
+    }
+    else if( sArg == "--client" )
+    {
+      bValid  = parseAddress( value(), remote );
+      bClient = true;
+    }
+    else if( sArg == "--latency" ) nLatencyMs = number();
+    else if( sArg == "--jitter" ) nJitterMs = number();
+    else if( sArg == "--loss" ) fLossPercent = float( std::atof( value().c_str() ) );
+    else if( sArg == "--ticks" ) nTicks = number();
+    else if( sArg == "--sessions" ) nSessions = number();
+    else if( sArg == "--threads" ) nThreads = number();
+    else if( sArg == "--clients" ) nClients = number();
+    else if( sArg == "--track" ) sTrack = value();
+    else if( sArg == "--racing-line" ) bRacingLine = true;
+    else if( sArg == "--edit" )
     {
-      for( int j = -1; j <= 1; j++ )
+      bEdit = true;
+      if( i + 2 < argc && std::isdigit( (unsigned char)argv[i + 1][0] ) )
       {
-        if( inRange( { curTilePos.x + i, curTilePos.y + j } )
-            && map[cordToIndex( curTilePos.x + i, curTilePos.y + j )] == mapTiles::Wall )
-          hasWall = true;
+        vNewTrack.x = int32_t( number() );
+        vNewTrack.y = int32_t( number() );
       }
     }
+    else if( sArg == "--random" )
+    {
+      bRandom = true;
+      if( i + 1 < argc && std::isdigit( (unsigned char)argv[i + 1][0] ) )
+        nSeed = std::strtoull( value().c_str(), nullptr, 10 );
+    }
+    else
+      bValid = false;
 
-    if( !hasWall ) return;
-
-    // Find 4 cords for car
-    // Car is 10 x 20
-    // Car angle is fCarAngle
-    int W  = 10;
-    int H  = 20;
-    int Ox = W / 2;
-    int Oy = H / 2;
-
-    olc::vi2d cornerPosBR;
-    olc::vi2d cornerPosBL;
-    olc::vi2d cornerPosTR;
-    olc::vi2d cornerPosTL;
-
-    cornerPosBR.x = carPos.x + ( Ox * cos( fCarAngle ) ) - ( Oy * sin( fCarAngle ) );
-    cornerPosBR.y = carPos.y + ( Ox * sin( fCarAngle ) ) + ( Oy * cos( fCarAngle ) );
-
-    cornerPosBL.x = carPos.x + ( -Ox * cos( fCarAngle ) ) - ( Oy * sin( fCarAngle ) );
-    cornerPosBL.y = carPos.y + ( -Ox * sin( fCarAngle ) ) + ( Oy * cos( fCarAngle ) );
-
-    cornerPosTR.x = carPos.x + ( Ox * cos( fCarAngle ) ) - ( -Oy * sin( fCarAngle ) );
-    cornerPosTR.y = carPos.y + ( Ox * sin( fCarAngle ) ) + ( -Oy * cos( fCarAngle ) );
+    if( !bValid )
+    {
+      std::cerr << "Bad argument " << sArg << "\n";
+      return 1;
+    }
+  }
 
-    cornerPosTL.x = carPos.x + ( -Ox * cos( fCarAngle ) ) - ( -Oy * sin( fCarAngle ) );
-    cornerPosTL.y = carPos.y + ( -Ox * sin( fCarAngle ) ) + ( -Oy * cos( fCarAngle ) );
+  // Modes that never open a window
+  if( bServer ) return runServer( nPort, nSessions, nThreads, nTicks );
+  if( bClient ) return runTestClients( remote, nClients, nTicks ? nTicks : 10 * TICK_RATE );
+  if( bReplay && bHeadless ) return runHeadlessReplay( replay );
+  if( bRacingLine ) return runRacingLine( sTrack, nThreads );
 
-    // Check if any are in a wall tile
-    // If in a wall tile stop movement along that direction
-  }
+  Game demo;
+  for( const Replay & ghost : ghosts ) demo.addGhost( ghost );
+  if( bReplay ) demo.playReplay( replay );
+  if( !sTrack.empty() ) demo.useTrack( sTrack );
+  if( bEdit ) demo.startEditing( vNewTrack );
+  if( bRandom ) demo.useRandomTrack( nSeed );
 
-  olc::vi2d worldCordToTileCord( olc::vi2d cord ) { return { cord.x / vBlockSize.x, cord.y / vBlockSize.y }; }
-  int       cordToIndex( olc::vi2d pos ) { return cordToIndex( pos.x, pos.y ); }
-  int       cordToIndex( int x, int y ) { return y * ( ScreenWidth() / vBlockSize.x ) + x; }
-  bool      inRange( olc::vi2d cord )
+  if( bNet )
   {
-    return cord.x >= 0 && cord.x < ScreenWidth() / vBlockSize.x && cord.y >= 0
-           && cord.y < ScreenHeight() / vBlockSize.y;
+    if( !demo.joinNetRace( nPort, remote, nNetPlayer ) )
+    {
+      std::cerr << "Could not open UDP port " << nPort << "\n";
+      return 1;
+    }
+    demo.netSocket().simulateLink( nLatencyMs, nJitterMs, fLossPercent, 1 + nNetPlayer );
+    if( bHeadless ) return runHeadlessNetRace( remote, nNetPlayer, nTicks ? nTicks : 30 * TICK_RATE, demo.netSocket() );
   }
-};
 
-int main()
-{
-  Game demo;
-  if( demo.Construct( 800, 400, 2, 2 ) ) demo.Start();
+  if( demo.Construct( SCREEN_WIDTH, SCREEN_HEIGHT, 2, 2 ) ) demo.Start();
   return 0;
-}
\ No newline at end of file
+}